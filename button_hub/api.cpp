@@ -14,6 +14,8 @@
 
 namespace api {
 
+static constexpr logging::Module kLogModule = logging::Module::kApi;
+
 static String g_host;
 static int g_port;
 
@@ -153,7 +155,7 @@ static void CheckFlags(const int flags) {
 static int HandleGetRobotVersionResponse(struct sh2lib_handle* /* handle */,
                                          const char* data, size_t len,
                                          int flags) {
-  Serial.printf(" <- GetRobotVersionResponse (len=%d)\n", len);
+  KB_LOGD(" <- GetRobotVersionResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -168,7 +170,7 @@ static int HandleGetRobotVersionResponse(struct sh2lib_handle* /* handle */,
     const int status = pb_decode(
         &stream, kachaka_api_GetRobotVersionResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
   }
@@ -178,7 +180,7 @@ static int HandleGetRobotVersionResponse(struct sh2lib_handle* /* handle */,
 
 static int HandleStartCommandResponse(struct sh2lib_handle* /* handle */,
                                       const char* data, size_t len, int flags) {
-  Serial.printf(" <- StartCommandResponse (len=%d)\n", len);
+  KB_LOGD(" <- StartCommandResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -195,12 +197,12 @@ static int HandleStartCommandResponse(struct sh2lib_handle* /* handle */,
     const int status =
         pb_decode(&stream, kachaka_api_StartCommandResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
-    Serial.printf("response = {success=%d, error_code=%d, command_id=\"%s\"}\n",
-                  response.result.success, response.result.error_code,
-                  command_id.c_str());
+    KB_LOGD("response = {success=%d, error_code=%d, command_id=\"%s\"}\n",
+            response.result.success, response.result.error_code,
+            command_id.c_str());
   }
 
   return 0;
@@ -208,7 +210,7 @@ static int HandleStartCommandResponse(struct sh2lib_handle* /* handle */,
 
 static int HandleGetShelvesResponse(struct sh2lib_handle* /* handle */,
                                     const char* data, size_t len, int flags) {
-  Serial.printf(" <- GetShelvesResponse (len=%d)\n", len);
+  KB_LOGD(" <- GetShelvesResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -223,7 +225,7 @@ static int HandleGetShelvesResponse(struct sh2lib_handle* /* handle */,
     const int status =
         pb_decode(&stream, kachaka_api_GetShelvesResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
   }
@@ -233,7 +235,7 @@ static int HandleGetShelvesResponse(struct sh2lib_handle* /* handle */,
 
 static int HandleGetLocationsResponse(struct sh2lib_handle* /* handle */,
                                       const char* data, size_t len, int flags) {
-  Serial.printf(" <- GetLocationsResponse (len=%d)\n", len);
+  KB_LOGD(" <- GetLocationsResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -248,7 +250,7 @@ static int HandleGetLocationsResponse(struct sh2lib_handle* /* handle */,
     const int status =
         pb_decode(&stream, kachaka_api_GetLocationsResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
   }
@@ -258,7 +260,7 @@ static int HandleGetLocationsResponse(struct sh2lib_handle* /* handle */,
 
 static int HandleGetShortcutsResponse(struct sh2lib_handle* /* handle */,
                                       const char* data, size_t len, int flags) {
-  Serial.printf(" <- GetShortcutsResponse (len=%d)\n", len);
+  KB_LOGD(" <- GetShortcutsResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -273,7 +275,7 @@ static int HandleGetShortcutsResponse(struct sh2lib_handle* /* handle */,
     const int status =
         pb_decode(&stream, kachaka_api_GetShortcutsResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
   }
@@ -283,7 +285,7 @@ static int HandleGetShortcutsResponse(struct sh2lib_handle* /* handle */,
 
 static int HandleProceedResponse(struct sh2lib_handle* /* handle */,
                                  const char* data, size_t len, int flags) {
-  Serial.printf(" <- HandleProceedResponse (len=%d)\n", len);
+  KB_LOGD(" <- HandleProceedResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -296,11 +298,11 @@ static int HandleProceedResponse(struct sh2lib_handle* /* handle */,
     const int status =
         pb_decode(&stream, kachaka_api_StartCommandResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
-    Serial.printf("response = {success=%d, error_code=%d}\n",
-                  response.result.success, response.result.error_code);
+    KB_LOGD("response = {success=%d, error_code=%d}\n",
+            response.result.success, response.result.error_code);
   }
 
   return 0;
@@ -309,7 +311,7 @@ static int HandleProceedResponse(struct sh2lib_handle* /* handle */,
 static int HandleStartShortcutCommandResponse(
     struct sh2lib_handle* /* handle */, const char* data, size_t len,
     int flags) {
-  Serial.printf(" <- HandleStartShortcutCommandResponse (len=%d)\n", len);
+  KB_LOGD(" <- HandleStartShortcutCommandResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -322,11 +324,11 @@ static int HandleStartShortcutCommandResponse(
     const int status = pb_decode(
         &stream, kachaka_api_StartShortcutCommandResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
-    Serial.printf("response = {success=%d, error_code=%d}\n",
-                  response.result.success, response.result.error_code);
+    KB_LOGD("response = {success=%d, error_code=%d}\n",
+            response.result.success, response.result.error_code);
   }
 
   return 0;
@@ -335,7 +337,7 @@ static int HandleStartShortcutCommandResponse(
 static int HandleCancelCommandResponse(struct sh2lib_handle* /* handle */,
                                        const char* data, size_t len,
                                        int flags) {
-  Serial.printf(" <- HandleCancelCommandResponse (len=%d)\n", len);
+  KB_LOGD(" <- HandleCancelCommandResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -348,11 +350,11 @@ static int HandleCancelCommandResponse(struct sh2lib_handle* /* handle */,
     const int status =
         pb_decode(&stream, kachaka_api_StartCommandResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
-    Serial.printf("response = {success=%d, error_code=%d}\n",
-                  response.result.success, response.result.error_code);
+    KB_LOGD("response = {success=%d, error_code=%d}\n",
+            response.result.success, response.result.error_code);
   }
 
   return 0;
@@ -361,7 +363,7 @@ static int HandleCancelCommandResponse(struct sh2lib_handle* /* handle */,
 static int HandleSetEmergencyStopResponse(struct sh2lib_handle* /* handle */,
                                           const char* data, size_t len,
                                           int flags) {
-  Serial.printf(" <- HandleSetEmergencyStopResponse (len=%d)\n", len);
+  KB_LOGD(" <- HandleSetEmergencyStopResponse (len=%d)\n", len);
   CheckFlags(flags);
 
   if (len > 0) {
@@ -374,11 +376,11 @@ static int HandleSetEmergencyStopResponse(struct sh2lib_handle* /* handle */,
     const int status = pb_decode(
         &stream, kachaka_api_SetEmergencyStopResponse_fields, &response);
     if (!status) {
-      Serial.printf("Decoding failed: %s\n", PB_GET_ERROR(&stream));
+      KB_LOGE("Decoding failed: %s\n", PB_GET_ERROR(&stream));
       return 1;
     }
-    Serial.printf("response = {success=%d, error_code=%d}\n",
-                  response.result.success, response.result.error_code);
+    KB_LOGD("response = {success=%d, error_code=%d}\n",
+            response.result.success, response.result.error_code);
   }
 
   return 0;
@@ -391,7 +393,7 @@ static bool EncodeProtoBufMessage(uint8_t* buffer, const int buffer_size,
 
   const bool status = pb_encode(&stream, fields, message);
   if (!status) {
-    Serial.printf("Encoding failed: %s\n", PB_GET_ERROR(&stream));
+    KB_LOGE("Encoding failed: %s\n", PB_GET_ERROR(&stream));
     return false;
   }
 
@@ -410,7 +412,7 @@ static void SendGrpcRequestAndWait(
   char path[64];
   char len[8];
 
-  Serial.printf("--> %s\n", service);
+  KB_LOGD("--> %s\n", service);
 
   snprintf(path, sizeof(path), "/kachaka_api.KachakaApi/%s", service);
   snprintf(len, sizeof(len), "%d", g_send_size);
@@ -431,7 +433,7 @@ static void SendGrpcRequestAndWait(
 
   while (!g_request_finished) {
     if (sh2lib_execute(hd) != ESP_OK) {
-      Serial.println("Error in execute");
+      KB_LOGE("Error in execute\n");
       break;
     }
     delay(20);
@@ -460,11 +462,11 @@ static void SendGrpcTask(void* param) {
   };
 
   if (sh2lib_connect(&config, &hd) != ESP_OK) {
-    Serial.println("Error connecting to HTTP2 server");
+    KB_LOGE("Error connecting to HTTP2 server\n");
 
     g_result_code = ResultCode::kNotConnected;
   } else {
-    Serial.println("Connected to HTTP2 server");
+    KB_LOGD("Connected to HTTP2 server\n");
 
     SendGrpcRequestAndWait(&hd, service->service_name,
                            service->response_callback);
@@ -482,7 +484,8 @@ static bool EncodeSendAndWait(Service& service, const pb_msgdesc_t* fields,
   if (!EncodeProtoBufMessage(g_send_buffer, sizeof(g_send_buffer), &g_send_size,
                              fields, request)) {
     g_result_code = ResultCode::kEncodeFailed;
-    logging::Log("API ERROR: Failed to encode %s", service.service_name);
+    logging::Log(logging::Level::kError, "API ERROR: Failed to encode %s",
+                 service.service_name);
     return false;
   }
 
@@ -491,13 +494,15 @@ static bool EncodeSendAndWait(Service& service, const pb_msgdesc_t* fields,
               reinterpret_cast<void*>(&service), 5, &task);
   const int retv = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kDefaultTimeoutMsec));
   if (g_result_code == ResultCode::kNotConnected) {
-    logging::Log("API ERROR: Not connected to HTTP2 server");
+    logging::Log(logging::Level::kError,
+                 "API ERROR: Not connected to HTTP2 server");
     return false;
   }
   if (retv == 0) {
-    Serial.printf("Timeout waiting for %s\n", service);
+    KB_LOGE("Timeout waiting for %s\n", service.service_name);
     g_result_code = ResultCode::kTimeout;
-    logging::Log("API ERROR: Timeout waiting for %s", service.service_name);
+    logging::Log(logging::Level::kError, "API ERROR: Timeout waiting for %s",
+                 service.service_name);
     return false;
   }
   if (service.service_name == "StartCommand") {
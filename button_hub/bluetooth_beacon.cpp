@@ -6,6 +6,9 @@
 #include <string>
 
 #include "bluetooth.hpp"
+#include "logging.hpp"
+
+static constexpr logging::Module kLogModule = logging::Module::kBluetooth;
 
 static constexpr int kScanDurationSec = 3;
 
@@ -73,7 +76,7 @@ void Begin(void (*beacon_callback)(const char* name, const uint8_t address[6],
   g_ble_scan->setWindow(99);
 
   g_ble_scan->start(kScanDurationSec, &OnScanComplete, true);
-  Serial.println("BLE Scan started");
+  KB_LOGI("BLE Scan started\n");
 }
 
 void Stop() {
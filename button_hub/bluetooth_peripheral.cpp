@@ -12,10 +12,13 @@
 #include "bluetooth.hpp"
 #include "ip_resolver.hpp"
 #include "lgfx/v1/lgfx_fonts.hpp"
+#include "logging.hpp"
 #include "screen.hpp"
 #include "settings.hpp"
 #include "wifi.hpp"
 
+static constexpr logging::Module kLogModule = logging::Module::kBluetooth;
+
 static constexpr char const* kServiceUuid =
     "B9E182A3-829C-4D6F-8237-05A11AF5E7B1";
 static constexpr char const* kCharacteristicInitialSettingsUuid =
@@ -92,9 +95,9 @@ class CharacteristicCallbacks : public NimBLECharacteristicCallbacks {
     unsigned char binaryData = 0x01;
     if (value.size() == 1 &&
         static_cast<unsigned char>(value[0]) == binaryData) {
-      Serial.println("Clearing settings...");
+      KB_LOGI("Clearing settings...\n");
       g_settings.Reset();
-      Serial.println("Completed");
+      KB_LOGI("Completed\n");
       screen::DrawWhiteTextWithBlackScreen(
           {"設定を消去しました。", "再起動します ..."});
       beep::PlayClearAllDataCompleted();
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// The buttons which commands are registered for, keyed by their identity
+// alone
+
+struct AppleIBeacon {
+  uint8_t address[6];
+  uint8_t uuid[16];
+  uint16_t major;
+  uint16_t minor;
+
+  explicit AppleIBeacon() = default;
+  explicit AppleIBeacon(const uint8_t address[6], const uint8_t uuid[16],
+                        uint16_t major, uint16_t minor)
+      : major(major), minor(minor) {
+    std::memcpy(this->address, address, 6);
+    std::memcpy(this->uuid, uuid, 16);
+  }
+};
+
+struct M5Button {
+  uint8_t id;  // 1,2,3
+
+  explicit M5Button() = default;
+  explicit M5Button(const int new_id) : id(new_id) {}
+};
+
+struct GpioButton {
+  uint8_t id;  // 1,2,3,4,5
+
+  explicit GpioButton() = default;
+  explicit GpioButton(const int new_id) : id(new_id) {}
+};
+
+enum class ButtonType : uint8_t {
+  kAppleIBeacon,
+  kM5Button,
+  kGpioButton,
+};
+
+struct KButton {
+  ButtonType type;
+  union {
+    AppleIBeacon apple_i_beacon;
+    M5Button m5_button;
+    GpioButton gpio_button;
+  } data;
+
+  explicit KButton() = default;
+  explicit KButton(const AppleIBeacon& beacon)
+      : type(ButtonType::kAppleIBeacon) {
+    data.apple_i_beacon = beacon;
+  }
+  explicit KButton(const M5Button& m5_button) : type(ButtonType::kM5Button) {
+    data.m5_button.id = m5_button.id;
+  }
+  explicit KButton(const GpioButton& gpio_button)
+      : type(ButtonType::kGpioButton) {
+    data.gpio_button.id = gpio_button.id;
+  }
+};
+
+inline bool operator<(const AppleIBeacon& lhs, const AppleIBeacon& rhs) {
+  int cmp = std::memcmp(lhs.address, rhs.address, sizeof(lhs.address));
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  cmp = std::memcmp(lhs.uuid, rhs.uuid, sizeof(lhs.uuid));
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  cmp = lhs.major - rhs.major;
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  return lhs.minor < rhs.minor;
+}
+
+inline bool operator<(const M5Button& lhs, const M5Button& rhs) {
+  return lhs.id < rhs.id;
+}
+
+inline bool operator<(const GpioButton& lhs, const GpioButton& rhs) {
+  return lhs.id < rhs.id;
+}
+
+inline bool operator<(const KButton& lhs, const KButton& rhs) {
+  if (lhs.type == ButtonType::kAppleIBeacon &&
+      rhs.type == ButtonType::kAppleIBeacon) {
+    return lhs.data.apple_i_beacon < rhs.data.apple_i_beacon;
+  }
+  if (lhs.type == ButtonType::kM5Button && rhs.type == ButtonType::kM5Button) {
+    return lhs.data.m5_button < rhs.data.m5_button;
+  }
+  if (lhs.type == ButtonType::kGpioButton &&
+      rhs.type == ButtonType::kGpioButton) {
+    return lhs.data.gpio_button < rhs.data.gpio_button;
+  }
+  return lhs.type < rhs.type;
+}
+
+inline bool operator==(const AppleIBeacon& lhs, const AppleIBeacon& rhs) {
+  return std::memcmp(lhs.address, rhs.address, sizeof(lhs.address)) == 0 &&
+         std::memcmp(lhs.uuid, rhs.uuid, sizeof(lhs.uuid)) == 0 &&
+         lhs.major == rhs.major && lhs.minor == rhs.minor;
+}
+
+inline bool operator==(const M5Button& lhs, const M5Button& rhs) {
+  return lhs.id == rhs.id;
+}
+
+inline bool operator==(const GpioButton& lhs, const GpioButton& rhs) {
+  return lhs.id == rhs.id;
+}
+
+inline bool operator==(const KButton& lhs, const KButton& rhs) {
+  if (lhs.type == ButtonType::kAppleIBeacon &&
+      rhs.type == ButtonType::kAppleIBeacon) {
+    return lhs.data.apple_i_beacon == rhs.data.apple_i_beacon;
+  }
+  if (lhs.type == ButtonType::kM5Button && rhs.type == ButtonType::kM5Button) {
+    return lhs.data.m5_button.id == rhs.data.m5_button.id;
+  }
+  if (lhs.type == ButtonType::kGpioButton &&
+      rhs.type == ButtonType::kGpioButton) {
+    return lhs.data.gpio_button == rhs.data.gpio_button;
+  }
+  return lhs.type == rhs.type;
+}
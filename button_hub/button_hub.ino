@@ -1,6 +1,7 @@
 #include <M5Unified.h>
 #include <SPIFFS.h>
 #include <TickTwo.h>
+#include <deque>
 #include <memory>
 
 #include "api.hpp"
@@ -9,11 +10,13 @@
 #include "bluetooth.hpp"
 #include "bluetooth_beacon.hpp"
 #include "bluetooth_peripheral.hpp"
+#include "button_map.hpp"
 #include "command_table.hpp"
 #include "fetch_state.hpp"
 #include "gpio_button.hpp"
 #include "init_setup.hpp"
 #include "ip_resolver.hpp"
+#include "log_shipper.hpp"
 #include "logging.hpp"
 #include "mutex.hpp"
 #include "ota.hpp"
@@ -27,8 +30,10 @@
 #include "version.hpp"
 #include "wifi.hpp"
 
+static constexpr logging::Module kLogModule = logging::Module::kMain;
+
 constexpr int kButtonIgnoreDurationSec = 11;
-constexpr int kMaxObservedButtonCount = 10;
+constexpr size_t kMaxObservedButtonCount = 64;
 constexpr int kMaxAutoOtaTrialCount = 3;
 
 constexpr int kBluetoothBeaconSetupIntervalMsec = 1 * 1000;
@@ -50,7 +55,7 @@ static Page g_page = Page::kMain;
 
 static int g_reboot_count_down = -1;
 
-static std::map<KButton, time_t> g_last_beacon_time;
+static ButtonMap<time_t> g_last_beacon_time;
 kb::Mutex g_button_queue_mutex;
 static std::deque<std::pair<KButton, double>> g_button_queue;
 
@@ -75,15 +80,15 @@ static void BeaconCallback(const char* name, const uint8_t address[6],
   bool accept = true;
   {
     const time_t now = time(nullptr);
-    const auto it = g_last_beacon_time.find(button);
-    if (it != g_last_beacon_time.end()) {
-      const int diff = now - it->second;
+    const time_t* last_time = g_last_beacon_time.Find(button);
+    if (last_time != nullptr) {
+      const int diff = now - *last_time;
       if (diff < kButtonIgnoreDurationSec) {
         accept = false;
       }
     }
     if (accept) {
-      g_last_beacon_time[button] = now;
+      g_last_beacon_time.Set(button, now);
     }
   }
 
@@ -110,16 +115,12 @@ static void BeaconCallback(const char* name, const uint8_t address[6],
   if (const kb::LockGuard lock(g_button_queue_mutex); lock) {
     g_button_queue.emplace_back(button, estimated_distance);
   } else {
-    logging::Log("Beacon: Discarding button event due to lock failure");
+    logging::Log(logging::Level::kWarn,
+                 "Beacon: Discarding button event due to lock failure");
   }
 }
 
-static void HandleButtonPressed(const KButton& button,
-                                const double estimated_distance) {
-  g_command_table.NotifyObservedButton(button, estimated_distance);
-  server::EnqueueWsMessage(to_json::ConvertObservedButtons(
-      g_command_table.GetObservedButtons(), g_command_table.GetButtonNames()));
-
+static void RunCommandOfButton(const KButton& button) {
   Command command;
   if (g_command_table.GetCommandByButton(button, &command)) {
     if (const kb::LockGuard lock(api_mutex); lock) {
@@ -136,6 +137,18 @@ static void HandleButtonPressed(const KButton& button,
   }
 }
 
+static void HandleButtonPressed(const KButton& button,
+                                const double estimated_distance) {
+  KButton evicted;
+  const bool has_evicted =
+      g_command_table.NotifyObservedButton(button, estimated_distance, &evicted);
+  server::PublishObservedButtonChange(button);
+  if (has_evicted) {
+    server::PublishObservedButtonChange(evicted);
+  }
+  RunCommandOfButton(button);
+}
+
 void RegisterOrUnregisterGpioButtonAccordingToSettings(
     bool gpio_button_is_enabled, CommandTable& command_table) {
   static bool prev = false;
@@ -152,8 +165,10 @@ void RegisterOrUnregisterGpioButtonAccordingToSettings(
 static void SendWifiRssi() {
   const int rssi = WiFi.RSSI();
   screen::DrawWiFiSignalStrength(WiFi.status() == WL_CONNECTED, rssi);
-  server::EnqueueWsMessage(
-      "{\"type\":\"wifi_rssi\",\"wifi_rssi\":" + String(rssi) + "}");
+  server::PublishWsMessage(
+      server::WsTopic::kWiFiRssi, [rssi](const auto format) {
+        return to_json::ConvertWiFiRssi(rssi, format);
+      });
 }
 
 static void CheckReboot() {
@@ -166,7 +181,7 @@ static void CheckReboot() {
   if (prev_hour == 4 && timeinfo.tm_hour == 5) {
     screen::DrawWhiteTextWithBlackScreen({"朝5時の定期再起動", "を実行します"});
     logging::Log("Rebooting due to a.m. 5 ...");
-    logging::Update();
+    logging::Flush();
     delay(1000);
     ESP.restart();
   }
@@ -181,7 +196,7 @@ static void CheckReboot() {
       screen::DrawWhiteTextWithBlackScreen(
           {"Wi-Fi接続が切れたまま", "復帰できないので", "再起動します"});
       logging::Log("Rebooting due to disconnection ...");
-      logging::Update();
+      logging::Flush();
       delay(1000);
       ESP.restart();
     }
@@ -193,7 +208,7 @@ static void CheckReboot() {
       screen::DrawWhiteTextWithBlackScreen(
           {"ロボットからの情報取得", "が長引いているので", "再起動します"});
       logging::Log("Rebooting due to fetch timeout ...");
-      logging::Update();
+      logging::Flush();
       delay(1000);
       ESP.restart();
     }
@@ -204,15 +219,15 @@ static void CheckReboot() {
     screen::DrawWhiteTextWithBlackScreen(
         {"ロボットへのpingが", "失敗し続けているので", "再起動します"});
     logging::Log("Rebooting due to ping failure ...");
-    logging::Update();
+    logging::Flush();
     delay(1000);
     ESP.restart();
   }
 
   // Stats
-  Serial.printf("Free heap: now=%6.1f kb, min=%6.1f kb\n",
-                esp_get_free_heap_size() / 1000.0,
-                esp_get_minimum_free_heap_size() / 1000.0);
+  KB_LOGI("Free heap: now=%6.1f kb, min=%6.1f kb\n",
+          esp_get_free_heap_size() / 1000.0,
+          esp_get_minimum_free_heap_size() / 1000.0);
 }
 
 static void CountDownReboot() {
@@ -221,7 +236,7 @@ static void CountDownReboot() {
   }
   if (--g_reboot_count_down <= 0) {
     logging::Log("Rebooting ...");
-    logging::Update();
+    logging::Flush();
     ESP.restart();
   }
   logging::Log("Count down ... %d", g_reboot_count_down);
@@ -234,10 +249,10 @@ static void InitSpiffs() {
     M5.Lcd.setTextColor(TFT_RED);
     M5.Lcd.println("Formatting SPIFFS ...");
     M5.Lcd.println("Do not turn off the power");
-    Serial.println("Formatting SPIFFS ...");
+    KB_LOGW("Formatting SPIFFS ...\n");
     SPIFFS.format();
     M5.Lcd.println("Done");
-    Serial.println("Done");
+    KB_LOGW("Done\n");
     delay(1000);
     ESP.restart();
   }
@@ -273,12 +288,13 @@ void setup() {
   M5.Lcd.println(kVersion);
 
   Serial.begin(115200);
-  Serial.println("Ok");
+  logging::BeginSerial();
+  KB_LOGI("Ok\n");
 
   InitSpiffs();
 
   if (!g_prefs.begin("kachaka", false)) {
-    Serial.println("Failed to open preferences");
+    KB_LOGE("Failed to open preferences\n");
   }
   g_settings.Begin(&g_prefs);
 
@@ -287,6 +303,10 @@ void setup() {
 
   logging::Begin(g_settings.GetNextLoggingId());
   logging::Log("Start");
+  // Records are spooled until Wi-Fi is connected.
+  logging::SetShipperDestination(g_settings.GetSyslogHost(),
+                                 g_settings.GetSyslogPort(),
+                                 g_settings.GetSyslogUsesTcp());
 
   bluetooth::Init();
 
@@ -316,7 +336,7 @@ void setup() {
       ota_url =
           ota::GetOtaImageUrlFromServerIfAvailable(g_settings.GetOtaEndpoint());
       if (g_settings.GetOtaFailCount() >= kMaxAutoOtaTrialCount) {
-        Serial.println("Auto OTA is turned off due to failure count");
+        KB_LOGW("Auto OTA is turned off due to failure count\n");
         g_settings.SetAutoOtaIsEnabled(false);
         g_settings.ClearOtaFailCount();
         ota_url.clear();
@@ -333,8 +353,7 @@ void setup() {
     }
   } else {
     WiFi.softAP(kApSsid, kApPass);
-    Serial.print("Hub IP: ");
-    Serial.println(WiFi.softAPIP());
+    KB_LOGI("Hub IP: %s\n", WiFi.softAPIP().toString().c_str());
 
     bluetooth_peripheral::Begin();
 
@@ -393,7 +412,7 @@ static void SetupOta() {
       [](ota::Error error) {  // on_error
         screen::DrawOtaError(error);
         if (error == ota::Error::kWatchdogNow) {
-          Serial.printf("OTA fail count: %d\n", g_settings.GetOtaFailCount());
+          KB_LOGE("OTA fail count: %d\n", g_settings.GetOtaFailCount());
           beep::PlayOtaFailed();
           delay(1000);
           ESP.restart();
@@ -430,8 +449,8 @@ static void SetupAsWiFiClient() {
 
   g_command_table.SetButtonName(KButton(M5Button(2)), "HubボタンA");
   g_command_table.SetButtonName(KButton(M5Button(3)), "HubボタンB");
-  server::EnqueueWsMessage(to_json::ConvertObservedButtons(
-      g_command_table.GetObservedButtons(), g_command_table.GetButtonNames()));
+  server::PublishObservedButtonChange(KButton(M5Button(2)));
+  server::PublishObservedButtonChange(KButton(M5Button(3)));
 
   g_reboot_timer.start();
   g_clock_timer.start();
@@ -498,7 +517,12 @@ void loop() {
         g_button_queue.pop_front();
       }
     } else {
-      Serial.println("Failed to lock button_queue mutex");
+      KB_LOGE("Failed to lock button_queue mutex\n");
+    }
+    // A test press from the UI runs the command without being observed
+    if (KButton button; server::PopTestPress(&button)) {
+      logging::Log("Test press");
+      RunCommandOfButton(button);
     }
     RegisterOrUnregisterGpioButtonAccordingToSettings(
         g_settings.GetGpioButtonIsEnabled(), g_command_table);
@@ -508,6 +532,5 @@ void loop() {
     g_clock_timer.update();
   }
   server::FlushWsMessageQueue();
-  logging::Update();
   delay(5);
 }
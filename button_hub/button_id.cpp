@@ -0,0 +1,131 @@
+#include "button_id.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace button_id {
+
+static constexpr char kAppleIBeaconPrefix[] = "ib-";
+static constexpr char kM5ButtonPrefix[] = "m5-";
+static constexpr char kGpioButtonPrefix[] = "gpio-";
+static constexpr char kHexDigits[] = "0123456789abcdef";
+// Bytes of an AppleIBeacon in its ID
+constexpr size_t kAppleIBeaconSize = 6 + 16 + 2 + 2;
+
+static char* FormatHex(const uint8_t* data, const size_t size, char* out) {
+  for (size_t i = 0; i < size; ++i) {
+    *out++ = kHexDigits[data[i] >> 4];
+    *out++ = kHexDigits[data[i] & 0x0f];
+  }
+  return out;
+}
+
+void Format(const KButton& button, char* out) {
+  switch (button.type) {
+    case ButtonType::kAppleIBeacon: {
+      const AppleIBeacon& beacon = button.data.apple_i_beacon;
+      const uint8_t major_minor[4] = {
+          static_cast<uint8_t>(beacon.major >> 8),
+          static_cast<uint8_t>(beacon.major & 0xff),
+          static_cast<uint8_t>(beacon.minor >> 8),
+          static_cast<uint8_t>(beacon.minor & 0xff)};
+      std::memcpy(out, kAppleIBeaconPrefix, sizeof(kAppleIBeaconPrefix) - 1);
+      out += sizeof(kAppleIBeaconPrefix) - 1;
+      out = FormatHex(beacon.address, sizeof(beacon.address), out);
+      out = FormatHex(beacon.uuid, sizeof(beacon.uuid), out);
+      out = FormatHex(major_minor, sizeof(major_minor), out);
+      *out = '\0';
+      return;
+    }
+    case ButtonType::kM5Button:
+      std::snprintf(out, kMaxLength + 1, "%s%u", kM5ButtonPrefix,
+                    button.data.m5_button.id);
+      return;
+    case ButtonType::kGpioButton:
+      std::snprintf(out, kMaxLength + 1, "%s%u", kGpioButtonPrefix,
+                    button.data.gpio_button.id);
+      return;
+  }
+  *out = '\0';
+}
+
+static const char* SkipPrefix(const char* id, const char* prefix) {
+  const size_t length = std::strlen(prefix);
+  return std::strncmp(id, prefix, length) == 0 ? id + length : nullptr;
+}
+
+static int ParseHexDigit(const char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Exactly 2 * `size` lowercase hex digits
+static bool ParseHex(const char* hex, uint8_t* out, const size_t size) {
+  if (std::strlen(hex) != 2 * size) {
+    return false;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    const int high = ParseHexDigit(hex[2 * i]);
+    const int low = ParseHexDigit(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    out[i] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return true;
+}
+
+// 0 to 255 in decimal, without leading zeros
+static bool ParseUint8(const char* decimal, uint8_t* out) {
+  if (*decimal == '\0' || (decimal[0] == '0' && decimal[1] != '\0')) {
+    return false;
+  }
+  unsigned int value = 0;
+  for (const char* p = decimal; *p != '\0'; ++p) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    value = value * 10 + (*p - '0');
+    if (value > 255) {
+      return false;
+    }
+  }
+  *out = static_cast<uint8_t>(value);
+  return true;
+}
+
+bool Parse(const char* id, KButton* button) {
+  uint8_t value = 0;
+  if (const char* rest = SkipPrefix(id, kM5ButtonPrefix); rest != nullptr) {
+    if (!ParseUint8(rest, &value)) {
+      return false;
+    }
+    *button = KButton(M5Button(value));
+    return true;
+  }
+  if (const char* rest = SkipPrefix(id, kGpioButtonPrefix); rest != nullptr) {
+    if (!ParseUint8(rest, &value)) {
+      return false;
+    }
+    *button = KButton(GpioButton(value));
+    return true;
+  }
+  if (const char* rest = SkipPrefix(id, kAppleIBeaconPrefix);
+      rest != nullptr) {
+    uint8_t bytes[kAppleIBeaconSize];
+    if (!ParseHex(rest, bytes, sizeof(bytes))) {
+      return false;
+    }
+    *button = KButton(AppleIBeacon(bytes, bytes + 6, bytes[22] << 8 | bytes[23],
+                                   bytes[24] << 8 | bytes[25]));
+    return true;
+  }
+  return false;
+}
+
+}  // namespace button_id
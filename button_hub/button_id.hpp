@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+#include "button.hpp"
+
+namespace button_id {
+
+// Short IDs of the buttons for the paths of the per-entry endpoints, e.g.
+// PUT /commands/m5-1. Each ID stands for exactly one button and back:
+//
+// - "m5-<id>" and "gpio-<id>" with the id in decimal
+// - "ib-<address><uuid><major><minor>" in 52 lowercase hex digits, each field
+//   most significant byte first
+
+constexpr size_t kMaxLength = 3 + 2 * (6 + 16 + 2 + 2);
+
+// `out` has room for kMaxLength characters and a terminator.
+void Format(const KButton& button, char* out);
+// Returns false unless `id` is what Format() writes for some button.
+bool Parse(const char* id, KButton* button);
+
+}  // namespace button_id
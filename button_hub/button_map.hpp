@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "button.hpp"
+
+// Values keyed by button, kept sorted by button in a single vector. A lookup
+// is a binary search, and an insertion moves the entries after it, which for
+// the few hundred buttons of a hub costs less than the node allocation per
+// entry of a std::map and leaves no per-entry overhead on the heap.
+//
+// Each entry takes sizeof(Entry), i.e. sizeof(KButton) (28 bytes) plus
+// sizeof(T), plus whatever T itself allocates. Capacity is only ever grown
+// by the vector, so Reserve() the expected size where it is known.
+//
+// The order is the one of operator<(KButton, KButton), which is also the
+// order of the pages of GET /commands and GET /buttons.
+template <typename T>
+class ButtonMap {
+ public:
+  struct Entry {
+    KButton button;
+    T value;
+  };
+
+  using const_iterator = typename std::vector<Entry>::const_iterator;
+
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+  const_iterator begin() const { return entries_.begin(); }
+  const_iterator end() const { return entries_.end(); }
+
+  void Reserve(const size_t size) { entries_.reserve(size); }
+  void Clear() { entries_.clear(); }
+
+  // nullptr if `button` has no entry
+  const T* Find(const KButton& button) const {
+    const auto iter = LowerBound(button);
+    return iter != entries_.end() && iter->button == button ? &iter->value
+                                                            : nullptr;
+  }
+
+  bool Contains(const KButton& button) const {
+    return Find(button) != nullptr;
+  }
+
+  // Returns true if the entry is new, and false if it replaced another
+  bool Set(const KButton& button, T value) {
+    const auto iter = LowerBound(button);
+    if (iter != entries_.end() && iter->button == button) {
+      entries_[iter - entries_.begin()].value = std::move(value);
+      return false;
+    }
+    entries_.insert(iter, Entry{button, std::move(value)});
+    return true;
+  }
+
+  // Returns false if `button` had no entry
+  bool Erase(const KButton& button) {
+    const auto iter = LowerBound(button);
+    if (iter == entries_.end() || !(iter->button == button)) {
+      return false;
+    }
+    entries_.erase(iter);
+    return true;
+  }
+
+  // The first entry after `button`, which need not have an entry itself,
+  // e.g. the start of the page after a cursor
+  const_iterator UpperBound(const KButton& button) const {
+    return std::upper_bound(entries_.begin(), entries_.end(), button,
+                            [](const KButton& lhs, const Entry& rhs) {
+                              return lhs < rhs.button;
+                            });
+  }
+
+ private:
+  const_iterator LowerBound(const KButton& button) const {
+    return std::lower_bound(entries_.begin(), entries_.end(), button,
+                            [](const Entry& lhs, const KButton& rhs) {
+                              return lhs.button < rhs;
+                            });
+  }
+
+  std::vector<Entry> entries_;
+};
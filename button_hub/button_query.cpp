@@ -0,0 +1,108 @@
+#include "button_query.hpp"
+
+#include <cstring>
+
+namespace button_query {
+
+// An observed_within of more than a day is as good as none
+constexpr uint32_t kMaxObservedWithinSec = 24 * 60 * 60;
+
+struct TypeName {
+  const char* name;
+  ButtonType type;
+};
+
+static constexpr TypeName kTypeNames[] = {
+    {"ib", ButtonType::kAppleIBeacon},
+    {"m5", ButtonType::kM5Button},
+    {"gpio", ButtonType::kGpioButton},
+};
+
+bool Matches(const Query& query, const KButton& button, const char* name,
+             const std::time_t* observed_at) {
+  if ((query.types & GetTypeBit(button.type)) == 0) {
+    return false;
+  }
+  if (query.name_prefix[0] != '\0' &&
+      (name == nullptr || std::strncmp(name, query.name_prefix,
+                                       std::strlen(query.name_prefix)) != 0)) {
+    return false;
+  }
+  if (query.observed_since != 0 &&
+      (observed_at == nullptr || *observed_at < query.observed_since)) {
+    return false;
+  }
+  return true;
+}
+
+bool IsAfterCursor(const Query& query, const KButton& button) {
+  return !query.has_cursor || query.cursor < button;
+}
+
+// Decimal without leading zeros, up to `max`
+static bool ParseDecimal(const char* decimal, const uint32_t max,
+                         uint32_t* out) {
+  if (*decimal == '\0' || (decimal[0] == '0' && decimal[1] != '\0')) {
+    return false;
+  }
+  uint32_t value = 0;
+  for (const char* p = decimal; *p != '\0'; ++p) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    value = value * 10 + (*p - '0');
+    if (value > max) {
+      return false;
+    }
+  }
+  *out = value;
+  return true;
+}
+
+bool ParseTypes(const char* types, uint8_t* out) {
+  uint8_t bits = 0;
+  const char* p = types;
+  while (true) {
+    const char* comma = std::strchr(p, ',');
+    const size_t length = comma != nullptr ? comma - p : std::strlen(p);
+    bool found = false;
+    for (const TypeName& type_name : kTypeNames) {
+      if (std::strlen(type_name.name) == length &&
+          std::strncmp(p, type_name.name, length) == 0) {
+        bits |= GetTypeBit(type_name.type);
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    if (comma == nullptr) {
+      break;
+    }
+    p = comma + 1;
+  }
+  *out = bits;
+  return true;
+}
+
+bool ParseLimit(const char* limit, size_t* out) {
+  uint32_t value = 0;
+  if (!ParseDecimal(limit, kMaxLimit, &value) || value == 0) {
+    return false;
+  }
+  *out = value;
+  return true;
+}
+
+bool ParseObservedWithin(const char* seconds, const std::time_t now,
+                         std::time_t* out) {
+  uint32_t value = 0;
+  if (!ParseDecimal(seconds, kMaxObservedWithinSec, &value)) {
+    return false;
+  }
+  // Not 0, which would mean no filter at all
+  *out = now > static_cast<std::time_t>(value) ? now - value : 1;
+  return true;
+}
+
+}  // namespace button_query
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include "button.hpp"
+
+namespace button_query {
+
+// Page sizes of GET /commands and GET /buttons
+constexpr size_t kDefaultLimit = 50;
+constexpr size_t kMaxLimit = 100;
+
+constexpr uint8_t GetTypeBit(const ButtonType type) {
+  return static_cast<uint8_t>(1 << static_cast<uint8_t>(type));
+}
+
+constexpr uint8_t kAllTypes = GetTypeBit(ButtonType::kAppleIBeacon) |
+                              GetTypeBit(ButtonType::kM5Button) |
+                              GetTypeBit(ButtonType::kGpioButton);
+
+// A page of GET /commands or GET /buttons: up to `limit` buttons that match
+// the filters, in the order of ButtonMap, after the cursor. The default is
+// the first page of everything.
+struct Query {
+  uint8_t types = kAllTypes;  // bits of GetTypeBit()
+  const char* name_prefix = "";
+  // Only the buttons observed at or after this time, unless 0
+  std::time_t observed_since = 0;
+  bool has_cursor = false;
+  KButton cursor{};  // the last button of the previous page
+  size_t limit = kDefaultLimit;
+};
+
+// `name` is null for a button without a name, and `observed_at` for one
+// that has not been observed recently.
+bool Matches(const Query& query, const KButton& button, const char* name,
+             const std::time_t* observed_at);
+bool IsAfterCursor(const Query& query, const KButton& button);
+
+// Parses the parameters of the query:
+//
+// - "type": comma separated "ib", "m5" and "gpio", the prefixes of their
+//   button IDs
+// - "limit": 1 to kMaxLimit
+// - "observed_within": seconds, which `now` turns into observed_since
+bool ParseTypes(const char* types, uint8_t* out);
+bool ParseLimit(const char* limit, size_t* out);
+bool ParseObservedWithin(const char* seconds, std::time_t now,
+                         std::time_t* out);
+
+}  // namespace button_query
@@ -6,23 +6,34 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <utility>
 #include <vector>
 
+#include "button_id.hpp"
 #include "from_json.hpp"
 #include "logging.hpp"
 #include "mutex.hpp"
 #include "settings.hpp"
 #include "to_json.hpp"
 
+static constexpr logging::Module kLogModule = logging::Module::kMain;
+
 constexpr int kFileVersion = 7;
 static constexpr char const* kCommandTablePath = "/command_table.dat";
 static constexpr char const* kTemporaryCommandTablePath = "/command_table.tmp";
+// Upper bound of a single record in {"commands": [...]}
+constexpr size_t kMaxCommandRecordSize = 4 * 1024;
+// Changes since the table file was written, see CommandTable::ApplyChanges()
+static constexpr char const* kCommandJournalPath = "/command_table.jnl";
+constexpr int kJournalVersion = 1;
+// The journal is folded into the table file instead of growing larger
+constexpr size_t kMaxJournalSize = 8 * 1024;
 
 static bool WriteInt32(File& file, const int32_t value) {
   const size_t retv =
       file.write(reinterpret_cast<const uint8_t*>(&value), sizeof(value));
   if (retv != sizeof(value)) {
-    logging::Log("Failed to write int32_t: %d", retv);
+    logging::Log(logging::Level::kError, "Failed to write int32_t: %d", retv);
     return false;
   }
   return true;
@@ -33,7 +44,7 @@ static int32_t ReadInt32(File& file) {
   const size_t retv =
       file.read(reinterpret_cast<uint8_t*>(&value), sizeof(value));
   if (retv != sizeof(value)) {
-    logging::Log("Failed to read int32_t: %d", retv);
+    logging::Log(logging::Level::kError, "Failed to read int32_t: %d", retv);
   }
   return value;
 }
@@ -46,23 +57,27 @@ static bool WriteString(File& file, const String& str) {
   const size_t retv =
       file.write(reinterpret_cast<const uint8_t*>(str.c_str()), size);
   if (retv != size) {
-    logging::Log("Failed to write string: %d != %u", size, retv);
+    logging::Log(logging::Level::kError, "Failed to write string: %d != %u",
+                 size, retv);
     return false;
   }
   return true;
 }
 
-static String ReadString(File& file) {
-  int32_t size = ReadInt32(file);
+static String ReadStringOfSize(File& file, const int32_t size) {
   std::vector<char> buf(size + 1);
   const size_t retv = file.read(reinterpret_cast<uint8_t*>(buf.data()), size);
   if (retv != size) {
-    logging::Log("Failed to read int32_t: %d", retv);
+    logging::Log(logging::Level::kError, "Failed to read int32_t: %d", retv);
   }
   buf.at(size) = '\0';
   return String(buf.data());
 }
 
+static String ReadString(File& file) {
+  return ReadStringOfSize(file, ReadInt32(file));
+}
+
 bool SerializeAddressToString(const uint8_t address[6], char* out, int len) {
   const int required_size = 18;  // 17 characters + null terminator
   if (len < required_size) {
@@ -151,152 +166,611 @@ bool DeserializeUuidToString(const char* data, int len, uint8_t out[16]) {
   return retv == 16;
 }
 
-CommandTable::CommandTable(const int max_observed_buttons)
-    : max_observed_buttons_(max_observed_buttons),
-      observed_buttons_(),
-      registered_commands_(),
-      button_names_() {}
+// Journal
+//
+// The version of the journal, then one record per change:
+//
+//   int32 Change::Type, String button_id, String payload
+//
+// where the payload is the command JSON of kSetCommand, the name of kSetName
+// and empty otherwise.
+
+struct JournalRecord {
+  CommandTable::Change::Type type;
+  char id[button_id::kMaxLength + 1];
+  String payload;
+};
+
+static JournalRecord MakeJournalRecord(const CommandTable::Change::Type type,
+                                       const KButton& button,
+                                       const String& payload) {
+  JournalRecord record{type, {}, payload};
+  button_id::Format(button, record.id);
+  return record;
+}
 
-void CommandTable::NotifyObservedButton(const KButton& button,
-                                        const double estimated_distance) {
-  const kb::LockGuard lock(mutex_);
+// The JSON of the command of kSetCommand and the name of kSetName, as kept
+// in the table and in the journal
+static String GetPayload(const CommandTable::Change& change) {
+  switch (change.type) {
+    case CommandTable::Change::Type::kSetCommand:
+      return to_json::ConvertCommand(change.command);
+    case CommandTable::Change::Type::kSetName:
+      return change.name;
+    default:
+      return String();
+  }
+}
 
-  std::time_t now{};
-  std::time(&now);
+// Returns false if the journal is full or cannot be written, in which case
+// the whole table has to be saved instead
+static bool AppendToJournal(const std::vector<JournalRecord>& records) {
+  size_t size = 0;
+  for (const JournalRecord& record : records) {
+    size += 3 * sizeof(int32_t) + std::strlen(record.id) +
+            record.payload.length();
+  }
+  File file = SPIFFS.open(kCommandJournalPath, "a");
+  if (!file) {
+    logging::Log(logging::Level::kError, "Failed to open the journal");
+    return false;
+  }
+  const size_t journal_size = file.size();
+  if (journal_size + size > kMaxJournalSize) {
+    return false;
+  }
+  if (journal_size == 0 && !WriteInt32(file, kJournalVersion)) {
+    return false;
+  }
+  for (const JournalRecord& record : records) {
+    if (!WriteInt32(file, static_cast<int32_t>(record.type)) ||
+        !WriteString(file, record.id) || !WriteString(file, record.payload)) {
+      logging::Log(logging::Level::kError, "Failed to write the journal");
+      return false;
+    }
+  }
+  file.flush();
+  return true;
+}
+
+// Returns false at the end of the journal, including a record cut short by a
+// reset while it was being written
+static bool ReadJournalString(File& file, String* out) {
+  if (file.available() < static_cast<int>(sizeof(int32_t))) {
+    return false;
+  }
+  const int32_t size = ReadInt32(file);
+  if (size < 0 || file.available() < size) {
+    return false;
+  }
+  *out = ReadStringOfSize(file, size);
+  return true;
+}
+
+static bool ReadJournalRecord(File& file, CommandTable::Change* change,
+                              String* payload) {
+  String id;
+  if (file.available() < static_cast<int>(sizeof(int32_t))) {
+    return false;
+  }
+  const int32_t type = ReadInt32(file);
+  if (!ReadJournalString(file, &id) || !ReadJournalString(file, payload)) {
+    return false;
+  }
+  if (type < static_cast<int32_t>(CommandTable::Change::Type::kSetCommand) ||
+      type > static_cast<int32_t>(CommandTable::Change::Type::kDeleteName) ||
+      !button_id::Parse(id.c_str(), &change->button)) {
+    logging::Log(logging::Level::kError, "Invalid journal record: %d %s",
+                 type, id.c_str());
+    return false;
+  }
+  change->type = static_cast<CommandTable::Change::Type>(type);
+  if (change->type == CommandTable::Change::Type::kSetCommand) {
+    JsonDocument doc;
+    if (deserializeJson(doc, *payload) ||
+        !from_json::ConvertCommandOnlyJson(doc.as<JsonObject>(),
+                                           change->command)) {
+      logging::Log(logging::Level::kError, "Invalid journal command: %s",
+                   id.c_str());
+      return false;
+    }
+  } else if (change->type == CommandTable::Change::Type::kSetName) {
+    change->name = *payload;
+  }
+  return true;
+}
+
+static bool ParseCommandJson(const String& json, Command* command) {
+  JsonDocument doc;
+  if (deserializeJson(doc, json)) {
+    logging::Log(logging::Level::kError, "Invalid command JSON");
+    return false;
+  }
+  return from_json::ConvertCommandOnlyJson(doc.as<JsonObject>(), *command);
+}
+
+// Copies a part of the entries only once the writer changes it
+class CommandTable::Draft {
+ public:
+  explicit Draft(const Entries& base) : base_(base) {}
 
-  // Remove entries which has the same button
-  observed_buttons_.erase(
-      std::remove_if(observed_buttons_.begin(), observed_buttons_.end(),
-                     [&button](const ObservedButton& observed_button) {
-                       return observed_button.button == button;
-                     }),
-      observed_buttons_.end());
+  const ButtonMap<String>& commands() const {
+    return commands_ != nullptr ? *commands_ : *base_.commands;
+  }
+  const ButtonMap<String>& names() const {
+    return names_ != nullptr ? *names_ : *base_.names;
+  }
+  ButtonMap<String>& mutable_commands() {
+    if (commands_ == nullptr) {
+      commands_ = std::make_shared<ButtonMap<String>>(*base_.commands);
+    }
+    return *commands_;
+  }
+  // Replaces the commands without copying those of the base first
+  void set_commands(ButtonMap<String> commands) {
+    commands_ = std::make_shared<ButtonMap<String>>(std::move(commands));
+  }
+  ButtonMap<String>& mutable_names() {
+    if (names_ == nullptr) {
+      names_ = std::make_shared<ButtonMap<String>>(*base_.names);
+    }
+    return *names_;
+  }
+
+  bool IsChanged() const {
+    return commands_ != nullptr || names_ != nullptr;
+  }
+  Entries ToEntries() const {
+    return Entries{
+        commands_ != nullptr ? commands_ : base_.commands,
+        names_ != nullptr ? names_ : base_.names,
+    };
+  }
+
+ private:
+  Entries base_;
+  std::shared_ptr<ButtonMap<String>> commands_;
+  std::shared_ptr<ButtonMap<String>> names_;
+};
+
+static const ObservedButton* FindObservedButton(
+    const CommandTable::ObservedButtons& observed_buttons,
+    const KButton& button) {
+  for (const ObservedButton& observed_button : observed_buttons) {
+    if (observed_button.button == button) {
+      return &observed_button;
+    }
+  }
+  return nullptr;
+}
+
+CommandTable::CommandTable(const size_t max_observed_buttons)
+    : max_observed_buttons_(max_observed_buttons) {
+  entries_.Publish(std::make_shared<const Entries>(
+      Entries{std::make_shared<const ButtonMap<String>>(),
+              std::make_shared<const ButtonMap<String>>()}));
+}
+
+bool CommandTable::NotifyObservedButton(const KButton& button,
+                                        const double estimated_distance,
+                                        KButton* evicted) {
+  const kb::LockGuard lock(observed_mutex_);
 
-  // Push the new entry
-  observed_buttons_.push_front({now, estimated_distance, button});
+  std::time_t now{};
+  std::time(&now);
 
-  // Pop the oldest entry if the size exceeds the limit
-  if (observed_buttons_.size() > max_observed_buttons_) {
-    observed_buttons_.pop_back();
+  // The new entry first, then the others but the same button, and the oldest
+  // is left out if the size exceeds the limit
+  const std::shared_ptr<const ObservedButtons> old = observed_buttons_.Get();
+  auto observed_buttons = std::make_shared<ObservedButtons>();
+  observed_buttons->reserve(
+      std::min(old->size() + 1, max_observed_buttons_));
+  observed_buttons->push_back({now, estimated_distance, button});
+  bool is_evicted = false;
+  for (const ObservedButton& observed_button : *old) {
+    if (observed_button.button == button) {
+      continue;
+    }
+    if (observed_buttons->size() >= max_observed_buttons_) {
+      *evicted = observed_button.button;
+      is_evicted = true;
+      break;
+    }
+    observed_buttons->push_back(observed_button);
   }
+  observed_buttons_.Publish(std::move(observed_buttons));
+  return is_evicted;
 }
 
-const std::deque<ObservedButton>& CommandTable::GetObservedButtons() const {
-  return observed_buttons_;
+std::shared_ptr<const CommandTable::ObservedButtons>
+CommandTable::GetObservedButtons() const {
+  return observed_buttons_.Get();
+}
+
+bool CommandTable::GetObservedButton(const KButton& button,
+                                     ObservedButton* out) const {
+  const std::shared_ptr<const ObservedButtons> observed_buttons =
+      observed_buttons_.Get();
+  const ObservedButton* observed_button =
+      FindObservedButton(*observed_buttons, button);
+  if (observed_button == nullptr) {
+    return false;
+  }
+  *out = *observed_button;
+  return true;
 }
 
 void CommandTable::SetCommand(const KButton& button, const Command& command) {
   const kb::LockGuard lock(mutex_);
-  SetCommandLocked(button, command);
+  Draft draft(*entries_.Get());
+  SetCommandJson(button, to_json::ConvertCommand(command), &draft);
+  Publish(draft);
 }
 
 void CommandTable::DeleteCommand(const KButton& button) {
+  Change change;
+  change.type = Change::Type::kDeleteCommand;
+  change.button = button;
   const kb::LockGuard lock(mutex_);
-  DeleteCommandLocked(button);
-  if (button.type == ButtonType::kAppleIBeacon) {
-    button_names_.erase(button);
-  }
+  Draft draft(*entries_.Get());
+  ApplyChange(change, String(), &draft);
+  Publish(draft);
 }
 
-std::vector<ButtonCommandPair> CommandTable::GetCommands() const {
-  const kb::LockGuard lock(mutex_);
-  return registered_commands_;
+std::shared_ptr<const ButtonMap<String>> CommandTable::GetCommands() const {
+  return entries_.Get()->commands;
+}
+
+bool CommandTable::HasCommand(const KButton& button) const {
+  return entries_.Get()->commands->Contains(button);
+}
+
+bool CommandTable::GetCommandJson(const KButton& button, String* json) const {
+  const std::shared_ptr<const Entries> entries = entries_.Get();
+  const String* command_json = entries->commands->Find(button);
+  if (command_json == nullptr) {
+    return false;
+  }
+  *json = *command_json;
+  return true;
 }
 
 bool CommandTable::GetCommandByButton(const KButton& button,
                                       Command* command) const {
+  String json;
+  return GetCommandJson(button, &json) && ParseCommandJson(json, command);
+}
+
+void CommandTable::SetButtonName(const KButton& button, const String& name) {
   const kb::LockGuard lock(mutex_);
-  for (const auto& pair : registered_commands_) {
-    if (pair.button == button) {
-      *command = pair.command;
+  Draft draft(*entries_.Get());
+  draft.mutable_names().Set(button, name);
+  Publish(draft);
+}
+
+void CommandTable::DeleteButtonName(const KButton& button) {
+  const kb::LockGuard lock(mutex_);
+  Draft draft(*entries_.Get());
+  if (draft.names().Contains(button)) {
+    draft.mutable_names().Erase(button);
+    Publish(draft);
+  }
+}
+
+std::shared_ptr<const ButtonMap<String>> CommandTable::GetButtonNames() const {
+  return entries_.Get()->names;
+}
+
+bool CommandTable::GetButtonName(const KButton& button, String* name) const {
+  const std::shared_ptr<const Entries> entries = entries_.Get();
+  const String* button_name = entries->names->Find(button);
+  if (button_name == nullptr) {
+    return false;
+  }
+  *name = *button_name;
+  return true;
+}
+
+bool CommandTable::GetCommandPage(const button_query::Query& query,
+                                  ButtonMap<String>* commands,
+                                  KButton* next_cursor) const {
+  const std::shared_ptr<const Entries> entries = entries_.Get();
+  const std::shared_ptr<const ObservedButtons> observed_buttons =
+      observed_buttons_.Get();
+  const ButtonMap<String>& registered_commands = *entries->commands;
+  commands->Clear();
+  auto iter = query.has_cursor ? registered_commands.UpperBound(query.cursor)
+                               : registered_commands.begin();
+  for (; iter != registered_commands.end(); ++iter) {
+    const String* name = entries->names->Find(iter->button);
+    const ObservedButton* observed =
+        FindObservedButton(*observed_buttons, iter->button);
+    if (!button_query::Matches(query, iter->button,
+                               name != nullptr ? name->c_str() : nullptr,
+                               observed != nullptr ? &observed->timestamp
+                                                   : nullptr)) {
+      continue;
+    }
+    if (commands->size() == query.limit) {
+      *next_cursor = (commands->end() - 1)->button;
       return true;
     }
+    // Appended in order, so never moves the others
+    commands->Set(iter->button, iter->value);
   }
   return false;
 }
 
-void CommandTable::SetButtonName(const KButton& button, const String& name) {
-  const kb::LockGuard lock(mutex_);
-  SetButtonNameLocked(button, name);
+bool CommandTable::GetButtonPage(const button_query::Query& query,
+                                 ObservedButtons* observed_buttons,
+                                 ButtonMap<String>* button_names,
+                                 KButton* next_cursor) const {
+  const std::shared_ptr<const ButtonMap<String>> names = GetButtonNames();
+  const std::shared_ptr<const ObservedButtons> observed = GetObservedButtons();
+  // The buttons are the union of the observed ones, few and unordered, and
+  // the named ones, which are walked in order from the cursor.
+  std::vector<KButton> buttons;
+  for (const ObservedButton& observed_button : *observed) {
+    if (button_query::IsAfterCursor(query, observed_button.button) &&
+        !names->Contains(observed_button.button)) {
+      buttons.push_back(observed_button.button);
+    }
+  }
+  std::sort(buttons.begin(), buttons.end());
+  auto name_iter =
+      query.has_cursor ? names->UpperBound(query.cursor) : names->begin();
+  auto observed_iter = buttons.begin();
+
+  ButtonMap<bool> page;  // the buttons of the page, if observed
+  bool has_more = false;
+  while (name_iter != names->end() || observed_iter != buttons.end()) {
+    const bool is_named =
+        observed_iter == buttons.end() ||
+        (name_iter != names->end() && name_iter->button < *observed_iter);
+    const KButton button = is_named ? name_iter->button : *observed_iter;
+    if (is_named) {
+      ++name_iter;
+    } else {
+      ++observed_iter;
+    }
+    const String* name = names->Find(button);
+    const ObservedButton* observed_button =
+        FindObservedButton(*observed, button);
+    if (!button_query::Matches(
+            query, button, name != nullptr ? name->c_str() : nullptr,
+            observed_button != nullptr ? &observed_button->timestamp
+                                       : nullptr)) {
+      continue;
+    }
+    if (page.size() == query.limit) {
+      *next_cursor = (page.end() - 1)->button;
+      has_more = true;
+      break;
+    }
+    page.Set(button, observed_button != nullptr);
+  }
+
+  // In the order of GET /buttons: the observed buttons first
+  observed_buttons->clear();
+  for (const ObservedButton& observed_button : *observed) {
+    if (page.Contains(observed_button.button)) {
+      observed_buttons->push_back(observed_button);
+    }
+  }
+  button_names->Clear();
+  for (const auto& entry : page) {
+    if (const String* name = names->Find(entry.button); name != nullptr) {
+      button_names->Set(entry.button, *name);
+    }
+  }
+  return has_more;
 }
 
-void CommandTable::DeleteButtonName(const KButton& button) {
+bool CommandTable::ApplyChanges(const std::vector<Change>& changes) {
   const kb::LockGuard lock(mutex_);
-  button_names_.erase(button);
+  std::vector<String> payloads;
+  payloads.reserve(changes.size());
+  for (const Change& change : changes) {
+    payloads.push_back(GetPayload(change));
+  }
+  Draft draft(*entries_.Get());
+  if (!CanApply(draft, changes, payloads)) {
+    return false;
+  }
+  std::vector<JournalRecord> records;
+  for (size_t i = 0; i < changes.size(); ++i) {
+    const Change& change = changes[i];
+    const bool is_named = draft.names().Contains(change.button);
+    ApplyChange(change, payloads[i], &draft);
+    if (change.type == Change::Type::kSetCommand && !is_named) {
+      // Named by SetCommandJson(), which would pick another name on replay
+      records.push_back(MakeJournalRecord(Change::Type::kSetName,
+                                          change.button,
+                                          *draft.names().Find(change.button)));
+    }
+    records.push_back(
+        MakeJournalRecord(change.type, change.button, payloads[i]));
+  }
+  // One generation for all the changes
+  Publish(draft);
+  if (!AppendToJournal(records)) {
+    SaveLocked();
+  }
+  return true;
 }
 
-std::map<KButton, String> CommandTable::GetButtonNames() const {
-  const kb::LockGuard lock(mutex_);
-  return button_names_;
+void CommandTable::Publish(const Draft& draft) {
+  if (draft.IsChanged()) {
+    entries_.Publish(std::make_shared<const Entries>(draft.ToEntries()));
+  }
 }
 
-bool CommandTable::LoadCommand(const String& json) {
-  const kb::LockGuard lock(mutex_);
+// Counts the entries that `changes` would add, ignoring those that they
+// delete, so that the limits hold after every single change
+bool CommandTable::CanApply(const Draft& draft,
+                            const std::vector<Change>& changes,
+                            const std::vector<String>& payloads) {
+  ButtonMap<bool> new_commands;
+  ButtonMap<bool> new_names;
+  for (size_t i = 0; i < changes.size(); ++i) {
+    const Change& change = changes[i];
+    if (change.type == Change::Type::kSetCommand) {
+      if (payloads[i].length() > kMaxCommandJsonSize) {
+        logging::Log(logging::Level::kError, "Too large command: %u",
+                     payloads[i].length());
+        return false;
+      }
+      if (!draft.commands().Contains(change.button)) {
+        new_commands.Set(change.button, true);
+      }
+    } else if (change.type == Change::Type::kSetName &&
+               payloads[i].length() > kMaxButtonNameSize) {
+      logging::Log(logging::Level::kError, "Too long name: %u",
+                   payloads[i].length());
+      return false;
+    }
+    if ((change.type == Change::Type::kSetCommand ||
+         change.type == Change::Type::kSetName) &&
+        !draft.names().Contains(change.button)) {
+      new_names.Set(change.button, true);
+    }
+  }
+  if (draft.commands().size() + new_commands.size() > kMaxCommands ||
+      draft.names().size() + new_names.size() > kMaxButtonNames) {
+    logging::Log(logging::Level::kError,
+                 "Too many buttons: %u new commands, %u new names",
+                 new_commands.size(), new_names.size());
+    return false;
+  }
+  return true;
+}
+
+void CommandTable::ApplyChange(const Change& change, const String& payload,
+                               Draft* draft) {
+  switch (change.type) {
+    case Change::Type::kSetCommand:
+      SetCommandJson(change.button, payload, draft);
+      break;
+    case Change::Type::kDeleteCommand:
+      if (draft->commands().Contains(change.button)) {
+        draft->mutable_commands().Erase(change.button);
+      }
+      if (change.button.type == ButtonType::kAppleIBeacon &&
+          draft->names().Contains(change.button)) {
+        draft->mutable_names().Erase(change.button);
+      }
+      break;
+    case Change::Type::kSetName:
+      draft->mutable_names().Set(change.button, change.name);
+      break;
+    case Change::Type::kDeleteName:
+      if (draft->names().Contains(change.button)) {
+        draft->mutable_names().Erase(change.button);
+      }
+      break;
+  }
+}
 
+CommandTable::CommandArrayLoader::CommandArrayLoader(CommandTable& table)
+    : table_(table),
+      splitter_("commands", kMaxCommandRecordSize,
+                [this](const char* json, const size_t size) {
+                  return AddRecord(json, size);
+                }) {}
+
+bool CommandTable::CommandArrayLoader::AddRecord(const char* json,
+                                                 const size_t size) {
   JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, json);
+  DeserializationError error = deserializeJson(doc, json, size);
   if (error) {
-    Serial.println("ERROR: Failed to parse JSON");
+    KB_LOGE("Failed to parse JSON\n");
     return false;
   }
-  JsonObject root = doc.as<JsonObject>();
+  JsonObject obj = doc.as<JsonObject>();
   KButton button;
   Command command;
-  if (!from_json::ConvertCommandJson(root, button, command)) {
-    return false;
+  if (!from_json::ConvertCommandJson(obj, button, command) ||
+      (commands_.size() >= kMaxCommands && !commands_.Contains(button))) {
+    // Skipped like the other invalid records, and reported by Commit()
+    has_invalid_record_ = true;
+    return true;
   }
-  SetCommandLocked(button, command);
+  commands_.Set(button, to_json::ConvertCommand(command));
   return true;
 }
 
-bool CommandTable::LoadCommandArray(const String& json) {
-  const kb::LockGuard lock(mutex_);
-  return LoadCommandArrayLocked(json);
+bool CommandTable::CommandArrayLoader::Write(const uint8_t* data,
+                                             const size_t len) {
+  return splitter_.Feed(reinterpret_cast<const char*>(data), len);
 }
 
-bool CommandTable::LoadCommandArrayLocked(const String& json) {
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, json);
-  if (error) {
-    Serial.println("ERROR: Failed to parse JSON");
+bool CommandTable::CommandArrayLoader::Commit() {
+  const kb::LockGuard lock(table_.mutex_);
+  Draft draft(*table_.entries_.Get());
+  if (!CommitLoader(*this, /*is_partial=*/false, &draft)) {
     return false;
   }
-  JsonObject root = doc.as<JsonObject>();
-  if (!root.containsKey("commands")) {
-    Serial.println("ERROR: Failed to parse JSON");
+  table_.Publish(draft);
+  return true;
+}
+
+bool CommandTable::CommitLoader(CommandArrayLoader& loader,
+                                const bool is_partial, Draft* draft) {
+  if (!loader.splitter_.IsComplete()) {
+    KB_LOGE("Failed to parse JSON\n");
     return false;
   }
-
-  registered_commands_.clear();
-
-  bool ok = true;
-  JsonArray arr = root["commands"].as<JsonArray>();
-  for (JsonObject obj : arr) {
-    KButton button;
-    Command command;
-    if (!from_json::ConvertCommandJson(obj, button, command)) {
-      ok = false;
-      continue;
+  // A new button with a command gets a name, so the commands of those past
+  // kMaxButtonNames are skipped like the records past kMaxCommands
+  std::vector<KButton> unnamed;
+  size_t name_count = draft->names().size();
+  for (const auto& [button, json] : loader.commands_) {
+    if (!draft->names().Contains(button) &&
+        name_count++ >= kMaxButtonNames) {
+      unnamed.push_back(button);
+    }
+  }
+  if (!unnamed.empty()) {
+    logging::Log(logging::Level::kError, "Too many names: %u commands skipped",
+                 unnamed.size());
+    for (const KButton& button : unnamed) {
+      loader.commands_.Erase(button);
     }
-    SetCommandLocked(button, command);
+    loader.has_invalid_record_ = true;
+  }
+  // Before any button is named, as a name uses up a button ID
+  if (loader.has_invalid_record_ && !is_partial) {
+    return false;
+  }
+  for (const auto& [button, json] : loader.commands_) {
+    NameButton(button, draft);
   }
-  return ok;
+  draft->set_commands(std::move(loader.commands_));
+  loader.commands_.Clear();
+  return !loader.has_invalid_record_;
 }
 
-bool CommandTable::LoadButtonNameArrayLocked(const String& json) {
+bool CommandTable::LoadCommandArray(const String& json, Draft* draft) {
+  CommandArrayLoader loader(*this);
+  loader.Write(reinterpret_cast<const uint8_t*>(json.c_str()), json.length());
+  return CommitLoader(loader, /*is_partial=*/true, draft);
+}
+
+bool CommandTable::LoadButtonNameArray(const String& json, Draft* draft) {
   JsonDocument doc;
   DeserializationError error = deserializeJson(doc, json);
   if (error) {
-    Serial.println("ERROR: Failed to parse JSON");
+    KB_LOGE("Failed to parse JSON\n");
     return false;
   }
   JsonObject root = doc.as<JsonObject>();
   if (!root.containsKey("buttons")) {
-    Serial.println("ERROR: Failed to parse JSON");
+    KB_LOGE("Failed to parse JSON\n");
     return false;
   }
 
-  button_names_.clear();
+  ButtonMap<String>& names = draft->mutable_names();
+  names.Clear();
 
   for (JsonObject item : root["buttons"].as<JsonArray>()) {
     if (!item.containsKey("name")) {
@@ -306,32 +780,46 @@ bool CommandTable::LoadButtonNameArrayLocked(const String& json) {
     if (!from_json::ConvertButtonJson(item, button)) {
       continue;
     }
-    SetButtonNameLocked(button, item["name"].as<String>());
+    if (names.size() >= kMaxButtonNames) {
+      logging::Log(logging::Level::kError, "Too many names");
+      break;
+    }
+    names.Set(button, item["name"].as<String>());
   }
   return true;
 }
 
 void CommandTable::Save() {
   const kb::LockGuard lock(mutex_);
+  SaveLocked();
+}
 
+void CommandTable::SaveLocked() {
   logging::Log("Save command table.");
+  const std::shared_ptr<const Entries> entries = entries_.Get();
   {
     File file = SPIFFS.open(kTemporaryCommandTablePath, "w");
     if (!file) {
-      logging::Log("Failed to open the command file");
+      logging::Log(logging::Level::kError, "Failed to open the command file");
       return;
     }
     if (!WriteInt32(file, kFileVersion) ||
-        !WriteString(file, to_json::ConvertObservedButtons(observed_buttons_,
-                                                           button_names_)) ||
-        !WriteString(file, to_json::ConvertCommands(registered_commands_))) {
-      logging::Log("Failed to write the command file");
+        !WriteString(file, to_json::ConvertObservedButtons(
+                               *observed_buttons_.Get(), *entries->names)) ||
+        !WriteString(file, to_json::ConvertCommands(*entries->commands))) {
+      logging::Log(logging::Level::kError, "Failed to write the command file");
       return;
     }
     file.flush();
   }
+  // The journal is folded into the new file. Should the swap below be cut
+  // short, a change is lost rather than replayed over newer ones.
+  if (SPIFFS.exists(kCommandJournalPath) &&
+      !SPIFFS.remove(kCommandJournalPath)) {
+    logging::Log(logging::Level::kError, "Failed to remove the journal");
+  }
   if (!SPIFFS.remove(kCommandTablePath)) {
-    logging::Log("Failed to remove the old file");
+    logging::Log(logging::Level::kError, "Failed to remove the old file");
   }
   if (!SPIFFS.rename(kTemporaryCommandTablePath, kCommandTablePath)) {
     logging::Log(
@@ -339,12 +827,20 @@ void CommandTable::Save() {
         "file is lost.");
   }
   logging::Log("Saved the command table: %d buttons, %d commands",
-               button_names_.size(), registered_commands_.size());
+               entries->names->size(), entries->commands->size());
 }
 
 void CommandTable::Load() {
   const kb::LockGuard lock(mutex_);
+  Draft draft(*entries_.Get());
+  LoadFile(&draft);
+  ReplayJournal(&draft);
+  Publish(draft);
+  logging::Log("Loaded the command table: %d buttons, %d commands",
+               draft.names().size(), draft.commands().size());
+}
 
+void CommandTable::LoadFile(Draft* draft) {
   logging::Log("Load command table.");
   File file = SPIFFS.open(kCommandTablePath);
   if (!file) {
@@ -355,54 +851,66 @@ void CommandTable::Load() {
   const int32_t version = ReadInt32(file);
   logging::Log("File version = %d", version);
   if (version != kFileVersion) {
-    logging::Log("Invalid version %d", version);
+    logging::Log(logging::Level::kError, "Invalid version %d", version);
     return;
   }
 
   const String buttons_json = ReadString(file);
-  if (!LoadButtonNameArrayLocked(buttons_json)) {
-    logging::Log("Failed to load observed buttons");
+  if (!LoadButtonNameArray(buttons_json, draft)) {
+    logging::Log(logging::Level::kError, "Failed to load observed buttons");
   }
 
   const String commands_json = ReadString(file);
-  if (!LoadCommandArrayLocked(commands_json)) {
-    logging::Log("Failed to load commands");
+  if (!LoadCommandArray(commands_json, draft)) {
+    logging::Log(logging::Level::kError, "Failed to load commands");
   }
 
   file.close();
+}
 
-  logging::Log("Loaded the command table: %d buttons, %d commands",
-               button_names_.size(), registered_commands_.size());
+void CommandTable::ReplayJournal(Draft* draft) {
+  File file = SPIFFS.open(kCommandJournalPath);
+  if (!file) {
+    return;
+  }
+  if (file.available() < static_cast<int>(sizeof(int32_t)) ||
+      ReadInt32(file) != kJournalVersion) {
+    logging::Log(logging::Level::kError, "Invalid journal");
+    return;
+  }
+  int count = 0;
+  Change change;
+  String payload;
+  while (ReadJournalRecord(file, &change, &payload)) {
+    ApplyChange(change, payload, draft);
+    ++count;
+  }
+  logging::Log("Replayed %d changes", count);
 }
 
 void CommandTable::Reset() {
   const kb::LockGuard lock(mutex_);
-  observed_buttons_.clear();
-  registered_commands_.clear();
-  button_names_.clear();
-  SPIFFS.remove(kCommandTablePath);
-}
-
-void CommandTable::SetCommandLocked(const KButton& button,
-                                    const Command& command) {
-  if (button_names_.count(button) == 0) {
-    const String name = "ボタン" + String(g_settings.GetNextButtonId());
-    SetButtonNameLocked(button, name);
+  {
+    const kb::LockGuard observed_lock(observed_mutex_);
+    observed_buttons_.Publish(std::make_shared<const ObservedButtons>());
   }
-  DeleteCommandLocked(button);
-  registered_commands_.push_back(ButtonCommandPair{button, command});
+  entries_.Publish(std::make_shared<const Entries>(
+      Entries{std::make_shared<const ButtonMap<String>>(),
+              std::make_shared<const ButtonMap<String>>()}));
+  SPIFFS.remove(kCommandTablePath);
+  SPIFFS.remove(kCommandJournalPath);
 }
 
-void CommandTable::DeleteCommandLocked(const KButton& button) {
-  registered_commands_.erase(
-      std::remove_if(registered_commands_.begin(), registered_commands_.end(),
-                     [&button](const ButtonCommandPair& pair) {
-                       return pair.button == button;
-                     }),
-      registered_commands_.end());
+void CommandTable::SetCommandJson(const KButton& button, String json,
+                                  Draft* draft) {
+  NameButton(button, draft);
+  draft->mutable_commands().Set(button, std::move(json));
 }
 
-void CommandTable::SetButtonNameLocked(const KButton& button,
-                                       const String& name) {
-  button_names_[button] = name;
+// Gives a new button with a command a name of its own
+void CommandTable::NameButton(const KButton& button, Draft* draft) {
+  if (!draft->names().Contains(button)) {
+    const String name = "ボタン" + String(g_settings.GetNextButtonId());
+    draft->mutable_names().Set(button, name);
+  }
 }
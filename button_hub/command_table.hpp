@@ -4,68 +4,15 @@
 #include <cstdint>
 #include <cstring>
 #include <ctime>
-#include <deque>
-#include <map>
+#include <memory>
 #include <vector>
 
+#include "button.hpp"
+#include "button_map.hpp"
+#include "button_query.hpp"
+#include "json_stream.hpp"
 #include "mutex.hpp"
-
-struct AppleIBeacon {
-  uint8_t address[6];
-  uint8_t uuid[16];
-  uint16_t major;
-  uint16_t minor;
-
-  explicit AppleIBeacon() = default;
-  explicit AppleIBeacon(const uint8_t address[6], const uint8_t uuid[16],
-                        uint16_t major, uint16_t minor)
-      : major(major), minor(minor) {
-    std::memcpy(this->address, address, 6);
-    std::memcpy(this->uuid, uuid, 16);
-  }
-};
-
-struct M5Button {
-  uint8_t id;  // 1,2,3
-
-  explicit M5Button() = default;
-  explicit M5Button(const int new_id) : id(new_id) {}
-};
-
-struct GpioButton {
-  uint8_t id;  // 1,2,3,4,5
-
-  explicit GpioButton() = default;
-  explicit GpioButton(const int new_id) : id(new_id) {}
-};
-
-enum class ButtonType : uint8_t {
-  kAppleIBeacon,
-  kM5Button,
-  kGpioButton,
-};
-
-struct KButton {
-  ButtonType type;
-  union {
-    AppleIBeacon apple_i_beacon;
-    M5Button m5_button;
-    GpioButton gpio_button;
-  } data;
-
-  explicit KButton() = default;
-  explicit KButton(const AppleIBeacon& beacon)
-      : type(ButtonType::kAppleIBeacon) {
-    data.apple_i_beacon = beacon;
-  }
-  explicit KButton(const M5Button& m5_button) : type(ButtonType::kM5Button) {
-    data.m5_button.id = m5_button.id;
-  }
-  explicit KButton(const GpioButton& gpio_button)
-      : type(ButtonType::kGpioButton) {
-    data.gpio_button.id = gpio_button.id;
-  }
-};
+#include "rcu.hpp"
 
 bool SerializeAddressToString(const uint8_t address[6], char* out, int len);
 String SerializeAddressToString(const uint8_t address[6]);
@@ -81,74 +28,6 @@ struct ObservedButton {
   KButton button;
 };
 
-inline bool operator<(const AppleIBeacon& lhs, const AppleIBeacon& rhs) {
-  int cmp = std::memcmp(lhs.address, rhs.address, sizeof(lhs.address));
-  if (cmp != 0) {
-    return cmp < 0;
-  }
-  cmp = std::memcmp(lhs.uuid, rhs.uuid, sizeof(lhs.uuid));
-  if (cmp != 0) {
-    return cmp < 0;
-  }
-  cmp = lhs.major - rhs.major;
-  if (cmp != 0) {
-    return cmp < 0;
-  }
-  return lhs.minor < rhs.minor;
-}
-
-inline bool operator<(const M5Button& lhs, const M5Button& rhs) {
-  return lhs.id < rhs.id;
-}
-
-inline bool operator<(const GpioButton& lhs, const GpioButton& rhs) {
-  return lhs.id < rhs.id;
-}
-
-inline bool operator<(const KButton& lhs, const KButton& rhs) {
-  if (lhs.type == ButtonType::kAppleIBeacon &&
-      rhs.type == ButtonType::kAppleIBeacon) {
-    return lhs.data.apple_i_beacon < rhs.data.apple_i_beacon;
-  }
-  if (lhs.type == ButtonType::kM5Button && rhs.type == ButtonType::kM5Button) {
-    return lhs.data.m5_button < rhs.data.m5_button;
-  }
-  if (lhs.type == ButtonType::kGpioButton &&
-      rhs.type == ButtonType::kGpioButton) {
-    return lhs.data.gpio_button < rhs.data.gpio_button;
-  }
-  return lhs.type < rhs.type;
-}
-
-inline bool operator==(const AppleIBeacon& lhs, const AppleIBeacon& rhs) {
-  return std::memcmp(lhs.address, rhs.address, sizeof(lhs.address)) == 0 &&
-         std::memcmp(lhs.uuid, rhs.uuid, sizeof(lhs.uuid)) == 0 &&
-         lhs.major == rhs.major && lhs.minor == rhs.minor;
-}
-
-inline bool operator==(const M5Button& lhs, const M5Button& rhs) {
-  return lhs.id == rhs.id;
-}
-
-inline bool operator==(const GpioButton& lhs, const GpioButton& rhs) {
-  return lhs.id == rhs.id;
-}
-
-inline bool operator==(const KButton& lhs, const KButton& rhs) {
-  if (lhs.type == ButtonType::kAppleIBeacon &&
-      rhs.type == ButtonType::kAppleIBeacon) {
-    return lhs.data.apple_i_beacon == rhs.data.apple_i_beacon;
-  }
-  if (lhs.type == ButtonType::kM5Button && rhs.type == ButtonType::kM5Button) {
-    return lhs.data.m5_button.id == rhs.data.m5_button.id;
-  }
-  if (lhs.type == ButtonType::kGpioButton &&
-      rhs.type == ButtonType::kGpioButton) {
-    return lhs.data.gpio_button == rhs.data.gpio_button;
-  }
-  return lhs.type == rhs.type;
-}
-
 inline bool operator<(const ObservedButton& lhs, const ObservedButton& rhs) {
   return lhs.timestamp < rhs.timestamp && lhs.button < rhs.button;
 }
@@ -232,47 +111,163 @@ struct Command {
   double lock_duration_sec;
 };
 
-struct ButtonCommandPair {
-  KButton button;
-  Command command;
-};
-
+// The commands and the names of the buttons of a hub, and the buttons
+// observed recently.
+//
+// Memory: a command takes sizeof(ButtonMap<String>::Entry), 44 bytes on the
+// ESP32, plus its compact JSON of up to kMaxCommandJsonSize bytes, typically
+// under 100. A name takes the same 44 bytes, with names of up to 15 bytes
+// stored inline by String. ApplyChanges(), CommandArrayLoader and Load() keep
+// the table within kMaxCommands commands and kMaxButtonNames names, those of
+// the buttons of the hub itself included, and there are max_observed_buttons
+// observed buttons of sizeof(ObservedButton) each.
+//
+// Readers get immutable generations of the table, which they can keep and
+// iterate without a lock or a copy while writers publish newer ones, see
+// kb::Rcu. Each writer builds one generation for all of its changes and
+// shares whatever it leaves unchanged with the previous one.
 class CommandTable {
  public:
-  CommandTable(int max_observed_buttons);
+  using ObservedButtons = std::vector<ObservedButton>;  // the latest first
+
+  static constexpr size_t kMaxCommands = 256;
+  static constexpr size_t kMaxButtonNames = 256;
+  // In bytes, of a name and of the JSON of a command
+  static constexpr size_t kMaxButtonNameSize = 64;
+  static constexpr size_t kMaxCommandJsonSize = 4 * 1024;
+
+  // A change to the entry of one button
+  struct Change {
+    enum class Type : uint8_t {
+      kSetCommand,
+      // Also deletes the name of an iBeacon, like DeleteCommand()
+      kDeleteCommand,
+      kSetName,
+      kDeleteName,
+    };
+
+    Type type;
+    KButton button;
+    Command command;  // of kSetCommand
+    String name;  // of kSetName
+  };
+
+  // Replaces all the commands with {"commands": [...]} given chunk by chunk,
+  // e.g. as the body of a request arrives. Each record is parsed as soon as
+  // it is complete, so the raw body is never buffered. The table is updated
+  // by Commit() only if the JSON is well-formed.
+  //
+  // The parsed commands are held until Commit(), next to the table in use,
+  // so an import peaks at the old table plus the whole new one, i.e. up to
+  // kMaxCommands commands of kMaxCommandJsonSize bytes each on top of it.
+  class CommandArrayLoader {
+   public:
+    explicit CommandArrayLoader(CommandTable& table);
+
+    // Returns false once the JSON turns out to be malformed
+    bool Write(const uint8_t* data, size_t len);
+    // Returns false if the JSON is malformed or some of the records are
+    // invalid, beyond kMaxCommands, or of new buttons beyond kMaxButtonNames,
+    // which get a name each. All or nothing: the table is left unchanged
+    // unless it returns true.
+    bool Commit();
+
+   private:
+    friend class CommandTable;
+
+    bool AddRecord(const char* json, size_t size);
+
+    CommandTable& table_;
+    json_stream::ArraySplitter splitter_;
+    ButtonMap<String> commands_;  // JSON of the commands
+    bool has_invalid_record_ = false;
+  };
+
+  CommandTable(size_t max_observed_buttons);
 
   CommandTable(const CommandTable&) = delete;
   CommandTable& operator=(const CommandTable&) = delete;
 
-  void NotifyObservedButton(const KButton& button, double estimated_distance);
-  const std::deque<ObservedButton>& GetObservedButtons() const;
+  // Returns true and sets `evicted` if the oldest button is pushed out.
+  //
+  // Each call publishes a new generation of the observed buttons, so it
+  // allocates and copies the whole list, up to max_observed_buttons entries
+  // of sizeof(ObservedButton), 48 bytes on the ESP32, i.e. 3 KiB for 64, for
+  // every advertisement accepted. max_observed_buttons bounds the cost.
+  bool NotifyObservedButton(const KButton& button, double estimated_distance,
+                            KButton* evicted);
+  std::shared_ptr<const ObservedButtons> GetObservedButtons() const;
+  bool GetObservedButton(const KButton& button, ObservedButton* out) const;
 
   void SetCommand(const KButton& button, const Command& command);
   void DeleteCommand(const KButton& button);
-  std::vector<ButtonCommandPair> GetCommands() const;
+  // The commands are kept as their JSON, the "command" of GET /commands.
+  // GetCommandByButton() parses it.
+  std::shared_ptr<const ButtonMap<String>> GetCommands() const;
+  bool HasCommand(const KButton& button) const;
+  bool GetCommandJson(const KButton& button, String* json) const;
   bool GetCommandByButton(const KButton& button, Command* command) const;
 
   void SetButtonName(const KButton& button, const String& name);
   void DeleteButtonName(const KButton& button);
-  std::map<KButton, String> GetButtonNames() const;
-
-  bool LoadCommand(const String& json);
-  bool LoadCommandArray(const String& json);
+  std::shared_ptr<const ButtonMap<String>> GetButtonNames() const;
+  bool GetButtonName(const KButton& button, String* name) const;
+
+  // A page of GetCommands() for `query`. Returns true and sets `next_cursor`
+  // if there are more commands after the page.
+  bool GetCommandPage(const button_query::Query& query,
+                      ButtonMap<String>* commands, KButton* next_cursor) const;
+  // The same for the buttons, which are both the observed buttons and the
+  // named ones as in GET /buttons
+  bool GetButtonPage(const button_query::Query& query,
+                     ObservedButtons* observed_buttons,
+                     ButtonMap<String>* button_names,
+                     KButton* next_cursor) const;
+
+  // Applies `changes` in order, and appends them to a journal next to the
+  // saved table instead of saving all of it. Load() replays the journal, and
+  // Save() folds it into the table, as does ApplyChanges() once it is full.
+  // Returns false and changes nothing if the changes would exceed the limits
+  // above.
+  bool ApplyChanges(const std::vector<Change>& changes);
 
   void Save();
   void Load();
   void Reset();
 
  private:
-  void SetCommandLocked(const KButton& button, const Command& command);
-  void DeleteCommandLocked(const KButton& button);
-  void SetButtonNameLocked(const KButton& button, const String& name);
-  bool LoadCommandArrayLocked(const String& json);
-  bool LoadButtonNameArrayLocked(const String& json);
-
-  int max_observed_buttons_;
-  mutable kb::Mutex mutex_;
-  std::deque<ObservedButton> observed_buttons_;
-  std::vector<ButtonCommandPair> registered_commands_;
-  std::map<KButton, String> button_names_;
+  // A generation of the commands and the names
+  struct Entries {
+    std::shared_ptr<const ButtonMap<String>> commands;
+    std::shared_ptr<const ButtonMap<String>> names;
+  };
+  // The next generation of Entries while a writer builds it
+  class Draft;
+
+  void Publish(const Draft& draft);
+  // Moves the commands of `loader` into `draft`, see CommandArrayLoader.
+  // Unless `is_partial`, `draft` is left unchanged if any record is invalid,
+  // otherwise the valid records are moved and false is still returned.
+  static bool CommitLoader(CommandArrayLoader& loader, bool is_partial,
+                           Draft* draft);
+  static bool CanApply(const Draft& draft, const std::vector<Change>& changes,
+                       const std::vector<String>& payloads);
+  // `payload` is the JSON of the command of kSetCommand
+  static void ApplyChange(const Change& change, const String& payload,
+                          Draft* draft);
+  static void SetCommandJson(const KButton& button, String json,
+                             Draft* draft);
+  static void NameButton(const KButton& button, Draft* draft);
+  void SaveLocked();
+  void LoadFile(Draft* draft);
+  void ReplayJournal(Draft* draft);
+  bool LoadCommandArray(const String& json, Draft* draft);
+  static bool LoadButtonNameArray(const String& json, Draft* draft);
+
+  size_t max_observed_buttons_;
+  // Serializes the writers of entries_ and of observed_buttons_ respectively
+  kb::Mutex mutex_;
+  kb::Mutex observed_mutex_;
+  kb::Rcu<ObservedButtons> observed_buttons_;
+  kb::Rcu<Entries> entries_;
 };
@@ -1,18 +0,0 @@
-#pragma once
-
-#include <cstdint>
-
-namespace data {
-
-extern const uint8_t index_css_data[];
-extern const size_t index_css_size;
-extern const uint8_t index_html_data[];
-extern const size_t index_html_size;
-extern const uint8_t index_js_data[];
-extern const size_t index_js_size;
-extern const uint8_t index_js_gz_data[];
-extern const size_t index_js_gz_size;
-extern const uint8_t license_txt_gz_data[];
-extern const size_t license_txt_gz_size;
-
-}  // namespace data
@@ -24,8 +24,15 @@ static int64_t g_last_start_time = 0;
 static int32_t g_last_fetch = 0;
 static constexpr int32_t kInterval = 30 * 1000;
 
+static void PublishRobotInfo(const RobotInfoHolder& robot_info) {
+  server::PublishWsMessage(
+      server::WsTopic::kRobotInfo, [&robot_info](const auto format) {
+        return to_json::ConvertRobotInfo(robot_info, format);
+      });
+}
+
 static void FetchImpl(RobotInfoHolder& out) {
-  server::EnqueueWsMessage(to_json::ConvertRobotInfo(out));
+  PublishRobotInfo(out);
 
   while (!out.has_robot_version) {
     auto [code, robot_version] = api::GetRobotVersion();
@@ -33,7 +40,7 @@ static void FetchImpl(RobotInfoHolder& out) {
       out.robot_version = std::move(robot_version);
       Serial.printf(" * robot_version = %s\n", out.robot_version.c_str());
       out.has_robot_version = true;
-      server::EnqueueWsMessage(to_json::ConvertRobotInfo(out));
+      PublishRobotInfo(out);
     } else {
       Serial.printf("Failed to get version: %s\n",
                     api::ResultCodeToString(code));
@@ -51,7 +58,7 @@ static void FetchImpl(RobotInfoHolder& out) {
       }
       done = true;
       out.has_shelves = true;
-      server::EnqueueWsMessage(to_json::ConvertRobotInfo(out));
+      PublishRobotInfo(out);
     } else {
       Serial.printf("Failed to get shelves: %s\n",
                     api::ResultCodeToString(code));
@@ -70,7 +77,7 @@ static void FetchImpl(RobotInfoHolder& out) {
       }
       done = true;
       out.has_locations = true;
-      server::EnqueueWsMessage(to_json::ConvertRobotInfo(out));
+      PublishRobotInfo(out);
     } else {
       Serial.printf("Failed to get locations: %s\n",
                     api::ResultCodeToString(code));
@@ -88,7 +95,7 @@ static void FetchImpl(RobotInfoHolder& out) {
       }
       done = true;
       out.has_shortcuts = true;
-      server::EnqueueWsMessage(to_json::ConvertRobotInfo(out));
+      PublishRobotInfo(out);
     } else {
       Serial.printf("Failed to get shortcuts: %s\n",
                     api::ResultCodeToString(code));
@@ -1,7 +1,12 @@
 #include "from_json.hpp"
 
+#include "button_id.hpp"
+#include "logging.hpp"
+
 namespace from_json {
 
+static constexpr logging::Module kLogModule = logging::Module::kServer;
+
 bool ConvertCommandJson(JsonObject& root, KButton& out_button,
                         Command& out_command) {
   // {
@@ -26,7 +31,7 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
   //   }
   // }
   if (!root.containsKey("button") || !root.containsKey("command")) {
-    Serial.println("ERROR: Invalid JSON");
+    KB_LOGE("Invalid JSON\n");
     return false;
   }
   const JsonObject& button_json = root["button"];
@@ -34,7 +39,10 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
   if (!ok) {
     return false;
   }
-  const JsonObject& command = root["command"];
+  return ConvertCommandOnlyJson(root["command"], out_command);
+}
+
+bool ConvertCommandOnlyJson(JsonObject command, Command& out_command) {
   const int type = command["type"].as<int>();
   const bool cancel_all = command["cancel_all"].as<bool>();
   String tts_on_success = (command.containsKey("tts_on_success") &&
@@ -52,13 +60,13 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
   switch (type) {
     case static_cast<int>(CommandType::MOVE_SHELF): {
       if (!command.containsKey("move_shelf")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& move_shelf = command["move_shelf"];
       if (!move_shelf.containsKey("shelf_id") ||
           !move_shelf.containsKey("location_id")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::MOVE_SHELF;
@@ -72,12 +80,12 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
     }
     case static_cast<int>(CommandType::RETURN_SHELF): {
       if (!command.containsKey("return_shelf")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& return_shelf = command["return_shelf"];
       if (!return_shelf.containsKey("shelf_id")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::RETURN_SHELF;
@@ -98,12 +106,12 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
     }
     case static_cast<int>(CommandType::MOVE_TO_LOCATION): {
       if (!command.containsKey("move_to_location")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& move_to_location = command["move_to_location"];
       if (!move_to_location.containsKey("location_id")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::MOVE_TO_LOCATION;
@@ -124,12 +132,12 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
     }
     case static_cast<int>(CommandType::SHORTCUT): {
       if (!command.containsKey("shortcut")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& shortcut = command["shortcut"];
       if (!shortcut.containsKey("shortcut_id")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::SHORTCUT;
@@ -142,12 +150,12 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
     }
     case static_cast<int>(CommandType::SPEAK): {
       if (!command.containsKey("speak")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& speak = command["speak"];
       if (!speak.containsKey("text")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::SPEAK;
@@ -160,13 +168,13 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
     }
     case static_cast<int>(CommandType::DOCK_ANY_SHELF): {
       if (!command.containsKey("dock_any_shelf")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& dock_any_shelf = command["dock_any_shelf"];
       if (!dock_any_shelf.containsKey("location_id") ||
           !dock_any_shelf.containsKey("dock_forward")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::DOCK_ANY_SHELF;
@@ -204,12 +212,12 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
     }
     case static_cast<int>(CommandType::HTTP_GET): {
       if (!command.containsKey("http_get")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& http_get = command["http_get"];
       if (!http_get.containsKey("url")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::HTTP_GET;
@@ -222,12 +230,12 @@ bool ConvertCommandJson(JsonObject& root, KButton& out_button,
     }
     case static_cast<int>(CommandType::HTTP_POST): {
       if (!command.containsKey("http_post")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       const JsonObject& http_post = command["http_post"];
       if (!http_post.containsKey("url") || !http_post.containsKey("body")) {
-        Serial.println("ERROR: Invalid JSON");
+        KB_LOGE("Invalid JSON\n");
         return false;
       }
       out_command.type = CommandType::HTTP_POST;
@@ -248,7 +256,7 @@ bool ConvertButtonJson(JsonObject json, KButton& out) {
     if (!beacon_json.containsKey("address") ||
         !beacon_json.containsKey("uuid") || !beacon_json.containsKey("major") ||
         !beacon_json.containsKey("minor")) {
-      Serial.println("ERROR: Invalid JSON");
+      KB_LOGE("Invalid JSON\n");
       return false;
     }
     const String& address = beacon_json["address"].as<String>();
@@ -267,7 +275,7 @@ bool ConvertButtonJson(JsonObject json, KButton& out) {
   if (json.containsKey("m5_button")) {
     const JsonObject& m5_json = json["m5_button"];
     if (!m5_json.containsKey("id")) {
-      Serial.println("ERROR: Invalid JSON");
+      KB_LOGE("Invalid JSON\n");
       return false;
     }
     const int id = m5_json["id"].as<int>();
@@ -278,7 +286,7 @@ bool ConvertButtonJson(JsonObject json, KButton& out) {
   if (json.containsKey("gpio_button")) {
     const JsonObject& gpio_button_json = json["gpio_button"];
     if (!gpio_button_json.containsKey("id")) {
-      Serial.println("ERROR: Invalid JSON");
+      KB_LOGE("Invalid JSON\n");
       return false;
     }
     const int id = gpio_button_json["id"].as<int>();
@@ -286,7 +294,49 @@ bool ConvertButtonJson(JsonObject json, KButton& out) {
     out = KButton(gpio_button);
     return true;
   }
-  Serial.println("ERROR: Invalid JSON");
+  KB_LOGE("Invalid JSON\n");
+  return false;
+}
+
+bool ConvertChangeJson(JsonObject json, CommandTable::Change& out) {
+  // {
+  //   "op": "set_command" | "delete_command" | "set_name" | "delete_name",
+  //   "id": "m5-1",
+  //   "command": { ... },  // set_command
+  //   "name": "Button 1",  // set_name
+  // }
+  const String op = json["op"].as<String>();
+  const String id = json["id"].as<String>();
+  if (!button_id::Parse(id.c_str(), &out.button)) {
+    KB_LOGE("Invalid button ID\n");
+    return false;
+  }
+  if (op == "set_command") {
+    if (!json.containsKey("command")) {
+      KB_LOGE("Invalid JSON\n");
+      return false;
+    }
+    out.type = CommandTable::Change::Type::kSetCommand;
+    return ConvertCommandOnlyJson(json["command"], out.command);
+  }
+  if (op == "delete_command") {
+    out.type = CommandTable::Change::Type::kDeleteCommand;
+    return true;
+  }
+  if (op == "set_name") {
+    if (!json["name"].is<String>()) {
+      KB_LOGE("Invalid JSON\n");
+      return false;
+    }
+    out.type = CommandTable::Change::Type::kSetName;
+    out.name = json["name"].as<String>();
+    return true;
+  }
+  if (op == "delete_name") {
+    out.type = CommandTable::Change::Type::kDeleteName;
+    return true;
+  }
+  KB_LOGE("Invalid JSON\n");
   return false;
 }
 
@@ -8,6 +8,10 @@ namespace from_json {
 
 bool ConvertCommandJson(JsonObject& root, KButton& out_button,
                         Command& out_command);
+// The "command" of ConvertCommandJson()
+bool ConvertCommandOnlyJson(JsonObject command, Command& out_command);
 bool ConvertButtonJson(JsonObject json, KButton& out);
+// An item of "changes" of PATCH /commands
+bool ConvertChangeJson(JsonObject json, CommandTable::Change& out);
 
 }  // namespace from_json
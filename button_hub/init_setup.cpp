@@ -10,8 +10,6 @@
 #include "qrcode.hpp"
 #include "server.hpp"
 #include "settings.hpp"
-#include "to_json.hpp"
-#include "wifi.hpp"
 
 InitialSetup::InitialSetup()
     : prev_state_(State::kInit), curr_state_(State::kInit) {}
@@ -33,30 +31,11 @@ void InitialSetup::RunLoop() {
         DrawScreen(next_state);
         beep::PlayInitialSetupNext();
         if (WiFi.softAPgetStationNum() > 0) {
-          wifi::StartApScan();
-          server::EnqueueWsMessage(to_json::ConvertWiFiApList(true, {}));
+          server::StartWiFiApScan(0);
         }
       }
       break;
     case State::kWaitingForSettings:
-      // Wait for the result of the Wi-Fi AP scan
-      if (WiFi.softAPgetStationNum() > 0) {
-        const auto& [state, wifi_ap_list] = wifi::GetScannedWiFiApList();
-        switch (state) {
-          case wifi::ScanState::kScanning:
-          case wifi::ScanState::kFailed:
-            break;
-          case wifi::ScanState::kSucceeded:
-            Serial.println("WiFi AP list:");
-            for (const auto& ap : wifi_ap_list) {
-              Serial.printf(" - %-24s %s %3d %d\n", ap.ssid.c_str(),
-                            ap.bssid.c_str(), ap.channel, ap.encryption_type);
-            }
-            server::EnqueueWsMessage(
-                to_json::ConvertWiFiApList(false, wifi_ap_list));
-            break;
-        }
-      }
       if (!is_any_device_connected) {
         next_state = State::kWaitingForConnection;
         DrawScreen(next_state);
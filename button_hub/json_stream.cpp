@@ -0,0 +1,142 @@
+#include "json_stream.hpp"
+
+#include <utility>
+
+namespace json_stream {
+
+static bool IsWhitespace(const char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+ArraySplitter::ArraySplitter(const char* key, const size_t max_element_size,
+                             ElementHandler handler)
+    : key_(key),
+      max_element_size_(max_element_size),
+      handler_(std::move(handler)) {}
+
+bool ArraySplitter::Feed(const char* data, const size_t size) {
+  for (size_t i = 0; i < size && !failed_; ++i) {
+    if (!FeedChar(data[i])) {
+      failed_ = true;
+    }
+  }
+  return !failed_;
+}
+
+bool ArraySplitter::IsComplete() const {
+  return done_ && found_array_ && !failed_;
+}
+
+bool ArraySplitter::FeedChar(const char c) {
+  if (done_) {
+    return IsWhitespace(c);
+  }
+  if (in_element_) {
+    if (element_.size() >= max_element_size_) {
+      return false;
+    }
+    element_.push_back(c);
+  }
+
+  if (in_string_) {
+    if (escaped_) {
+      escaped_ = false;
+    } else if (c == '\\') {
+      escaped_ = true;
+    } else if (c == '"') {
+      in_string_ = false;
+      if (capturing_key_) {
+        capturing_key_ = false;
+        key_matches_ = captured_key_ == key_;
+      }
+    } else if (capturing_key_ && captured_key_.size() <= key_.size()) {
+      // One more character than the key is enough to tell a mismatch
+      captured_key_.push_back(c);
+    }
+    return true;
+  }
+
+  switch (c) {
+    case '"':
+      if (depth_ == 0) {
+        return false;
+      }
+      in_string_ = true;
+      if (depth_ == 1 && expecting_key_) {
+        expecting_key_ = false;
+        capturing_key_ = true;
+        captured_key_.clear();
+      }
+      return true;
+    case '{':
+    case '[':
+      return Open(c);
+    case '}':
+    case ']':
+      return Close(c);
+    case ',':
+      if (depth_ == 1) {
+        expecting_key_ = true;
+        key_matches_ = false;
+      }
+      return depth_ > 0;
+    default:
+      if (IsWhitespace(c)) {
+        return true;
+      }
+      // A scalar directly in the array is not an object
+      return depth_ > 0 && !(in_array_ && depth_ == 2);
+  }
+}
+
+bool ArraySplitter::Open(const char c) {
+  if (depth_ == kMaxDepth || (depth_ == 0 && c != '{')) {
+    return false;
+  }
+  if (depth_ == 1 && c == '[' && key_matches_ && !found_array_) {
+    in_array_ = true;
+    found_array_ = true;
+  } else if (in_array_ && depth_ == 2) {
+    if (c != '{') {
+      return false;
+    }
+    in_element_ = true;
+    element_.assign(1, c);
+  }
+  if (c == '[') {
+    array_bits_ |= 1u << depth_;
+  } else {
+    array_bits_ &= ~(1u << depth_);
+  }
+  ++depth_;
+  if (depth_ == 1) {
+    expecting_key_ = true;
+  }
+  return true;
+}
+
+bool ArraySplitter::Close(const char c) {
+  if (depth_ == 0) {
+    return false;
+  }
+  --depth_;
+  const bool is_array = (array_bits_ >> depth_) & 1u;
+  if (is_array != (c == ']')) {
+    return false;
+  }
+  if (in_element_ && depth_ == 2) {
+    in_element_ = false;
+    const bool ok = handler_(element_.data(), element_.size());
+    element_.clear();
+    return ok;
+  }
+  if (in_array_ && depth_ == 1) {
+    in_array_ = false;
+  }
+  if (depth_ == 0) {
+    done_ = true;
+  }
+  return true;
+}
+
+}  // namespace json_stream
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace json_stream {
+
+// Splits a JSON object given chunk by chunk, e.g. the body of a request, into
+// the elements of the array of `key` at the top level so that each element
+// can be parsed on its own:
+//
+//   {"other": {...}, "commands": [{...}, {...}]}
+//                                 ^^^^^  ^^^^^  passed to the handler
+//
+// Only one element is held at a time. The other members are skipped without
+// being stored. The elements must be objects. Scalars are not validated here;
+// the handler is expected to parse each element strictly.
+class ArraySplitter {
+ public:
+  // Returns false to stop splitting
+  using ElementHandler = std::function<bool(const char* json, size_t size)>;
+
+  static constexpr size_t kMaxDepth = 32;
+
+  ArraySplitter(const char* key, size_t max_element_size,
+                ElementHandler handler);
+
+  ArraySplitter(const ArraySplitter&) = delete;
+  ArraySplitter& operator=(const ArraySplitter&) = delete;
+
+  // Returns false once the input turns out to be malformed, an element is
+  // larger than max_element_size or the handler has returned false.
+  bool Feed(const char* data, size_t size);
+
+  // True if the top-level object has been closed and the array was found
+  bool IsComplete() const;
+
+ private:
+  bool FeedChar(char c);
+  bool Open(char c);
+  bool Close(char c);
+
+  std::string key_;
+  size_t max_element_size_;
+  ElementHandler handler_;
+
+  size_t depth_ = 0;
+  uint32_t array_bits_ = 0;  // bit n is set if level n + 1 is an array
+  bool in_string_ = false;
+  bool escaped_ = false;
+
+  // Members of the top-level object
+  bool expecting_key_ = false;
+  bool capturing_key_ = false;
+  std::string captured_key_;
+  bool key_matches_ = false;
+
+  bool in_array_ = false;
+  bool found_array_ = false;
+  bool in_element_ = false;
+  std::string element_;
+
+  bool done_ = false;
+  bool failed_ = false;
+};
+
+}  // namespace json_stream
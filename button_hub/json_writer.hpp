@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace json_writer {
+
+// Writes the punctuation and the keys of a JSON object, so that a large object
+// can be written member by member without holding it in a document. The
+// caller writes each value to `out` itself, right after BeginMember() or
+// BeginElement().
+//
+// Keys are written as they are, so they must not need escaping.
+//
+// `Out` has `size_t write(const uint8_t* data, size_t size)`, e.g. Print.
+//
+// Usage:
+//
+//  ObjectWriter<Print> writer(out);
+//  writer.BeginMember("type");
+//  serializeJson(type, out);
+//  writer.BeginArray("commands");
+//  writer.BeginElement();
+//  serializeJson(command, out);
+//  writer.EndArray();
+//  writer.End();
+template <typename Out>
+class ObjectWriter {
+ public:
+  explicit ObjectWriter(Out& out) : out_(out) { Write("{"); }
+
+  void BeginMember(const char* key) {
+    if (!is_first_member_) {
+      Write(",");
+    }
+    is_first_member_ = false;
+    Write("\"");
+    Write(key);
+    Write("\":");
+  }
+
+  void BeginArray(const char* key) {
+    BeginMember(key);
+    Write("[");
+    is_first_element_ = true;
+  }
+  void BeginElement() {
+    if (!is_first_element_) {
+      Write(",");
+    }
+    is_first_element_ = false;
+  }
+  void EndArray() { Write("]"); }
+
+  void End() { Write("}"); }
+
+ private:
+  void Write(const char* text) {
+    out_.write(reinterpret_cast<const uint8_t*>(text), std::strlen(text));
+  }
+
+  Out& out_;
+  bool is_first_member_ = true;
+  bool is_first_element_ = true;
+};
+
+// The same in MessagePack: a map with str keys. As the counts of a map and
+// of an array come first in MessagePack, they are written as 32-bit
+// placeholders and filled in by EndArray() and End(), so the message is built
+// in a std::string rather than streamed. The caller appends each value in
+// MessagePack to `out`.
+class MsgPackObjectWriter {
+ public:
+  explicit MsgPackObjectWriter(std::string& out)
+      : out_(out), map_pos_(BeginContainer(kMap32)) {}
+
+  void BeginMember(const char* key) {
+    ++member_count_;
+    WriteStr(key);
+  }
+
+  void BeginArray(const char* key) {
+    BeginMember(key);
+    array_pos_ = BeginContainer(kArray32);
+    element_count_ = 0;
+  }
+  void BeginElement() { ++element_count_; }
+  void EndArray() { Patch(array_pos_, element_count_); }
+
+  void End() { Patch(map_pos_, member_count_); }
+
+ private:
+  static constexpr uint8_t kFixStr = 0xa0;
+  static constexpr uint8_t kStr8 = 0xd9;
+  static constexpr uint8_t kStr16 = 0xda;
+  static constexpr uint8_t kArray32 = 0xdd;
+  static constexpr uint8_t kMap32 = 0xdf;
+
+  // Returns the position of the count
+  size_t BeginContainer(const uint8_t type) {
+    out_.push_back(static_cast<char>(type));
+    const size_t pos = out_.size();
+    out_.append(4, '\0');
+    return pos;
+  }
+
+  // Big endian
+  void Patch(const size_t pos, const uint32_t count) {
+    for (int i = 0; i < 4; ++i) {
+      out_[pos + i] = static_cast<char>(count >> (24 - 8 * i));
+    }
+  }
+
+  void WriteStr(const char* text) {
+    const size_t size = std::strlen(text);
+    if (size < 32) {
+      out_.push_back(static_cast<char>(kFixStr | size));
+    } else if (size < 256) {
+      out_.push_back(static_cast<char>(kStr8));
+      out_.push_back(static_cast<char>(size));
+    } else {
+      out_.push_back(static_cast<char>(kStr16));
+      out_.push_back(static_cast<char>(size >> 8));
+      out_.push_back(static_cast<char>(size));
+    }
+    out_.append(text, size);
+  }
+
+  std::string& out_;
+  size_t map_pos_;
+  size_t array_pos_ = 0;
+  uint32_t member_count_ = 0;
+  uint32_t element_count_ = 0;
+};
+
+}  // namespace json_writer
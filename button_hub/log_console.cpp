@@ -0,0 +1,132 @@
+#include <Arduino.h>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include <freertos/ringbuf.h>
+
+#include "logging.hpp"
+
+namespace logging {
+
+// Large enough to absorb the burst of a WebSocket connect or an API response
+// at 115200 baud (about 11.5 bytes/msec).
+constexpr size_t kSerialBufferSize = 4 * 1024;
+constexpr size_t kSerialChunkSize = 256;
+constexpr size_t kMaxMessageSize = 256;
+constexpr int kSerialTaskPriority = 1;
+
+static constexpr const char* kLevelNames[] = {"none", "error", "warn", "info",
+                                              "debug"};
+static constexpr const char* kModuleNames[] = {"main", "api", "server", "wifi",
+                                               "bluetooth"};
+static_assert(sizeof(kModuleNames) / sizeof(kModuleNames[0]) ==
+                  static_cast<size_t>(Module::kCount),
+              "kModuleNames must match Module");
+
+static std::atomic<uint8_t> g_levels[] = {
+    KB_LOG_MAX_LEVEL, KB_LOG_MAX_LEVEL, KB_LOG_MAX_LEVEL,
+    KB_LOG_MAX_LEVEL, KB_LOG_MAX_LEVEL,
+};
+static_assert(sizeof(g_levels) / sizeof(g_levels[0]) ==
+                  static_cast<size_t>(Module::kCount),
+              "g_levels must match Module");
+
+static RingbufHandle_t g_serial_buffer = nullptr;
+static std::atomic<uint32_t> g_serial_dropped_count{0};
+
+const char* GetLevelName(const Level level) {
+  const size_t i = static_cast<size_t>(level);
+  return i < sizeof(kLevelNames) / sizeof(kLevelNames[0]) ? kLevelNames[i]
+                                                          : "(unknown)";
+}
+
+bool ParseLevel(const char* name, Level* out) {
+  for (size_t i = 0; i < sizeof(kLevelNames) / sizeof(kLevelNames[0]); ++i) {
+    if (strcmp(name, kLevelNames[i]) == 0) {
+      *out = static_cast<Level>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* GetModuleName(const Module module) {
+  const size_t i = static_cast<size_t>(module);
+  return i < static_cast<size_t>(Module::kCount) ? kModuleNames[i]
+                                                 : "(unknown)";
+}
+
+bool ParseModule(const char* name, Module* out) {
+  for (size_t i = 0; i < static_cast<size_t>(Module::kCount); ++i) {
+    if (strcmp(name, kModuleNames[i]) == 0) {
+      *out = static_cast<Module>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+Level GetLevel(const Module module) {
+  return static_cast<Level>(
+      g_levels[static_cast<size_t>(module)].load(std::memory_order_relaxed));
+}
+
+void SetLevel(const Module module, const Level level) {
+  g_levels[static_cast<size_t>(module)].store(static_cast<uint8_t>(level),
+                                              std::memory_order_relaxed);
+}
+
+void WriteToSerial(const char* data, const size_t size) {
+  if (g_serial_buffer == nullptr) {
+    Serial.write(reinterpret_cast<const uint8_t*>(data), size);
+    return;
+  }
+  if (xRingbufferSend(g_serial_buffer, data, size, 0) != pdTRUE) {
+    g_serial_dropped_count.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+static void RunSerialTask(void*) {
+  while (true) {
+    size_t size = 0;
+    void* item = xRingbufferReceiveUpTo(g_serial_buffer, &size, portMAX_DELAY,
+                                        kSerialChunkSize);
+    if (item == nullptr) {
+      continue;
+    }
+    Serial.write(static_cast<const uint8_t*>(item), size);
+    vRingbufferReturnItem(g_serial_buffer, item);
+
+    const uint32_t dropped = g_serial_dropped_count.exchange(0);
+    if (dropped > 0) {
+      Serial.printf("(%u console messages dropped)\n",
+                    static_cast<unsigned>(dropped));
+    }
+  }
+}
+
+void BeginSerial() {
+  g_serial_buffer = xRingbufferCreate(kSerialBufferSize, RINGBUF_TYPE_BYTEBUF);
+  if (g_serial_buffer == nullptr) {
+    Serial.println("Failed to create the console buffer");
+    return;
+  }
+  xTaskCreate(RunSerialTask, "LogSerial", 2 * 1024, nullptr,
+              kSerialTaskPriority, nullptr);
+}
+
+void Printf(const char* format, ...) {
+  char buf[kMaxMessageSize];
+  va_list args;
+  va_start(args, format);
+  const int needed = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (needed <= 0) {
+    return;
+  }
+  WriteToSerial(buf, std::min(static_cast<size_t>(needed), sizeof(buf) - 1));
+}
+
+}  // namespace logging
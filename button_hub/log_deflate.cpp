@@ -0,0 +1,343 @@
+#include "log_deflate.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace logging {
+
+namespace {
+
+constexpr size_t kMinMatch = 3;
+constexpr size_t kMaxMatch = 258;
+constexpr int kMaxChainLength = 16;
+
+constexpr uint16_t kLengthBase[] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t kLengthExtraBits[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                        1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                        4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr int kLengthCodeCount = sizeof(kLengthBase) / sizeof(kLengthBase[0]);
+
+// Distances up to kMaxBlockSize
+constexpr uint16_t kDistanceBase[] = {
+    1,   2,   3,   4,   5,   7,   9,    13,   17,   25,   33,   49,
+    65,  97,  129, 193, 257, 385, 513,  769,  1025, 1537, 2049, 3073};
+constexpr uint8_t kDistanceExtraBits[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4,
+                                          5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10};
+constexpr uint32_t kDistanceCodeCount =
+    sizeof(kDistanceBase) / sizeof(kDistanceBase[0]);
+static_assert(kMaxBlockSize < 4097, "kDistanceBase must cover the block");
+
+class BitWriter {
+ public:
+  explicit BitWriter(uint8_t* out) : out_(out) {}
+
+  // Extra bits and headers, least significant bit first
+  void WriteBits(uint32_t value, int count) {
+    bits_ |= value << count_;
+    count_ += count;
+    while (count_ >= 8) {
+      out_[size_++] = static_cast<uint8_t>(bits_);
+      bits_ >>= 8;
+      count_ -= 8;
+    }
+  }
+  // Huffman codes, most significant bit first
+  void WriteCode(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+      reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    WriteBits(reversed, length);
+  }
+  void AlignToByte() {
+    if (count_ > 0) {
+      WriteBits(0, 8 - count_);
+    }
+  }
+  size_t size() const { return size_; }
+
+ private:
+  uint8_t* out_;
+  size_t size_ = 0;
+  uint32_t bits_ = 0;
+  int count_ = 0;
+};
+
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  bool ReadBits(int count, uint32_t* value) {
+    while (count_ < count) {
+      if (pos_ == size_) {
+        return false;
+      }
+      bits_ |= static_cast<uint32_t>(data_[pos_++]) << count_;
+      count_ += 8;
+    }
+    *value = bits_ & ((1u << count) - 1);
+    bits_ >>= count;
+    count_ -= count;
+    return true;
+  }
+  // Appends one bit of a Huffman code to `code`
+  bool ReadCodeBit(uint32_t* code) {
+    uint32_t bit;
+    if (!ReadBits(1, &bit)) {
+      return false;
+    }
+    *code = (*code << 1) | bit;
+    return true;
+  }
+  void AlignToByte() {
+    bits_ >>= count_ % 8;
+    count_ -= count_ % 8;
+  }
+  bool IsAtEnd() const { return pos_ == size_ && count_ < 8; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+  uint32_t bits_ = 0;
+  int count_ = 0;
+};
+
+void WriteLiteralOrLength(BitWriter& writer, const int symbol) {
+  if (symbol < 144) {
+    writer.WriteCode(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    writer.WriteCode(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    writer.WriteCode(symbol - 256, 7);
+  } else {
+    writer.WriteCode(0xc0 + symbol - 280, 8);
+  }
+}
+
+void WriteMatch(BitWriter& writer, const size_t length, const size_t distance) {
+  int i = kLengthCodeCount - 1;
+  while (kLengthBase[i] > length) {
+    --i;
+  }
+  WriteLiteralOrLength(writer, 257 + i);
+  writer.WriteBits(length - kLengthBase[i], kLengthExtraBits[i]);
+  int j = kDistanceCodeCount - 1;
+  while (kDistanceBase[j] > distance) {
+    --j;
+  }
+  writer.WriteCode(j, 5);
+  writer.WriteBits(distance - kDistanceBase[j], kDistanceExtraBits[j]);
+}
+
+// Reads a literal/length symbol of the fixed Huffman codes
+bool ReadLiteralOrLength(BitReader& reader, int* symbol) {
+  uint32_t code = 0;
+  for (int i = 0; i < 7; ++i) {
+    if (!reader.ReadCodeBit(&code)) {
+      return false;
+    }
+  }
+  if (code <= 0x17) {
+    *symbol = 256 + code;
+    return true;
+  }
+  if (!reader.ReadCodeBit(&code)) {
+    return false;
+  }
+  if (code >= 0x30 && code <= 0xbf) {
+    *symbol = code - 0x30;
+    return true;
+  }
+  if (code >= 0xc0 && code <= 0xc7) {
+    *symbol = 280 + code - 0xc0;
+    return true;
+  }
+  if (!reader.ReadCodeBit(&code)) {
+    return false;
+  }
+  *symbol = 144 + code - 0x190;
+  return true;
+}
+
+uint32_t Hash(const uint8_t* p) {
+  return ((p[0] << 4) ^ (p[1] << 2) ^ p[2]) % 256;
+}
+
+}  // namespace
+
+size_t BlockDeflater::Deflate(const uint8_t* data, const size_t size,
+                              uint8_t* out) {
+  static_assert(kHashSize == 256, "Hash() assumes 256 buckets");
+  std::memset(head_, 0xff, sizeof(head_));
+
+  BitWriter writer(out);
+  writer.WriteBits(0, 1);  // BFINAL
+  writer.WriteBits(1, 2);  // BTYPE: fixed Huffman codes
+  size_t pos = 0;
+  while (pos < size) {
+    size_t best_length = 0;
+    size_t best_distance = 0;
+    if (pos + kMinMatch <= size) {
+      const size_t max_length = std::min(kMaxMatch, size - pos);
+      const uint32_t hash = Hash(data + pos);
+      int candidate = head_[hash];
+      for (int chain = 0; candidate >= 0 && chain < kMaxChainLength;
+           ++chain, candidate = prev_[candidate]) {
+        size_t length = 0;
+        while (length < max_length &&
+               data[candidate + length] == data[pos + length]) {
+          ++length;
+        }
+        if (length > best_length) {
+          best_length = length;
+          best_distance = pos - candidate;
+        }
+      }
+      prev_[pos] = head_[hash];
+      head_[hash] = static_cast<int16_t>(pos);
+    }
+    if (best_length >= kMinMatch) {
+      WriteMatch(writer, best_length, best_distance);
+      // Index the skipped positions too
+      for (size_t i = pos + 1; i < pos + best_length; ++i) {
+        if (i + kMinMatch <= size) {
+          const uint32_t hash = Hash(data + i);
+          prev_[i] = head_[hash];
+          head_[hash] = static_cast<int16_t>(i);
+        }
+      }
+      pos += best_length;
+    } else {
+      WriteLiteralOrLength(writer, data[pos]);
+      ++pos;
+    }
+  }
+  WriteLiteralOrLength(writer, 256);  // end of block
+  // Empty stored block to end byte-aligned
+  writer.WriteBits(0, 3);
+  writer.AlignToByte();
+  writer.WriteBits(0x0000, 16);
+  writer.WriteBits(0xffff, 16);
+
+  if (writer.size() <= kStoredBlockHeaderSize + size) {
+    return writer.size();
+  }
+  WriteStoredBlockHeader(size, out);
+  std::memcpy(out + kStoredBlockHeaderSize, data, size);
+  return kStoredBlockHeaderSize + size;
+}
+
+bool InflateBlock(const uint8_t* data, const size_t size, uint8_t* out,
+                  const size_t capacity, size_t* out_size) {
+  BitReader reader(data, size);
+  size_t n = 0;
+  while (!reader.IsAtEnd()) {
+    uint32_t is_final;
+    uint32_t type;
+    if (!reader.ReadBits(1, &is_final) || !reader.ReadBits(2, &type)) {
+      return false;
+    }
+    if (type == 0) {
+      reader.AlignToByte();
+      uint32_t length;
+      uint32_t inverted_length;
+      if (!reader.ReadBits(16, &length) ||
+          !reader.ReadBits(16, &inverted_length) ||
+          (length ^ 0xffff) != inverted_length || n + length > capacity) {
+        return false;
+      }
+      for (uint32_t i = 0; i < length; ++i) {
+        uint32_t byte;
+        if (!reader.ReadBits(8, &byte)) {
+          return false;
+        }
+        out[n++] = static_cast<uint8_t>(byte);
+      }
+    } else if (type == 1) {
+      while (true) {
+        int symbol;
+        if (!ReadLiteralOrLength(reader, &symbol)) {
+          return false;
+        }
+        if (symbol < 256) {
+          if (n == capacity) {
+            return false;
+          }
+          out[n++] = static_cast<uint8_t>(symbol);
+          continue;
+        }
+        if (symbol == 256) {
+          break;
+        }
+        const int i = symbol - 257;
+        uint32_t extra;
+        uint32_t code = 0;
+        if (i >= kLengthCodeCount ||
+            !reader.ReadBits(kLengthExtraBits[i], &extra)) {
+          return false;
+        }
+        const size_t length = kLengthBase[i] + extra;
+        for (int bit = 0; bit < 5; ++bit) {
+          if (!reader.ReadCodeBit(&code)) {
+            return false;
+          }
+        }
+        if (code >= kDistanceCodeCount ||
+            !reader.ReadBits(kDistanceExtraBits[code], &extra)) {
+          return false;
+        }
+        const size_t distance = kDistanceBase[code] + extra;
+        if (distance > n || n + length > capacity) {
+          return false;
+        }
+        for (size_t k = 0; k < length; ++k, ++n) {
+          out[n] = out[n - distance];
+        }
+      }
+    } else {
+      return false;  // dynamic Huffman codes are never written
+    }
+    if (is_final) {
+      break;
+    }
+  }
+  *out_size = n;
+  return true;
+}
+
+uint32_t Adler32(const uint8_t* data, const size_t size, const uint32_t adler) {
+  constexpr uint32_t kBase = 65521;
+  uint32_t a = adler & 0xffff;
+  uint32_t b = adler >> 16;
+  for (size_t i = 0; i < size; ++i) {
+    a = (a + data[i]) % kBase;
+    b = (b + a) % kBase;
+  }
+  return (b << 16) | a;
+}
+
+uint32_t CombineAdler32(const uint32_t adler1, const uint32_t adler2,
+                        const size_t size2) {
+  constexpr uint32_t kBase = 65521;
+  const uint32_t remainder = size2 % kBase;
+  uint32_t a = adler1 & 0xffff;
+  uint32_t b = (remainder * a) % kBase;
+  a += (adler2 & 0xffff) + kBase - 1;
+  b += (adler1 >> 16) + (adler2 >> 16) + kBase - remainder;
+  a %= kBase;
+  b %= kBase;
+  return (b << 16) | a;
+}
+
+void WriteStoredBlockHeader(const size_t size, uint8_t* out) {
+  out[0] = 0x00;  // BFINAL = 0, BTYPE = 00
+  out[1] = static_cast<uint8_t>(size);
+  out[2] = static_cast<uint8_t>(size >> 8);
+  out[3] = static_cast<uint8_t>(~size);
+  out[4] = static_cast<uint8_t>(~size >> 8);
+}
+
+}  // namespace logging
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace logging {
+
+// Compression of log blocks
+//
+// A block is compressed into deflate blocks (RFC 1951) with the fixed Huffman
+// codes and ends byte-aligned like zlib's Z_SYNC_FLUSH, or is stored if it
+// doesn't compress. Compressed blocks can therefore be concatenated into one
+// deflate stream and sent as "Content-Encoding: deflate" without inflating
+// them on the device. Matches never reach outside the block, so each block
+// can also be inflated on its own.
+
+constexpr size_t kMaxBlockSize = 1024;
+constexpr size_t kMaxDeflatedBlockSize = kMaxBlockSize * 9 / 8 + 16;
+
+class BlockDeflater {
+ public:
+  // `out` must have kMaxDeflatedBlockSize bytes. Returns the size written.
+  size_t Deflate(const uint8_t* data, size_t size, uint8_t* out);
+
+ private:
+  static constexpr size_t kHashSize = 256;
+
+  // Positions of the last occurrence of each hash and the previous one with
+  // the same hash, or -1
+  int16_t head_[kHashSize];
+  int16_t prev_[kMaxBlockSize];
+};
+
+// Inflates blocks written by BlockDeflater::Deflate() or any other stored or
+// fixed Huffman blocks. Returns false if the data is invalid or `out` is too
+// small.
+bool InflateBlock(const uint8_t* data, size_t size, uint8_t* out,
+                  size_t capacity, size_t* out_size);
+
+uint32_t Adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+// Adler-32 of the concatenation of two data from the checksums of each
+uint32_t CombineAdler32(uint32_t adler1, uint32_t adler2, size_t size2);
+
+// A zlib stream (RFC 1950) of compressed blocks is kZlibHeader, the blocks,
+// kFinalDeflateBlock and the big-endian Adler-32 of the uncompressed data.
+constexpr uint8_t kZlibHeader[] = {0x78, 0x01};
+constexpr uint8_t kFinalDeflateBlock[] = {0x03, 0x00};
+// Header of a stored block of `size` bytes (up to 65535)
+constexpr size_t kStoredBlockHeaderSize = 5;
+void WriteStoredBlockHeader(size_t size, uint8_t* out);
+
+}  // namespace logging
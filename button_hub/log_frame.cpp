@@ -0,0 +1,79 @@
+#include "log_frame.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace logging {
+
+uint32_t Crc32(const void* data, const size_t size) {
+  // Half-byte table: small enough for the writer task and fast enough for
+  // records of a few hundred bytes.
+  static constexpr uint32_t kTable[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+      0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+  };
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < size; ++i) {
+    crc = kTable[(crc ^ p[i]) & 0x0f] ^ (crc >> 4);
+    crc = kTable[(crc ^ (p[i] >> 4)) & 0x0f] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+FrameHeader MakeFrameHeader(const void* payload, const uint16_t length,
+                            const uint16_t magic) {
+  return FrameHeader{magic, length, Crc32(payload, length)};
+}
+
+size_t FrameDecoder::Fill(const uint8_t* data, const size_t size) {
+  if (begin_ > 0) {
+    std::memmove(buffer_, buffer_ + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  const size_t n = std::min(size, sizeof(buffer_) - end_);
+  std::memcpy(buffer_ + end_, data, n);
+  end_ += n;
+  return n;
+}
+
+bool FrameDecoder::Next(const bool is_end, FrameType* type,
+                        const uint8_t** payload, uint16_t* length) {
+  while (end_ - begin_ >= sizeof(FrameHeader)) {
+    FrameHeader header;
+    std::memcpy(&header, buffer_ + begin_, sizeof(header));
+    if ((header.magic == kFrameMagic &&
+         header.length <= kMaxFramePayloadSize) ||
+        (header.magic == kBlockFrameMagic &&
+         header.length <= kMaxBlockFramePayloadSize)) {
+      const size_t frame_size = sizeof(header) + header.length;
+      if (end_ - begin_ < frame_size) {
+        if (!is_end) {
+          return false;  // wait for the rest of the frame
+        }
+      } else {
+        const uint8_t* p = buffer_ + begin_ + sizeof(header);
+        if (Crc32(p, header.length) == header.crc) {
+          *type = header.magic == kFrameMagic ? FrameType::kRecord
+                                              : FrameType::kBlock;
+          *payload = p;
+          *length = header.length;
+          begin_ += frame_size;
+          return true;
+        }
+      }
+    }
+    // Not an intact frame. Look for the next one from the following byte.
+    ++begin_;
+    ++skipped_bytes_;
+  }
+  if (is_end) {
+    skipped_bytes_ += end_ - begin_;
+    begin_ = end_;
+  }
+  return false;
+}
+
+}  // namespace logging
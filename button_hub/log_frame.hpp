@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "log_deflate.hpp"
+
+namespace logging {
+
+// Record framing of log segments
+//
+// Every record in a log segment is written as FrameHeader followed by
+// `length` bytes of payload. A record torn by a power loss fails the CRC check
+// and FrameDecoder skips it and resynchronizes on the next intact frame, so
+// only that record is lost.
+//
+// Closed segments are compacted into block frames, each of which holds
+// BlockHeader followed by the records of up to kMaxBlockSize bytes compressed
+// by BlockDeflater. Records never span two blocks.
+
+constexpr uint16_t kFrameMagic = 0x4c4b;       // "KL"
+constexpr uint16_t kBlockFrameMagic = 0x5a4b;  // "KZ"
+constexpr size_t kMaxFramePayloadSize = 256;
+
+struct __attribute__((packed)) BlockHeader {
+  uint32_t adler32;  // Adler32() of the uncompressed records
+  uint16_t size;     // of the uncompressed records
+};
+
+constexpr size_t kMaxBlockFramePayloadSize =
+    sizeof(BlockHeader) + kMaxDeflatedBlockSize;
+
+enum class FrameType : uint8_t {
+  kRecord,
+  kBlock,
+};
+
+struct __attribute__((packed)) FrameHeader {
+  uint16_t magic;
+  uint16_t length;
+  uint32_t crc;  // Crc32() of the payload
+};
+
+uint32_t Crc32(const void* data, size_t size);  // CRC-32/ISO-HDLC
+
+FrameHeader MakeFrameHeader(const void* payload, uint16_t length,
+                            uint16_t magic = kFrameMagic);
+
+// Extracts the payloads from a byte stream split at arbitrary positions.
+//
+// Usage:
+//
+//  logging::FrameDecoder decoder;
+//  while ((n = file.read(buf, sizeof(buf))) > 0) {
+//    decoder.Feed(buf, n, on_frame);
+//  }
+//  decoder.Finish(on_frame);
+class FrameDecoder {
+ public:
+  // `on_frame` is called as
+  // `void(FrameType type, const uint8_t* payload, size_t length)` for each
+  // intact frame. The payload is valid only during the call.
+  template <typename OnFrame>
+  void Feed(const uint8_t* data, size_t size, OnFrame&& on_frame) {
+    while (size > 0) {
+      const size_t n = Fill(data, size);
+      data += n;
+      size -= n;
+      FrameType type;
+      const uint8_t* payload;
+      uint16_t length;
+      while (Next(false, &type, &payload, &length)) {
+        on_frame(type, payload, static_cast<size_t>(length));
+      }
+    }
+  }
+
+  // Call at the end of the stream. The frames left in the buffer are decoded
+  // and a truncated frame at the end is dropped.
+  template <typename OnFrame>
+  void Finish(OnFrame&& on_frame) {
+    FrameType type;
+    const uint8_t* payload;
+    uint16_t length;
+    while (Next(true, &type, &payload, &length)) {
+      on_frame(type, payload, static_cast<size_t>(length));
+    }
+  }
+
+  // Number of bytes skipped because of corruption
+  size_t skipped_bytes() const { return skipped_bytes_; }
+
+ private:
+  size_t Fill(const uint8_t* data, size_t size);
+  bool Next(bool is_end, FrameType* type, const uint8_t** payload,
+            uint16_t* length);
+
+  uint8_t buffer_[sizeof(FrameHeader) + kMaxBlockFramePayloadSize];
+  size_t begin_ = 0;
+  size_t end_ = 0;
+  size_t skipped_bytes_ = 0;
+};
+
+}  // namespace logging
@@ -0,0 +1,89 @@
+#include "log_query.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+#include "log_record.hpp"
+
+namespace logging {
+
+static int CompareDate(const char* date, const char* bound) {
+  return std::strncmp(date, bound,
+                      std::min(std::strlen(bound), kRecordDateLength));
+}
+
+static bool Contains(const char* text, const size_t length,
+                     const char* pattern) {
+  const size_t pattern_length = std::strlen(pattern);
+  if (pattern_length == 0) {
+    return true;
+  }
+  for (size_t i = 0; i + pattern_length <= length; ++i) {
+    if (std::memcmp(text + i, pattern, pattern_length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseTextRecord(const char* payload, size_t length, QueryRecord* out) {
+  // "YYYY-MM-DD HH:MM:SS L "
+  constexpr size_t kPrefixLength = kRecordDateLength + 3;
+  if (length < kPrefixLength || payload[kRecordDateLength] != ' ' ||
+      payload[kRecordDateLength + 2] != ' ' ||
+      !ParseLevelLetter(payload[kRecordDateLength + 1], &out->level)) {
+    return false;
+  }
+  std::memcpy(out->date, payload, kRecordDateLength);
+  out->date[kRecordDateLength] = '\0';
+  if (payload[length - 1] == '\n') {
+    --length;
+  }
+  out->message = payload + kPrefixLength;
+  out->message_length = length - kPrefixLength;
+  return true;
+}
+
+void FormatRecordDate(const uint32_t time, char out[kRecordDateLength + 1]) {
+  const time_t t = time;
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  strftime(out, kRecordDateLength + 1, "%Y-%m-%d %H:%M:%S", &timeinfo);
+}
+
+bool ParseBinaryRecord(const uint8_t* payload, const size_t length,
+                       QueryRecord* out) {
+  RecordHeader header;
+  if (length < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, payload, sizeof(header));
+  FormatRecordDate(header.time, out->date);
+  out->level = static_cast<Level>(header.level);
+  out->message = "";
+  out->message_length = 0;
+  return true;
+}
+
+bool Matches(const QueryFilter& filter, const QueryRecord& record) {
+  return record.level <= filter.level &&
+         !IsBeforeRange(filter, record.date) &&
+         !IsAfterRange(filter, record.date) &&
+         Contains(record.message, record.message_length, filter.text);
+}
+
+bool IsAfterRange(const QueryFilter& filter, const char* date) {
+  return filter.to[0] != '\0' && CompareDate(date, filter.to) > 0;
+}
+
+bool IsBeforeRange(const QueryFilter& filter, const char* date) {
+  return filter.from[0] != '\0' && CompareDate(date, filter.from) < 0;
+}
+
+bool OverlapsRange(const QueryFilter& filter, const char* min_date,
+                   const char* max_date) {
+  return !IsBeforeRange(filter, max_date) && !IsAfterRange(filter, min_date);
+}
+
+}  // namespace logging
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "logging.hpp"
+
+namespace logging {
+
+// Length of the date of a record, "YYYY-MM-DD HH:MM:SS"
+constexpr size_t kRecordDateLength = 19;
+
+// Filter of GET /log/query. The default matches every record.
+struct QueryFilter {
+  // Compared with the date of a record up to their own length, so that e.g.
+  // from = to = "2024-05-01 10:3" selects 10:30:00 to 10:39:59.
+  const char* from = "";
+  const char* to = "";
+  const char* text = "";  // substring of the message
+  Level level = Level::kDebug;  // this level or more severe
+};
+
+struct QueryRecord {
+  char date[kRecordDateLength + 1];
+  Level level;
+  const char* message;  // not terminated. Empty for binary records.
+  size_t message_length;
+};
+
+// Parses a text record "YYYY-MM-DD HH:MM:SS L message\n".
+bool ParseTextRecord(const char* payload, size_t length, QueryRecord* out);
+// Parses RecordHeader of a binary record. The date is in the local time.
+bool ParseBinaryRecord(const uint8_t* payload, size_t length,
+                       QueryRecord* out);
+
+// `time` (seconds since the epoch) as the date of a record, in the local time
+void FormatRecordDate(uint32_t time, char out[kRecordDateLength + 1]);
+
+bool Matches(const QueryFilter& filter, const QueryRecord& record);
+bool IsAfterRange(const QueryFilter& filter, const char* date);
+bool IsBeforeRange(const QueryFilter& filter, const char* date);
+// False if no record dated from `min_date` to `max_date` is in the range
+bool OverlapsRange(const QueryFilter& filter, const char* min_date,
+                   const char* max_date);
+
+}  // namespace logging
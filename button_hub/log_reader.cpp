@@ -0,0 +1,130 @@
+#include "log_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "log_record.hpp"
+
+namespace logging {
+
+SegmentReader::SegmentReader(File file) : file_(std::move(file)) {
+  uint16_t magic = 0;
+  const bool has_magic =
+      file_.read(reinterpret_cast<uint8_t*>(&magic), sizeof(magic)) ==
+      sizeof(magic);
+  is_framed_ = has_magic && (magic == kFrameMagic || magic == kBlockFrameMagic);
+  is_compressed_ = has_magic && magic == kBlockFrameMagic;
+  file_.seek(0);
+}
+
+size_t SegmentReader::Read(uint8_t* out, const size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    if (pending_pos_ == pending_.size() && !Refill()) {
+      break;
+    }
+    const size_t m = std::min(len - n, pending_.size() - pending_pos_);
+    std::memcpy(out + n, pending_.data() + pending_pos_, m);
+    pending_pos_ += m;
+    n += m;
+  }
+  return n;
+}
+
+size_t SegmentReader::ReadDeflated(uint8_t* out, const size_t len) {
+  size_t n = 0;
+  while (n < len) {
+    if (pending_pos_ == pending_.size() && !RefillDeflated()) {
+      break;
+    }
+    const size_t m = std::min(len - n, pending_.size() - pending_pos_);
+    std::memcpy(out + n, pending_.data() + pending_pos_, m);
+    pending_pos_ += m;
+    n += m;
+  }
+  return n;
+}
+
+bool SegmentReader::InflateBlockFrame(const uint8_t* payload,
+                                      const size_t length, size_t* size) {
+  BlockHeader header;
+  if (length < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, payload, sizeof(header));
+  return InflateBlock(payload + sizeof(header), length - sizeof(header),
+                      block_, sizeof(block_), size) &&
+         *size == header.size && Adler32(block_, *size) == header.adler32;
+}
+
+size_t SegmentReader::GetRecordSize(const uint8_t* data, const size_t size) {
+#ifdef KB_LOG_DEFERRED_FORMAT
+  return GetBinaryRecordSize(data, size);
+#else
+  return GetTextRecordSize(data, size);
+#endif
+}
+
+bool SegmentReader::Refill() {
+  pending_.clear();
+  pending_pos_ = 0;
+  const auto on_record = [this](const uint8_t* payload, const size_t length) {
+    pending_.insert(pending_.end(), payload, payload + length);
+  };
+  while (pending_.empty() && !is_finished_) {
+    if (is_framed_) {
+      ReadRecords(on_record);
+      continue;
+    }
+    uint8_t chunk[kReadChunkSize];
+    const size_t size = file_.read(chunk, sizeof(chunk));
+    if (size == 0) {
+      is_finished_ = true;
+    }
+    pending_.assign(chunk, chunk + size);
+  }
+  return !pending_.empty();
+}
+
+bool SegmentReader::RefillDeflated() {
+  pending_.clear();
+  pending_pos_ = 0;
+  if (!is_stream_started_) {
+    pending_.assign(std::begin(kZlibHeader), std::end(kZlibHeader));
+    is_stream_started_ = true;
+    return true;
+  }
+  const auto on_frame = [this](FrameType type, const uint8_t* payload,
+                               const size_t length) {
+    if (type == FrameType::kBlock) {
+      BlockHeader header;
+      if (length < sizeof(header)) {
+        return;
+      }
+      std::memcpy(&header, payload, sizeof(header));
+      pending_.insert(pending_.end(), payload + sizeof(header),
+                      payload + length);
+      adler32_ = CombineAdler32(adler32_, header.adler32, header.size);
+      return;
+    }
+    uint8_t header[kStoredBlockHeaderSize];
+    WriteStoredBlockHeader(length, header);
+    pending_.insert(pending_.end(), std::begin(header), std::end(header));
+    pending_.insert(pending_.end(), payload, payload + length);
+    adler32_ = CombineAdler32(adler32_, Adler32(payload, length), length);
+  };
+  while (pending_.empty() && !is_finished_) {
+    ReadFrames(on_frame);
+    if (is_finished_) {
+      pending_.insert(pending_.end(), std::begin(kFinalDeflateBlock),
+                      std::end(kFinalDeflateBlock));
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        pending_.push_back(static_cast<uint8_t>(adler32_ >> shift));
+      }
+    }
+  }
+  return !pending_.empty();
+}
+
+}  // namespace logging
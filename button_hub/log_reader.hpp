@@ -0,0 +1,96 @@
+#pragma once
+
+#include <FS.h>
+#include <vector>
+
+#include "log_deflate.hpp"
+#include "log_frame.hpp"
+
+namespace logging {
+
+// Reads a log segment as the concatenation of its record payloads, i.e. the
+// same bytes as a log file without framing. Corrupted records are skipped and
+// compressed blocks are inflated. Files written before the framing was
+// introduced are read as they are.
+class SegmentReader {
+ public:
+  explicit SegmentReader(File file);
+
+  // Returns the number of bytes written to `out`, or 0 at the end.
+  size_t Read(uint8_t* out, size_t len);
+
+  // Same as Read() but returns the contents as a zlib stream for
+  // "Content-Encoding: deflate". Compressed blocks are copied as they are and
+  // the other records are sent as stored blocks. Only for framed segments.
+  size_t ReadDeflated(uint8_t* out, size_t len);
+
+  // Reads the next chunk of the file and calls `on_record` as
+  // `void(const uint8_t* payload, size_t length)` for each record completed by
+  // it. Returns false at the end. Don't mix with Read().
+  template <typename OnRecord>
+  bool ReadRecords(OnRecord&& on_record) {
+    return ReadFrames([this, &on_record](FrameType type,
+                                         const uint8_t* payload,
+                                         size_t length) {
+      if (type == FrameType::kRecord) {
+        on_record(payload, length);
+        return;
+      }
+      size_t size;
+      if (!InflateBlockFrame(payload, length, &size)) {
+        return;
+      }
+      size_t n;
+      for (size_t pos = 0; pos < size; pos += n) {
+        n = GetRecordSize(block_ + pos, size - pos);
+        if (n == 0) {
+          break;
+        }
+        on_record(block_ + pos, n);
+      }
+    });
+  }
+
+  bool is_framed() const { return is_framed_; }
+  // True if the segment has been compacted into compressed blocks
+  bool is_compressed() const { return is_compressed_; }
+
+ private:
+  static constexpr size_t kReadChunkSize = 128;
+
+  template <typename OnFrame>
+  bool ReadFrames(OnFrame&& on_frame) {
+    if (is_finished_) {
+      return false;
+    }
+    uint8_t chunk[kReadChunkSize];
+    const size_t size = file_.read(chunk, sizeof(chunk));
+    if (size == 0) {
+      decoder_.Finish(on_frame);
+      is_finished_ = true;
+      return false;
+    }
+    decoder_.Feed(chunk, size, on_frame);
+    return true;
+  }
+
+  // Inflates the block to `block_`. Returns false if it is corrupted.
+  bool InflateBlockFrame(const uint8_t* payload, size_t length, size_t* size);
+  static size_t GetRecordSize(const uint8_t* data, size_t size);
+  bool Refill();
+  bool RefillDeflated();
+
+  File file_;
+  bool is_framed_;
+  bool is_compressed_;
+  bool is_finished_ = false;
+  FrameDecoder decoder_;
+  uint8_t block_[kMaxBlockSize];
+  std::vector<uint8_t> pending_;
+  size_t pending_pos_ = 0;
+  // For ReadDeflated()
+  bool is_stream_started_ = false;
+  uint32_t adler32_ = 1;
+};
+
+}  // namespace logging
@@ -0,0 +1,431 @@
+#include "log_record.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace logging {
+
+namespace {
+
+enum class ArgClass : uint8_t {
+  kNone,  // "%%"
+  kInt,
+  kDouble,
+  kPointer,
+  kString,
+  kCount,  // "%n"
+  kUnknown,
+};
+
+// One conversion specification, e.g. "%-08.3lld"
+struct Spec {
+  const char* flags;
+  size_t flag_count;
+  int width;  // -1: none, -2: '*'
+  int precision;  // -1: none, -2: '*'
+  bool is_long_long;  // "ll" or "j"
+  bool is_long_double;  // "L"
+  char conversion;
+  ArgClass arg_class;
+};
+
+ArgClass ClassifyConversion(const char c) {
+  switch (c) {
+    case '%':
+      return ArgClass::kNone;
+    case 'd':
+    case 'i':
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'c':
+      return ArgClass::kInt;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      return ArgClass::kDouble;
+    case 'p':
+      return ArgClass::kPointer;
+    case 's':
+      return ArgClass::kString;
+    case 'n':
+      return ArgClass::kCount;
+    default:
+      return ArgClass::kUnknown;
+  }
+}
+
+// `p` points to '%'. Returns the position after the specification.
+const char* ParseSpec(const char* p, Spec& spec) {
+  ++p;
+  spec.flags = p;
+  while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0') {
+    ++p;
+  }
+  spec.flag_count = p - spec.flags;
+
+  spec.width = -1;
+  if (*p == '*') {
+    spec.width = -2;
+    ++p;
+  } else if (*p >= '0' && *p <= '9') {
+    spec.width = 0;
+    while (*p >= '0' && *p <= '9') {
+      spec.width = spec.width * 10 + (*p++ - '0');
+    }
+  }
+
+  spec.precision = -1;
+  if (*p == '.') {
+    ++p;
+    spec.precision = 0;
+    if (*p == '*') {
+      spec.precision = -2;
+      ++p;
+    } else {
+      while (*p >= '0' && *p <= '9') {
+        spec.precision = spec.precision * 10 + (*p++ - '0');
+      }
+    }
+  }
+
+  spec.is_long_long = false;
+  spec.is_long_double = false;
+  if (p[0] == 'l' && p[1] == 'l') {
+    spec.is_long_long = true;
+    p += 2;
+  } else if (p[0] == 'h' && p[1] == 'h') {
+    p += 2;
+  } else if (*p == 'j') {
+    spec.is_long_long = true;
+    ++p;
+  } else if (*p == 'L') {
+    spec.is_long_double = true;
+    ++p;
+  } else if (*p == 'l' || *p == 'h' || *p == 'z' || *p == 't') {
+    ++p;
+  }
+
+  spec.conversion = *p;
+  spec.arg_class = ClassifyConversion(*p);
+  return *p ? p + 1 : p;
+}
+
+class ByteWriter {
+ public:
+  ByteWriter(uint8_t* out, const size_t capacity)
+      : out_(out), capacity_(capacity), size_(0) {}
+
+  bool Write(const void* data, const size_t size) {
+    if (size_ + size > capacity_) {
+      return false;
+    }
+    std::memcpy(out_ + size_, data, size);
+    size_ += size;
+    return true;
+  }
+  size_t Remaining() const { return capacity_ - size_; }
+  size_t size() const { return size_; }
+
+ private:
+  uint8_t* out_;
+  size_t capacity_;
+  size_t size_;
+};
+
+class ByteReader {
+ public:
+  ByteReader(const uint8_t* data, const size_t size)
+      : data_(data), size_(size), pos_(0) {}
+
+  template <typename T>
+  bool Read(T& value) {
+    if (pos_ + sizeof(T) > size_) {
+      return false;
+    }
+    std::memcpy(&value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+  const char* ReadBytes(const size_t size) {
+    if (pos_ + size > size_) {
+      return nullptr;
+    }
+    const char* p = reinterpret_cast<const char*>(data_ + pos_);
+    pos_ += size;
+    return p;
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_;
+};
+
+class TextWriter {
+ public:
+  TextWriter(char* out, const size_t len) : out_(out), len_(len), pos_(0) {
+    if (len_ > 0) {
+      out_[0] = '\0';
+    }
+  }
+
+  void Put(const char c) {
+    if (pos_ + 1 < len_) {
+      out_[pos_++] = c;
+      out_[pos_] = '\0';
+    }
+  }
+  // Appends the result of snprintf(format, value)
+  template <typename... Args>
+  void Printf(const char* format, Args... args) {
+    if (pos_ + 1 >= len_) {
+      return;
+    }
+    const int n = std::snprintf(out_ + pos_, len_ - pos_, format, args...);
+    if (n > 0) {
+      pos_ = std::min(pos_ + static_cast<size_t>(n), len_ - 1);
+    }
+  }
+  size_t length() const { return pos_; }
+
+ private:
+  char* out_;
+  size_t len_;
+  size_t pos_;
+};
+
+constexpr char kLevelLetters[] = "NEWID";
+
+}  // namespace
+
+char GetLevelLetter(const Level level) {
+  const size_t i = static_cast<size_t>(level);
+  return i < sizeof(kLevelLetters) - 1 ? kLevelLetters[i] : '?';
+}
+
+bool ParseLevelLetter(const char letter, Level* out) {
+  const char* p =
+      letter != '\0' ? std::strchr(kLevelLetters, letter) : nullptr;
+  if (p == nullptr) {
+    return false;
+  }
+  *out = static_cast<Level>(p - kLevelLetters);
+  return true;
+}
+
+uint32_t HashFormat(const char* format) {
+  uint32_t hash = 2166136261u;
+  for (const char* p = format; *p; ++p) {
+    hash ^= static_cast<uint8_t>(*p);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+size_t CaptureArgs(const char* format, va_list args, uint8_t* out,
+                   const size_t capacity) {
+  ByteWriter writer(out, capacity);
+  const char* p = format;
+  while (*p) {
+    if (*p != '%') {
+      ++p;
+      continue;
+    }
+    Spec spec;
+    p = ParseSpec(p, spec);
+    if (spec.width == -2) {
+      const int32_t v = va_arg(args, int);
+      if (!writer.Write(&v, sizeof(v))) {
+        break;
+      }
+    }
+    if (spec.precision == -2) {
+      const int32_t v = va_arg(args, int);
+      if (!writer.Write(&v, sizeof(v))) {
+        break;
+      }
+    }
+    bool ok = true;
+    switch (spec.arg_class) {
+      case ArgClass::kNone:
+        break;
+      case ArgClass::kInt:
+        if (spec.is_long_long) {
+          const int64_t v = va_arg(args, long long);
+          ok = writer.Write(&v, sizeof(v));
+        } else {
+          const int32_t v = va_arg(args, int);
+          ok = writer.Write(&v, sizeof(v));
+        }
+        break;
+      case ArgClass::kDouble: {
+        const double v = spec.is_long_double
+                             ? static_cast<double>(va_arg(args, long double))
+                             : va_arg(args, double);
+        ok = writer.Write(&v, sizeof(v));
+      } break;
+      case ArgClass::kPointer: {
+        const uint32_t v = static_cast<uint32_t>(
+            reinterpret_cast<uintptr_t>(va_arg(args, void*)));
+        ok = writer.Write(&v, sizeof(v));
+      } break;
+      case ArgClass::kString: {
+        const char* s = va_arg(args, const char*);
+        if (s == nullptr) {
+          s = "(null)";
+        }
+        if (writer.Remaining() < 1) {
+          ok = false;
+          break;
+        }
+        size_t max_len = std::min<size_t>(255, writer.Remaining() - 1);
+        if (spec.precision >= 0) {
+          max_len = std::min<size_t>(max_len, spec.precision);
+        }
+        const uint8_t n = static_cast<uint8_t>(strnlen(s, max_len));
+        ok = writer.Write(&n, sizeof(n)) && writer.Write(s, n);
+      } break;
+      case ArgClass::kCount:
+        va_arg(args, void*);
+        break;
+      case ArgClass::kUnknown:
+        // The type of the argument is unknown. Stop here.
+        return writer.size();
+    }
+    if (!ok) {
+      break;
+    }
+  }
+  return writer.size();
+}
+
+size_t FormatArgs(const char* format, const uint8_t* args, const size_t size,
+                  char* out, const size_t len) {
+  TextWriter writer(out, len);
+  ByteReader reader(args, size);
+  const char* p = format;
+  while (*p) {
+    if (*p != '%') {
+      writer.Put(*p++);
+      continue;
+    }
+    Spec spec;
+    p = ParseSpec(p, spec);
+    if (spec.arg_class == ArgClass::kNone) {
+      writer.Put('%');
+      continue;
+    }
+    if (spec.arg_class == ArgClass::kCount) {
+      continue;
+    }
+    if (spec.arg_class == ArgClass::kUnknown) {
+      break;
+    }
+
+    int32_t width = spec.width;
+    int32_t precision = spec.precision;
+    if ((width == -2 && !reader.Read(width)) ||
+        (precision == -2 && !reader.Read(precision))) {
+      break;
+    }
+
+    // Rebuild the specification without '*' and without length modifiers
+    // except "ll", then format the single value with it.
+    char single[32];
+    size_t n = 0;
+    single[n++] = '%';
+    std::memcpy(single + n, spec.flags, spec.flag_count);
+    n += spec.flag_count;
+    if (width >= 0) {
+      n += std::snprintf(single + n, sizeof(single) - n, "%d",
+                         static_cast<int>(width));
+    }
+    if (spec.arg_class == ArgClass::kString) {
+      n += std::snprintf(single + n, sizeof(single) - n, ".*s");
+    } else {
+      if (precision >= 0) {
+        n += std::snprintf(single + n, sizeof(single) - n, ".%d",
+                           static_cast<int>(precision));
+      }
+      if (spec.arg_class == ArgClass::kInt && spec.is_long_long) {
+        single[n++] = 'l';
+        single[n++] = 'l';
+      }
+      single[n++] =
+          spec.arg_class == ArgClass::kPointer ? 'x' : spec.conversion;
+      single[n] = '\0';
+    }
+
+    bool ok = true;
+    switch (spec.arg_class) {
+      case ArgClass::kInt:
+        if (spec.is_long_long) {
+          int64_t v;
+          if ((ok = reader.Read(v))) {
+            writer.Printf(single, static_cast<long long>(v));
+          }
+        } else {
+          int32_t v;
+          if ((ok = reader.Read(v))) {
+            writer.Printf(single, static_cast<int>(v));
+          }
+        }
+        break;
+      case ArgClass::kDouble: {
+        double v;
+        if ((ok = reader.Read(v))) {
+          writer.Printf(single, v);
+        }
+      } break;
+      case ArgClass::kPointer: {
+        uint32_t v;
+        if ((ok = reader.Read(v))) {
+          writer.Put('0');
+          writer.Put('x');
+          writer.Printf(single, static_cast<unsigned>(v));
+        }
+      } break;
+      case ArgClass::kString: {
+        uint8_t length;
+        const char* s = nullptr;
+        if ((ok = reader.Read(length) &&
+                  (s = reader.ReadBytes(length)) != nullptr)) {
+          const int shown =
+              precision >= 0 ? std::min<int>(precision, length) : length;
+          writer.Printf(single, shown, s);
+        }
+      } break;
+      default:
+        break;
+    }
+    if (!ok) {
+      break;
+    }
+  }
+  return writer.length();
+}
+
+size_t GetTextRecordSize(const uint8_t* data, const size_t size) {
+  const void* newline = std::memchr(data, '\n', size);
+  return newline ? static_cast<const uint8_t*>(newline) - data + 1 : 0;
+}
+
+size_t GetBinaryRecordSize(const uint8_t* data, const size_t size) {
+  RecordHeader header;
+  if (size < sizeof(header)) {
+    return 0;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  const size_t record_size = sizeof(header) + header.size;
+  return record_size <= size ? record_size : 0;
+}
+
+}  // namespace logging
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+#include "logging.hpp"
+
+namespace logging {
+
+// A text log record is "YYYY-MM-DD HH:MM:SS L message\n" where L is the
+// letter of the level, e.g. 'E' for Level::kError.
+char GetLevelLetter(Level level);
+bool ParseLevelLetter(char letter, Level* out);
+
+// Deferred formatting
+//
+// Instead of formatting a message, CaptureArgs() copies the raw arguments
+// referenced by a printf-style format into a byte buffer. The message is
+// identified by HashFormat(format) on flash and formatted later, either on the
+// device by FormatArgs() or on a host by tools/decode_log.py with the string
+// table generated by tools/gen_log_string_table.py.
+//
+// Argument encoding (little endian, no padding):
+//   d i o u x X c, '*'  int32 (int64 with the "ll" or "j" modifier)
+//   e E f F g G a A     double
+//   p                   uint32
+//   s                   uint8 length followed by the bytes (no terminator)
+
+uint32_t HashFormat(const char* format);  // FNV-1a
+
+// Returns the number of bytes written to `out`. Arguments which don't fit in
+// `capacity` are dropped and strings are truncated.
+size_t CaptureArgs(const char* format, va_list args, uint8_t* out,
+                   size_t capacity);
+
+// Formats like vsnprintf() but takes the arguments captured by CaptureArgs().
+// Returns the length of the text written to `out` (always null-terminated).
+size_t FormatArgs(const char* format, const uint8_t* args, size_t size,
+                  char* out, size_t len);
+
+// A binary log file is a sequence of RecordHeader followed by `size` bytes of
+// captured arguments.
+struct __attribute__((packed)) RecordHeader {
+  uint16_t size;
+  uint32_t time;  // seconds since the epoch
+  uint32_t format_id;
+  uint8_t level;  // Level
+};
+
+// Returns the size of the first record of concatenated records, e.g. the
+// contents of a compressed block, or 0 if it is truncated.
+size_t GetTextRecordSize(const uint8_t* data, size_t size);
+size_t GetBinaryRecordSize(const uint8_t* data, size_t size);
+
+}  // namespace logging
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace logging {
+
+// Bounded multi-producer multi-consumer ring of preallocated slots, based on
+// Dmitry Vyukov's bounded MPMC queue.
+//
+// A producer claims a slot with a single CAS, fills it in place and publishes
+// it. Producers never allocate and never wait for each other or for the
+// consumer; TryPush() just fails when every slot is in use.
+//
+// Usage:
+//
+//  logging::Ring<Slot, 64> ring;
+//  ring.TryPush([](Slot& slot) { ... });     // from any task
+//  ring.TryPop([](const Slot& slot) { ... });
+template <typename T, size_t kCapacity>
+class Ring {
+  static_assert(kCapacity >= 2 && (kCapacity & (kCapacity - 1)) == 0,
+                "kCapacity must be a power of two");
+
+ public:
+  Ring() {
+    for (size_t i = 0; i < kCapacity; ++i) {
+      cells_[i].sequence.store(static_cast<uint32_t>(i),
+                               std::memory_order_relaxed);
+    }
+  }
+
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  // `fill` is called with the claimed slot as `void(T&)`.
+  template <typename Fill>
+  bool TryPush(Fill&& fill) {
+    uint32_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & kMask];
+      const uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+      const int32_t diff = static_cast<int32_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    fill(cell->data);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // `consume` is called with the oldest published slot as `void(const T&)`.
+  template <typename Consume>
+  bool TryPop(Consume&& consume) {
+    uint32_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &cells_[pos & kMask];
+      const uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+      const int32_t diff = static_cast<int32_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;  // empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    consume(static_cast<const T&>(cell->data));
+    cell->sequence.store(pos + static_cast<uint32_t>(kCapacity),
+                         std::memory_order_release);
+    return true;
+  }
+
+ private:
+  static constexpr uint32_t kMask = static_cast<uint32_t>(kCapacity - 1);
+
+  struct Cell {
+    std::atomic<uint32_t> sequence;
+    T data;
+  };
+
+  Cell cells_[kCapacity];
+  std::atomic<uint32_t> enqueue_pos_{0};
+  std::atomic<uint32_t> dequeue_pos_{0};
+};
+
+}  // namespace logging
@@ -0,0 +1,341 @@
+#include "log_shipper.hpp"
+
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+
+#include <freertos/ringbuf.h>
+
+#include "log_syslog.hpp"
+#include "logging.hpp"
+#include "mutex.hpp"
+
+namespace logging {
+
+// Lines wait here between the writer task and the shipper task. They are
+// dropped when it is full, so logging never waits for the network.
+constexpr size_t kQueueBytes = 4 * 1024;
+// Lines are sent in batches of entries of a uint16 length followed by the
+// line. The spool file is a sequence of the same entries.
+constexpr size_t kMaxBatchBytes = 1024;
+constexpr size_t kMaxLineSize = 256;
+constexpr size_t kMaxMessageSize = 384;
+constexpr size_t kTcpBufferSize = 1460;  // one TCP segment
+constexpr char kSpoolPath[] = "/syslog.spool";
+// How much of the spool has been sent, so that it is not sent again after a
+// reboot
+constexpr char kSpoolPositionPath[] = "/syslog.pos";
+constexpr size_t kMaxSpoolBytes = 64 * 1024;
+// After the first line of a batch, wait this long for more lines.
+constexpr uint32_t kBatchWindowMsec = 100;
+constexpr uint32_t kIdlePollMsec = 1000;
+constexpr uint32_t kRetryIntervalMsec = 10 * 1000;
+constexpr int32_t kConnectTimeoutMsec = 2000;
+// Spooled batches sent per loop, so that the queue is drained meanwhile
+constexpr int kMaxReplayBatchesPerLoop = 8;
+constexpr int kShipperTaskPriority = 1;
+
+struct Destination {
+  String host;
+  uint16_t port;
+  bool use_tcp;
+};
+
+static kb::Mutex g_shipper_mutex;
+static Destination g_destination;  // guard by g_shipper_mutex
+// Created with the shipper task by the first SetShipperDestination() with a
+// host. guard by g_shipper_mutex (read by OnLogLine() once it is added)
+static RingbufHandle_t g_queue = nullptr;
+static std::atomic<uint32_t> g_sent_count{0};
+static std::atomic<uint32_t> g_dropped_count{0};
+static std::atomic<size_t> g_spooled_bytes{0};
+
+// Used only by the shipper task
+static WiFiUDP g_udp;
+static WiFiClient g_tcp;
+static bool g_is_unreachable = false;
+static uint32_t g_last_failure_time = 0;
+static size_t g_spool_read_pos = 0;
+static uint8_t g_batch[kMaxBatchBytes];
+static char g_tcp_buffer[kTcpBufferSize];
+
+// logging::LineListener called from the writer task
+static void OnLogLine(const char* line, const size_t length) {
+  if (xRingbufferSend(g_queue, line, std::min(length, kMaxLineSize), 0) !=
+      pdTRUE) {
+    g_dropped_count.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Calls `on_line` as `void(const char* line, size_t length)` for each entry.
+// Returns the size of the whole entries.
+template <typename OnLine>
+static size_t ForEachEntry(const uint8_t* batch, const size_t size,
+                           OnLine&& on_line) {
+  size_t pos = 0;
+  while (pos + sizeof(uint16_t) <= size) {
+    uint16_t length;
+    std::memcpy(&length, batch + pos, sizeof(length));
+    if (pos + sizeof(length) + length > size) {
+      break;
+    }
+    on_line(reinterpret_cast<const char*>(batch + pos + sizeof(length)),
+            static_cast<size_t>(length));
+    pos += sizeof(length) + length;
+  }
+  return pos;
+}
+
+// Waits for a line and gathers the lines following it into g_batch.
+static size_t CollectBatch() {
+  size_t used = 0;
+  TickType_t wait = pdMS_TO_TICKS(kIdlePollMsec);
+  while (used + sizeof(uint16_t) + kMaxLineSize <= sizeof(g_batch)) {
+    size_t length = 0;
+    void* item = xRingbufferReceive(g_queue, &length, wait);
+    if (item == nullptr) {
+      break;
+    }
+    const uint16_t n = static_cast<uint16_t>(length);
+    std::memcpy(g_batch + used, &n, sizeof(n));
+    std::memcpy(g_batch + used + sizeof(n), item, n);
+    used += sizeof(n) + n;
+    vRingbufferReturnItem(g_queue, item);
+    wait = pdMS_TO_TICKS(kBatchWindowMsec);
+  }
+  return used;
+}
+
+// "+09:00" for JST
+static void GetUtcOffset(char* out, const size_t len) {
+  const time_t now = time(nullptr);
+  struct tm timeinfo;
+  localtime_r(&now, &timeinfo);
+  char offset[8];
+  if (strftime(offset, sizeof(offset), "%z", &timeinfo) != 5) {
+    snprintf(out, len, "Z");
+    return;
+  }
+  snprintf(out, len, "%.3s:%.2s", offset, offset + 3);
+}
+
+static bool MarkUnreachable() {
+  g_is_unreachable = true;
+  g_last_failure_time = millis();
+  g_tcp.stop();
+  return false;
+}
+
+// Returns false if the collector is unreachable. Some of the messages may
+// have been sent then, so a retry can duplicate them.
+static bool SendBatch(const Destination& destination, const uint8_t* batch,
+                      const size_t size) {
+  if (WiFi.status() != WL_CONNECTED) {
+    return false;
+  }
+  if (g_is_unreachable &&
+      millis() - g_last_failure_time < kRetryIntervalMsec) {
+    return false;
+  }
+  if (destination.use_tcp && !g_tcp.connected()) {
+    g_tcp.stop();
+    if (!g_tcp.connect(destination.host.c_str(), destination.port,
+                       kConnectTimeoutMsec)) {
+      Serial.printf("syslog: Failed to connect to %s:%u\n",
+                    destination.host.c_str(), destination.port);
+      return MarkUnreachable();
+    }
+  }
+  char utc_offset[8];
+  GetUtcOffset(utc_offset, sizeof(utc_offset));
+  const char* hostname = WiFi.getHostname();
+
+  bool ok = true;
+  uint32_t count = 0;
+  size_t tcp_used = 0;
+  const auto flush_tcp = [&tcp_used]() {
+    const bool written =
+        g_tcp.write(reinterpret_cast<const uint8_t*>(g_tcp_buffer),
+                    tcp_used) == tcp_used;
+    tcp_used = 0;
+    return written;
+  };
+  ForEachEntry(batch, size, [&](const char* line, const size_t length) {
+    char message[kMaxMessageSize];
+    const size_t n = FormatSyslogMessage(line, length, hostname, utc_offset,
+                                         message, sizeof(message));
+    if (!ok || n == 0) {
+      return;
+    }
+    if (destination.use_tcp) {
+      char prefix[8];
+      const size_t prefix_size = snprintf(prefix, sizeof(prefix), "%u ",
+                                          static_cast<unsigned>(n));
+      if (tcp_used + prefix_size + n > sizeof(g_tcp_buffer)) {
+        ok = flush_tcp();
+      }
+      std::memcpy(g_tcp_buffer + tcp_used, prefix, prefix_size);
+      std::memcpy(g_tcp_buffer + tcp_used + prefix_size, message, n);
+      tcp_used += prefix_size + n;
+    } else {
+      ok = g_udp.beginPacket(destination.host.c_str(), destination.port) &&
+           g_udp.write(reinterpret_cast<const uint8_t*>(message), n) == n &&
+           g_udp.endPacket();
+    }
+    count += ok ? 1 : 0;
+  });
+  if (ok && tcp_used > 0) {
+    ok = flush_tcp();
+  }
+  if (!ok) {
+    return MarkUnreachable();
+  }
+  g_is_unreachable = false;
+  g_sent_count.fetch_add(count, std::memory_order_relaxed);
+  return true;
+}
+
+static void AppendToSpool(const uint8_t* batch, const size_t size) {
+  if (g_spooled_bytes.load() + size > kMaxSpoolBytes) {
+    ForEachEntry(batch, size, [](const char*, size_t) {
+      g_dropped_count.fetch_add(1, std::memory_order_relaxed);
+    });
+    return;
+  }
+  File file = SPIFFS.open(kSpoolPath, "a");
+  if (!file || file.write(batch, size) != size) {
+    Serial.println("syslog: Failed to write the spool");
+    return;
+  }
+  g_spooled_bytes += size;
+}
+
+static void ClearSpool() {
+  SPIFFS.remove(kSpoolPath);
+  SPIFFS.remove(kSpoolPositionPath);
+  g_spool_read_pos = 0;
+  g_spooled_bytes = 0;
+}
+
+static void SaveSpoolPosition() {
+  File file = SPIFFS.open(kSpoolPositionPath, "w");
+  char line[16];
+  const int n = snprintf(line, sizeof(line), "%u\n",
+                         static_cast<unsigned>(g_spool_read_pos));
+  if (!file ||
+      file.write(reinterpret_cast<const uint8_t*>(line), n) !=
+          static_cast<size_t>(n)) {
+    Serial.println("syslog: Failed to save the spool position");
+  }
+}
+
+// Resumes the spool left by the previous boot after the part already sent
+static void LoadSpool() {
+  if (!SPIFFS.exists(kSpoolPath)) {
+    return;
+  }
+  File file = SPIFFS.open(kSpoolPath, "r");
+  const size_t size = file ? file.size() : 0;
+  file.close();
+  unsigned pos = 0;
+  File position = SPIFFS.open(kSpoolPositionPath, "r");
+  if (position) {
+    const String line = position.readStringUntil('\n');
+    if (sscanf(line.c_str(), "%u", &pos) != 1) {
+      pos = 0;
+    }
+  }
+  if (pos >= size) {
+    ClearSpool();
+    return;
+  }
+  g_spool_read_pos = pos;
+  g_spooled_bytes = size - pos;
+}
+
+// Sends the next batch from the spool. Returns false if nothing was sent.
+static bool ReplaySpool(const Destination& destination) {
+  File file = SPIFFS.open(kSpoolPath, "r");
+  if (!file || !file.seek(g_spool_read_pos)) {
+    ClearSpool();
+    return false;
+  }
+  const size_t size =
+      ForEachEntry(g_batch, file.read(g_batch, sizeof(g_batch)),
+                   [](const char*, size_t) {});
+  file.close();
+  if (size == 0) {
+    ClearSpool();  // at the end, or a torn entry
+    return false;
+  }
+  if (!SendBatch(destination, g_batch, size)) {
+    return false;
+  }
+  g_spool_read_pos += size;
+  g_spooled_bytes -= std::min(g_spooled_bytes.load(), size);
+  if (g_spooled_bytes == 0) {
+    ClearSpool();
+  } else {
+    SaveSpoolPosition();
+  }
+  return true;
+}
+
+static void RunShipperTask(void*) {
+  LoadSpool();
+  while (true) {
+    const size_t size = CollectBatch();
+    Destination destination;
+    {
+      const kb::LockGuard lock(g_shipper_mutex);
+      destination = g_destination;
+    }
+    if (destination.host.isEmpty()) {
+      g_tcp.stop();
+      continue;
+    }
+    // Keep the order: new lines wait behind the spooled ones.
+    if (size > 0 && (g_spooled_bytes > 0 ||
+                     !SendBatch(destination, g_batch, size))) {
+      AppendToSpool(g_batch, size);
+    }
+    for (int i = 0; i < kMaxReplayBatchesPerLoop && g_spooled_bytes > 0 &&
+                    ReplaySpool(destination);
+         ++i) {
+    }
+  }
+}
+
+void SetShipperDestination(const String& host, const uint16_t port,
+                           const bool use_tcp) {
+  const kb::LockGuard lock(g_shipper_mutex);
+  g_destination = Destination{host, port, use_tcp};
+  if (host.isEmpty()) {
+    RemoveLineListener(OnLogLine);
+    return;
+  }
+  // Under the lock, so that concurrent calls (setup() and PUT /config/syslog)
+  // don't start two shipper tasks
+  if (g_queue == nullptr) {
+    g_queue = xRingbufferCreate(kQueueBytes, RINGBUF_TYPE_NOSPLIT);
+    if (g_queue == nullptr) {
+      Serial.println("syslog: Failed to create the queue");
+      return;
+    }
+    xTaskCreate(RunShipperTask, "LogShipper", 4 * 1024, nullptr,
+                kShipperTaskPriority, nullptr);
+  }
+  Serial.printf("syslog: Shipping logs to %s:%u (%s)\n", host.c_str(), port,
+                use_tcp ? "tcp" : "udp");
+  AddLineListener(OnLogLine);
+}
+
+ShipperStats GetShipperStats() {
+  return ShipperStats{g_sent_count.load(), g_dropped_count.load(),
+                      g_spooled_bytes.load()};
+}
+
+}  // namespace logging
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+
+namespace logging {
+
+// Ships log records to a syslog collector (see log_syslog.hpp) over UDP
+// (RFC 5426, one message per datagram) or TCP (RFC 6587 octet counting, a
+// batch of messages per write). Records which can't be sent, e.g. while Wi-Fi
+// is down or the TCP collector is unreachable, are spooled to flash up to a
+// fixed size and sent in order once the collector is back. UDP can't tell if
+// the collector is up, so use TCP where losing records matters.
+
+struct ShipperStats {
+  uint32_t sent_count;
+  uint32_t dropped_count;  // the queue or the spool was full
+  size_t spooled_bytes;
+};
+
+// Starts shipping the records logged from now on, or stops it if `host` is
+// empty. Can be called again to change the destination.
+void SetShipperDestination(const String& host, uint16_t port, bool use_tcp);
+ShipperStats GetShipperStats();
+
+}  // namespace logging
@@ -0,0 +1,57 @@
+#include "log_syslog.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "log_query.hpp"
+
+namespace logging {
+
+namespace {
+
+// RFC 5424 severities
+int GetSeverity(const Level level) {
+  switch (level) {
+    case Level::kError:
+      return 3;
+    case Level::kWarn:
+      return 4;
+    case Level::kInfo:
+      return 6;
+    case Level::kDebug:
+      return 7;
+    default:
+      return 5;  // notice
+  }
+}
+
+bool IsAscii(const char* text, const size_t length) {
+  return std::none_of(text, text + length,
+                      [](char c) { return static_cast<uint8_t>(c) >= 0x80; });
+}
+
+}  // namespace
+
+size_t FormatSyslogMessage(const char* line, const size_t length,
+                           const char* hostname, const char* utc_offset,
+                           char* out, const size_t len) {
+  QueryRecord record;
+  if (len == 0 || !ParseTextRecord(line, length, &record)) {
+    return 0;
+  }
+  // "YYYY-MM-DD HH:MM:SS" to "YYYY-MM-DDTHH:MM:SS"
+  record.date[10] = 'T';
+  // The message may be Japanese. The BOM tells the collector it is UTF-8.
+  const char* bom = IsAscii(record.message, record.message_length)
+                        ? ""
+                        : "\xef\xbb\xbf";
+  const int n = snprintf(
+      out, len, "<%d>1 %s%s %s %s - - - %s%.*s",
+      kSyslogFacility * 8 + GetSeverity(record.level), record.date,
+      utc_offset, hostname && hostname[0] ? hostname : "-", kSyslogAppName,
+      bom, static_cast<int>(record.message_length), record.message);
+  return n > 0 ? std::min(static_cast<size_t>(n), len - 1) : 0;
+}
+
+}  // namespace logging
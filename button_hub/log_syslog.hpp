@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace logging {
+
+// Syslog messages (RFC 5424)
+//
+// A log line "YYYY-MM-DD HH:MM:SS L message" (see LineListener) is sent as
+//
+//   <PRI>1 YYYY-MM-DDTHH:MM:SS+09:00 HOSTNAME button_hub - - - message
+//
+// with the facility local0 and the severity of the level.
+
+constexpr char kSyslogAppName[] = "button_hub";
+constexpr int kSyslogFacility = 16;  // local0
+
+// `utc_offset` is "+hh:mm" or "-hh:mm". `hostname` may be null or empty, e.g.
+// before Wi-Fi starts, and is sent as "-" then. Returns the length of the message
+// written to `out` (null-terminated and truncated to `len`), or 0 if the line
+// is malformed.
+size_t FormatSyslogMessage(const char* line, size_t length,
+                           const char* hostname, const char* utc_offset,
+                           char* out, size_t len);
+
+}  // namespace logging
@@ -2,134 +2,697 @@
 
 #include <FS.h>
 #include <SPIFFS.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
-#include <deque>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <memory>
 #include <vector>
 
+#include "log_deflate.hpp"
+#include "log_frame.hpp"
+#include "log_reader.hpp"
+#include "log_record.hpp"
+#include "log_ring.hpp"
 #include "mutex.hpp"
 
 namespace logging {
 
-constexpr int kMaxLogFileCount = 30;
+#ifdef KB_LOG_DEFERRED_FORMAT
+// Log files hold RecordHeader and the raw arguments instead of text. Decode
+// them with tools/decode_log.py. See log_record.hpp.
+constexpr char kLogFileExtension[] = ".bin";
+#else
+constexpr char kLogFileExtension[] = ".txt";
+#endif
 
-static String g_filename;
+// Logs are written to numbered segments of up to kMaxSegmentBytes, and the
+// oldest segments are removed so that they never use more than
+// kMaxLogBytes of flash. The range of existing segment numbers is kept in
+// kSegmentIndexPath so that the directory doesn't have to be scanned.
+constexpr size_t kMaxSegmentBytes = 32 * 1024;
+constexpr size_t kMaxLogBytes = 1024 * 1024;
+constexpr char kSegmentIndexPath[] = "/segments.idx";
+// The range of the record times of each closed segment, one "number min max"
+// line per segment, so that queries can skip segments without reading them.
+// Times are not in order across segments, e.g. records written before the
+// clock is set are dated 1970.
+constexpr char kSegmentTimesPath[] = "/segtimes.idx";
 
-static kb::Mutex g_mutex;
-static std::deque<String> g_queue;  // guard by g_mutex
+// Records are written uncompressed so that each of them is on flash within
+// kFlushIntervalMsec. Once a segment is closed, the writer task compacts it
+// into compressed blocks through kCompactionPath, which keeps several times
+// more history in kMaxLogBytes. See log_frame.hpp.
+constexpr char kCompactionPath[] = "/compact.tmp";
 
-static String GenDateTime() {
+// Messages (or captured arguments) longer than this are truncated.
+constexpr size_t kSlotDataSize = 192;
+constexpr size_t kSlotCount = 64;
+
+// Lines are gathered into a buffer of this size and written to SPIFFS in one
+// go instead of one small write per line.
+constexpr size_t kWriteBufferSize = 1024;
+// The file is flushed when this much data is pending or after the interval.
+constexpr size_t kFlushThresholdBytes = 4 * 1024;
+constexpr uint32_t kFlushIntervalMsec = 2 * 1000;
+constexpr int kWriterPollIntervalMsec = 500;
+constexpr int kWriterTaskPriority = 1;
+
+struct SegmentTimes {
+  int number;
+  uint32_t min_time;
+  uint32_t max_time;
+};
+
+struct Slot {
+  int64_t timestamp_us;  // esp_timer_get_time()
+  Level level;
+  const char* format;
+  uint16_t length;
+  char data[kSlotDataSize];  // text, or arguments captured by CaptureArgs()
+};
+
+static Ring<Slot, kSlotCount> g_ring;
+static std::atomic<uint32_t> g_dropped_count{0};
+
+static kb::Mutex g_file_mutex;
+static File g_file;                            // guard by g_file_mutex
+static String g_segment_path;                  // guard by g_file_mutex
+static size_t g_segment_size = 0;              // guard by g_file_mutex
+static int g_first_segment = 1;                // guard by g_file_mutex
+static int g_last_segment = 0;                 // guard by g_file_mutex
+// Size of the segments before the current one. Segments removed through the
+// HTTP API are still counted until the next boot.
+static size_t g_closed_segment_bytes = 0;      // guard by g_file_mutex
+// Closed segment waiting for compaction, or 0
+static int g_segment_to_compact = 0;           // guard by g_file_mutex
+static char g_write_buffer[kWriteBufferSize];  // guard by g_file_mutex
+static size_t g_write_buffer_used = 0;         // guard by g_file_mutex
+static size_t g_unflushed_bytes = 0;           // guard by g_file_mutex
+static std::vector<SegmentTimes> g_segment_times;  // guard by g_file_mutex
+// The range of the current segment is known unless it has records from before
+// this boot. guard by g_file_mutex
+static bool g_has_segment_times = false;
+static uint32_t g_segment_min_time = std::numeric_limits<uint32_t>::max();
+static uint32_t g_segment_max_time = 0;
+static uint32_t g_last_flush_time = 0;         // guard by g_file_mutex
+static TaskHandle_t g_writer_task_handle = nullptr;
+static std::atomic<LineListener> g_line_listeners[kMaxLineListeners] = {};
+
+// The slot has a monotonic timestamp. Convert it to the wall clock time here
+// so that the producers don't need to call getLocalTime().
+static time_t ToWallClock(const int64_t timestamp_us) {
+  const int64_t age_sec = (esp_timer_get_time() - timestamp_us) / 1000000;
+  return time(nullptr) - static_cast<time_t>(age_sec);
+}
+
+static size_t FormatDateTime(const time_t t, char* out, const size_t len) {
   struct tm timeinfo;
-  getLocalTime(&timeinfo, 10);
-  char out[20];
-  sprintf(out, "%04d-%02d-%02d %02d:%02d:%02d", timeinfo.tm_year + 1900,
-          timeinfo.tm_mon + 1, timeinfo.tm_mday, timeinfo.tm_hour,
-          timeinfo.tm_min, timeinfo.tm_sec);
-  return out;
+  localtime_r(&t, &timeinfo);
+  const int written =
+      snprintf(out, len, "%04d-%02d-%02d %02d:%02d:%02d ",
+               timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
+               timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+  return written > 0 ? std::min(static_cast<size_t>(written), len - 1) : 0;
+}
+
+static String GetSegmentPath(const int number) {
+  char buf[16];
+  GetSegmentPath(number, buf, sizeof(buf));
+  return buf;
+}
+
+static bool LoadSegmentIndex() {
+  File file = SPIFFS.open(kSegmentIndexPath, "r");
+  if (!file) {
+    return false;
+  }
+  const String line = file.readStringUntil('\n');
+  return sscanf(line.c_str(), "%d %d", &g_first_segment, &g_last_segment) ==
+             2 &&
+         g_first_segment <= g_last_segment + 1;
+}
+
+static void LoadSegmentTimes() {
+  File file = SPIFFS.open(kSegmentTimesPath, "r");
+  if (!file) {
+    return;
+  }
+  while (file.available()) {
+    const String line = file.readStringUntil('\n');
+    SegmentTimes times;
+    unsigned min_time;
+    unsigned max_time;
+    if (sscanf(line.c_str(), "%d %u %u", &times.number, &min_time,
+               &max_time) == 3) {
+      times.min_time = min_time;
+      times.max_time = max_time;
+      g_segment_times.push_back(times);
+    }
+  }
+}
+
+// Records the range of the segment being closed and forgets removed ones
+static void SaveSegmentTimesLocked(const int closed_segment) {
+  if (g_has_segment_times && g_segment_min_time <= g_segment_max_time) {
+    g_segment_times.push_back(
+        SegmentTimes{closed_segment, g_segment_min_time, g_segment_max_time});
+  }
+  g_segment_times.erase(
+      std::remove_if(g_segment_times.begin(), g_segment_times.end(),
+                     [](const SegmentTimes& times) {
+                       return times.number < g_first_segment;
+                     }),
+      g_segment_times.end());
+  File file = SPIFFS.open(kSegmentTimesPath, "w");
+  if (!file) {
+    Serial.println("logging: Failed to save the segment times");
+    return;
+  }
+  for (const SegmentTimes& times : g_segment_times) {
+    char line[40];
+    const int n = snprintf(line, sizeof(line), "%d %u %u\n", times.number,
+                           static_cast<unsigned>(times.min_time),
+                           static_cast<unsigned>(times.max_time));
+    file.write(reinterpret_cast<const uint8_t*>(line), n);
+  }
 }
 
-void RemoveOldLogsKeepingLastNItems(int size) {
-  constexpr char kDir[] = "/";
-  File root = SPIFFS.open(kDir);
+static void SaveSegmentIndexLocked() {
+  File file = SPIFFS.open(kSegmentIndexPath, "w");
+  char line[24];
+  const int n =
+      snprintf(line, sizeof(line), "%d %d\n", g_first_segment, g_last_segment);
+  if (!file ||
+      file.write(reinterpret_cast<const uint8_t*>(line), n) !=
+          static_cast<size_t>(n)) {
+    Serial.println("logging: Failed to save the segment index");
+  }
+}
+
+// Only used when there is no index, i.e. on the first boot after an update
+// from the one-file-per-boot logs whose numbers were the boot IDs.
+static void ScanSegments() {
+  File root = SPIFFS.open("/");
   if (!root || !root.isDirectory()) {
     Serial.println("Failed to open directory");
     return;
   }
-
-  std::vector<String> file_names;
+  int first = 0;
+  int last = 0;
   for (File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
-    String name = entry.name();
-    if (name.startsWith("log") && name.endsWith(".txt")) {
-      file_names.push_back(std::move(name));
+    const String name = entry.name();
+    int number;
+    if (name.endsWith(kLogFileExtension) &&
+        sscanf(name.c_str(), "log%d", &number) == 1) {
+      first = first == 0 ? number : std::min(first, number);
+      last = std::max(last, number);
+    }
+  }
+  g_first_segment = first == 0 ? 1 : first;
+  g_last_segment = last;
+}
+
+static size_t GetFileSize(const String& path) {
+  if (!SPIFFS.exists(path)) {
+    return 0;
+  }
+  File file = SPIFFS.open(path, "r");
+  return file ? file.size() : 0;
+}
+
+static void SumClosedSegmentBytesLocked() {
+  g_closed_segment_bytes = 0;
+  for (int number = g_first_segment; number < g_last_segment; ++number) {
+    g_closed_segment_bytes += GetFileSize(GetSegmentPath(number));
+  }
+}
+
+// Makes room for a full current segment
+static void RemoveOldSegmentsLocked() {
+  while (g_first_segment < g_last_segment &&
+         g_closed_segment_bytes + kMaxSegmentBytes > kMaxLogBytes) {
+    const String path = GetSegmentPath(g_first_segment++);
+    // It may have been removed through the HTTP API or never existed.
+    const size_t size = GetFileSize(path);
+    if (size > 0) {
+      Serial.printf("Removing %s\n", path.c_str());
+      g_closed_segment_bytes -= std::min(g_closed_segment_bytes, size);
+      SPIFFS.remove(path);
     }
   }
+}
 
-  std::sort(file_names.begin(), file_names.end());
-  while (file_names.size() > size) {
-    const String& name = file_names.front();
-    Serial.printf("Removing %s%s\n", kDir, name.c_str());
-    if (!SPIFFS.remove(kDir + name)) {
-      Serial.printf("Failed to remove %s%s\n", kDir, name.c_str());
+static void OpenNewSegmentLocked() {
+  g_file.close();
+  const int closed_segment = g_last_segment;
+  if (g_first_segment <= g_last_segment) {
+    g_closed_segment_bytes += g_segment_size;
+    g_segment_to_compact = g_last_segment;
+  }
+  g_segment_path = GetSegmentPath(++g_last_segment);
+  g_segment_size = 0;
+  RemoveOldSegmentsLocked();
+  SaveSegmentIndexLocked();
+  SaveSegmentTimesLocked(closed_segment);
+  g_has_segment_times = true;
+  g_segment_min_time = std::numeric_limits<uint32_t>::max();
+  g_segment_max_time = 0;
+  g_file = SPIFFS.open(g_segment_path, "a");
+  Serial.printf("Logging to %s\n", g_segment_path.c_str());
+}
+
+static void WriteBufferLocked() {
+  if (g_write_buffer_used == 0) {
+    return;
+  }
+  if (!g_file && !g_segment_path.isEmpty()) {
+    g_file = SPIFFS.open(g_segment_path, "a");
+  }
+  if (g_file) {
+    const size_t written = g_file.write(
+        reinterpret_cast<const uint8_t*>(g_write_buffer), g_write_buffer_used);
+    if (written != g_write_buffer_used) {
+      // The file may have been removed. Reopen it at the next write.
+      Serial.println("logging: Failed to write");
+      g_file.close();
     }
-    file_names.erase(file_names.begin());
+    g_unflushed_bytes += g_write_buffer_used;
+  } else {
+    Serial.println("logging: File is not opened");
   }
+  g_write_buffer_used = 0;
 }
 
-void Begin(int log_unique_id) {
-  RemoveOldLogsKeepingLastNItems(kMaxLogFileCount);
+static void FlushFileLocked() {
+  WriteBufferLocked();
+  if (g_file && g_unflushed_bytes > 0) {
+    g_file.flush();
+  }
+  g_unflushed_bytes = 0;
+  g_last_flush_time = millis();
+}
 
-  char buf[16];
-  snprintf(buf, sizeof(buf), "/log%05d.txt", log_unique_id);
-  g_filename = buf;
+static void AppendLocked(const char* data, size_t remaining) {
+  while (remaining > 0) {
+    const size_t n =
+        std::min(remaining, kWriteBufferSize - g_write_buffer_used);
+    std::memcpy(g_write_buffer + g_write_buffer_used, data, n);
+    g_write_buffer_used += n;
+    data += n;
+    remaining -= n;
+    if (g_write_buffer_used == kWriteBufferSize) {
+      WriteBufferLocked();
+    }
+  }
+}
 
-  Serial.printf("Logging to %s\n", g_filename.c_str());
+static void FillSlot(Slot& slot, const int64_t timestamp_us, const Level level,
+                     const char* format, va_list args) {
+  slot.timestamp_us = timestamp_us;
+  slot.level = level;
+  slot.format = format;
+#ifdef KB_LOG_DEFERRED_FORMAT
+  slot.length = CaptureArgs(format, args, reinterpret_cast<uint8_t*>(slot.data),
+                            sizeof(slot.data));
+#else
+  const int needed = vsnprintf(slot.data, sizeof(slot.data), format, args);
+  if (needed < 0) {
+    slot.length = 0;
+  } else if (static_cast<size_t>(needed) < sizeof(slot.data)) {
+    slot.length = static_cast<uint16_t>(needed);
+  } else {
+    slot.length = sizeof(slot.data) - 1;
+    std::memcpy(&slot.data[slot.length - 3], "...", 3);
+  }
+#endif
 }
 
-void Log(const char* format, ...) {
-  // Minimize memory allocation as much as possible
-  int needed = 0;
-  {
-    va_list args;
-    va_start(args, format);
-    needed = vsnprintf(nullptr, 0, format, args);
-    va_end(args);
+static void FillSlotf(Slot& slot, const int64_t timestamp_us,
+                      const Level level, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  FillSlot(slot, timestamp_us, level, format, args);
+  va_end(args);
+}
+
+static bool HasLineListener() {
+  for (const std::atomic<LineListener>& slot : g_line_listeners) {
+    if (slot.load()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Passes the message to the line listeners and echoes it to Serial if
+// `echo` is true
+static void PublishLine(const char* header, const size_t header_size,
+                        const char* text, const size_t length,
+                        const bool echo) {
+  // Send the line at once so that it is not interleaved with other output
+  char line[32 + kSlotDataSize];
+  const size_t n = std::min(header_size + length, sizeof(line) - 1);
+  std::memcpy(line, header, header_size);
+  std::memcpy(line + header_size, text, n - header_size);
+  for (const std::atomic<LineListener>& slot : g_line_listeners) {
+    const LineListener listener = slot.load();
+    if (listener) {
+      listener(line, n);
+    }
+  }
+  if (echo) {
+    line[n] = '\n';
+    WriteToSerial(line, n + 1);
+  }
+}
+
+#ifdef KB_LOG_DEFERRED_FORMAT
+// Echoes a binary record to Serial as '#' and the record in hex, which
+// tools/decode_log.py --console turns into text on the host.
+static void EchoRecord(const char* record, const size_t size) {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  char line[1 + 2 * (sizeof(RecordHeader) + kSlotDataSize) + 1];
+  size_t n = 0;
+  line[n++] = '#';
+  for (size_t i = 0; i < size && n + 3 <= sizeof(line); ++i) {
+    const uint8_t byte = static_cast<uint8_t>(record[i]);
+    line[n++] = kDigits[byte >> 4];
+    line[n++] = kDigits[byte & 0x0f];
   }
-  if (needed <= 0) {
+  line[n++] = '\n';
+  WriteToSerial(line, n);
+}
+#endif
+
+// Appends one record. A new segment is started when it doesn't fit in the
+// current one, so that a record never spans two segments.
+static void AppendFrameLocked(const char* payload, const size_t length) {
+  const FrameHeader frame =
+      MakeFrameHeader(payload, static_cast<uint16_t>(length));
+  const size_t frame_size = sizeof(frame) + length;
+  if (g_segment_size + frame_size > kMaxSegmentBytes) {
+    FlushFileLocked();
+    OpenNewSegmentLocked();
+  }
+  AppendLocked(reinterpret_cast<const char*>(&frame), sizeof(frame));
+  AppendLocked(payload, length);
+  g_segment_size += frame_size;
+}
+
+// "YYYY-MM-DD HH:MM:SS L " of a text record
+static size_t FormatRecordHeader(const time_t t, const Level level, char* out,
+                                 const size_t len) {
+  size_t n = FormatDateTime(t, out, len - 2);
+  out[n++] = GetLevelLetter(level);
+  out[n++] = ' ';
+  return n;
+}
+
+static void AppendSlotLocked(const Slot& slot) {
+  const time_t t = ToWallClock(slot.timestamp_us);
+  char header[24];
+  static_assert(sizeof(header) + kSlotDataSize + 1 <= kMaxFramePayloadSize,
+                "A record must fit in a frame");
+  char payload[kMaxFramePayloadSize];
+#ifdef KB_LOG_DEFERRED_FORMAT
+  const RecordHeader record{slot.length, static_cast<uint32_t>(t),
+                            HashFormat(slot.format),
+                            static_cast<uint8_t>(slot.level)};
+  std::memcpy(payload, &record, sizeof(record));
+  std::memcpy(payload + sizeof(record), slot.data, slot.length);
+  AppendFrameLocked(payload, sizeof(record) + slot.length);
+  EchoRecord(payload, sizeof(record) + slot.length);
+
+  // Only the live log and the syslog shipper need the text, and only while
+  // they are active.
+  if (HasLineListener()) {
+    const size_t header_size =
+        FormatRecordHeader(t, slot.level, header, sizeof(header));
+    char text[kSlotDataSize];
+    const size_t length =
+        FormatArgs(slot.format, reinterpret_cast<const uint8_t*>(slot.data),
+                   slot.length, text, sizeof(text));
+    PublishLine(header, header_size, text, length, false);
+  }
+#else
+  const size_t header_size =
+      FormatRecordHeader(t, slot.level, header, sizeof(header));
+  std::memcpy(payload, header, header_size);
+  std::memcpy(payload + header_size, slot.data, slot.length);
+  payload[header_size + slot.length] = '\n';
+  AppendFrameLocked(payload, header_size + slot.length + 1);
+  PublishLine(header, header_size, slot.data, slot.length, true);
+#endif
+  // After AppendFrameLocked(), which may have started a new segment
+  g_segment_min_time = std::min(g_segment_min_time, static_cast<uint32_t>(t));
+  g_segment_max_time = std::max(g_segment_max_time, static_cast<uint32_t>(t));
+}
+
+// A compaction interrupted by a power loss between removing the segment and
+// renaming kCompactionPath to it. Only the segment before the current one can
+// be compacted.
+static void RecoverCompactionLocked() {
+  if (!SPIFFS.exists(kCompactionPath)) {
     return;
   }
+  const String path = GetSegmentPath(g_last_segment - 1);
+  if (g_first_segment < g_last_segment && !SPIFFS.exists(path)) {
+    SPIFFS.rename(kCompactionPath, path);
+  } else {
+    SPIFFS.remove(kCompactionPath);
+  }
+}
 
-  String line;
-  int header_size = 0;
-  {
-    const String date = GenDateTime();
-    header_size = static_cast<int>(date.length()) + 1;  // +1 for space
-
-    // Pre-allocate buffer (+2 for \n and \0)
-    line.reserve(header_size + needed + 2);
-    line += date;
-    line += ' ';
-    for (int i = 0; i < needed; i++) {
-      line += '_';  // this will be overwritten
+struct Compaction {
+  BlockDeflater deflater;
+  uint8_t block[kMaxBlockSize];
+  size_t block_size = 0;
+  uint8_t payload[kMaxBlockFramePayloadSize];
+  File file;
+  size_t file_size = 0;
+  bool ok = true;
+
+  void WriteBlock() {
+    if (block_size == 0) {
+      return;
     }
+    const BlockHeader header{Adler32(block, block_size),
+                             static_cast<uint16_t>(block_size)};
+    std::memcpy(payload, &header, sizeof(header));
+    const size_t length =
+        sizeof(header) +
+        deflater.Deflate(block, block_size, payload + sizeof(header));
+    const FrameHeader frame = MakeFrameHeader(
+        payload, static_cast<uint16_t>(length), kBlockFrameMagic);
+    ok = ok &&
+         file.write(reinterpret_cast<const uint8_t*>(&frame), sizeof(frame)) ==
+             sizeof(frame) &&
+         file.write(payload, length) == length;
+    file_size += sizeof(frame) + length;
+    block_size = 0;
   }
+};
 
-  {
-    va_list args;
-    va_start(args, format);
-    vsnprintf(&line[header_size], needed + 1, format, args);
-    va_end(args);
+// Rewrites a closed segment into compressed blocks. This runs without holding
+// g_file_mutex since it takes a while, so Flush() and the HTTP API are not
+// blocked meanwhile.
+static void CompactSegment(const int number) {
+  const String path = GetSegmentPath(number);
+  if (!SPIFFS.exists(path)) {
+    return;  // removed through the HTTP API
+  }
+  File file = SPIFFS.open(path, "r");
+  if (!file) {
+    return;
+  }
+  const size_t segment_size = file.size();
+  auto reader = std::make_unique<SegmentReader>(std::move(file));
+  if (!reader->is_framed() || reader->is_compressed()) {
+    return;
+  }
+  auto compaction = std::make_unique<Compaction>();
+  compaction->file = SPIFFS.open(kCompactionPath, "w");
+  if (!compaction->file) {
+    Serial.println("logging: Failed to open the compaction file");
+    return;
   }
-  line += '\n';
+  while (reader->ReadRecords([&](const uint8_t* payload, size_t length) {
+    if (compaction->block_size + length > kMaxBlockSize) {
+      compaction->WriteBlock();
+    }
+    std::memcpy(compaction->block + compaction->block_size, payload, length);
+    compaction->block_size += length;
+  })) {
+  }
+  compaction->WriteBlock();
+  compaction->file.close();
+  reader.reset();
 
-  Serial.print(line);
-  if (kb::LockGuard lock(g_mutex); lock) {
-    g_queue.push_back(std::move(line));
+  const kb::LockGuard lock(g_file_mutex);
+  // The segment may have been removed meanwhile
+  if (!compaction->ok || number < g_first_segment || !SPIFFS.exists(path)) {
+    SPIFFS.remove(kCompactionPath);
+    return;
   }
+  SPIFFS.remove(path);
+  SPIFFS.rename(kCompactionPath, path);
+  g_closed_segment_bytes =
+      g_closed_segment_bytes - std::min(g_closed_segment_bytes, segment_size) +
+      compaction->file_size;
+  Serial.printf("Compacted %s (%u -> %u bytes)\n", path.c_str(),
+                static_cast<unsigned>(segment_size),
+                static_cast<unsigned>(compaction->file_size));
 }
 
-void Update() {
+static void DrainQueueLocked() {
+  while (g_ring.TryPop([](const Slot& slot) { AppendSlotLocked(slot); })) {
+  }
+  const uint32_t dropped = g_dropped_count.exchange(0);
+  if (dropped > 0) {
+    Slot slot;
+    FillSlotf(slot, esp_timer_get_time(), Level::kWarn,
+              "(%u log messages dropped)", static_cast<unsigned>(dropped));
+    AppendSlotLocked(slot);
+  }
+}
+
+static void RunWriterTask(void*) {
   while (true) {
-    String line;
+    // Woken up by Log(), or periodically to flush the file
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kWriterPollIntervalMsec));
+    int segment_to_compact;
     {
-      kb::LockGuard lock(g_mutex);
-      if (!lock) {
-        break;
-      }
-      if (g_queue.empty()) {
-        break;
+      const kb::LockGuard lock(g_file_mutex);
+      DrainQueueLocked();
+      if (g_unflushed_bytes + g_write_buffer_used >= kFlushThresholdBytes ||
+          millis() - g_last_flush_time >= kFlushIntervalMsec) {
+        FlushFileLocked();
       }
-      line = std::move(g_queue.front());
-      g_queue.pop_front();
+      segment_to_compact = g_segment_to_compact;
+      g_segment_to_compact = 0;
     }
+    if (segment_to_compact > 0) {
+      CompactSegment(segment_to_compact);
+    }
+  }
+}
 
-    File file = SPIFFS.open(g_filename, "a");
-    if (file) {
-      file.write(reinterpret_cast<const uint8_t*>(line.c_str()), line.length());
-      file.flush();
-      file.close();
+void Begin(int log_unique_id) {
+  {
+    const kb::LockGuard lock(g_file_mutex);
+    const bool has_index = LoadSegmentIndex();
+    LoadSegmentTimes();
+    if (has_index && g_first_segment <= g_last_segment) {
+      // Keep appending to the last segment so that a boot loop doesn't push
+      // the history out.
+      g_segment_path = GetSegmentPath(g_last_segment);
+      g_file = SPIFFS.open(g_segment_path, "a");
+      g_segment_size = g_file ? g_file.size() : 0;
+      g_has_segment_times = g_segment_size == 0;
+      Serial.printf("Logging to %s\n", g_segment_path.c_str());
+      RecoverCompactionLocked();
+      SumClosedSegmentBytesLocked();
+      // In case the last compaction didn't finish
+      if (g_first_segment < g_last_segment) {
+        g_segment_to_compact = g_last_segment - 1;
+      }
     } else {
-      Serial.println("logging: File is not opened");
+      if (!has_index) {
+        ScanSegments();
+      }
+      // The last existing segment is closed by OpenNewSegmentLocked()
+      SumClosedSegmentBytesLocked();
+      g_segment_size = GetFileSize(GetSegmentPath(g_last_segment));
+      OpenNewSegmentLocked();
     }
   }
+  // Segments are shared by boots. Mark where this one starts.
+  Log("Boot #%d", log_unique_id);
+
+  xTaskCreate(RunWriterTask, "LogWriter", 4 * 1024, nullptr,
+              kWriterTaskPriority, &g_writer_task_handle);
+}
+
+static void LogV(const Level level, const char* format, va_list args) {
+  // This can be called from any task. It must not allocate nor block.
+  const int64_t now = esp_timer_get_time();
+  const bool pushed = g_ring.TryPush(
+      [&](Slot& slot) { FillSlot(slot, now, level, format, args); });
+  if (!pushed) {
+    g_dropped_count.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (g_writer_task_handle) {
+    xTaskNotifyGive(g_writer_task_handle);
+  }
+}
+
+void Log(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  LogV(Level::kInfo, format, args);
+  va_end(args);
+}
+
+void Log(const Level level, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  LogV(level, format, args);
+  va_end(args);
+}
+
+void Flush() {
+  const kb::LockGuard lock(g_file_mutex);
+  DrainQueueLocked();
+  FlushFileLocked();
+}
+
+void GetSegmentRange(int* first, int* last) {
+  const kb::LockGuard lock(g_file_mutex);
+  *first = g_first_segment;
+  *last = g_last_segment;
+}
+
+bool GetSegmentTimeRange(const int number, uint32_t* min_time,
+                         uint32_t* max_time) {
+  const kb::LockGuard lock(g_file_mutex);
+  for (const SegmentTimes& times : g_segment_times) {
+    if (times.number == number) {
+      *min_time = times.min_time;
+      *max_time = times.max_time;
+      return true;
+    }
+  }
+  return false;
+}
+
+void GetSegmentPath(const int number, char* out, const size_t len) {
+  snprintf(out, len, "/log%05d%s", number, kLogFileExtension);
+}
+
+bool AddLineListener(const LineListener listener) {
+  for (const std::atomic<LineListener>& slot : g_line_listeners) {
+    if (slot.load() == listener) {
+      return true;
+    }
+  }
+  for (std::atomic<LineListener>& slot : g_line_listeners) {
+    LineListener expected = nullptr;
+    if (slot.compare_exchange_strong(expected, listener)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RemoveLineListener(const LineListener listener) {
+  for (std::atomic<LineListener>& slot : g_line_listeners) {
+    LineListener expected = listener;
+    slot.compare_exchange_strong(expected, nullptr);
+  }
 }
 
 }  // namespace logging
@@ -1,14 +1,111 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
+// Console message levels. Messages above KB_LOG_MAX_LEVEL are removed at
+// compile time (`make LOG_MAX_LEVEL=DEBUG` to keep them all).
+#define KB_LOG_LEVEL_NONE 0
+#define KB_LOG_LEVEL_ERROR 1
+#define KB_LOG_LEVEL_WARN 2
+#define KB_LOG_LEVEL_INFO 3
+#define KB_LOG_LEVEL_DEBUG 4
+
+#ifndef KB_LOG_MAX_LEVEL
+#define KB_LOG_MAX_LEVEL KB_LOG_LEVEL_INFO
+#endif
+
 namespace logging {
 
+enum class Level : uint8_t {
+  kNone = KB_LOG_LEVEL_NONE,
+  kError = KB_LOG_LEVEL_ERROR,
+  kWarn = KB_LOG_LEVEL_WARN,
+  kInfo = KB_LOG_LEVEL_INFO,
+  kDebug = KB_LOG_LEVEL_DEBUG,
+};
+
+// Starts the background writer task which appends the queued messages to the
+// log file.
 void Begin(int log_unique_id);
 
-// This function only enqueues the log message. The actual logging is done by
-// Update().
+// This function only enqueues the log message. The actual writing is done by
+// the writer task started in Begin(). Messages are logged as Level::kInfo
+// unless a level is given.
 void Log(const char* format, ...);
+void Log(Level level, const char* format, ...);
+
+// Writes all the queued messages to the file synchronously. Call this before
+// rebooting so that the last messages are not lost.
+void Flush();
+
+// Log segments are numbered from the oldest to the newest. Some of them may
+// have been removed through the HTTP API.
+void GetSegmentRange(int* first, int* last);
+void GetSegmentPath(int number, char* out, size_t len);
+// The times (seconds since the epoch) of the oldest and the newest records of
+// a closed segment. Returns false if they are unknown, e.g. for the current
+// segment. Times are not in order across segments.
+bool GetSegmentTimeRange(int number, uint32_t* min_time, uint32_t* max_time);
+
+// Called from the writer task with each message as it is written, formatted
+// as "YYYY-MM-DD HH:MM:SS L message" without a newline. It must not block.
+// Up to kMaxLineListeners can be added. Adding one twice has no effect.
+using LineListener = void (*)(const char* line, size_t length);
+constexpr size_t kMaxLineListeners = 4;
+bool AddLineListener(LineListener listener);
+void RemoveLineListener(LineListener listener);
+
+// Console
 
-// This must be called periodically to write the log messages to the file.
-void Update();
+enum class Module : uint8_t {
+  kMain,
+  kApi,
+  kServer,
+  kWiFi,
+  kBluetooth,
+  kCount,
+};
+
+const char* GetLevelName(Level level);
+bool ParseLevel(const char* name, Level* out);
+const char* GetModuleName(Module module);
+bool ParseModule(const char* name, Module* out);
+
+// Runtime level of each module (KB_LOG_MAX_LEVEL by default)
+Level GetLevel(Module module);
+void SetLevel(Module module, Level level);
+
+// Starts the task which drains the console output to Serial. Call this after
+// Serial.begin(). Until then Printf() writes to Serial directly.
+void BeginSerial();
+
+// Writes to Serial through a ring buffer without waiting for the UART. The
+// message is dropped if the buffer is full. Use the KB_LOG* macros below.
+void Printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void WriteToSerial(const char* data, size_t size);
 
 }  // namespace logging
+
+// Usage:
+//
+//  static constexpr logging::Module kLogModule = logging::Module::kApi;
+//  ...
+//  KB_LOGD("response = {success=%d}\n", success);
+
+#define KB_LOG_IS_ENABLED(level)                        \
+  (KB_LOG_LEVEL_##level <= KB_LOG_MAX_LEVEL &&          \
+   static_cast<int>(::logging::GetLevel(kLogModule)) >= \
+       KB_LOG_LEVEL_##level)
+
+#define KB_LOG_PRINTF(level, ...)       \
+  do {                                  \
+    if (KB_LOG_IS_ENABLED(level)) {     \
+      ::logging::Printf(__VA_ARGS__);   \
+    }                                   \
+  } while (false)
+
+#define KB_LOGE(...) KB_LOG_PRINTF(ERROR, __VA_ARGS__)
+#define KB_LOGW(...) KB_LOG_PRINTF(WARN, __VA_ARGS__)
+#define KB_LOGI(...) KB_LOG_PRINTF(INFO, __VA_ARGS__)
+#define KB_LOGD(...) KB_LOG_PRINTF(DEBUG, __VA_ARGS__)
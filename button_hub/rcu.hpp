@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace kb {
+
+// A value that readers share without a lock, read-copy-update style. Each
+// generation is immutable and reference counted: Get() hands out the current
+// one, which stays valid for as long as the reader holds it, and Publish()
+// swaps in a new one built by the writer. Writers have to be serialized
+// against each other, e.g. by a kb::Mutex, so that no update is lost.
+//
+// The current generation is kept in one of two slots. A reader announces
+// itself on the slot with an atomic counter while it copies the shared_ptr
+// out of it, and starts over if a writer has switched slots meanwhile, so
+// Get() takes no lock; std::atomic_load() of a shared_ptr would take a
+// mutex of libstdc++'s pool, a FreeRTOS mutex on the ESP32. The writer fills
+// the other slot once no reader is on it, and frees the previous generation
+// of its slot once the readers copying it are done. Those few instructions
+// are all it can wait for, sleeping after a few yields so that a reader of a
+// lower priority gets to finish.
+//
+// Usage:
+//
+//  kb::Rcu<std::vector<int>> g_values;
+//  ...
+//  // reader
+//  const auto values = g_values.Get();
+//  for (const int value : *values) { ... }
+//  ...
+//  // writer
+//  auto values = std::make_shared<std::vector<int>>(*g_values.Get());
+//  values->push_back(1);
+//  g_values.Publish(std::move(values));
+
+template <typename T>
+class Rcu {
+ public:
+  explicit Rcu() { slots_[0] = std::make_shared<const T>(); }
+
+  std::shared_ptr<const T> Get() const {
+    while (true) {
+      const int slot = current_;
+      ++readers_[slot];
+      // Otherwise the writer may have seen no reader on the slot and be
+      // filling it
+      if (slot == current_) {
+        std::shared_ptr<const T> value = slots_[slot];
+        --readers_[slot];
+        return value;
+      }
+      --readers_[slot];
+    }
+  }
+
+  void Publish(std::shared_ptr<const T> value) {
+    const int old_slot = current_;
+    const int new_slot = 1 - old_slot;
+    // Only readers that are about to start over can be on it
+    WaitForReaders(new_slot);
+    slots_[new_slot] = std::move(value);
+    current_ = new_slot;
+    WaitForReaders(old_slot);
+    slots_[old_slot].reset();
+  }
+
+ private:
+  Rcu(const Rcu&) = delete;
+  Rcu& operator=(const Rcu&) = delete;
+
+  void WaitForReaders(const int slot) const {
+    for (int yields = 0; readers_[slot] != 0; ++yields) {
+      if (yields < kMaxYields) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }
+
+  static constexpr int kMaxYields = 16;
+
+  std::shared_ptr<const T> slots_[2];
+  std::atomic<int> current_{0};
+  mutable std::atomic<int> readers_[2] = {};
+};
+
+}  // namespace kb
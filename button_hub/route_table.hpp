@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace route_table {
+
+// Routes of the HTTP API known at compile time. A table is a constexpr array
+// of Route, so it lives in flash and dispatching a request is a scan of it
+// with no object per route on the heap.
+//
+// Usage:
+//
+//  constexpr route_table::Route<Handler> kRoutes[] = {
+//      {"/config/wifi", route_table::kGet, Handler{...}},
+//      {"/config/wifi", route_table::kPut, Handler{...}},
+//  };
+//  static_assert(!route_table::HasConflicts(kRoutes));
+//  const auto* route = route_table::Find(kRoutes, method, path);
+
+// Methods of the routes, one bit each like ESPAsyncWebServer's
+// WebRequestMethod, which server.cpp maps to them
+constexpr uint8_t kGet = 1;
+constexpr uint8_t kPost = 2;
+constexpr uint8_t kDelete = 4;
+constexpr uint8_t kPut = 8;
+constexpr uint8_t kPatch = 16;
+
+template <typename Handler>
+struct Route {
+  const char* path;  // see MatchesPath()
+  uint8_t method;  // one of the bits above
+  Handler handler;
+};
+
+constexpr bool IsSamePath(const char* a, const char* b) {
+  while (*a != '\0' && *a == *b) {
+    ++a;
+    ++b;
+  }
+  return *a == *b;
+}
+
+// True if `path` is `pattern`, or if `pattern` ends with "*", starts with
+// the rest of `pattern` followed by one non-empty segment. e.g. "/commands/*"
+// matches "/commands/m5-1" but neither "/commands/" nor "/commands/a/b".
+constexpr bool MatchesPath(const char* pattern, const char* path) {
+  while (*pattern != '\0' && *pattern != '*' && *pattern == *path) {
+    ++pattern;
+    ++path;
+  }
+  if (*pattern != '*') {
+    return *pattern == *path;
+  }
+  if (*path == '\0') {
+    return false;
+  }
+  for (; *path != '\0'; ++path) {
+    if (*path == '/') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The segment of `path` matched by the "*" of `pattern`, or nullptr if
+// `pattern` has none. `path` must match `pattern`.
+constexpr const char* GetWildcard(const char* pattern, const char* path) {
+  for (size_t i = 0; pattern[i] != '\0'; ++i) {
+    if (pattern[i] == '*') {
+      return path + i;
+    }
+  }
+  return nullptr;
+}
+
+// e.g. "PUT" for kPut. nullptr for anything else.
+constexpr const char* GetMethodName(const uint8_t method) {
+  switch (method) {
+    case kGet:
+      return "GET";
+    case kPost:
+      return "POST";
+    case kDelete:
+      return "DELETE";
+    case kPut:
+      return "PUT";
+    case kPatch:
+      return "PATCH";
+    default:
+      return nullptr;
+  }
+}
+
+// The inverse of GetMethodName(). 0 for an unknown name.
+constexpr uint8_t ParseMethod(const char* name) {
+  for (const uint8_t method : {kGet, kPost, kDelete, kPut, kPatch}) {
+    if (IsSamePath(name, GetMethodName(method))) {
+      return method;
+    }
+  }
+  return 0;
+}
+
+template <typename Handler>
+constexpr bool Conflicts(const Route<Handler>& a, const Route<Handler>& b) {
+  return a.method == b.method &&
+         (MatchesPath(a.path, b.path) || MatchesPath(b.path, a.path));
+}
+
+// True if two routes of `routes` would serve the same requests, or one has
+// an unknown method, so that only the first would be reachable
+template <typename Handler, size_t N>
+constexpr bool HasConflicts(const Route<Handler> (&routes)[N]) {
+  for (size_t i = 0; i < N; ++i) {
+    if (GetMethodName(routes[i].method) == nullptr) {
+      return true;
+    }
+    for (size_t j = i + 1; j < N; ++j) {
+      if (Conflicts(routes[i], routes[j])) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// The same for the union of two tables
+template <typename Handler, size_t N, size_t M>
+constexpr bool HasConflicts(const Route<Handler> (&a)[N],
+                            const Route<Handler> (&b)[M]) {
+  if (HasConflicts(a) || HasConflicts(b)) {
+    return true;
+  }
+  for (size_t i = 0; i < N; ++i) {
+    for (size_t j = 0; j < M; ++j) {
+      if (Conflicts(a[i], b[j])) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// The route for `method` and `path`, or nullptr
+template <typename Handler, size_t N>
+constexpr const Route<Handler>* Find(const Route<Handler> (&routes)[N],
+                                     const uint8_t method, const char* path) {
+  for (const Route<Handler>& route : routes) {
+    if (route.method == method && MatchesPath(route.path, path)) {
+      return &route;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace route_table
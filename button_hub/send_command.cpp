@@ -8,6 +8,8 @@
 #include "robot_version.hpp"
 #include "types.hpp"
 
+static constexpr logging::Module kLogModule = logging::Module::kApi;
+
 namespace send_command {
 namespace {
 constexpr double kValidLockDurationSecThreshold = 0.001;
@@ -177,12 +179,11 @@ bool SendCommand(const RobotInfoHolder& robot_info, const Command& command) {
                 command.http_post.body);
       break;
     default:
-      Serial.printf("Unknown command: %d\n", command.type);
+      KB_LOGE("Unknown command: %d\n", static_cast<int>(command.type));
       return false;
   }
   if (result != api::ResultCode::kOk) {
-    Serial.printf("Failed to send command: %s\n",
-                  api::ResultCodeToString(result));
+    KB_LOGE("Failed to send command: %s\n", api::ResultCodeToString(result));
     return false;
   }
   // start lock command for backward compatibility
@@ -192,7 +193,7 @@ bool SendCommand(const RobotInfoHolder& robot_info, const Command& command) {
       RobotVersion(robot_info.robot_version) >= RobotVersion(3, 1, 0);
   if (command.lock_duration_sec > kValidLockDurationSecThreshold and
       not is_lock_on_end_option_supported) {
-    Serial.printf("Lock: %d sec\n", command.lock_duration_sec);
+    KB_LOGD("Lock: %d sec\n", static_cast<int>(command.lock_duration_sec));
     delay(3000);
     api::Lock(command.lock_duration_sec,
               (String(int(command.lock_duration_sec)) + "秒の待機").c_str());
@@ -1,77 +1,863 @@
 #include "server.hpp"
 
-#include <set>
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "command_table.hpp"
-#include "data.hpp"
 #include "fetch_state.hpp"
+#include "log_deflate.hpp"
+#include "logging.hpp"
 #include "mutex.hpp"
+#include "route_table.hpp"
 #include "server_commands.hpp"
 #include "server_info.hpp"
 #include "server_logging.hpp"
 #include "settings.hpp"
 #include "to_json.hpp"
 #include "types.hpp"
+#include "ui_bundle.hpp"
+#include "web_ui.hpp"
 #include "wifi.hpp"
 
 namespace server {
 
+static constexpr logging::Module kLogModule = logging::Module::kServer;
+
 static AsyncWebServer g_server(80);
 static kb::Mutex g_ws_mutex;
 static AsyncWebSocket g_ws("/ws");
-static std::set<AsyncWebSocketClient*> g_ws_clients;
-static std::vector<String> g_ws_message_queue;
+
+// At most this many UIs stay connected. The oldest one is closed when
+// another one connects.
+constexpr size_t kMaxWsClients = 4;
+// Idle clients are pinged, and closed when nothing has been heard from them
+// or their outbound queue has been full for kWsTimeoutMsec.
+constexpr uint32_t kWsPingIntervalMsec = 10 * 1000;
+constexpr uint32_t kWsTimeoutMsec = 30 * 1000;
+constexpr uint32_t kWsMaintenanceIntervalMsec = 1000;
+// A delta topic sends a snapshot instead when more deltas are pending
+constexpr size_t kMaxPendingWsDeltas = 16;
+// GET /wifi_scan returns the last result instead within this period
+constexpr uint32_t kWiFiScanMaxAgeMsec = 15 * 1000;
+// Test presses waiting for the main loop
+constexpr size_t kMaxPendingTestPresses = 4;
+
+// How the messages are encoded for a client, chosen by the query of "/ws":
+//
+// - "format=msgpack": in MessagePack instead of JSON, in the same schemas,
+//   and in binary frames. The to_json writers emit each message in
+//   MessagePack as well while such a client is connected.
+// - "compress=deflate": in binary frames of a header byte, kWsFramePlain or
+//   kWsFrameDeflated, and the message. A message of kWsDeflateMinSize bytes
+//   or more is deflated in logging::BlockDeflater's blocks, so that matches
+//   reach back at most logging::kMaxBlockSize bytes and the compressor needs
+//   only a few KB.
+//
+// The log stream and the RPC responses are JSON text frames either way.
+constexpr uint8_t kWsMsgPack = 1;
+constexpr uint8_t kWsDeflate = 2;
+constexpr size_t kWsEncodingCount = 4;
+constexpr uint8_t kWsFramePlain = 0;
+constexpr uint8_t kWsFrameDeflated = 1;
+constexpr size_t kWsDeflateMinSize = 512;
+
+struct WsClient {
+  AsyncWebSocketClient* client;  // valid until WS_EVT_DISCONNECT
+  uint8_t encoding;  // kWsMsgPack | kWsDeflate
+  uint32_t last_seen_time;
+  uint32_t last_ping_time;
+  bool is_stalled;
+  uint32_t stalled_time;  // when a message was first skipped
+  // Topics skipped while the outbound queue was full or asked to resync. The
+  // latest message, or a snapshot, of each is sent once the queue drains.
+  uint32_t stale_topics;
+};
+static_assert(static_cast<size_t>(WsTopic::kCount) <= 32,
+              "WsClient::stale_topics must hold all the topics");
+
+// The deflated frames of a message, indexed by the encoding. Each is built
+// the first time a client needs it, and shared by all the clients with the
+// same encoding.
+using WsFrames = std::array<std::string, kWsEncodingCount>;
+
+struct WsMessage {
+  String json;
+  // Empty if no client took MessagePack when the message was made
+  std::string msgpack;
+  WsFrames frames;
+};
+
+struct WsTopicState {
+  WsMessage pending;
+  bool has_pending = false;
+  // The last message sent, to skip the same one and to resync slow clients
+  WsMessage sent;
+  bool has_sent = false;
+  // Delta topics
+  uint32_t version = 0;
+  bool needs_snapshot = false;
+  std::vector<WsMessage> deltas;
+  // Serialized once per version for the clients and GET requests. Shared
+  // with the responses still being sent.
+  std::shared_ptr<const String> snapshot;
+  std::string snapshot_msgpack;  // made for the first client which takes it
+  WsFrames snapshot_frames;
+  uint32_t snapshot_version = 0;
+  bool has_snapshot = false;
+};
+
+// guard by g_ws_mutex
+static std::vector<WsClient> g_ws_clients;
 static int g_ws_client_count = 0;
+static WsTopicState g_ws_topics[static_cast<size_t>(WsTopic::kCount)];
+
+static std::atomic<bool> g_ws_has_pending{false};
+static uint32_t g_last_ws_maintenance_time = 0;
+static const CommandTable* g_command_table = nullptr;
+// Part of the ETags so that the versions before a reboot don't match
+static const uint32_t g_boot_id = esp_random();
+
+static bool IsDeltaTopic(const size_t topic) {
+  return topic == static_cast<size_t>(WsTopic::kObservedButtons) ||
+         topic == static_cast<size_t>(WsTopic::kCommands);
+}
+
+static bool HasMsgPackClientLocked() {
+  return std::any_of(g_ws_clients.begin(), g_ws_clients.end(),
+                     [](const WsClient& ws_client) {
+                       return (ws_client.encoding & kWsMsgPack) != 0;
+                     });
+}
+
+// A message made by `make`, called as `make(to_json::Json())` and, while a
+// client takes MessagePack, as `make(to_json::MsgPack())`
+template <typename Make>
+static WsMessage MakeWsMessageLocked(Make make) {
+  return {make(to_json::Json()),
+          HasMsgPackClientLocked() ? make(to_json::MsgPack()) : std::string(),
+          {}};
+}
+
+template <typename Format>
+static typename Format::Output MakeSnapshot(const size_t topic,
+                                            const uint32_t version,
+                                            const Format format) {
+  if (topic == static_cast<size_t>(WsTopic::kObservedButtons)) {
+    return to_json::ConvertObservedButtons(
+        *g_command_table->GetObservedButtons(),
+        *g_command_table->GetButtonNames(), version, format);
+  }
+  return to_json::ConvertCommands(*g_command_table->GetCommands(), version,
+                                  format);
+}
+
+// Every change of a delta topic increments its version, which invalidates
+// the cached snapshot.
+static const String& GetSnapshotLocked(const size_t topic) {
+  WsTopicState& state = g_ws_topics[topic];
+  if (state.has_snapshot && state.snapshot_version == state.version) {
+    return *state.snapshot;
+  }
+  state.snapshot = std::make_shared<const String>(
+      MakeSnapshot(topic, state.version, to_json::Json()));
+  state.snapshot_msgpack.clear();
+  state.snapshot_frames = {};
+  state.snapshot_version = state.version;
+  state.has_snapshot = true;
+  return *state.snapshot;
+}
+
+// Made only for a client whose `encoding` takes MessagePack. The others get
+// whatever is cached, as they don't use it.
+static const std::string& GetSnapshotMsgPackLocked(const size_t topic,
+                                                   const uint8_t encoding) {
+  GetSnapshotLocked(topic);  // drops the one of an older version
+  WsTopicState& state = g_ws_topics[topic];
+  if ((encoding & kWsMsgPack) != 0 && state.snapshot_msgpack.empty()) {
+    state.snapshot_msgpack =
+        MakeSnapshot(topic, state.snapshot_version, to_json::MsgPack());
+  }
+  return state.snapshot_msgpack;
+}
 
-void EnqueueWsMessage(String msg) {
+void GetSnapshot(const WsTopic topic, std::shared_ptr<const String>* json,
+                 String* etag) {
   const kb::LockGuard lock(g_ws_mutex);
-  g_ws_message_queue.push_back(std::move(msg));
+  const size_t i = static_cast<size_t>(topic);
+  GetSnapshotLocked(i);
+  *json = g_ws_topics[i].snapshot;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "\"%08x-%u-%u\"",
+           static_cast<unsigned>(g_boot_id), static_cast<unsigned>(i),
+           static_cast<unsigned>(g_ws_topics[i].snapshot_version));
+  *etag = buf;
 }
 
-void FlushWsMessageQueue() {
-  if (g_ws_message_queue.empty()) {
+// The latest message of a value topic. It is built by `make`, called as
+// `make(format)`, only when nothing has been published since the boot, or
+// in MessagePack when it was published before any client took MessagePack.
+template <typename Make>
+static WsMessage& GetLatestMessageLocked(const WsTopic topic,
+                                         const bool needs_msgpack, Make make) {
+  WsTopicState& state = g_ws_topics[static_cast<size_t>(topic)];
+  if (!state.has_pending && !state.has_sent) {
+    state.sent = MakeWsMessageLocked(make);
+    state.has_sent = true;
+  }
+  WsMessage& message = state.has_pending ? state.pending : state.sent;
+  if (needs_msgpack && message.msgpack.empty()) {
+    message.msgpack = make(to_json::MsgPack());
+  }
+  return message;
+}
+
+void PublishWsMessage(const WsTopic topic, String json,
+                      const std::function<std::string()>& make_msgpack) {
+  const kb::LockGuard lock(g_ws_mutex);
+  WsTopicState& state = g_ws_topics[static_cast<size_t>(topic)];
+  state.pending = {std::move(json),
+                   HasMsgPackClientLocked() ? make_msgpack() : std::string(),
+                   {}};
+  state.has_pending = true;
+  g_ws_has_pending = true;
+}
+
+// `make_delta` is called as `WsMessage(uint32_t version)` with g_ws_mutex
+// held, so that the deltas are numbered in the order of the changes.
+template <typename MakeDelta>
+static void PublishWsDelta(const WsTopic topic, MakeDelta make_delta) {
+  const kb::LockGuard lock(g_ws_mutex);
+  if (g_command_table == nullptr) {
+    return;
+  }
+  WsTopicState& state = g_ws_topics[static_cast<size_t>(topic)];
+  ++state.version;
+  g_ws_has_pending = true;
+  if (state.needs_snapshot) {
+    return;  // The snapshot will include this change.
+  }
+  if (state.deltas.size() >= kMaxPendingWsDeltas) {
+    state.deltas.clear();
+    state.needs_snapshot = true;
+    return;
+  }
+  state.deltas.push_back(make_delta(state.version));
+}
+
+void PublishObservedButtonChange(const KButton& button) {
+  PublishWsDelta(WsTopic::kObservedButtons, [&button](const uint32_t version) {
+    ObservedButton observed;
+    const bool is_observed =
+        g_command_table->GetObservedButton(button, &observed);
+    String name;
+    const bool has_name = g_command_table->GetButtonName(button, &name);
+    return MakeWsMessageLocked([&](const auto format) {
+      return to_json::ConvertObservedButtonDelta(
+          version, button, is_observed ? &observed : nullptr,
+          has_name ? &name : nullptr, format);
+    });
+  });
+}
+
+void PublishCommandChange(const KButton& button) {
+  PublishWsDelta(WsTopic::kCommands, [&button](const uint32_t version) {
+    String json;
+    const bool exists = g_command_table->GetCommandJson(button, &json);
+    return MakeWsMessageLocked([&](const auto format) {
+      return to_json::ConvertCommandDelta(version, button,
+                                          exists ? &json : nullptr, format);
+    });
+  });
+}
+
+void PublishCommandTableSnapshot() {
+  const kb::LockGuard lock(g_ws_mutex);
+  for (const WsTopic topic : {WsTopic::kObservedButtons, WsTopic::kCommands}) {
+    WsTopicState& state = g_ws_topics[static_cast<size_t>(topic)];
+    ++state.version;
+    state.needs_snapshot = true;
+    state.deltas.clear();
+  }
+  g_ws_has_pending = true;
+}
+
+struct WsDeflater {
+  logging::BlockDeflater deflater;
+  uint8_t out[logging::kMaxDeflatedBlockSize];
+};
+// Made for the first client which asks for deflate. guard by g_ws_mutex
+static std::unique_ptr<WsDeflater> g_ws_deflater;
+
+// Appends `payload` deflated, or returns false if it doesn't get smaller
+static bool AppendDeflatedLocked(const char* payload, const size_t length,
+                                 std::string* frame) {
+  if (!g_ws_deflater) {
+    g_ws_deflater.reset(new WsDeflater());
+  }
+  const size_t header_size = frame->size();
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(payload);
+  for (size_t pos = 0; pos < length; pos += logging::kMaxBlockSize) {
+    const size_t size = std::min(logging::kMaxBlockSize, length - pos);
+    const size_t deflated_size = g_ws_deflater->deflater.Deflate(
+        data + pos, size, g_ws_deflater->out);
+    frame->append(reinterpret_cast<const char*>(g_ws_deflater->out),
+                  deflated_size);
+    if (frame->size() - header_size >= length) {
+      frame->resize(header_size);
+      return false;
+    }
+  }
+  return true;
+}
+
+// A frame of "compress=deflate"
+static std::string EncodeDeflateFrameLocked(const char* payload,
+                                            const size_t length) {
+  std::string frame(1, static_cast<char>(kWsFrameDeflated));
+  if (length >= kWsDeflateMinSize &&
+      AppendDeflatedLocked(payload, length, &frame)) {
+    return frame;
+  }
+  frame[0] = static_cast<char>(kWsFramePlain);
+  frame.append(payload, length);
+  return frame;
+}
+
+// `msgpack` is empty if no client took MessagePack when the message was
+// made. A MessagePack client skips such a message, as it has got a newer one
+// of the topic on connecting (see SendAllToClient()). `frames` caches the
+// deflated frames for the other clients. It may be nullptr for a message
+// sent only once.
+static void SendWsMessageLocked(AsyncWebSocketClient* client,
+                                const uint8_t encoding, const String& json,
+                                const std::string& msgpack,
+                                WsFrames* frames) {
+  const bool is_msgpack = (encoding & kWsMsgPack) != 0;
+  if (encoding == 0) {
+    client->text(json);
     return;
   }
+  if (is_msgpack && msgpack.empty()) {
+    return;
+  }
+  if (encoding == kWsMsgPack) {
+    client->binary(msgpack.data(), msgpack.size());
+    return;
+  }
+  WsFrames encoded;
+  if (frames == nullptr) {
+    frames = &encoded;
+  }
+  std::string& frame = (*frames)[encoding];
+  if (frame.empty()) {
+    frame = is_msgpack ? EncodeDeflateFrameLocked(msgpack.data(),
+                                                  msgpack.size())
+                       : EncodeDeflateFrameLocked(json.c_str(),
+                                                  json.length());
+  }
+  client->binary(frame.data(), frame.size());
+}
+
+static void SendWsMessageLocked(AsyncWebSocketClient* client,
+                                const uint8_t encoding, WsMessage& message) {
+  SendWsMessageLocked(client, encoding, message.json, message.msgpack,
+                      &message.frames);
+}
+
+// The message is not queued while the queue of the client is full, so that
+// a stalled client holds at most WS_MAX_QUEUED_MESSAGES messages.
+static void SendToClientLocked(WsClient& ws_client, const size_t topic,
+                               const String& json, const std::string& msgpack,
+                               WsFrames* frames, const uint32_t now) {
+  if (ws_client.client->queueIsFull()) {
+    ws_client.stale_topics |= 1u << topic;
+    if (!ws_client.is_stalled) {
+      ws_client.is_stalled = true;
+      ws_client.stalled_time = now;
+    }
+    return;
+  }
+  SendWsMessageLocked(ws_client.client, ws_client.encoding, json, msgpack,
+                      frames);
+  ws_client.stale_topics &= ~(1u << topic);
+  ws_client.is_stalled = false;
+}
+
+static void SendToClientLocked(WsClient& ws_client, const size_t topic,
+                               WsMessage& message, const uint32_t now) {
+  SendToClientLocked(ws_client, topic, message.json, message.msgpack,
+                     &message.frames, now);
+}
+
+static WsMessage MakeClockMessageLocked() {
+  return MakeWsMessageLocked(
+      [](const auto format) { return to_json::ConvertClock(format); });
+}
+
+// A snapshot is preceded by the time of the hub, which the cached snapshot
+// doesn't have. `clock` is MakeClockMessageLocked().
+static void SendSnapshotToClientLocked(WsClient& ws_client,
+                                       const size_t topic, WsMessage& clock,
+                                       const uint32_t now) {
+  if (!ws_client.client->queueIsFull()) {
+    SendWsMessageLocked(ws_client.client, ws_client.encoding, clock);
+  }
+  const std::string& msgpack =
+      GetSnapshotMsgPackLocked(topic, ws_client.encoding);
+  SendToClientLocked(ws_client, topic, *g_ws_topics[topic].snapshot, msgpack,
+                     &g_ws_topics[topic].snapshot_frames, now);
+}
+
+static void ResyncClientLocked(WsClient& ws_client, const uint32_t now) {
+  for (size_t i = 0; i < static_cast<size_t>(WsTopic::kCount); ++i) {
+    if ((ws_client.stale_topics & (1u << i)) == 0) {
+      continue;
+    }
+    WsTopicState& state = g_ws_topics[i];
+    if (IsDeltaTopic(i)) {
+      WsMessage clock = MakeClockMessageLocked();
+      SendSnapshotToClientLocked(ws_client, i, clock, now);
+    } else if (state.has_sent) {
+      SendToClientLocked(ws_client, i, state.sent, now);
+    }
+  }
+}
+
+static void TouchWsClient(AsyncWebSocketClient* client) {
+  const kb::LockGuard lock(g_ws_mutex);
+  for (WsClient& ws_client : g_ws_clients) {
+    if (ws_client.client == client) {
+      ws_client.last_seen_time = millis();
+      return;
+    }
+  }
+}
+
+// Pings idle clients, closes dead ones and resyncs the ones which have caught
+// up. The clients are closed outside g_ws_mutex because closing may fire
+// WS_EVT_DISCONNECT synchronously.
+static void MaintainWsClients() {
+  const uint32_t now = millis();
+  if (now - g_last_ws_maintenance_time < kWsMaintenanceIntervalMsec) {
+    return;
+  }
+  g_last_ws_maintenance_time = now;
+
+  std::vector<uint32_t> dead_client_ids;
   {
     const kb::LockGuard lock(g_ws_mutex);
-    for (const String& msg : g_ws_message_queue) {
-      for (auto& client : g_ws_clients) {
-        client->text(msg);
+    for (WsClient& ws_client : g_ws_clients) {
+      if (now - ws_client.last_seen_time > kWsTimeoutMsec ||
+          (ws_client.is_stalled &&
+           now - ws_client.stalled_time > kWsTimeoutMsec)) {
+        dead_client_ids.push_back(ws_client.client->id());
+        continue;
+      }
+      if (now - ws_client.last_seen_time > kWsPingIntervalMsec &&
+          now - ws_client.last_ping_time > kWsPingIntervalMsec) {
+        ws_client.client->ping();
+        ws_client.last_ping_time = now;
+      }
+      if (ws_client.stale_topics != 0) {
+        ResyncClientLocked(ws_client, now);
+      }
+    }
+  }
+  for (const uint32_t id : dead_client_ids) {
+    KB_LOGW("ws[%u] not responding, closing\n", id);
+    g_ws.close(id);
+  }
+  g_ws.cleanupClients(kMaxWsClients);
+}
+
+// A client which has missed a delta gets a snapshot by ResyncClientLocked()
+// instead of the following deltas.
+static void FlushDeltaTopicLocked(const size_t topic, const uint32_t now) {
+  WsTopicState& state = g_ws_topics[topic];
+  if (state.needs_snapshot) {
+    state.needs_snapshot = false;
+    WsMessage clock = MakeClockMessageLocked();
+    for (WsClient& ws_client : g_ws_clients) {
+      SendSnapshotToClientLocked(ws_client, topic, clock, now);
+    }
+    return;
+  }
+  for (WsMessage& delta : state.deltas) {
+    for (WsClient& ws_client : g_ws_clients) {
+      if ((ws_client.stale_topics & (1u << topic)) == 0) {
+        SendToClientLocked(ws_client, topic, delta, now);
       }
     }
-    g_ws_message_queue.clear();
+  }
+  state.deltas.clear();
+}
+
+// Set while the scan started by StartWiFiApScan() is running
+static std::atomic<bool> g_wifi_scan_pending{false};
+
+WiFiApScanStart StartWiFiApScan(const uint32_t max_age_msec) {
+  uint32_t age_msec = 0;
+  if (wifi::GetApScanAge(&age_msec) && age_msec < max_age_msec) {
+    return WiFiApScanStart::kFresh;
+  }
+  if (!wifi::StartApScan()) {
+    return WiFiApScanStart::kFailed;
+  }
+  PublishWsMessage(WsTopic::kWiFiApList, [](const auto format) {
+    return to_json::ConvertWiFiApList(true, {}, format);
+  });
+  g_wifi_scan_pending = true;
+  return WiFiApScanStart::kStarted;
+}
+
+static void PollWiFiApScan() {
+  if (!g_wifi_scan_pending) {
+    return;
+  }
+  const auto& [state, wifi_ap_list] = wifi::GetScannedWiFiApList();
+  if (state == wifi::ScanState::kScanning) {
+    return;
+  }
+  g_wifi_scan_pending = false;
+  if (state == wifi::ScanState::kFailed) {
+    KB_LOGE("ERROR: Failed to scan WiFi APs\n");
+  } else {
+    KB_LOGI("WiFi AP list:\n");
+    for (const auto& ap : wifi_ap_list) {
+      KB_LOGI(" - %-24s %s %3d %d\n", ap.ssid.c_str(), ap.bssid.c_str(),
+              ap.channel, ap.encryption_type);
+    }
+  }
+  // An empty list tells the clients that the scan has ended
+  PublishWsMessage(WsTopic::kWiFiApList, [&wifi_ap_list](const auto format) {
+    return to_json::ConvertWiFiApList(false, wifi_ap_list, format);
+  });
+}
+
+void FlushWsMessageQueue() {
+  FlushLogStream();
+  MaintainWsClients();
+  PollWiFiApScan();
+  if (!g_ws_has_pending.exchange(false)) {
+    return;
+  }
+  const uint32_t now = millis();
+  const kb::LockGuard lock(g_ws_mutex);
+  for (size_t i = 0; i < static_cast<size_t>(WsTopic::kCount); ++i) {
+    if (IsDeltaTopic(i)) {
+      FlushDeltaTopicLocked(i, now);
+      continue;
+    }
+    WsTopicState& state = g_ws_topics[i];
+    if (!state.has_pending) {
+      continue;
+    }
+    state.has_pending = false;
+    if (state.has_sent && state.pending.json == state.sent.json) {
+      state.pending = {};
+      continue;
+    }
+    state.sent = std::move(state.pending);
+    state.has_sent = true;
+    state.pending = {};
+    for (WsClient& ws_client : g_ws_clients) {
+      SendToClientLocked(ws_client, i, state.sent, now);
+    }
+  }
+  for (WsClient& ws_client : g_ws_clients) {
+    if (ws_client.stale_topics != 0 && !ws_client.client->queueIsFull()) {
+      ResyncClientLocked(ws_client, now);
+    }
   }
 }
 
 static void SendAllToClient(AsyncWebSocketClient* client,
-                            const RobotInfoHolder& robot_info,
-                            const CommandTable& command_table) {
+                            const uint8_t encoding,
+                            const RobotInfoHolder& robot_info) {
   const kb::LockGuard lock(g_ws_mutex);
-  client->text(to_json::ConvertHubInfo(g_ws_client_count));
-  client->text(to_json::ConvertRobotInfo(robot_info));
-  client->text(to_json::ConvertSettings(g_settings));
-  client->text(to_json::ConvertObservedButtons(
-      command_table.GetObservedButtons(), command_table.GetButtonNames()));
-  client->text(to_json::ConvertCommands(command_table.GetCommands()));
-  const auto& [scanning, wifi_ap_list] = wifi::GetLatestScannedWiFiApList();
-  client->text(to_json::ConvertWiFiApList(scanning, wifi_ap_list));
+  const bool needs_msgpack = (encoding & kWsMsgPack) != 0;
+  const auto send = [client, encoding](WsMessage& message) {
+    SendWsMessageLocked(client, encoding, message);
+  };
+  WsMessage clock = MakeClockMessageLocked();
+  const auto send_snapshot = [&](const WsTopic topic) {
+    const size_t i = static_cast<size_t>(topic);
+    send(clock);
+    const std::string& msgpack = GetSnapshotMsgPackLocked(i, encoding);
+    SendWsMessageLocked(client, encoding, *g_ws_topics[i].snapshot, msgpack,
+                        &g_ws_topics[i].snapshot_frames);
+  };
+  // hub_info changes on every connection
+  WsMessage hub_info = MakeWsMessageLocked([](const auto format) {
+    return to_json::ConvertHubInfo(g_ws_client_count, format);
+  });
+  send(hub_info);
+  send(GetLatestMessageLocked(WsTopic::kRobotInfo, needs_msgpack,
+                              [&robot_info](const auto format) {
+                                return to_json::ConvertRobotInfo(robot_info,
+                                                                 format);
+                              }));
+  send(GetLatestMessageLocked(
+      WsTopic::kSettings, needs_msgpack, [](const auto format) {
+        return to_json::ConvertSettings(g_settings, format);
+      }));
+  send_snapshot(WsTopic::kObservedButtons);
+  send_snapshot(WsTopic::kCommands);
+  send(GetLatestMessageLocked(
+      WsTopic::kWiFiApList, needs_msgpack, [](const auto format) {
+        const auto& [scanning, wifi_ap_list] =
+            wifi::GetLatestScannedWiFiApList();
+        return to_json::ConvertWiFiApList(scanning, wifi_ap_list, format);
+      }));
+}
+
+static void PublishHubInfo() {
+  PublishWsMessage(WsTopic::kHubInfo, [](const auto format) {
+    return to_json::ConvertHubInfo(g_ws_client_count, format);
+  });
+}
+
+// The encoding is chosen once by the URL which the client connects to
+static uint8_t GetRequestedWsEncoding(const AsyncWebServerRequest* request) {
+  if (request == nullptr) {
+    return 0;
+  }
+  const auto has_param = [request](const char* name, const char* value) {
+    return request->hasParam(name) && request->getParam(name)->value() == value;
+  };
+  return (has_param("format", "msgpack") ? kWsMsgPack : 0) |
+         (has_param("compress", "deflate") ? kWsDeflate : 0);
+}
+
+static void LogWebSocketMessage(AsyncWebSocket* server,
+                                AsyncWebSocketClient* client,
+                                const AwsFrameInfo* info, const uint8_t* data,
+                                const size_t len) {
+  if (info->opcode == WS_TEXT) {
+    KB_LOGD("ws[%s][%u] text-message[%llu]: %.*s\n", server->url(),
+            client->id(), info->len, static_cast<int>(len),
+            reinterpret_cast<const char*>(data));
+    return;
+  }
+  // Dump the frame with a single write instead of one per byte. Long frames
+  // are truncated.
+  char hex[3 * 64 + 1];
+  size_t pos = 0;
+  for (size_t i = 0; i < len && pos + 3 < sizeof(hex); i++) {
+    pos += snprintf(hex + pos, sizeof(hex) - pos, "%02x ", data[i]);
+  }
+  hex[pos] = '\0';
+  KB_LOGD("ws[%s][%u] binary-message[%llu]: %s%s\n", server->url(),
+          client->id(), info->len, hex, pos / 3 < len ? "..." : "");
+}
+
+// Sends a snapshot of the delta topic to the client at the next flush
+static void RequestWsResync(AsyncWebSocketClient* client,
+                            const String& topic) {
+  size_t i;
+  if (topic == "observed_buttons") {
+    i = static_cast<size_t>(WsTopic::kObservedButtons);
+  } else if (topic == "commands") {
+    i = static_cast<size_t>(WsTopic::kCommands);
+  } else {
+    KB_LOGW("ws[%u] unknown topic: %s\n", client->id(), topic.c_str());
+    return;
+  }
+  const kb::LockGuard lock(g_ws_mutex);
+  for (WsClient& ws_client : g_ws_clients) {
+    if (ws_client.client == client) {
+      ws_client.stale_topics |= 1u << i;
+      g_ws_has_pending = true;
+      return;
+    }
+  }
+}
+
+struct BodyContext;
+
+// How a route is served. Exactly one of the functions is set.
+struct RouteHandler {
+  // The body, if any, is ignored
+  void (*read)(AsyncWebServerRequest* request);
+  // The body is buffered and passed whole. Body-less requests are not served.
+  void (*write)(AsyncWebServerRequest* request, const String& body);
+  // Like `write`, and also serves the RPC requests on /ws
+  void (*rpc)(Responder& responder, const String& body);
+  // Sets up `context` to take the body chunk by chunk, see StreamTo()
+  int (*stream)(BodyContext& context, size_t total);
+};
+
+using Route = route_table::Route<RouteHandler>;
+using route_table::kDelete;
+using route_table::kGet;
+using route_table::kPatch;
+using route_table::kPost;
+using route_table::kPut;
+
+static constexpr RouteHandler ReadRoute(
+    void (*read)(AsyncWebServerRequest*)) {
+  return RouteHandler{read, nullptr, nullptr, nullptr};
+}
+
+static constexpr RouteHandler WriteRoute(
+    void (*write)(AsyncWebServerRequest*, const String&)) {
+  return RouteHandler{nullptr, write, nullptr, nullptr};
+}
+
+static constexpr RouteHandler RpcRoute(void (*rpc)(Responder&,
+                                                   const String&)) {
+  return RouteHandler{nullptr, nullptr, rpc, nullptr};
+}
+
+static constexpr RouteHandler StreamRoute(int (*stream)(BodyContext&,
+                                                        size_t)) {
+  return RouteHandler{nullptr, nullptr, nullptr, stream};
+}
+
+// nullptr if no route serves `method` (one of route_table's) at `path`
+static const Route* FindRoute(uint8_t method, const char* path);
+
+static kb::Mutex g_test_press_mutex;
+static std::deque<KButton> g_test_presses;  // guard by g_test_press_mutex
+
+void Responder::Send(const int status) {
+  if (request_ != nullptr) {
+    request_->send(status);
+  } else {
+    Send(status, "text/plain", String());
+  }
+}
+
+void Responder::Send(const int status, const char* content_type,
+                     const String& content) {
+  if (request_ != nullptr) {
+    request_->send(status, content_type, content);
+    return;
+  }
+  JsonDocument doc;
+  doc["type"] = "response";
+  doc["id"] = rpc_id_;
+  doc["status"] = status;
+  if (!content.isEmpty()) {
+    if (std::strstr(content_type, "json") != nullptr) {
+      doc["body"] = serialized(content);
+    } else {
+      doc["body"] = content;
+    }
+  }
+  // A reply that is dropped would leave the request pending on the client
+  // until it times out, although the change has been applied. The client is
+  // closed instead, which fails its pending requests at once, and it gets the
+  // current state from the snapshots once reconnected.
+  if (client_->status() != WS_CONNECTED || client_->queueIsFull()) {
+    KB_LOGE("ws[%u] cannot queue the response to %u\n", client_->id(),
+            rpc_id_);
+    client_->close();
+    return;
+  }
+  String out;
+  serializeJson(doc, out);
+  client_->text(out);
+}
+
+bool RequestTestPress(const KButton& button) {
+  const kb::LockGuard lock(g_test_press_mutex);
+  if (g_test_presses.size() >= kMaxPendingTestPresses) {
+    return false;
+  }
+  g_test_presses.push_back(button);
+  return true;
+}
+
+bool PopTestPress(KButton* button) {
+  const kb::LockGuard lock(g_test_press_mutex);
+  if (g_test_presses.empty()) {
+    return false;
+  }
+  *button = g_test_presses.front();
+  g_test_presses.pop_front();
+  return true;
+}
+
+// The handler runs in the AsyncTCP task like that of an HTTP request, so the
+// requests of a client are answered in order.
+static void HandleRpcRequest(AsyncWebSocketClient* client,
+                             const JsonDocument& doc) {
+  Responder responder(client, doc["id"].as<uint32_t>());
+  const String method = doc["method"].as<String>();
+  const String path = doc["path"].as<String>();
+  const Route* route =
+      FindRoute(route_table::ParseMethod(method.c_str()), path.c_str());
+  if (route == nullptr || route->handler.rpc == nullptr) {
+    responder.Send(404, "text/plain", "Not Found");
+    return;
+  }
+  responder.set_path_param(
+      route_table::GetWildcard(route->path, path.c_str()));
+  String body;
+  serializeJson(doc["body"], body);
+  route->handler.rpc(responder, body);
+}
+
+// {"type": "subscribe" | "unsubscribe", "topic": "log"}
+// {"type": "resync", "topic": "observed_buttons" | "commands"}
+// {"type": "request", ...}, see Responder
+static void HandleWsTextMessage(AsyncWebSocketClient* client, const char* data,
+                                const size_t len) {
+  JsonDocument doc;
+  const DeserializationError error = deserializeJson(doc, data, len);
+  if (error) {
+    KB_LOGW("ws[%u] invalid message: %s\n", client->id(), error.c_str());
+    return;
+  }
+  const String type = doc["type"].as<String>();
+  if (type == "request") {
+    HandleRpcRequest(client, doc);
+    return;
+  }
+  const String topic = doc["topic"].as<String>();
+  if (type == "resync") {
+    RequestWsResync(client, topic);
+    return;
+  }
+  if (topic != "log") {
+    KB_LOGW("ws[%u] unknown topic: %s\n", client->id(), topic.c_str());
+    return;
+  }
+  if (type == "subscribe") {
+    SubscribeLogStream(client);
+  } else if (type == "unsubscribe") {
+    UnsubscribeLogStream(client);
+  }
 }
 
 static void OnWebSocketEvent(AsyncWebSocket* server,
                              AsyncWebSocketClient* client, AwsEventType type,
                              void* arg, uint8_t* data, size_t len,
-                             RobotInfoHolder& robot_info,
-                             const CommandTable& command_table) {
+                             RobotInfoHolder& robot_info) {
   if (type == WS_EVT_CONNECT) {
     // client connected
-    Serial.printf("ws[%s][%u] connect\n", server->url(), client->id());
+    KB_LOGI("ws[%s][%u] connect\n", server->url(), client->id());
+    // `arg` is the upgrade request
+    const uint8_t encoding =
+        GetRequestedWsEncoding(static_cast<AsyncWebServerRequest*>(arg));
     {
       const kb::LockGuard lock(g_ws_mutex);
-      g_ws_clients.insert(client);
+      const uint32_t now = millis();
+      g_ws_clients.push_back(
+          WsClient{client, encoding, now, now, false, 0, 0});
       g_ws_client_count++;
     }
-    SendAllToClient(client, robot_info, command_table);
-    EnqueueWsMessage(to_json::ConvertHubInfo(g_ws_client_count));
+    SendAllToClient(client, encoding, robot_info);
+    PublishHubInfo();
     if (g_settings.GetAutoRefetchOnUiLoad()) {
       fetch_state::FetchRobotInfoThrottled(&robot_info);
     }
@@ -79,352 +865,604 @@ static void OnWebSocketEvent(AsyncWebSocket* server,
   }
   if (type == WS_EVT_DISCONNECT) {
     // client disconnected
-    Serial.printf("ws[%s][%u] disconnect: %u\n", server->url(), client->id());
+    KB_LOGI("ws[%s][%u] disconnect\n", server->url(), client->id());
+    UnsubscribeLogStream(client);
     int removed = 0;
     {
       const kb::LockGuard lock(g_ws_mutex);
-      removed = g_ws_clients.erase(client);
+      const auto it = std::remove_if(g_ws_clients.begin(), g_ws_clients.end(),
+                                     [client](const WsClient& ws_client) {
+                                       return ws_client.client == client;
+                                     });
+      removed = g_ws_clients.end() - it;
+      g_ws_clients.erase(it, g_ws_clients.end());
       g_ws_client_count--;
     }
     if (removed != 1) {
-      Serial.printf("ERROR: Failed to remove client: %d\n", removed);
+      KB_LOGE("ERROR: Failed to remove client: %d\n", removed);
     }
-    EnqueueWsMessage(to_json::ConvertHubInfo(g_ws_client_count));
+    PublishHubInfo();
     return;
   }
   if (type == WS_EVT_ERROR) {
     // error was received from the other end
-    Serial.printf("ws[%s][%u] error(%u): %s\n", server->url(), client->id(),
-                  *reinterpret_cast<uint16_t*>(arg), data);
+    KB_LOGE("ws[%s][%u] error(%u): %s\n", server->url(), client->id(),
+            *reinterpret_cast<uint16_t*>(arg), data);
     return;
   }
   if (type == WS_EVT_PONG) {
     // pong message was received (in response to a ping request maybe)
-    Serial.printf("ws[%s][%u] pong[%u]: %s\n", server->url(), client->id(), len,
-                  len ? reinterpret_cast<char*>(data) : "");
+    TouchWsClient(client);
+    KB_LOGD("ws[%s][%u] pong[%u]: %.*s\n", server->url(), client->id(), len,
+            static_cast<int>(len), reinterpret_cast<char*>(data));
     return;
   }
   if (type == WS_EVT_DATA) {
     // data packet
+    TouchWsClient(client);
     auto* info = reinterpret_cast<AwsFrameInfo*>(arg);
     if (info->final && info->index == 0 && info->len == len) {
       // the whole message is in a single frame and we got all of it's data
-      Serial.printf("ws[%s][%u] %s-message[%llu]: ", server->url(),
-                    client->id(), (info->opcode == WS_TEXT) ? "text" : "binary",
-                    info->len);
-      if (info->opcode == WS_TEXT) {
-        data[len] = 0;
-        Serial.printf("%s\n", data);
-      } else {
-        for (size_t i = 0; i < info->len; i++) {
-          Serial.printf("%02x ", data[i]);
-        }
-        Serial.printf("\n");
+      if (KB_LOG_IS_ENABLED(DEBUG)) {
+        LogWebSocketMessage(server, client, info, data, len);
       }
       if (info->opcode == WS_TEXT) {
-        client->text("I got your text message");
+        HandleWsTextMessage(client, reinterpret_cast<const char*>(data), len);
       } else {
-        client->binary("I got your binary message");
+        // Binary frames only go from the hub to the clients, see
+        // SendWsMessageLocked(). 1003 is "unsupported data".
+        KB_LOGW("ws[%u] unexpected binary message\n", client->id());
+        client->close(1003);
       }
     } else {
       // message is comprised of multiple frames or the frame is split into
       // multiple packets
-      Serial.println("ERROR: Message is comprised of multiple frames");
+      KB_LOGE("Message is comprised of multiple frames\n");
     }
     return;
   }
 }
 
-static void RegisterReadEntry(
-    AsyncWebServer& server, const char* url, WebRequestMethodComposite method,
-    std::function<void(AsyncWebServerRequest*)> handler) {
-  server.on(
-      url, method,
-      [url, handler = std::move(handler)](AsyncWebServerRequest* request) {
-        Serial.printf("%s %s\n", request->methodToString(), url);
-        handler(request);
-      });
-}
-
-static void RegisterWriteEntry(
-    AsyncWebServer& server, const char* url, WebRequestMethodComposite method,
-    std::function<void(AsyncWebServerRequest*, const String&)> handler) {
-  server.on(
-      url, method,
-      [url, handler](AsyncWebServerRequest* request) {
-        Serial.printf("%s %s\n", request->methodToString(), url);
-        // body-less request is not supported
-        if (request->hasArg("body")) {
-          const String& body = request->arg("body");
-          handler(request, body);
-        }
-      },
-      nullptr,
-      [url, handler = std::move(handler)](AsyncWebServerRequest* request,
-                                          uint8_t* data, size_t len,
-                                          size_t index, size_t total) {
-        Serial.printf("%s %s (BODY: %zu, %zu, %zu)\n",
-                      request->methodToString(), url, index, len, total);
-        static String buffer;  // TODO: Use a buffer pool
-        if (index == 0) {
-          buffer = String(data, len);
-        } else {
-          buffer += String(data, len);
-        }
-        if (index + len == total) {
-          handler(request, buffer);
-        }
-      });
-}
-
-static void RegisterGetAndPutEntry(
-    AsyncWebServer& server, const char* url_path,
-    std::function<void(AsyncWebServerRequest*)> get_handler,
-    std::function<void(AsyncWebServerRequest*, const String&)> put_handler) {
-  RegisterReadEntry(server, url_path, HTTP_GET, std::move(get_handler));
-  RegisterWriteEntry(server, url_path, HTTP_PUT, std::move(put_handler));
-}
-
-static void SetWifiHandler(AsyncWebServer& server) {
-  RegisterGetAndPutEntry(
-      server, "/config/wifi",
-      [](AsyncWebServerRequest* request) { HandleGetWiFi(request); },
-      [](AsyncWebServerRequest* request, const String& body) {
-        HandleSetWiFi(request, body);
-      });
-  RegisterReadEntry(
-      server, "/wifi_scan", HTTP_GET, [](AsyncWebServerRequest* request) {
-        server::EnqueueWsMessage(to_json::ConvertWiFiApList(true, {}));
-        delay(100);
-        wifi::StartApScan();
-        while (true) {
-          const auto& [state, wifi_ap_list] = wifi::GetScannedWiFiApList();
-          switch (state) {
-            case wifi::ScanState::kFailed:
-              request->send(500, "text/plain", "Failed to scan WiFi APs");
-              return;
-            case wifi::ScanState::kSucceeded:
-              EnqueueWsMessage(to_json::ConvertWiFiApList(false, wifi_ap_list));
-              request->send(200, "text/plain",
-                            "OK (" + String(wifi_ap_list.size()) + " APs)");
-              return;
-          }
-        }
-      });
-  RegisterReadEntry(server, "/ota/desired_hub_version", HTTP_GET,
-                    [](AsyncWebServerRequest* request) {
-                      HandleGetDesiredHubVersion(request);
-                    });
-  RegisterWriteEntry(server, "/ota/image_url_by_version", HTTP_GET,
-                     [](AsyncWebServerRequest* request, const String& body) {
-                       HandleGetOtaImageUrlByVersion(request, body);
-                     });
-  RegisterWriteEntry(server, "/ota/trigger_ota_by_url", HTTP_POST,
-                     [](AsyncWebServerRequest* request, const String& body) {
-                       HandleOtaByImageUrl(request, body);
-                     });
+// Request bodies
+//
+// Each request with a body takes one of a fixed number of contexts from the
+// arrival of its first chunk until its handler has been called or the client
+// has disconnected. The body callbacks and the disconnect handlers all run in
+// the AsyncTCP task, so the contexts are not guarded by a mutex.
+
+// Bodies of the requests in flight at a time
+constexpr size_t kMaxBodyContexts = 4;
+// Larger bodies are rejected unless the route streams them
+constexpr size_t kMaxBufferedBodySize = 16 * 1024;
+
+struct BodyContext {
+  AsyncWebServerRequest* request = nullptr;  // nullptr if free
+  // Consumes the next chunk. Returns false to reject the request.
+  std::function<bool(const uint8_t* data, size_t len)> write;
+  // Called after the last chunk has been written
+  std::function<void(AsyncWebServerRequest*)> finish;
+  int error_status = 0;
+};
+
+static BodyContext g_body_contexts[kMaxBodyContexts];
+
+static BodyContext* FindBodyContext(const AsyncWebServerRequest* request) {
+  for (BodyContext& context : g_body_contexts) {
+    if (context.request == request) {
+      return &context;
+    }
+  }
+  return nullptr;
+}
+
+static void ReleaseBodyContext(BodyContext* context) {
+  if (context == nullptr) {
+    return;
+  }
+  context->request = nullptr;
+  context->write = nullptr;
+  context->finish = nullptr;
+  context->error_status = 0;
+}
+
+static BodyContext* AcquireBodyContext(AsyncWebServerRequest* request) {
+  BodyContext* context = FindBodyContext(nullptr);
+  if (context == nullptr) {
+    return nullptr;
+  }
+  context->request = request;
+  // The handler is not called if the client goes away in the middle
+  request->onDisconnect(
+      [request]() { ReleaseBodyContext(FindBodyContext(request)); });
+  return context;
+}
+
+static void SendBodyError(AsyncWebServerRequest* request, const int status) {
+  switch (status) {
+    case 413:
+      request->send(413, "text/plain", "Payload Too Large");
+      break;
+    case 503:
+      request->send(503, "text/plain", "Service Unavailable");
+      break;
+    default:
+      request->send(400, "text/plain", "Bad Request");
+      break;
+  }
+}
+
+// Calls the handler of a `write` or `rpc` route
+static void CallWriteHandler(const Route& route,
+                             AsyncWebServerRequest* request,
+                             const String& body) {
+  if (route.handler.rpc != nullptr) {
+    Responder responder(request);
+    responder.set_path_param(
+        route_table::GetWildcard(route.path, request->url().c_str()));
+    route.handler.rpc(responder, body);
+  } else {
+    route.handler.write(request, body);
+  }
+}
+
+// Sets up `context` for a body of `total` bytes. Returns the status to reject
+// the request with, or 0.
+static int BeginBody(const Route& route, BodyContext& context,
+                     const size_t total) {
+  if (route.handler.stream != nullptr) {
+    return route.handler.stream(context, total);
+  }
+  if (total > kMaxBufferedBodySize) {
+    return 413;
+  }
+  auto buffer = std::make_shared<String>();
+  if (!buffer->reserve(total)) {
+    return 503;
+  }
+  context.write = [buffer](const uint8_t* data, const size_t len) {
+    return buffer->concat(reinterpret_cast<const char*>(data), len);
+  };
+  // `route` is in a route table, which is never destroyed
+  context.finish = [buffer, &route](AsyncWebServerRequest* request) {
+    CallWriteHandler(route, request, *buffer);
+  };
+  return 0;
+}
+
+static void OnBodyChunk(const Route& route, AsyncWebServerRequest* request,
+                        const uint8_t* data, const size_t len,
+                        const size_t index, const size_t total) {
+  KB_LOGD("%s %s (BODY: %zu, %zu, %zu)\n", request->methodToString(),
+          route.path, index, len, total);
+  const bool is_last = index + len == total;
+  BodyContext* context = FindBodyContext(request);
+  if (context == nullptr && index == 0) {
+    context = AcquireBodyContext(request);
+    if (context != nullptr) {
+      context->error_status = BeginBody(route, *context, total);
+    }
+  }
+  if (context == nullptr) {
+    if (is_last) {
+      KB_LOGW("Too many request bodies in flight: %s\n", route.path);
+      SendBodyError(request, 503);
+    }
+    return;
+  }
+
+  if (context->error_status == 0 && !context->write(data, len)) {
+    context->error_status = 400;
+  }
+  if (is_last) {
+    if (context->error_status == 0) {
+      context->finish(request);
+    } else {
+      SendBodyError(request, context->error_status);
+    }
+    ReleaseBodyContext(context);
+  }
+}
+
+// `stream` of a route which passes each chunk of the body to a reader made by
+// `Begin` as it arrives instead of buffering the body. `End` is called with
+// the reader after the last chunk unless the reader has rejected one.
+//
+// Reader: bool Write(const uint8_t* data, size_t len);
+template <typename Reader, std::unique_ptr<Reader> (*Begin)(),
+          void (*End)(AsyncWebServerRequest*, Reader&)>
+static int StreamTo(BodyContext& context, size_t /*total*/) {
+  std::shared_ptr<Reader> reader = Begin();
+  if (!reader) {
+    return 503;
+  }
+  context.write = [reader](const uint8_t* data, const size_t len) {
+    return reader->Write(data, len);
+  };
+  context.finish = [reader](AsyncWebServerRequest* request) {
+    End(request, *reader);
+  };
+  return 0;
+}
+
+// Routes
+//
+// The handlers are plain functions, and those which take the command table
+// are adapted by the templates below, so that the routes are constant tables
+// with nothing on the heap. Paths are matched by route_table::MatchesPath().
+
+// Set before the server starts, and only read after that
+static CommandTable* g_route_command_table = nullptr;
+static bool g_serves_app_routes = false;
+
+template <void (*F)(AsyncWebServerRequest*, CommandTable&)>
+static void ReadWithTable(AsyncWebServerRequest* request) {
+  F(request, *g_route_command_table);
+}
+
+template <void (*F)(Responder&, const String&, CommandTable&)>
+static void RpcWithTable(Responder& responder, const String& body) {
+  F(responder, body, *g_route_command_table);
+}
+
+static std::unique_ptr<CommandTable::CommandArrayLoader> BeginPutCommands() {
+  return std::make_unique<CommandTable::CommandArrayLoader>(
+      *g_route_command_table);
+}
+
+static void EndPutCommands(AsyncWebServerRequest* request,
+                           CommandTable::CommandArrayLoader& loader) {
+  HandlePutCommands(request, loader, *g_route_command_table);
+}
+
+// Returns 202 at once. The result is sent as the "wifi_ap_list" WebSocket
+// message, and can be polled at /wifi_ap_list.
+static void HandleWiFiScan(AsyncWebServerRequest* request) {
+  switch (StartWiFiApScan(kWiFiScanMaxAgeMsec)) {
+    case WiFiApScanStart::kStarted:
+      request->send(202, "text/plain", "Accepted");
+      return;
+    case WiFiApScanStart::kFresh: {
+      const auto& [scanning, wifi_ap_list] =
+          wifi::GetLatestScannedWiFiApList();
+      request->send(200, "text/json; charset=utf-8",
+                    to_json::ConvertWiFiApList(scanning, wifi_ap_list));
+    }
+      return;
+    case WiFiApScanStart::kFailed:
+      request->send(500, "text/plain", "Failed to scan WiFi APs");
+      return;
+  }
+}
+
+static void HandleGetWiFiApList(AsyncWebServerRequest* request) {
+  const auto& [scanning, wifi_ap_list] = wifi::GetLatestScannedWiFiApList();
+  request->send(200, "text/json; charset=utf-8",
+                to_json::ConvertWiFiApList(scanning, wifi_ap_list));
+}
+
+static void HandleGetLog(AsyncWebServerRequest* request) {
+  AsyncWebParameter* path_param = request->getParam("path");
+  if (path_param) {
+    AsyncWebParameter* download_param = request->getParam("download");
+    HandleLoggingGet(request, path_param->value(),
+                     download_param && download_param->value() == "true");
+  } else {
+    HandleLoggingList(request);
+  }
+}
+
+static void HandleReboot(AsyncWebServerRequest* request) {
+  request->send(203);
+  delay(100);
+  ESP.restart();
+}
+
+static void HandleGetUiBundle(AsyncWebServerRequest* request) {
+  JsonDocument doc;
+  doc["installed"] = web_ui::IsInstalled();
+  doc["version"] = web_ui::GetVersion();
+  String out;
+  serializeJson(doc, out);
+  request->send(200, "text/json; charset=utf-8", out);
+}
+
+static void HandlePutUiBundle(AsyncWebServerRequest* request,
+                              web_ui::BundleWriter& writer) {
+  if (writer.Commit()) {
+    request->send(200, "text/plain", "OK");
+  } else {
+    request->send(400, "text/plain", "Bad Request");
+  }
+}
+
+static void HandleGetRoutes(AsyncWebServerRequest* request);
+
+// Served in both modes, including while the Wi-Fi is being set up
+static constexpr Route kCommonRoutes[] = {
+    {"/config/wifi", kGet, ReadRoute(HandleGetWiFi)},
+    {"/config/wifi", kPut, WriteRoute(HandleSetWiFi)},
+    {"/wifi_scan", kGet, ReadRoute(HandleWiFiScan)},
+    {"/wifi_ap_list", kGet, ReadRoute(HandleGetWiFiApList)},
+    {"/ota/desired_hub_version", kGet, ReadRoute(HandleGetDesiredHubVersion)},
+    {"/ota/image_url_by_version", kGet,
+     WriteRoute(HandleGetOtaImageUrlByVersion)},
+    {"/ota/trigger_ota_by_url", kPost, WriteRoute(HandleOtaByImageUrl)},
+    {"/ui_bundle", kGet, ReadRoute(HandleGetUiBundle)},
+    // The web UI can be updated without a firmware update
+    {"/ui_bundle", kPut,
+     StreamRoute(StreamTo<web_ui::BundleWriter, web_ui::BundleWriter::Create,
+                          HandlePutUiBundle>)},
+    {"/routes", kGet, ReadRoute(HandleGetRoutes)},
+};
+
+// Served once the hub is connected
+static constexpr Route kAppRoutes[] = {
+    {"/config/robot_host", kGet, ReadRoute(HandleGetRobotHost)},
+    {"/config/robot_host", kPut, WriteRoute(HandleSetRobotHost)},
+    {"/config/beep_volume", kGet, ReadRoute(HandleGetBeepVolume)},
+    {"/config/beep_volume", kPut, RpcRoute(HandleSetBeepVolume)},
+    {"/config/screen_brightness", kGet, ReadRoute(HandleGetScreenBrightness)},
+    {"/config/screen_brightness", kPut, RpcRoute(HandleSetScreenBrightness)},
+    {"/config/auto_ota_is_enabled", kGet,
+     ReadRoute(HandleGetAutoOtaIsEnabled)},
+    {"/config/auto_ota_is_enabled", kPut,
+     RpcRoute(HandleSetAutoOtaIsEnabled)},
+    {"/config/one_shot_auto_ota_is_enabled", kGet,
+     ReadRoute(HandleGetOneShotAutoOtaIsEnabled)},
+    {"/config/one_shot_auto_ota_is_enabled", kPut,
+     RpcRoute(HandleSetOneShotAutoOtaIsEnabled)},
+    {"/config/auto_refetch_on_ui_load", kGet,
+     ReadRoute(HandleGetAutoRefetchOnUiLoad)},
+    {"/config/auto_refetch_on_ui_load", kPut,
+     RpcRoute(HandleSetAutoRefetchOnUiLoad)},
+    {"/config/gpio_button_is_enabled", kGet,
+     ReadRoute(HandleGetGpioButtonIsEnabled)},
+    {"/config/gpio_button_is_enabled", kPut,
+     RpcRoute(RpcWithTable<HandleSetGpioButtonIsEnabled>)},
+
+    {"/buttons", kGet, ReadRoute(ReadWithTable<HandleGetObservedButtons>)},
+    {"/buttons", kPut, RpcRoute(RpcWithTable<HandleSetButtonName>)},
+    {"/buttons", kDelete, RpcRoute(RpcWithTable<HandleDeleteButtonName>)},
+    {"/buttons/*", kPut, RpcRoute(RpcWithTable<HandlePutButtonById>)},
+    {"/buttons/*", kDelete, RpcRoute(RpcWithTable<HandleDeleteButtonById>)},
+
+    {"/commands", kGet, ReadRoute(ReadWithTable<HandleGetCommands>)},
+    {"/commands", kPost, RpcRoute(RpcWithTable<HandlePostCommand>)},
+    // The body is parsed record by record instead of buffered, but the
+    // parsed commands are held until the body ends, see CommandArrayLoader
+    {"/commands", kPut,
+     StreamRoute(StreamTo<CommandTable::CommandArrayLoader, BeginPutCommands,
+                          EndPutCommands>)},
+    {"/commands", kDelete, RpcRoute(RpcWithTable<HandleDeleteCommand>)},
+    {"/commands", kPatch, RpcRoute(RpcWithTable<HandlePatchCommands>)},
+    // Per-entry endpoints keyed by a button_id, which change and save only
+    // that entry
+    {"/commands/*", kPut, RpcRoute(RpcWithTable<HandlePutCommandById>)},
+    {"/commands/*", kDelete, RpcRoute(RpcWithTable<HandleDeleteCommandById>)},
+    {"/test_press", kPost, RpcRoute(RpcWithTable<HandleTestPress>)},
+
+    {"/log", kGet, ReadRoute(HandleGetLog)},
+    {"/log", kDelete, WriteRoute(HandleLoggingDelete)},
+    {"/log/query", kGet, ReadRoute(HandleLoggingQuery)},
+    {"/config/log_levels", kGet, ReadRoute(HandleGetLogLevels)},
+    {"/config/log_levels", kPut, WriteRoute(HandleSetLogLevels)},
+    {"/config/syslog", kGet, ReadRoute(HandleGetSyslog)},
+    {"/config/syslog", kPut, WriteRoute(HandleSetSyslog)},
+
+    {"/reboot", kGet, ReadRoute(HandleReboot)},
+    {"/clear_all_data", kGet, ReadRoute(ReadWithTable<HandleClearAllData>)},
+};
+
+static_assert(!route_table::HasConflicts(kCommonRoutes, kAppRoutes),
+              "Each method and path must be served by one route");
+
+static const Route* FindRoute(const uint8_t method, const char* path) {
+  const Route* route = route_table::Find(kCommonRoutes, method, path);
+  if (route == nullptr && g_serves_app_routes) {
+    route = route_table::Find(kAppRoutes, method, path);
+  }
+  return route;
+}
+
+// The method of `request` as in route_table, or 0 if no route can have it
+static uint8_t GetRouteMethod(AsyncWebServerRequest* request) {
+  const auto method = request->method();
+  if (method == HTTP_GET) {
+    return kGet;
+  }
+  if (method == HTTP_POST) {
+    return kPost;
+  }
+  if (method == HTTP_PUT) {
+    return kPut;
+  }
+  if (method == HTTP_DELETE) {
+    return kDelete;
+  }
+  if (method == HTTP_PATCH) {
+    return kPatch;
+  }
+  return 0;
+}
+
+template <size_t N>
+static void AppendRoutes(const Route (&routes)[N], JsonArray out) {
+  for (const Route& route : routes) {
+    JsonObject object = out.add<JsonObject>();
+    object["method"] = route_table::GetMethodName(route.method);
+    object["path"] = route.path;
+    object["rpc"] = route.handler.rpc != nullptr;
+  }
+}
+
+// The routes served now, generated from the tables:
+// [{"method": "PUT", "path": "/config/beep_volume", "rpc": true}, ...]
+static void HandleGetRoutes(AsyncWebServerRequest* request) {
+  JsonDocument doc;
+  JsonArray routes = doc.to<JsonArray>();
+  AppendRoutes(kCommonRoutes, routes);
+  if (g_serves_app_routes) {
+    AppendRoutes(kAppRoutes, routes);
+  }
+  String out;
+  serializeJson(doc, out);
+  request->send(200, "text/json; charset=utf-8", out);
 }
 
 static void SetWebSocketHandler(AsyncWebServer& server, AsyncWebSocket& ws,
                                 RobotInfoHolder& robot_info,
                                 CommandTable& command_table) {
-  ws.onEvent([&robot_info, &command_table](
-                 AsyncWebSocket* server, AsyncWebSocketClient* client,
-                 AwsEventType type, void* arg, uint8_t* data, size_t len) {
-    OnWebSocketEvent(server, client, type, arg, data, len, robot_info,
-                     command_table);
+  {
+    const kb::LockGuard lock(g_ws_mutex);
+    g_command_table = &command_table;
+  }
+  ws.onEvent([&robot_info](AsyncWebSocket* server,
+                           AsyncWebSocketClient* client, AwsEventType type,
+                           void* arg, uint8_t* data, size_t len) {
+    OnWebSocketEvent(server, client, type, arg, data, len, robot_info);
   });
   server.addHandler(&ws);
 }
 
-static void SetAppHandler(AsyncWebServer& server, CommandTable& command_table) {
-  RegisterGetAndPutEntry(
-      server, "/config/robot_host",
-      [](AsyncWebServerRequest* request) { HandleGetRobotHost(request); },
-      [](AsyncWebServerRequest* request, const String& body) {
-        HandleSetRobotHost(request, body);
-      });
-  RegisterGetAndPutEntry(
-      server, "/config/beep_volume",
-      [](AsyncWebServerRequest* request) { HandleGetBeepVolume(request); },
-      [](AsyncWebServerRequest* request, const String& body) {
-        HandleSetBeepVolume(request, body);
-      });
-  RegisterGetAndPutEntry(
-      server, "/config/screen_brightness",
-      [](AsyncWebServerRequest* request) {
-        HandleGetScreenBrightness(request);
-      },
-      [](AsyncWebServerRequest* request, const String& body) {
-        HandleSetScreenBrightness(request, body);
-      });
-  RegisterGetAndPutEntry(
-      server, "/config/auto_ota_is_enabled",
-      [](AsyncWebServerRequest* request) {
-        HandleGetAutoOtaIsEnabled(request);
-      },
-      [](AsyncWebServerRequest* request, const String& body) {
-        HandleSetAutoOtaIsEnabled(request, body);
-      });
-  RegisterGetAndPutEntry(
-      server, "/config/one_shot_auto_ota_is_enabled",
-      [](AsyncWebServerRequest* request) {
-        HandleGetOneShotAutoOtaIsEnabled(request);
-      },
-      [](AsyncWebServerRequest* request, const String& body) {
-        HandleSetOneShotAutoOtaIsEnabled(request, body);
-      });
-  RegisterGetAndPutEntry(
-      server, "/config/auto_refetch_on_ui_load",
-      [](AsyncWebServerRequest* request) {
-        HandleGetAutoRefetchOnUiLoad(request);
-      },
-      [](AsyncWebServerRequest* request, const String& body) {
-        HandleSetAutoRefetchOnUiLoad(request, body);
-      });
-  RegisterGetAndPutEntry(
-      server, "/config/gpio_button_is_enabled",
-      [](AsyncWebServerRequest* request) {
-        HandleGetGpioButtonIsEnabled(request);
-      },
-      [&command_table](AsyncWebServerRequest* request, const String& body) {
-        HandleSetGpioButtonIsEnabled(request, body, command_table);
-      });
-
-  RegisterGetAndPutEntry(
-      server, "/buttons",
-      [&command_table](AsyncWebServerRequest* request) {
-        HandleGetObservedButtons(request, command_table);
-      },
-      [&command_table](AsyncWebServerRequest* request, const String& body) {
-        HandleSetButtonName(request, body, command_table);
-      });
-  RegisterWriteEntry(
-      server, "/buttons", HTTP_DELETE,
-      [&command_table](AsyncWebServerRequest* request, const String& body) {
-        HandleDeleteButtonName(request, body, command_table);
-      });
-
-  RegisterWriteEntry(
-      server, "/commands", HTTP_POST,
-      [&command_table](AsyncWebServerRequest* request, const String& body) {
-        HandlePostCommand(request, body, command_table);
-      });
-  RegisterGetAndPutEntry(
-      server, "/commands",
-      [&command_table](AsyncWebServerRequest* request) {
-        HandleGetCommands(request, command_table);
-      },
-      [&command_table](AsyncWebServerRequest* request, const String& body) {
-        HandlePutCommands(request, body, command_table);
-      });
-  // Ideally, it should be /commands/{id}, but since ASYNCWEBSERVER_REGEX must
-  // be enabled in order to use path variables, we will proceed with the policy
-  // of not using variables for now.
-  RegisterWriteEntry(
-      server, "/commands", HTTP_DELETE,
-      [&command_table](AsyncWebServerRequest* request, const String& body) {
-        HandleDeleteCommand(request, body, command_table);
-      });
-
-  RegisterReadEntry(
-      server, "/log", HTTP_GET, [](AsyncWebServerRequest* request) {
-        AsyncWebParameter* path_param = request->getParam("path");
-        if (path_param) {
-          AsyncWebParameter* download_param = request->getParam("download");
-          HandleLoggingGet(request, path_param->value(),
-                           download_param && download_param->value() == "true");
-        } else {
-          HandleLoggingList(request);
-        }
-      });
-  RegisterWriteEntry(
-      server, "/log", HTTP_DELETE,
-      [&command_table](AsyncWebServerRequest* request, const String& body) {
-        HandleLoggingDelete(request, body);
-      });
-
-  RegisterReadEntry(server, "/reboot", HTTP_GET,
-                    [](AsyncWebServerRequest* request) {
-                      request->send(203);
-                      delay(100);
-                      ESP.restart();
-                    });
-  RegisterReadEntry(server, "/clear_all_data", HTTP_GET,
-                    [&command_table](AsyncWebServerRequest* request) {
-                      HandleClearAllData(request, command_table);
-                    });
+// An asset sent from the flash, whose bundle is not erased until the
+// response is deleted, i.e. sent or dropped with the client
+class AssetResponse : public AsyncProgmemResponse {
+ public:
+  AssetResponse(const char* mime_type, const uint8_t* data, const size_t size,
+                web_ui::AssetLease& lease)
+      : AsyncProgmemResponse(200, mime_type, data, size),
+        lease_(std::move(lease)) {}
+
+ private:
+  web_ui::AssetLease lease_;
+};
+
+// Sends the best variant of `asset` which the client accepts. A browser
+// revalidates "/" with its ETag on every load, and keeps the content-hashed
+// files it refers to without asking again. The embedded bundle has no
+// original of the files it has gzipped, so those are sent gzipped anyway.
+static void SendAsset(AsyncWebServerRequest* request,
+                      const ui_bundle::Asset& asset,
+                      web_ui::AssetLease& lease) {
+  KB_LOGD("GET %s\n", asset.path);
+  AsyncWebHeader* if_none_match = request->getHeader("If-None-Match");
+  AsyncWebServerResponse* response = nullptr;
+  if (if_none_match != nullptr && if_none_match->value() == asset.etag) {
+    response = request->beginResponse(304);
+  } else {
+    AsyncWebHeader* accept_encoding = request->getHeader("Accept-Encoding");
+    const String accepted =
+        accept_encoding != nullptr ? accept_encoding->value() : String();
+    if (asset.br_data != nullptr && accepted.indexOf("br") >= 0) {
+      response = new AssetResponse(asset.mime_type, asset.br_data,
+                                   asset.br_size, lease);
+      response->addHeader("Content-Encoding", "br");
+    } else if (asset.gz_data != nullptr &&
+               (accepted.indexOf("gzip") >= 0 || asset.data == nullptr)) {
+      response = new AssetResponse(asset.mime_type, asset.gz_data,
+                                   asset.gz_size, lease);
+      response->addHeader("Content-Encoding", "gzip");
+    } else {
+      response =
+          new AssetResponse(asset.mime_type, asset.data, asset.size, lease);
+    }
+  }
+  response->addHeader("ETag", asset.etag);
+  response->addHeader("Cache-Control",
+                      asset.is_immutable ? "public, max-age=31536000, immutable"
+                                         : "no-cache");
+  response->addHeader("Vary", "Accept-Encoding");
+  request->send(response);
 }
 
-static void SetCommonSettings(AsyncWebServer& server) {
-  const auto register_static_content =
-      [&server](const char* url_path, const uint8_t* data, const size_t size,
-                const uint8_t* gz_data, const size_t gz_size,
-                const char* mime_type) {
-        server.on(url_path, HTTP_GET,
-                  [url_path, data, size, gz_data, gz_size,
-                   mime_type](AsyncWebServerRequest* request) {
-                    Serial.printf("GET %s\n", url_path);
-                    bool use_gz = false;
-                    if (gz_data && !data) {
-                      use_gz = true;
-                    } else if (data && !gz_data) {
-                      use_gz = false;
-                    } else {
-                      AsyncWebHeader* enc =
-                          request->getHeader("Accept-Encoding");
-                      use_gz = enc && enc->value().indexOf("gzip") >= 0;
-                    }
-                    auto* p = new AsyncProgmemResponse(200, mime_type,
-                                                       use_gz ? gz_data : data,
-                                                       use_gz ? gz_size : size);
-                    if (use_gz) {
-                      p->addHeader("Content-Encoding", "gzip");
-                    }
-                    request->send(p);
-                  });
-      };
-  register_static_content("/", data::index_html_data, data::index_html_size,
-                          nullptr, 0, "text/html");
-  register_static_content("/index.css", data::index_css_data,
-                          data::index_css_size, nullptr, 0, "text/css");
-  register_static_content("/index.js", data::index_js_data, data::index_js_size,
-                          data::index_js_gz_data, data::index_js_gz_size,
-                          "text/javascript");
-  register_static_content("/license.txt", nullptr, 0, data::license_txt_gz_data,
-                          data::license_txt_gz_size, "text/plain");
-
-  server.onNotFound([](AsyncWebServerRequest* request) {
-    request->send(request->method() == HTTP_OPTIONS ? 200 : 404);
-  });
+// Served at "/" if not even the embedded web UI is valid
+static constexpr char kNoWebUiHtml[] =
+    "<!doctype html><meta charset=\"utf-8\"><title>Kachaka Button Hub</title>"
+    "<p>Web UI is not installed. Select ui.bin to install it.</p>"
+    "<input type=\"file\" onchange=\"fetch('/ui_bundle', {method: 'PUT', "
+    "body: this.files[0]}).then(() => location.reload())\">";
+
+// The assets of the web UI are looked up in the bundle installed at the time
+static void SendAssetOrNotFound(AsyncWebServerRequest* request) {
+  if (request->method() == HTTP_GET) {
+    ui_bundle::Asset asset;
+    web_ui::AssetLease lease;
+    if (web_ui::FindAsset(request->url().c_str(), &asset, &lease)) {
+      SendAsset(request, asset, lease);
+      return;
+    }
+    if (request->url() == "/") {
+      request->send(200, "text/html", kNoWebUiHtml);
+      return;
+    }
+  }
+  request->send(request->method() == HTTP_OPTIONS ? 200 : 404);
+}
 
+// Every HTTP request but those of /ws ends up here, as the server has no
+// other handler
+static void OnRequest(AsyncWebServerRequest* request) {
+  const Route* route =
+      FindRoute(GetRouteMethod(request), request->url().c_str());
+  if (route == nullptr) {
+    SendAssetOrNotFound(request);
+    return;
+  }
+  KB_LOGD("%s %s\n", request->methodToString(), route->path);
+  const RouteHandler& handler = route->handler;
+  if (handler.read != nullptr) {
+    handler.read(request);
+  } else if (handler.stream == nullptr && request->hasArg("body")) {
+    // A plain text body, which the server parses instead of passing on
+    CallWriteHandler(*route, request, request->arg("body"));
+  } else if (handler.stream == nullptr && request->contentLength() == 0) {
+    // e.g. DELETE /commands/m5-1
+    CallWriteHandler(*route, request, String());
+  }
+  // Otherwise the last chunk of the body has been answered
+}
+
+static void OnRequestBody(AsyncWebServerRequest* request, uint8_t* data,
+                          const size_t len, const size_t index,
+                          const size_t total) {
+  const Route* route =
+      FindRoute(GetRouteMethod(request), request->url().c_str());
+  if (route == nullptr || route->handler.read != nullptr) {
+    return;  // the body is ignored
+  }
+  OnBodyChunk(*route, request, data, len, index, total);
+}
+
+static void SetCommonSettings(AsyncWebServer& server) {
+  web_ui::Begin();
+  server.onNotFound(OnRequest);
+  server.onRequestBody(OnRequestBody);
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "*");
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers",
                                        "Content-Type");
 
   server.begin();
-  Serial.println("HTTP server started");
+  KB_LOGI("HTTP server started\n");
 }
 
 void SetupHttpServerForWiFiSetting(RobotInfoHolder& robot_info,
                                    CommandTable& command_table) {
-  SetWifiHandler(g_server);
   SetWebSocketHandler(g_server, g_ws, robot_info, command_table);
   SetCommonSettings(g_server);
 }
 
 void SetupHttpServer(RobotInfoHolder& robot_info, CommandTable& command_table) {
-  SetWifiHandler(g_server);
+  g_route_command_table = &command_table;
+  g_serves_app_routes = true;
   SetWebSocketHandler(g_server, g_ws, robot_info, command_table);
-  SetAppHandler(g_server, command_table);
   SetCommonSettings(g_server);
 }
 
 void Stop() {
   const kb::LockGuard lock(g_ws_mutex);
-  for (auto& client : g_ws_clients) {
-    client->close();
+  for (auto& ws_client : g_ws_clients) {
+    ws_client.client->close();
   }
   g_ws_clients.clear();
   g_ws_client_count = 0;
@@ -2,8 +2,12 @@
 
 #include <ESPAsyncWebServer.h>
 #include <M5Unified.h>
+#include <functional>
+#include <memory>
+#include <string>
 
 #include "command_table.hpp"
+#include "to_json.hpp"
 #include "types.hpp"
 
 namespace server {
@@ -12,9 +16,105 @@ void SetupHttpServerForWiFiSetting(RobotInfoHolder& robot_info,
                                    CommandTable& command_table);
 void SetupHttpServer(RobotInfoHolder& robot_info, CommandTable& command_table);
 
-void EnqueueWsMessage(String msg);
+// Each topic holds the latest snapshot of one kind of state. A message
+// replaces the pending one of its topic, and FlushWsMessageQueue() sends it
+// to all the clients unless it is the same as the last one sent. A client
+// whose outbound queue is full skips messages and gets the latest one of each
+// skipped topic once it catches up.
+enum class WsTopic : uint8_t {
+  kHubInfo,
+  kRobotInfo,
+  kSettings,
+  kObservedButtons,
+  kCommands,
+  kWiFiApList,
+  kWiFiRssi,
+  kCount,
+};
+
+// `make_msgpack` is called, with the mutex of the clients held, only while a
+// client takes MessagePack (see "format=msgpack" in server.cpp).
+void PublishWsMessage(WsTopic topic, String json,
+                      const std::function<std::string()>& make_msgpack);
+// `make` is called as `make(to_json::Json())` and, while a client takes
+// MessagePack, as `make(to_json::MsgPack())`, e.g.
+//
+//   PublishWsMessage(WsTopic::kSettings, [](auto format) {
+//     return to_json::ConvertSettings(g_settings, format);
+//   });
+template <typename Make>
+void PublishWsMessage(const WsTopic topic, Make make) {
+  PublishWsMessage(topic, make(to_json::Json()),
+                   [&make] { return make(to_json::MsgPack()); });
+}
 void FlushWsMessageQueue();
 
+// kObservedButtons and kCommands are sent as deltas of one entry, e.g.
+// {"type": "commands_delta", "version": 8, "upsert": [...]}, numbered by a
+// version per topic. Their snapshots carry "version" too. A client which
+// misses a version sends {"type": "resync", "topic": "commands"} to get a new
+// snapshot. Each snapshot is preceded by {"type": "clock", "timestamp_now":
+// ...}, as the cached snapshot doesn't have the current time.
+void PublishObservedButtonChange(const KButton& button);
+void PublishCommandChange(const KButton& button);
+// After changes to many entries, e.g. loading the whole table
+void PublishCommandTableSnapshot();
+
+// The snapshot of kObservedButtons or kCommands, serialized once per version,
+// and its ETag
+void GetSnapshot(WsTopic topic, std::shared_ptr<const String>* json,
+                 String* etag);
+
+// Starts a Wi-Fi AP scan without waiting for it. The result is published as
+// WsTopic::kWiFiApList by FlushWsMessageQueue() once the scan completes.
+enum class WiFiApScanStart {
+  kStarted,
+  kFresh,  // the last result is younger than `max_age_msec`
+  kFailed,
+};
+WiFiApScanStart StartWiFiApScan(uint32_t max_age_msec);
+
+// Where a write handler sends its response. The handlers of the rpc routes
+// serve both HTTP requests and RPC requests on /ws:
+//
+//   {"type": "request", "id": 1, "method": "PUT",
+//    "path": "/config/beep_volume", "body": {"beep_volume": 5}}
+//
+// which are answered in the order received with
+//
+//   {"type": "response", "id": 1, "status": 203, "body": "..."}
+//
+// where "body" is left out if empty, and is JSON for a JSON response. If the
+// queue of the client is full, the client is closed instead of the response
+// being dropped.
+class Responder {
+ public:
+  explicit Responder(AsyncWebServerRequest* request) : request_(request) {}
+  Responder(AsyncWebSocketClient* client, uint32_t rpc_id)
+      : client_(client), rpc_id_(rpc_id) {}
+
+  void Send(int status);
+  void Send(int status, const char* content_type, const String& content);
+
+  // The segment of the path matched by the "*" of the route, e.g. "m5-1" of
+  // /commands/m5-1 for /commands/*. Empty if the route has none.
+  const String& path_param() const { return path_param_; }
+  void set_path_param(const char* path_param) {
+    path_param_ = path_param != nullptr ? path_param : "";
+  }
+
+ private:
+  AsyncWebServerRequest* request_ = nullptr;
+  AsyncWebSocketClient* client_ = nullptr;
+  uint32_t rpc_id_ = 0;
+  String path_param_;
+};
+
+// Test presses are run by the main loop, since sending a command blocks.
+// Returns false if too many are pending.
+bool RequestTestPress(const KButton& button);
+bool PopTestPress(KButton* button);
+
 void Stop();
 
 }  // namespace server
@@ -2,40 +2,207 @@
 
 #include <ArduinoJson.h>
 #include <M5Unified.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <set>
+#include <vector>
 
+#include "button_id.hpp"
+#include "button_query.hpp"
 #include "command_table.hpp"
 #include "from_json.hpp"
+#include "logging.hpp"
 #include "server.hpp"
 #include "to_json.hpp"
 
+static constexpr logging::Module kLogModule = logging::Module::kServer;
+
+// Responds 304 if the client has the same version of the snapshot. The body
+// is copied from the shared snapshot into the TCP buffer chunk by chunk.
+static void SendSnapshot(AsyncWebServerRequest* request,
+                         const server::WsTopic topic) {
+  std::shared_ptr<const String> json;
+  String etag;
+  server::GetSnapshot(topic, &json, &etag);
+  AsyncWebHeader* if_none_match = request->getHeader("If-None-Match");
+  AsyncWebServerResponse* response =
+      if_none_match != nullptr && if_none_match->value() == etag
+          ? request->beginResponse(304)
+          : request->beginResponse(
+                "text/json; charset=utf-8", json->length(),
+                [json](uint8_t* buffer, size_t max_len, size_t index) {
+                  const size_t size = std::min(max_len, json->length() - index);
+                  std::memcpy(buffer, json->c_str() + index, size);
+                  return size;
+                });
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", "no-cache");
+  // The cached snapshot has no "timestamp_now". The time of the hub is in
+  // the Date header instead.
+  const std::time_t now = std::time(nullptr);
+  struct tm timeinfo;
+  gmtime_r(&now, &timeinfo);
+  char date[32];
+  strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &timeinfo);
+  response->addHeader("Date", date);
+  request->send(response);
+}
+
+// Changes in one PATCH /commands
+constexpr size_t kMaxPatchChanges = 32;
+
+// Applies and saves `changes`, publishes the deltas of the entries they
+// touch and responds. Nothing is changed if the table would be too large.
+static void ApplyChanges(server::Responder& responder,
+                         CommandTable& command_table,
+                         const std::vector<CommandTable::Change>& changes) {
+  if (!command_table.ApplyChanges(changes)) {
+    responder.Send(507, "text/plain", "Too many buttons");
+    return;
+  }
+  // Setting a command names a new button, and deleting the command of an
+  // iBeacon deletes its name
+  std::set<KButton> buttons;
+  std::set<KButton> command_buttons;
+  for (const CommandTable::Change& change : changes) {
+    buttons.insert(change.button);
+    if (change.type == CommandTable::Change::Type::kSetCommand ||
+        change.type == CommandTable::Change::Type::kDeleteCommand) {
+      command_buttons.insert(change.button);
+    }
+  }
+  for (const KButton& button : buttons) {
+    server::PublishObservedButtonChange(button);
+  }
+  for (const KButton& button : command_buttons) {
+    server::PublishCommandChange(button);
+  }
+  responder.Send(200, "text/plain", "OK");
+}
+
+// True if GET /buttons or GET /commands asks for a page rather than the
+// whole list
+static bool IsPageRequest(AsyncWebServerRequest* request) {
+  for (const char* name :
+       {"limit", "cursor", "type", "name_prefix", "observed_within"}) {
+    if (request->hasParam(name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Sends 400 if a parameter is invalid. `query` refers to the name_prefix of
+// `request`.
+static bool GetPageQuery(AsyncWebServerRequest* request,
+                         button_query::Query* query) {
+  std::time_t now;
+  std::time(&now);
+  AsyncWebParameter* limit = request->getParam("limit");
+  AsyncWebParameter* cursor = request->getParam("cursor");
+  AsyncWebParameter* type = request->getParam("type");
+  AsyncWebParameter* name_prefix = request->getParam("name_prefix");
+  AsyncWebParameter* observed_within = request->getParam("observed_within");
+  query->has_cursor = cursor != nullptr;
+  if ((limit != nullptr &&
+       !button_query::ParseLimit(limit->value().c_str(), &query->limit)) ||
+      (cursor != nullptr &&
+       !button_id::Parse(cursor->value().c_str(), &query->cursor)) ||
+      (type != nullptr &&
+       !button_query::ParseTypes(type->value().c_str(), &query->types)) ||
+      (observed_within != nullptr &&
+       !button_query::ParseObservedWithin(observed_within->value().c_str(),
+                                          now, &query->observed_since))) {
+    request->send(400, "text/plain", "Bad Request");
+    return false;
+  }
+  if (name_prefix != nullptr) {
+    query->name_prefix = name_prefix->value().c_str();
+  }
+  return true;
+}
+
+// Sends 404 unless the path ends with a valid button ID
+static bool GetPathButton(server::Responder& responder, KButton* button) {
+  if (!button_id::Parse(responder.path_param().c_str(), button)) {
+    responder.Send(404, "text/plain", "Not Found");
+    return false;
+  }
+  return true;
+}
+
+// Parses a body with a "button" into `doc` and `button`. Sends 400 if it is
+// not valid.
+static bool ParseButtonBody(server::Responder& responder, const String& body,
+                            JsonDocument* doc, KButton* button) {
+  DeserializationError error = deserializeJson(*doc, body);
+  if (error) {
+    KB_LOGE("Failed to parse JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
+    return false;
+  }
+  const JsonObject& root = doc->as<JsonObject>();
+  if (!root.containsKey("button")) {
+    KB_LOGE("Invalid JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
+    return false;
+  }
+  const JsonObject& button_json = root["button"];
+  if (!from_json::ConvertButtonJson(button_json, *button)) {
+    responder.Send(400, "text/plain", "Bad Request");
+    return false;
+  }
+  return true;
+}
+
 void HandleGetObservedButtons(AsyncWebServerRequest* request,
                               CommandTable& command_table) {
-  const String json = to_json::ConvertObservedButtons(
-      command_table.GetObservedButtons(), command_table.GetButtonNames());
-  request->send(200, "text/json; charset=utf-8", json);
+  if (!IsPageRequest(request)) {
+    SendSnapshot(request, server::WsTopic::kObservedButtons);
+    return;
+  }
+  button_query::Query query;
+  if (!GetPageQuery(request, &query)) {
+    return;
+  }
+  CommandTable::ObservedButtons observed_buttons;
+  ButtonMap<String> button_names;
+  KButton next_cursor;
+  const bool has_more = command_table.GetButtonPage(
+      query, &observed_buttons, &button_names, &next_cursor);
+  request->send(200, "text/json; charset=utf-8",
+                to_json::ConvertObservedButtonPage(
+                    observed_buttons, button_names,
+                    has_more ? &next_cursor : nullptr));
 }
 
-void HandlePostCommand(AsyncWebServerRequest* request, const String& body,
+void HandlePostCommand(server::Responder& responder, const String& body,
                        CommandTable& command_table) {
-  if (command_table.LoadCommand(body)) {
-    command_table.Save();
-    // button names may have changed if the button is new
-    server::EnqueueWsMessage(to_json::ConvertObservedButtons(
-        command_table.GetObservedButtons(), command_table.GetButtonNames()));
-    server::EnqueueWsMessage(
-        to_json::ConvertCommands(command_table.GetCommands()));
-    request->send(200, "text/plain", "OK");
-  } else {
-    request->send(400, "text/plain", "Bad Request");
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, body);
+  if (error) {
+    KB_LOGE("Failed to parse JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
+    return;
   }
+  JsonObject root = doc.as<JsonObject>();
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kSetCommand;
+  if (!from_json::ConvertCommandJson(root, change.button, change.command)) {
+    responder.Send(400, "text/plain", "Bad Request");
+    return;
+  }
+  ApplyChanges(responder, command_table, {change});
 }
 
-void HandlePutCommands(AsyncWebServerRequest* request, const String& body,
+void HandlePutCommands(AsyncWebServerRequest* request,
+                       CommandTable::CommandArrayLoader& loader,
                        CommandTable& command_table) {
-  if (command_table.LoadCommandArray(body)) {
+  if (loader.Commit()) {
     command_table.Save();
-    server::EnqueueWsMessage(
-        to_json::ConvertCommands(command_table.GetCommands()));
+    server::PublishCommandTableSnapshot();
     request->send(200, "text/plain", "OK");
   } else {
     request->send(400, "text/plain", "Bad Request");
@@ -44,11 +211,24 @@ void HandlePutCommands(AsyncWebServerRequest* request, const String& body,
 
 void HandleGetCommands(AsyncWebServerRequest* request,
                        CommandTable& command_table) {
-  String json = to_json::ConvertCommands(command_table.GetCommands());
-  request->send(200, "text/json; charset=utf-8", json);
+  if (!IsPageRequest(request)) {
+    SendSnapshot(request, server::WsTopic::kCommands);
+    return;
+  }
+  button_query::Query query;
+  if (!GetPageQuery(request, &query)) {
+    return;
+  }
+  ButtonMap<String> commands;
+  KButton next_cursor;
+  const bool has_more =
+      command_table.GetCommandPage(query, &commands, &next_cursor);
+  request->send(200, "text/json; charset=utf-8",
+                to_json::ConvertCommandPage(
+                    commands, has_more ? &next_cursor : nullptr));
 }
 
-void HandleDeleteCommand(AsyncWebServerRequest* request, const String& body,
+void HandleDeleteCommand(server::Responder& responder, const String& body,
                          CommandTable& command_table) {
   // {
   //   "button": {
@@ -61,37 +241,18 @@ void HandleDeleteCommand(AsyncWebServerRequest* request, const String& body,
   //   },
   // }
   JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, body);
-  if (error) {
-    Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
-    return;
-  }
-  const JsonObject& root = doc.as<JsonObject>();
-  if (!root.containsKey("button")) {
-    Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
-    return;
-  }
   KButton button{};
-  const JsonObject& button_json = root["button"];
-  const bool ok = from_json::ConvertButtonJson(button_json, button);
-  if (!ok) {
-    request->send(400, "text/plain", "Bad Request");
+  if (!ParseButtonBody(responder, body, &doc, &button)) {
     return;
   }
 
-  command_table.DeleteCommand(button);
-  command_table.Save();
-  server::EnqueueWsMessage(
-      to_json::ConvertCommands(command_table.GetCommands()));
-  server::EnqueueWsMessage(to_json::ConvertObservedButtons(
-      command_table.GetObservedButtons(), command_table.GetButtonNames()));
-
-  request->send(200, "text/plain", "OK");
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kDeleteCommand;
+  change.button = button;
+  ApplyChanges(responder, command_table, {change});
 }
 
-void HandleSetButtonName(AsyncWebServerRequest* request, const String& body,
+void HandleSetButtonName(server::Responder& responder, const String& body,
                          CommandTable& command_table) {
   // {
   //   "button": {
@@ -105,36 +266,25 @@ void HandleSetButtonName(AsyncWebServerRequest* request, const String& body,
   //   "name": "Button 1"
   // }
   JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, body);
-  if (error) {
-    Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+  KButton button{};
+  if (!ParseButtonBody(responder, body, &doc, &button)) {
     return;
   }
-  const JsonObject& root = doc.as<JsonObject>();
-  if (!root.containsKey("button") || !root.containsKey("name")) {
-    Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+  if (!doc.containsKey("name")) {
+    KB_LOGE("Invalid JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
-  KButton button{};
-  const JsonObject& button_json = root["button"];
-  const bool ok = from_json::ConvertButtonJson(button_json, button);
-  if (!ok) {
-    request->send(400, "text/plain", "Bad Request");
-    return;
-  }
-  const String& name = root["name"].as<String>();
-
-  command_table.SetButtonName(button, name);
-  command_table.Save();
-  server::EnqueueWsMessage(to_json::ConvertObservedButtons(
-      command_table.GetObservedButtons(), command_table.GetButtonNames()));
+  const String& name = doc["name"].as<String>();
 
-  request->send(200, "text/plain", "OK");
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kSetName;
+  change.button = button;
+  change.name = name;
+  ApplyChanges(responder, command_table, {change});
 }
 
-void HandleDeleteButtonName(AsyncWebServerRequest* request, const String& body,
+void HandleDeleteButtonName(server::Responder& responder, const String& body,
                             CommandTable& command_table) {
   // {
   //   "button": {
@@ -147,30 +297,161 @@ void HandleDeleteButtonName(AsyncWebServerRequest* request, const String& body,
   //   },
   // }
   JsonDocument doc;
+  KButton button{};
+  if (!ParseButtonBody(responder, body, &doc, &button)) {
+    return;
+  }
+
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kDeleteName;
+  change.button = button;
+  ApplyChanges(responder, command_table, {change});
+}
+
+void HandlePutCommandById(server::Responder& responder, const String& body,
+                          CommandTable& command_table) {
+  // {
+  //   "command": {
+  //     "type": 12,
+  //     "speak": {"text": "hello"},
+  //     ...
+  //   },
+  // }
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kSetCommand;
+  if (!GetPathButton(responder, &change.button)) {
+    return;
+  }
+  JsonDocument doc;
   DeserializationError error = deserializeJson(doc, body);
   if (error) {
-    Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+    KB_LOGE("Failed to parse JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   const JsonObject& root = doc.as<JsonObject>();
-  if (!root.containsKey("button")) {
-    Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+  if (!root.containsKey("command")) {
+    KB_LOGE("Invalid JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
-  KButton button{};
-  const JsonObject& button_json = root["button"];
-  const bool ok = from_json::ConvertButtonJson(button_json, button);
-  if (!ok) {
-    request->send(400, "text/plain", "Bad Request");
+  if (!from_json::ConvertCommandOnlyJson(root["command"], change.command)) {
+    responder.Send(400, "text/plain", "Bad Request");
+    return;
+  }
+  ApplyChanges(responder, command_table, {change});
+}
+
+void HandleDeleteCommandById(server::Responder& responder, const String& body,
+                             CommandTable& command_table) {
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kDeleteCommand;
+  if (!GetPathButton(responder, &change.button)) {
+    return;
+  }
+  if (!command_table.HasCommand(change.button)) {
+    responder.Send(404, "text/plain", "Not Found");
+    return;
+  }
+  ApplyChanges(responder, command_table, {change});
+}
+
+void HandlePutButtonById(server::Responder& responder, const String& body,
+                         CommandTable& command_table) {
+  // {
+  //   "name": "Button 1"
+  // }
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kSetName;
+  if (!GetPathButton(responder, &change.button)) {
+    return;
+  }
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, body);
+  if (error) {
+    KB_LOGE("Failed to parse JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
+    return;
+  }
+  if (!doc["name"].is<String>()) {
+    KB_LOGE("Invalid JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
+    return;
+  }
+  change.name = doc["name"].as<String>();
+  ApplyChanges(responder, command_table, {change});
+}
+
+void HandleDeleteButtonById(server::Responder& responder, const String& body,
+                            CommandTable& command_table) {
+  CommandTable::Change change;
+  change.type = CommandTable::Change::Type::kDeleteName;
+  if (!GetPathButton(responder, &change.button)) {
+    return;
+  }
+  if (!command_table.GetButtonName(change.button, &change.name)) {
+    responder.Send(404, "text/plain", "Not Found");
+    return;
+  }
+  ApplyChanges(responder, command_table, {change});
+}
+
+void HandlePatchCommands(server::Responder& responder, const String& body,
+                         CommandTable& command_table) {
+  // {
+  //   "changes": [
+  //     {"op": "set_command", "id": "m5-1", "command": { ... }},
+  //     {"op": "delete_command", "id": "gpio-2"},
+  //     {"op": "set_name", "id": "m5-1", "name": "Button 1"},
+  //     {"op": "delete_name", "id": "ib-..."},
+  //   ],
+  // }
+  // The changes are applied in order, or none of them if one is invalid.
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, body);
+  if (error) {
+    KB_LOGE("Failed to parse JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
+  const JsonArray& changes_json = doc["changes"];
+  if (changes_json.isNull() || changes_json.size() > kMaxPatchChanges) {
+    KB_LOGE("Invalid JSON\n");
+    responder.Send(400, "text/plain", "Bad Request");
+    return;
+  }
+  std::vector<CommandTable::Change> changes(changes_json.size());
+  size_t i = 0;
+  for (JsonObject change_json : changes_json) {
+    if (!from_json::ConvertChangeJson(change_json, changes[i++])) {
+      responder.Send(400, "text/plain", "Bad Request");
+      return;
+    }
+  }
+  ApplyChanges(responder, command_table, changes);
+}
 
-  command_table.DeleteButtonName(button);
-  command_table.Save();
-  server::EnqueueWsMessage(to_json::ConvertObservedButtons(
-      command_table.GetObservedButtons(), command_table.GetButtonNames()));
+void HandleTestPress(server::Responder& responder, const String& body,
+                     CommandTable& command_table) {
+  // {
+  //   "button": {
+  //     "m5_button": {"id": 1},
+  //   },
+  // }
+  JsonDocument doc;
+  KButton button{};
+  if (!ParseButtonBody(responder, body, &doc, &button)) {
+    return;
+  }
+  if (!command_table.HasCommand(button)) {
+    responder.Send(404, "text/plain", "No command for the button");
+    return;
+  }
+  if (!server::RequestTestPress(button)) {
+    responder.Send(503, "text/plain", "Too many test presses");
+    return;
+  }
 
-  request->send(200, "text/plain", "OK");
+  // The command is sent later by the main loop
+  responder.Send(202);
 }
@@ -3,18 +3,37 @@
 #include <ESPAsyncWebServer.h>
 
 #include "command_table.hpp"
+#include "server.hpp"
 
 void HandleGetObservedButtons(AsyncWebServerRequest* request,
                               CommandTable& command_table);
-void HandlePostCommand(AsyncWebServerRequest* request, const String& body,
+void HandlePostCommand(server::Responder& responder, const String& body,
                        CommandTable& command_table);
-void HandlePutCommands(AsyncWebServerRequest* request, const String& body,
+// `loader` has been given the whole body
+void HandlePutCommands(AsyncWebServerRequest* request,
+                       CommandTable::CommandArrayLoader& loader,
                        CommandTable& command_table);
 void HandleGetCommands(AsyncWebServerRequest* request,
                        CommandTable& command_table);
-void HandleDeleteCommand(AsyncWebServerRequest* request, const String& body,
+void HandleDeleteCommand(server::Responder& responder, const String& body,
                          CommandTable& command_table);
-void HandleSetButtonName(AsyncWebServerRequest* request, const String& body,
+void HandleSetButtonName(server::Responder& responder, const String& body,
                          CommandTable& command_table);
-void HandleDeleteButtonName(AsyncWebServerRequest* request, const String& body,
+void HandleDeleteButtonName(server::Responder& responder, const String& body,
                             CommandTable& command_table);
+// Per-entry endpoints, /commands/{id} and /buttons/{id}, where {id} is a
+// button_id and is given by responder.path_param()
+void HandlePutCommandById(server::Responder& responder, const String& body,
+                          CommandTable& command_table);
+void HandleDeleteCommandById(server::Responder& responder, const String& body,
+                             CommandTable& command_table);
+void HandlePutButtonById(server::Responder& responder, const String& body,
+                         CommandTable& command_table);
+void HandleDeleteButtonById(server::Responder& responder, const String& body,
+                            CommandTable& command_table);
+// Applies several of the changes above at once
+void HandlePatchCommands(server::Responder& responder, const String& body,
+                         CommandTable& command_table);
+// Runs the command of the button as if the button were pressed
+void HandleTestPress(server::Responder& responder, const String& body,
+                     CommandTable& command_table);
@@ -11,6 +11,12 @@
 #include "to_json.hpp"
 #include "version.hpp"
 
+static void PublishSettings() {
+  server::PublishWsMessage(server::WsTopic::kSettings, [](const auto format) {
+    return to_json::ConvertSettings(g_settings, format);
+  });
+}
+
 void HandleGetRobotHost(AsyncWebServerRequest* request) {
   JsonDocument doc;
   doc["robot_host"] = g_settings.GetRobotHost();
@@ -34,7 +40,7 @@ void HandleSetRobotHost(AsyncWebServerRequest* request, const String& body) {
   }
   const String& robot_host = doc["robot_host"].as<String>();
   g_settings.SetRobotHost(robot_host.c_str());
-  server::EnqueueWsMessage(to_json::ConvertSettings(g_settings));
+  PublishSettings();
   request->send(203);
 
   // reboot in 1 second
@@ -82,7 +88,7 @@ void HandleSetWiFi(AsyncWebServerRequest* request, const String& body) {
   g_settings.SetNetworkDnsServer2(
       doc.containsKey("dns_server_2") ? doc["dns_server_2"].as<String>() : "");
 
-  server::EnqueueWsMessage(to_json::ConvertSettings(g_settings));
+  PublishSettings();
 
   request->send(203);
 
@@ -101,27 +107,27 @@ void HandleGetBeepVolume(AsyncWebServerRequest* request) {
   request->send(200, "text/json; charset=utf-8", out);
 }
 
-void HandleSetBeepVolume(AsyncWebServerRequest* request, const String& body) {
+void HandleSetBeepVolume(server::Responder& responder, const String& body) {
   JsonDocument doc;
   DeserializationError error = deserializeJson(doc, body);
   if (error) {
     Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   if (!doc.containsKey("beep_volume")) {
     Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   const int beep_volume = doc["beep_volume"].as<int>();
   if (0 <= beep_volume && beep_volume <= 11) {
     g_settings.SetBeepVolume(beep_volume);
     beep::SetVolume(beep_volume);
-    server::EnqueueWsMessage(to_json::ConvertSettings(g_settings));
-    request->send(203);
+    PublishSettings();
+    responder.Send(203);
   } else {
-    request->send(400, "text/plain", "Invalid range of beep_volume");
+    responder.Send(400, "text/plain", "Invalid range of beep_volume");
   }
 }
 
@@ -133,28 +139,28 @@ void HandleGetScreenBrightness(AsyncWebServerRequest* request) {
   request->send(200, "text/json; charset=utf-8", out);
 }
 
-void HandleSetScreenBrightness(AsyncWebServerRequest* request,
+void HandleSetScreenBrightness(server::Responder& responder,
                                const String& body) {
   JsonDocument doc;
   DeserializationError error = deserializeJson(doc, body);
   if (error) {
     Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   if (!doc.containsKey("screen_brightness")) {
     Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   const int v = doc["screen_brightness"].as<int>();
   if (0 <= v && v <= 255) {
     g_settings.SetScreenBrightness(v);
     M5.Lcd.setBrightness(v);
-    server::EnqueueWsMessage(to_json::ConvertSettings(g_settings));
-    request->send(203);
+    PublishSettings();
+    responder.Send(203);
   } else {
-    request->send(400, "text/plain", "Invalid range of screen_brightness");
+    responder.Send(400, "text/plain", "Invalid range of screen_brightness");
   }
 }
 
@@ -217,24 +223,24 @@ void HandleGetAutoOtaIsEnabled(AsyncWebServerRequest* request) {
   request->send(200, "text/json; charset=utf-8", out);
 }
 
-void HandleSetAutoOtaIsEnabled(AsyncWebServerRequest* request,
+void HandleSetAutoOtaIsEnabled(server::Responder& responder,
                                const String& body) {
   JsonDocument doc;
   DeserializationError error = deserializeJson(doc, body);
   if (error) {
     Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   if (!doc.containsKey("auto_ota_is_enabled")) {
     Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   const bool v = doc["auto_ota_is_enabled"].as<bool>();
   g_settings.SetAutoOtaIsEnabled(v);
-  server::EnqueueWsMessage(to_json::ConvertSettings(g_settings));
-  request->send(203);
+  PublishSettings();
+  responder.Send(203);
 }
 
 void HandleGetOneShotAutoOtaIsEnabled(AsyncWebServerRequest* request) {
@@ -245,23 +251,23 @@ void HandleGetOneShotAutoOtaIsEnabled(AsyncWebServerRequest* request) {
   request->send(200, "text/json; charset=utf-8", out);
 }
 
-void HandleSetOneShotAutoOtaIsEnabled(AsyncWebServerRequest* request,
+void HandleSetOneShotAutoOtaIsEnabled(server::Responder& responder,
                                       const String& body) {
   JsonDocument doc;
   DeserializationError error = deserializeJson(doc, body);
   if (error) {
     Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   if (!doc.containsKey("one_shot_auto_ota_is_enabled")) {
     Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   const bool v = doc["one_shot_auto_ota_is_enabled"].as<bool>();
   g_settings.SetOneShotAutoOtaIsEnabled(v);
-  request->send(203);
+  responder.Send(203);
 }
 
 void HandleGetAutoRefetchOnUiLoad(AsyncWebServerRequest* request) {
@@ -272,24 +278,24 @@ void HandleGetAutoRefetchOnUiLoad(AsyncWebServerRequest* request) {
   request->send(200, "text/json; charset=utf-8", out);
 }
 
-void HandleSetAutoRefetchOnUiLoad(AsyncWebServerRequest* request,
+void HandleSetAutoRefetchOnUiLoad(server::Responder& responder,
                                   const String& body) {
   JsonDocument doc;
   DeserializationError error = deserializeJson(doc, body);
   if (error) {
     Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   if (!doc.containsKey("auto_refetch_on_ui_load")) {
     Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   const bool v = doc["auto_refetch_on_ui_load"].as<bool>();
   g_settings.SetAutoRefetchOnUiLoad(v);
-  server::EnqueueWsMessage(to_json::ConvertSettings(g_settings));
-  request->send(203);
+  PublishSettings();
+  responder.Send(203);
 }
 
 void HandleGetGpioButtonIsEnabled(AsyncWebServerRequest* request) {
@@ -300,25 +306,25 @@ void HandleGetGpioButtonIsEnabled(AsyncWebServerRequest* request) {
   request->send(200, "text/json; charset=utf-8", out);
 }
 
-void HandleSetGpioButtonIsEnabled(AsyncWebServerRequest* request,
+void HandleSetGpioButtonIsEnabled(server::Responder& responder,
                                   const String& body,
                                   CommandTable& command_table) {
   JsonDocument doc;
   DeserializationError error = deserializeJson(doc, body);
   if (error) {
     Serial.println("ERROR: Failed to parse JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   if (!doc.containsKey("gpio_button_is_enabled")) {
     Serial.println("ERROR: Invalid JSON");
-    request->send(400, "text/plain", "Bad Request");
+    responder.Send(400, "text/plain", "Bad Request");
     return;
   }
   const bool v = doc["gpio_button_is_enabled"].as<bool>();
   g_settings.SetGpioButtonIsEnabled(v);
-  server::EnqueueWsMessage(to_json::ConvertSettings(g_settings));
-  request->send(203);
+  PublishSettings();
+  responder.Send(203);
 }
 
 void HandleOtaByImageUrl(AsyncWebServerRequest* request, const String& body) {
@@ -3,6 +3,7 @@
 #include <ESPAsyncWebServer.h>
 
 #include "command_table.hpp"
+#include "server.hpp"
 #include "types.hpp"
 
 void HandleGetRobotHost(AsyncWebServerRequest* request);
@@ -10,21 +11,21 @@ void HandleSetRobotHost(AsyncWebServerRequest* request, const String& body);
 void HandleGetWiFi(AsyncWebServerRequest* request);
 void HandleSetWiFi(AsyncWebServerRequest* request, const String& body);
 void HandleGetBeepVolume(AsyncWebServerRequest* request);
-void HandleSetBeepVolume(AsyncWebServerRequest* request, const String& body);
+void HandleSetBeepVolume(server::Responder& responder, const String& body);
 void HandleGetScreenBrightness(AsyncWebServerRequest* request);
-void HandleSetScreenBrightness(AsyncWebServerRequest* request,
+void HandleSetScreenBrightness(server::Responder& responder,
                                const String& body);
 void HandleGetAutoOtaIsEnabled(AsyncWebServerRequest* request);
-void HandleSetAutoOtaIsEnabled(AsyncWebServerRequest* request,
+void HandleSetAutoOtaIsEnabled(server::Responder& responder,
                                const String& body);
 void HandleGetOneShotAutoOtaIsEnabled(AsyncWebServerRequest* request);
-void HandleSetOneShotAutoOtaIsEnabled(AsyncWebServerRequest* request,
+void HandleSetOneShotAutoOtaIsEnabled(server::Responder& responder,
                                       const String& body);
 void HandleGetAutoRefetchOnUiLoad(AsyncWebServerRequest* request);
-void HandleSetAutoRefetchOnUiLoad(AsyncWebServerRequest* request,
+void HandleSetAutoRefetchOnUiLoad(server::Responder& responder,
                                   const String& body);
 void HandleGetGpioButtonIsEnabled(AsyncWebServerRequest* request);
-void HandleSetGpioButtonIsEnabled(AsyncWebServerRequest* request,
+void HandleSetGpioButtonIsEnabled(server::Responder& responder,
                                   const String& body,
                                   CommandTable& command_table);
 
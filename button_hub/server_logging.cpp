@@ -2,11 +2,256 @@
 
 #include <ArduinoJson.h>
 #include <SPIFFS.h>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
 
 #include "ESPAsyncWebServer.h"
+#include "log_query.hpp"
+#include "log_reader.hpp"
+#include "log_shipper.hpp"
+#include "logging.hpp"
+#include "mutex.hpp"
+#include "settings.hpp"
 
 namespace server {
 
+static constexpr logging::Module kLogModule = logging::Module::kServer;
+
+constexpr uint32_t kLogStreamLinesPerSec = 20;
+constexpr uint32_t kLogStreamBurstLines = 40;
+constexpr size_t kLogStreamMaxPendingBytes = 2 * 1024;
+constexpr uint32_t kLogStreamFlushIntervalMsec = 200;
+// A /log/query callback stops reading after this until the next one
+constexpr uint32_t kLogQueryWorkMsec = 20;
+// The writer task doesn't wait longer than this for FlushLogStream()
+constexpr int kLogStreamLockTimeoutMsec = 10;
+
+struct LogSubscriber {
+  AsyncWebSocketClient* client;
+  String pending;
+  uint32_t dropped;
+  uint32_t tokens;  // token bucket in 1/1000 lines
+  uint32_t last_refill_time;
+};
+
+static kb::Mutex g_log_stream_mutex;
+// guard by g_log_stream_mutex
+static std::vector<LogSubscriber> g_log_subscribers;
+static std::atomic<uint32_t> g_log_stream_missed_count{0};
+static uint32_t g_last_log_stream_flush_time = 0;
+
+// Streams the records matching a query. The segments are read one chunk at a
+// time, so only a chunk and the matching records of it are held in RAM.
+//
+// Segments are read in the order of their numbers, i.e. as they were written.
+// Record times are not in order across segments (records written before the
+// clock is set are dated 1970), so a segment is skipped only if its own time
+// range is out of the query.
+class LogQueryStream {
+ public:
+  LogQueryStream(const String& from, const String& to, const String& text,
+                 const logging::Level level, const size_t limit,
+                 const size_t tail)
+      : from_(from),
+        to_(to),
+        text_(text),
+        tail_(tail),
+        remaining_(limit > 0 ? limit : std::numeric_limits<size_t>::max()) {
+    filter_.from = from_.c_str();
+    filter_.to = to_.c_str();
+    filter_.text = text_.c_str();
+    filter_.level = level;
+  }
+
+  // Returns RESPONSE_TRY_AGAIN if nothing was found to send within
+  // kLogQueryWorkMsec, so that a query over the whole log doesn't hold the
+  // async_tcp task in one call.
+  size_t Read(uint8_t* out, const size_t len) {
+    if (!is_started_) {
+      Start();
+      is_started_ = true;
+    }
+    const uint32_t start_time = millis();
+    size_t n = 0;
+    while (n < len) {
+      if (pending_pos_ == pending_.size()) {
+        pending_.clear();
+        pending_pos_ = 0;
+        if (millis() - start_time >= kLogQueryWorkMsec || !Advance()) {
+          break;
+        }
+        continue;
+      }
+      const size_t m = std::min(len - n, pending_.size() - pending_pos_);
+      std::memcpy(out + n, pending_.data() + pending_pos_, m);
+      pending_pos_ += m;
+      n += m;
+    }
+    return n == 0 && !is_done_ ? RESPONSE_TRY_AGAIN : n;
+  }
+
+ private:
+  void Start() {
+    logging::GetSegmentRange(&first_segment_, &last_segment_);
+    segment_ = first_segment_;
+    if (tail_ > 0) {
+      is_counting_ = true;
+      count_segment_ = last_segment_;
+    }
+  }
+
+  // False if the records of the segment are known to be out of the range
+  bool MayMatch(const int number) const {
+    if (filter_.from[0] == '\0' && filter_.to[0] == '\0') {
+      return true;
+    }
+    uint32_t min_time;
+    uint32_t max_time;
+    if (!logging::GetSegmentTimeRange(number, &min_time, &max_time)) {
+      return true;
+    }
+    char min_date[logging::kRecordDateLength + 1];
+    char max_date[logging::kRecordDateLength + 1];
+    logging::FormatRecordDate(min_time, min_date);
+    logging::FormatRecordDate(max_time, max_date);
+    return logging::OverlapsRange(filter_, min_date, max_date);
+  }
+
+  // For `tail`, counts the matches backwards from the newest segment, a chunk
+  // per call, until there are enough. The extra ones at the beginning of that
+  // segment are skipped when they are sent.
+  void CountChunk() {
+    if (!reader_) {
+      while (count_segment_ >= first_segment_ && !MayMatch(count_segment_)) {
+        --count_segment_;
+      }
+      if (count_segment_ < first_segment_) {
+        is_counting_ = false;  // fewer matches than `tail`
+        return;
+      }
+      reader_ = OpenSegment(count_segment_);
+      if (!reader_) {
+        --count_segment_;
+      }
+      return;
+    }
+    const bool has_more =
+        reader_->ReadRecords([this](const uint8_t* payload, size_t length) {
+          logging::QueryRecord record;
+          if (Parse(payload, length, &record) &&
+              logging::Matches(filter_, record)) {
+            ++count_;
+          }
+        });
+    if (has_more) {
+      return;
+    }
+    reader_.reset();
+    if (count_ >= tail_) {
+      segment_ = count_segment_;
+      skip_ = count_ - tail_;
+      is_counting_ = false;
+      return;
+    }
+    --count_segment_;
+  }
+
+  // Reads the next chunk. Returns false at the end of the query.
+  bool Advance() {
+    if (is_done_) {
+      return false;
+    }
+    if (is_counting_) {
+      CountChunk();
+      return true;
+    }
+    if (!reader_) {
+      while (segment_ <= last_segment_ && !MayMatch(segment_)) {
+        ++segment_;
+      }
+      if (segment_ > last_segment_) {
+        is_done_ = true;
+        return false;
+      }
+      reader_ = OpenSegment(segment_++);
+      return true;
+    }
+    const bool has_more =
+        reader_->ReadRecords([this](const uint8_t* payload, size_t length) {
+          OnRecord(payload, length);
+        });
+    if (!has_more) {
+      reader_.reset();
+    }
+    return true;
+  }
+
+  void OnRecord(const uint8_t* payload, const size_t length) {
+    logging::QueryRecord record;
+    if (is_done_ || !Parse(payload, length, &record) ||
+        !logging::Matches(filter_, record)) {
+      return;
+    }
+    if (skip_ > 0) {
+      --skip_;
+      return;
+    }
+    // Text records are sent as lines and binary records as they are, which
+    // tools/decode_log.py can decode.
+    pending_.insert(pending_.end(), payload, payload + length);
+    if (--remaining_ == 0) {
+      is_done_ = true;
+    }
+  }
+
+  static bool Parse(const uint8_t* payload, const size_t length,
+                    logging::QueryRecord* record) {
+#ifdef KB_LOG_DEFERRED_FORMAT
+    return logging::ParseBinaryRecord(payload, length, record);
+#else
+    return logging::ParseTextRecord(reinterpret_cast<const char*>(payload),
+                                    length, record);
+#endif
+  }
+
+  // Segments without framing (written by old firmware) are not supported.
+  static std::unique_ptr<logging::SegmentReader> OpenSegment(
+      const int number) {
+    char path[16];
+    logging::GetSegmentPath(number, path, sizeof(path));
+    File file = SPIFFS.open(path, "r");
+    if (!file) {
+      return nullptr;
+    }
+    auto reader = std::make_unique<logging::SegmentReader>(std::move(file));
+    if (!reader->is_framed()) {
+      return nullptr;
+    }
+    return reader;
+  }
+
+  String from_;
+  String to_;
+  String text_;
+  logging::QueryFilter filter_;
+  size_t tail_;
+  size_t remaining_;
+  size_t skip_ = 0;
+  int first_segment_ = 0;
+  int last_segment_ = 0;
+  int segment_ = 0;  // next one to send
+  bool is_counting_ = false;
+  int count_segment_ = 0;
+  size_t count_ = 0;
+  bool is_started_ = false;
+  bool is_done_ = false;
+  std::unique_ptr<logging::SegmentReader> reader_;
+  std::vector<uint8_t> pending_;
+  size_t pending_pos_ = 0;
+};
+
 void HandleLoggingList(AsyncWebServerRequest* request) {
   File root = SPIFFS.open("/");
   if (!root) {
@@ -54,8 +299,75 @@ void HandleLoggingGet(AsyncWebServerRequest* request, const String& path,
     request->send(500, "text/plain", "Internal Server Error");
     return;
   }
-  request->send(new AsyncFileResponse(std::move(file), path,
-                                      "text/plain; charset=UTF-8", download));
+  // Binary logs (LOG_FORMAT=binary) are decoded by tools/decode_log.py
+  const char* content_type = path.endsWith(".bin")
+                                 ? "application/octet-stream"
+                                 : "text/plain; charset=UTF-8";
+  // The record framing of the segment is removed on the fly. The size is
+  // unknown until the end, so the response is chunked.
+  auto reader = std::make_shared<logging::SegmentReader>(std::move(file));
+  // Compacted segments are sent without inflating them if the client can.
+  AsyncWebHeader* encoding = request->getHeader("Accept-Encoding");
+  const bool send_deflated = reader->is_compressed() && encoding &&
+                             encoding->value().indexOf("deflate") >= 0;
+  AsyncWebServerResponse* response = request->beginChunkedResponse(
+      content_type, [reader, send_deflated](uint8_t* buffer, size_t max_len,
+                                            size_t /* index */) {
+        return send_deflated ? reader->ReadDeflated(buffer, max_len)
+                             : reader->Read(buffer, max_len);
+      });
+  if (send_deflated) {
+    response->addHeader("Content-Encoding", "deflate");
+  }
+  if (download) {
+    response->addHeader("Content-Disposition",
+                        "attachment; filename=\"" +
+                            path.substring(path.lastIndexOf('/') + 1) + "\"");
+  }
+  request->send(response);
+}
+
+void HandleLoggingQuery(AsyncWebServerRequest* request) {
+  const auto get_param = [request](const char* name) {
+    AsyncWebParameter* param = request->getParam(name);
+    return param ? param->value() : String();
+  };
+  const String from = get_param("from");
+  const String to = get_param("to");
+  const String text = get_param("q");
+  const String level_name = get_param("level");
+  const long limit = get_param("limit").toInt();
+  const long tail = get_param("tail").toInt();
+  logging::Level level = logging::Level::kDebug;
+  if (from.length() > logging::kRecordDateLength ||
+      to.length() > logging::kRecordDateLength || limit < 0 || tail < 0 ||
+      (!level_name.isEmpty() &&
+       !logging::ParseLevel(level_name.c_str(), &level))) {
+    request->send(400, "text/plain", "Bad Request");
+    return;
+  }
+#ifdef KB_LOG_DEFERRED_FORMAT
+  // Messages of binary logs are formatted only by tools/decode_log.py
+  if (!text.isEmpty()) {
+    request->send(400, "text/plain", "q is not supported by binary logs");
+    return;
+  }
+  const char* content_type = "application/octet-stream";
+#else
+  const char* content_type = "text/plain; charset=UTF-8";
+#endif
+  KB_LOGD("Querying logs from=\"%s\" to=\"%s\" q=\"%s\"\n", from.c_str(),
+          to.c_str(), text.c_str());
+
+  // Make the latest records visible
+  logging::Flush();
+  auto stream = std::make_shared<LogQueryStream>(from, to, text, level, limit,
+                                                 tail);
+  request->send(request->beginChunkedResponse(
+      content_type,
+      [stream](uint8_t* buffer, size_t max_len, size_t /* index */) {
+        return stream->Read(buffer, max_len);
+      }));
 }
 
 void HandleLoggingDelete(AsyncWebServerRequest* request, const String& path) {
@@ -72,4 +384,193 @@ void HandleLoggingDelete(AsyncWebServerRequest* request, const String& path) {
   request->send(200, "text/plain", "OK");
 }
 
+// logging::LineListener called from the writer task
+static void OnLogLine(const char* line, const size_t length) {
+  const kb::LockGuard lock(g_log_stream_mutex, kLogStreamLockTimeoutMsec);
+  if (!lock) {
+    g_log_stream_missed_count.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  const uint32_t now = millis();
+  for (LogSubscriber& subscriber : g_log_subscribers) {
+    subscriber.tokens = std::min(
+        subscriber.tokens +
+            (now - subscriber.last_refill_time) * kLogStreamLinesPerSec,
+        kLogStreamBurstLines * 1000);
+    subscriber.last_refill_time = now;
+    if (subscriber.tokens < 1000 || subscriber.pending.length() + length + 1 >
+                                        kLogStreamMaxPendingBytes) {
+      subscriber.dropped++;
+      continue;
+    }
+    subscriber.tokens -= 1000;
+    subscriber.pending.concat(line, length);
+    subscriber.pending += '\n';
+  }
+}
+
+void SubscribeLogStream(AsyncWebSocketClient* client) {
+  const kb::LockGuard lock(g_log_stream_mutex);
+  for (const LogSubscriber& subscriber : g_log_subscribers) {
+    if (subscriber.client == client) {
+      return;
+    }
+  }
+  KB_LOGI("ws[%u] subscribed to log\n", client->id());
+  g_log_subscribers.push_back(
+      LogSubscriber{client, String(), 0, kLogStreamBurstLines * 1000,
+                    static_cast<uint32_t>(millis())});
+  g_log_subscribers.back().pending.reserve(kLogStreamMaxPendingBytes);
+  logging::AddLineListener(OnLogLine);
+}
+
+void UnsubscribeLogStream(AsyncWebSocketClient* client) {
+  const kb::LockGuard lock(g_log_stream_mutex);
+  g_log_subscribers.erase(
+      std::remove_if(g_log_subscribers.begin(), g_log_subscribers.end(),
+                     [client](const LogSubscriber& subscriber) {
+                       return subscriber.client == client;
+                     }),
+      g_log_subscribers.end());
+  if (g_log_subscribers.empty()) {
+    logging::RemoveLineListener(OnLogLine);
+  }
+}
+
+void FlushLogStream() {
+  if (millis() - g_last_log_stream_flush_time < kLogStreamFlushIntervalMsec) {
+    return;
+  }
+  g_last_log_stream_flush_time = millis();
+
+  const kb::LockGuard lock(g_log_stream_mutex);
+  const uint32_t missed = g_log_stream_missed_count.exchange(0);
+  for (LogSubscriber& subscriber : g_log_subscribers) {
+    subscriber.dropped += missed;
+    if (subscriber.pending.isEmpty() && subscriber.dropped == 0) {
+      continue;
+    }
+    // Keep the lines of a slow client. New lines are dropped once its buffer
+    // is full.
+    if (subscriber.client->queueIsFull()) {
+      continue;
+    }
+    JsonDocument doc;
+    doc["type"] = "log";
+    doc["lines"] = subscriber.pending;
+    doc["dropped"] = subscriber.dropped;
+    String out;
+    serializeJson(doc, out);
+    subscriber.client->text(out);
+    subscriber.pending = "";
+    subscriber.dropped = 0;
+  }
+}
+
+void HandleGetLogLevels(AsyncWebServerRequest* request) {
+  JsonDocument doc;
+  doc["max_level"] =
+      logging::GetLevelName(static_cast<logging::Level>(KB_LOG_MAX_LEVEL));
+  JsonObject levels = doc.createNestedObject("levels");
+  for (size_t i = 0; i < static_cast<size_t>(logging::Module::kCount); ++i) {
+    const auto module = static_cast<logging::Module>(i);
+    levels[logging::GetModuleName(module)] =
+        logging::GetLevelName(logging::GetLevel(module));
+  }
+  String out;
+  serializeJson(doc, out);
+  request->send(200, "text/json; charset=utf-8", out);
+}
+
+// Body: {"levels": {"api": "debug", ...}}. Modules not in the body are left
+// unchanged. Levels above max_level are accepted but have no effect.
+void HandleSetLogLevels(AsyncWebServerRequest* request, const String& body) {
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, body);
+  if (error) {
+    KB_LOGE("Failed to parse JSON\n");
+    request->send(400, "text/plain", "Bad Request");
+    return;
+  }
+  JsonObject levels = doc["levels"].as<JsonObject>();
+  if (levels.isNull()) {
+    KB_LOGE("Invalid JSON\n");
+    request->send(400, "text/plain", "Bad Request");
+    return;
+  }
+  // Validate everything first so that a bad entry changes nothing.
+  logging::Level new_levels[static_cast<size_t>(logging::Module::kCount)];
+  bool is_set[static_cast<size_t>(logging::Module::kCount)] = {};
+  for (JsonPair kv : levels) {
+    logging::Module module;
+    logging::Level level;
+    const char* level_name = kv.value().as<const char*>();
+    if (!logging::ParseModule(kv.key().c_str(), &module) ||
+        level_name == nullptr || !logging::ParseLevel(level_name, &level)) {
+      KB_LOGE("Invalid JSON\n");
+      request->send(400, "text/plain", "Bad Request");
+      return;
+    }
+    new_levels[static_cast<size_t>(module)] = level;
+    is_set[static_cast<size_t>(module)] = true;
+  }
+  for (size_t i = 0; i < static_cast<size_t>(logging::Module::kCount); ++i) {
+    if (is_set[i]) {
+      const auto module = static_cast<logging::Module>(i);
+      logging::SetLevel(module, new_levels[i]);
+      KB_LOGI("Log level of %s set to %s\n", logging::GetModuleName(module),
+              logging::GetLevelName(new_levels[i]));
+    }
+  }
+  request->send(203);
+}
+
+void HandleGetSyslog(AsyncWebServerRequest* request) {
+  const logging::ShipperStats stats = logging::GetShipperStats();
+  JsonDocument doc;
+  doc["host"] = g_settings.GetSyslogHost();
+  doc["port"] = g_settings.GetSyslogPort();
+  doc["protocol"] = g_settings.GetSyslogUsesTcp() ? "tcp" : "udp";
+  doc["sent"] = stats.sent_count;
+  doc["dropped"] = stats.dropped_count;
+  doc["spooled_bytes"] = stats.spooled_bytes;
+  String out;
+  serializeJson(doc, out);
+  request->send(200, "text/json; charset=utf-8", out);
+}
+
+// Body: {"host": "192.168.1.10", "port": 514, "protocol": "udp"}. An empty
+// host disables shipping. "port" and "protocol" are optional.
+void HandleSetSyslog(AsyncWebServerRequest* request, const String& body) {
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, body);
+  if (error) {
+    Serial.println("ERROR: Failed to parse JSON");
+    request->send(400, "text/plain", "Bad Request");
+    return;
+  }
+  if (!doc.containsKey("host")) {
+    Serial.println("ERROR: Invalid JSON");
+    request->send(400, "text/plain", "Bad Request");
+    return;
+  }
+  const String host = doc["host"].as<String>();
+  const int port = doc.containsKey("port") ? doc["port"].as<int>()
+                                            : g_settings.GetSyslogPort();
+  const String protocol =
+      doc.containsKey("protocol")
+          ? doc["protocol"].as<String>()
+          : String(g_settings.GetSyslogUsesTcp() ? "tcp" : "udp");
+  if (port <= 0 || port > 65535 || (protocol != "udp" && protocol != "tcp")) {
+    Serial.println("ERROR: Invalid JSON");
+    request->send(400, "text/plain", "Bad Request");
+    return;
+  }
+  g_settings.SetSyslogHost(host);
+  g_settings.SetSyslogPort(port);
+  g_settings.SetSyslogUsesTcp(protocol == "tcp");
+  logging::SetShipperDestination(host, port, protocol == "tcp");
+  request->send(203);
+}
+
 }  // namespace server
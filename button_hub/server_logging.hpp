@@ -7,6 +7,22 @@ namespace server {
 void HandleLoggingList(AsyncWebServerRequest* request);
 void HandleLoggingGet(AsyncWebServerRequest* request, const String& path,
                       bool download);
+// GET /log/query?from=&to=&q=&level=&limit=&tail=
+void HandleLoggingQuery(AsyncWebServerRequest* request);
 void HandleLoggingDelete(AsyncWebServerRequest* request, const String& path);
+void HandleGetLogLevels(AsyncWebServerRequest* request);
+void HandleSetLogLevels(AsyncWebServerRequest* request, const String& body);
+void HandleGetSyslog(AsyncWebServerRequest* request);
+void HandleSetSyslog(AsyncWebServerRequest* request, const String& body);
+
+// Live log on /ws
+//
+// A client sends {"type": "subscribe", "topic": "log"} and then receives
+// {"type": "log", "lines": "...\n", "dropped": 0} a few times per second.
+// Each client gets a limited rate of lines and a bounded buffer while it is
+// slow. The lines over the limits are counted in "dropped".
+void SubscribeLogStream(AsyncWebSocketClient* client);
+void UnsubscribeLogStream(AsyncWebSocketClient* client);
+void FlushLogStream();
 
 }  // namespace server
@@ -12,6 +12,9 @@ static constexpr bool kDefaultAutoOtaIsEnabled = true;
 static constexpr bool kDefaultOneShotAutoOtaIsEnabled = false;
 static constexpr bool kDefaultAutoRefetchOnUiLoad = false;
 static constexpr bool kDefaultGpioButtonIsEnabled = false;
+static constexpr char kDefaultSyslogHost[] = "";
+static constexpr int kDefaultSyslogPort = 514;
+static constexpr bool kDefaultSyslogUsesTcp = false;
 
 Settings::Settings() : prefs_(nullptr) {}
 
@@ -36,6 +39,9 @@ void Settings::Begin(Preferences* prefs) {
       prefs_->getBool("auto_refetch", kDefaultAutoRefetchOnUiLoad);
   gpio_button_is_enabled_ =
       prefs_->getBool("gpio_button", kDefaultGpioButtonIsEnabled);
+  syslog_host_ = prefs_->getString("syslog_host", kDefaultSyslogHost);
+  syslog_port_ = prefs_->getInt("syslog_port", kDefaultSyslogPort);
+  syslog_uses_tcp_ = prefs_->getBool("syslog_tcp", kDefaultSyslogUsesTcp);
 
   Serial.printf(
       "Network: ssid=\"%s\", pass=XXXX, ip=\"%s\", gw=\"%s\", "
@@ -48,6 +54,8 @@ void Settings::Begin(Preferences* prefs) {
       "auto_refetch=%d, gpio_button=%d\n",
       robot_host_.c_str(), beep_volume_, screen_brightness_,
       auto_ota_is_enabled_, auto_refetch_on_ui_load_, gpio_button_is_enabled_);
+  Serial.printf("Syslog: host=\"%s\", port=%d, tcp=%d\n",
+                syslog_host_.c_str(), syslog_port_, syslog_uses_tcp_);
   Serial.printf(
       "OTA settings: ota_endpoint=\"%s\", ota_label=\"%s\", "
       "reboot_ota_url=\"%s\", auto_ota=%d, one_shot_auto_ota=%d\n",
@@ -138,6 +146,21 @@ bool Settings::GetGpioButtonIsEnabled() const {
   return gpio_button_is_enabled_;
 }
 
+const String& Settings::GetSyslogHost() const {
+  Check();
+  return syslog_host_;
+}
+
+int Settings::GetSyslogPort() const {
+  Check();
+  return syslog_port_;
+}
+
+bool Settings::GetSyslogUsesTcp() const {
+  Check();
+  return syslog_uses_tcp_;
+}
+
 const char* Settings::GetOtaEndpoint() const {
 #ifdef OTA_ENDPOINT
   return OTA_ENDPOINT;
@@ -244,6 +267,24 @@ void Settings::SetGpioButtonIsEnabled(const bool enable) {
   prefs_->putBool("gpio_button", enable);
 }
 
+void Settings::SetSyslogHost(const String& host) {
+  Check();
+  syslog_host_ = host;
+  prefs_->putString("syslog_host", host);
+}
+
+void Settings::SetSyslogPort(const int port) {
+  Check();
+  syslog_port_ = port;
+  prefs_->putInt("syslog_port", port);
+}
+
+void Settings::SetSyslogUsesTcp(const bool use_tcp) {
+  Check();
+  syslog_uses_tcp_ = use_tcp;
+  prefs_->putBool("syslog_tcp", use_tcp);
+}
+
 int Settings::GetNextButtonId() {
   Check();
   const int next_id = prefs_->getInt("next_button_id", 1);
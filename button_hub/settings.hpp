@@ -28,6 +28,9 @@ class Settings {
   bool GetOneShotAutoOtaIsEnabled() const;
   bool GetAutoRefetchOnUiLoad() const;
   bool GetGpioButtonIsEnabled() const;
+  const String& GetSyslogHost() const;
+  int GetSyslogPort() const;
+  bool GetSyslogUsesTcp() const;
 
   const char* GetOtaEndpoint() const;
   const char* GetOtaLabel() const;
@@ -47,6 +50,9 @@ class Settings {
   void SetOneShotAutoOtaIsEnabled(bool enable);
   void SetAutoRefetchOnUiLoad(bool enable);
   void SetGpioButtonIsEnabled(bool enable);
+  void SetSyslogHost(const String& host);  // empty: disabled
+  void SetSyslogPort(int port);
+  void SetSyslogUsesTcp(bool use_tcp);
 
   // Non-settings
   int GetNextButtonId();
@@ -76,6 +82,9 @@ class Settings {
   bool one_shot_auto_ota_is_enabled_;
   bool auto_refetch_on_ui_load_;
   bool gpio_button_is_enabled_;
+  String syslog_host_;
+  int syslog_port_;
+  bool syslog_uses_tcp_;
 };
 
 extern Settings g_settings;
@@ -1,14 +1,207 @@
 #include "to_json.hpp"
 
 #include <ArduinoJson.h>
+#include <algorithm>
+#include <string>
 
+#include "button_id.hpp"
+#include "json_writer.hpp"
 #include "settings.hpp"
 #include "types.hpp"
 #include "version.hpp"
 
 namespace to_json {
 
-String ConvertHubInfo(const int client_count) {
+namespace {
+
+// Each observed button or command takes about this much besides the command
+// itself. Used to reserve the String of a message up front.
+constexpr size_t kEstimatedButtonJsonSize = 160;
+
+// Grows the String by half of its size when it is full, as String::concat()
+// reallocates to the exact length otherwise.
+class StringPrint : public Print {
+ public:
+  StringPrint(String& out, const size_t capacity)
+      : out_(out), capacity_(capacity) {
+    out_.reserve(capacity_);
+  }
+
+  size_t write(const uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, const size_t size) override {
+    const size_t length = out_.length() + size;
+    if (length > capacity_) {
+      capacity_ = std::max(length, capacity_ + capacity_ / 2);
+      out_.reserve(capacity_);
+    }
+    return out_.concat(reinterpret_cast<const char*>(buffer), size) ? size
+                                                                    : 0;
+  }
+
+ private:
+  String& out_;
+  size_t capacity_;
+};
+
+// Appends to a std::string, which serializeMsgPack() would replace instead
+class StdStringPrint : public Print {
+ public:
+  explicit StdStringPrint(std::string& out) : out_(out) {}
+
+  size_t write(const uint8_t c) override {
+    out_.push_back(static_cast<char>(c));
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, const size_t size) override {
+    out_.append(reinterpret_cast<const char*>(buffer), size);
+    return size;
+  }
+
+ private:
+  std::string& out_;
+};
+
+// Writes a JSON object member by member. The elements of an array are
+// serialized one at a time, so only a single element is held in a
+// JsonDocument whatever the length of the array.
+//
+// Usage:
+//
+//  JsonObjectWriter writer(out);
+//  writer.Add("type", "commands");
+//  writer.BeginArray("commands");
+//  writer.AddElement([](JsonObject item) { ... });
+//  writer.EndArray();
+//  writer.End();
+class JsonObjectWriter {
+ public:
+  using Format = Json;
+
+  explicit JsonObjectWriter(Print& out) : out_(out), writer_(out) {}
+
+  template <typename T>
+  void Add(const char* key, const T& value) {
+    writer_.BeginMember(key);
+    JsonDocument doc;
+    doc.set(value);
+    serializeJson(doc, out_);
+  }
+  void Add(const char* key, const char* value) {
+    writer_.BeginMember(key);
+    JsonDocument doc;
+    doc.set(value);
+    serializeJson(doc, out_);
+  }
+
+  void BeginArray(const char* key) { writer_.BeginArray(key); }
+  // `fill` is called as `void(JsonObject)`.
+  template <typename Fill>
+  void AddElement(Fill fill) {
+    writer_.BeginElement();
+    JsonDocument doc;
+    fill(doc.to<JsonObject>());
+    serializeJson(doc, out_);
+  }
+  void EndArray() { writer_.EndArray(); }
+
+  void End() { writer_.End(); }
+
+ private:
+  Print& out_;
+  json_writer::ObjectWriter<Print> writer_;
+};
+
+// The same in MessagePack
+class MsgPackObjectWriter {
+ public:
+  using Format = MsgPack;
+
+  explicit MsgPackObjectWriter(std::string& out) : out_(out), writer_(out) {}
+
+  template <typename T>
+  void Add(const char* key, const T& value) {
+    writer_.BeginMember(key);
+    JsonDocument doc;
+    doc.set(value);
+    serializeMsgPack(doc, out_);
+  }
+  void Add(const char* key, const char* value) {
+    writer_.BeginMember(key);
+    JsonDocument doc;
+    doc.set(value);
+    serializeMsgPack(doc, out_);
+  }
+
+  void BeginArray(const char* key) { writer_.BeginArray(key); }
+  // `fill` is called as `void(JsonObject)`.
+  template <typename Fill>
+  void AddElement(Fill fill) {
+    writer_.BeginElement();
+    JsonDocument doc;
+    fill(doc.to<JsonObject>());
+    serializeMsgPack(doc, out_);
+  }
+  void EndArray() { writer_.EndArray(); }
+
+  void End() { writer_.End(); }
+
+ private:
+  StdStringPrint out_;
+  json_writer::MsgPackObjectWriter writer_;
+};
+
+// `write` is called once as `void(Writer&)` with a JsonObjectWriter or a
+// MsgPackObjectWriter, whose output is reserved for `estimated_size` bytes.
+template <typename Write>
+String WriteMessage(const size_t estimated_size, Json /*format*/,
+                    Write write) {
+  String out;
+  StringPrint printer(out, estimated_size);
+  JsonObjectWriter writer(printer);
+  write(writer);
+  return out;
+}
+
+template <typename Write>
+std::string WriteMessage(const size_t estimated_size, MsgPack /*format*/,
+                         Write write) {
+  std::string out;
+  out.reserve(estimated_size);
+  MsgPackObjectWriter writer(out);
+  write(writer);
+  return out;
+}
+
+String Serialize(const JsonDocument& doc, Json /*format*/) {
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+std::string Serialize(const JsonDocument& doc, MsgPack /*format*/) {
+  std::string out;
+  StdStringPrint printer(out);
+  serializeMsgPack(doc, printer);
+  return out;
+}
+
+// Sets a value kept as JSON, e.g. a command of CommandTable. MessagePack
+// needs it parsed, which takes a document of the size of the value only.
+void SetStoredJson(JsonVariant dst, const String& json, Json /*format*/) {
+  dst.set(serialized(json));
+}
+
+void SetStoredJson(JsonVariant dst, const String& json, MsgPack /*format*/) {
+  JsonDocument doc;
+  deserializeJson(doc, json);
+  dst.set(doc.as<JsonVariantConst>());
+}
+
+}  // namespace
+
+template <typename Format>
+typename Format::Output ConvertHubInfo(const int client_count,
+                                       const Format format) {
   // {
   //   "type": "hub_info",
   //   "hub_version": "1.2.3",
@@ -21,13 +214,32 @@ String ConvertHubInfo(const int client_count) {
   doc["ota_available"] = ota_endpoint != nullptr && ota_endpoint[0] != '\0';
   doc["ota_label"] = g_settings.GetOtaLabel();
   doc["client_count"] = client_count;
+  return Serialize(doc, format);
+}
 
-  String out;
-  serializeJson(doc, out);
-  return out;
+template String ConvertHubInfo(int client_count, Json format);
+template std::string ConvertHubInfo(int client_count, MsgPack format);
+
+template <typename Format>
+typename Format::Output ConvertClock(const Format format) {
+  // {
+  //   "type": "clock",
+  //   "timestamp_now": 10
+  // }
+  std::time_t now;
+  std::time(&now);
+  JsonDocument doc;
+  doc["type"] = "clock";
+  doc["timestamp_now"] = now;
+  return Serialize(doc, format);
 }
 
-String ConvertRobotInfo(const RobotInfoHolder& robot_info) {
+template String ConvertClock(Json format);
+template std::string ConvertClock(MsgPack format);
+
+template <typename Format>
+typename Format::Output ConvertRobotInfo(const RobotInfoHolder& robot_info,
+                                         const Format format) {
   // {
   //   "type": "robot_info",
   //   "robot_version": "1.0.0",
@@ -59,43 +271,57 @@ String ConvertRobotInfo(const RobotInfoHolder& robot_info) {
   //     }
   //   ]
   // }
-  JsonDocument doc;
-  doc["type"] = "robot_info";
-  if (robot_info.has_robot_version) {
-    doc["robot_version"] = robot_info.robot_version;
-  }
-  if (robot_info.has_shelves) {
-    doc["shelves"] = JsonArray();
-    for (const Shelf& shelf : robot_info.shelves) {
-      JsonObject shelf_json = doc["shelves"].createNestedObject();
-      shelf_json["id"] = shelf.id;
-      shelf_json["name"] = shelf.name;
+  const size_t estimated_size =
+      64 * (2 + robot_info.shelves.size() + robot_info.locations.size() +
+            robot_info.shortcuts.size());
+  return WriteMessage(estimated_size, format, [&robot_info](auto& writer) {
+    writer.Add("type", "robot_info");
+    if (robot_info.has_robot_version) {
+      writer.Add("robot_version", robot_info.robot_version);
     }
-  }
-  if (robot_info.has_locations) {
-    doc["locations"] = JsonArray();
-    for (const Location& location : robot_info.locations) {
-      JsonObject location_json = doc["locations"].createNestedObject();
-      location_json["id"] = location.id;
-      location_json["name"] = location.name;
-      location_json["type"] = GetLocationTypeString(location.type);
+    if (robot_info.has_shelves) {
+      writer.BeginArray("shelves");
+      for (const Shelf& shelf : robot_info.shelves) {
+        writer.AddElement([&shelf](JsonObject shelf_json) {
+          shelf_json["id"] = shelf.id;
+          shelf_json["name"] = shelf.name;
+        });
+      }
+      writer.EndArray();
     }
-  }
-  if (robot_info.has_shortcuts) {
-    doc["shortcuts"] = JsonArray();
-    for (const Shortcut& shortcut : robot_info.shortcuts) {
-      JsonObject shortcut_json = doc["shortcuts"].createNestedObject();
-      shortcut_json["id"] = shortcut.id;
-      shortcut_json["name"] = shortcut.name;
+    if (robot_info.has_locations) {
+      writer.BeginArray("locations");
+      for (const Location& location : robot_info.locations) {
+        writer.AddElement([&location](JsonObject location_json) {
+          location_json["id"] = location.id;
+          location_json["name"] = location.name;
+          location_json["type"] = GetLocationTypeString(location.type);
+        });
+      }
+      writer.EndArray();
     }
-  }
-
-  String out;
-  serializeJson(doc, out);
-  return out;
+    if (robot_info.has_shortcuts) {
+      writer.BeginArray("shortcuts");
+      for (const Shortcut& shortcut : robot_info.shortcuts) {
+        writer.AddElement([&shortcut](JsonObject shortcut_json) {
+          shortcut_json["id"] = shortcut.id;
+          shortcut_json["name"] = shortcut.name;
+        });
+      }
+      writer.EndArray();
+    }
+    writer.End();
+  });
 }
 
-String ConvertSettings(const Settings& settings) {
+template String ConvertRobotInfo(const RobotInfoHolder& robot_info,
+                                 Json format);
+template std::string ConvertRobotInfo(const RobotInfoHolder& robot_info,
+                                      MsgPack format);
+
+template <typename Format>
+typename Format::Output ConvertSettings(const Settings& settings,
+                                        const Format format) {
   // {
   //   "type": "settings",
   //   "settings": {
@@ -125,14 +351,17 @@ String ConvertSettings(const Settings& settings) {
   settings_json["auto_ota_is_enabled"] = settings.GetAutoOtaIsEnabled();
   settings_json["auto_refetch_on_ui_load"] = settings.GetAutoRefetchOnUiLoad();
   settings_json["gpio_button_is_enabled"] = settings.GetGpioButtonIsEnabled();
-
-  String out;
-  serializeJson(doc, out);
-  return out;
+  return Serialize(doc, format);
 }
 
-String ConvertWiFiApList(const bool scanning,
-                         const std::vector<wifi::WiFiAp>& wifi_ap_list) {
+template String ConvertSettings(const Settings& settings, Json format);
+template std::string ConvertSettings(const Settings& settings,
+                                     MsgPack format);
+
+template <typename Format>
+typename Format::Output ConvertWiFiApList(
+    const bool scanning, const std::vector<wifi::WiFiAp>& wifi_ap_list,
+    const Format format) {
   // {
   //   "type": "wifi_ap_list",
   //   "scanning": true,
@@ -148,24 +377,50 @@ String ConvertWiFiApList(const bool scanning,
   //     }
   //   ]
   // }
-  JsonDocument doc;
-  doc["type"] = "wifi_ap_list";
-  doc["scanning"] = scanning;
-  JsonArray wifi_ap_list_json = doc.createNestedArray("wifi_ap_list");
-  for (const auto& ap : wifi_ap_list) {
-    JsonObject ap_json = wifi_ap_list_json.createNestedObject();
-    ap_json["ssid"] = ap.ssid;
-    ap_json["bssid"] = ap.bssid;
-    ap_json["channel"] = ap.channel;
-    ap_json["encryption_type"] = ap.encryption_type;
-  }
+  const size_t estimated_size = 64 * (1 + wifi_ap_list.size());
+  return WriteMessage(estimated_size, format, [&](auto& writer) {
+    writer.Add("type", "wifi_ap_list");
+    writer.Add("scanning", scanning);
+    writer.BeginArray("wifi_ap_list");
+    for (const auto& ap : wifi_ap_list) {
+      writer.AddElement([&ap](JsonObject ap_json) {
+        ap_json["ssid"] = ap.ssid;
+        ap_json["bssid"] = ap.bssid;
+        ap_json["channel"] = ap.channel;
+        ap_json["encryption_type"] = ap.encryption_type;
+      });
+    }
+    writer.EndArray();
+    writer.End();
+  });
+}
 
-  String out;
-  serializeJson(doc, out);
-  return out;
+template String ConvertWiFiApList(
+    bool scanning, const std::vector<wifi::WiFiAp>& wifi_ap_list, Json format);
+template std::string ConvertWiFiApList(
+    bool scanning, const std::vector<wifi::WiFiAp>& wifi_ap_list,
+    MsgPack format);
+
+template <typename Format>
+typename Format::Output ConvertWiFiRssi(const int rssi, const Format format) {
+  // {
+  //   "type": "wifi_rssi",
+  //   "wifi_rssi": -60
+  // }
+  JsonDocument doc;
+  doc["type"] = "wifi_rssi";
+  doc["wifi_rssi"] = rssi;
+  return Serialize(doc, format);
 }
 
+template String ConvertWiFiRssi(int rssi, Json format);
+template std::string ConvertWiFiRssi(int rssi, MsgPack format);
+
 static void FillButtonJson(const KButton& button, JsonObject object) {
+  // The key of the per-entry endpoints, e.g. PUT /commands/{id}
+  char id[button_id::kMaxLength + 1];
+  button_id::Format(button, id);
+  object["id"] = id;
   switch (button.type) {
     case ButtonType::kAppleIBeacon: {
       const AppleIBeacon& beacon = button.data.apple_i_beacon;
@@ -188,15 +443,58 @@ static void FillButtonJson(const KButton& button, JsonObject object) {
   }
 }
 
-String ConvertObservedButtons(
-    const std::deque<ObservedButton>& observed_buttons,
-    const std::map<KButton, String>& button_names) {
+static void FillObservedButtonJson(const KButton& button,
+                                   const ObservedButton* observed,
+                                   const String* name, JsonObject item) {
+  if (observed != nullptr) {
+    item["timestamp"] = observed->timestamp;
+    if (observed->estimated_distance >= 0.0) {
+      item["estimated_distance"] = observed->estimated_distance;
+    }
+  }
+  if (name != nullptr) {
+    item["name"] = *name;
+  }
+  FillButtonJson(button, item);
+}
+
+// "next_cursor" of a page, unless it is the last one
+template <typename Writer>
+static void AddNextCursor(Writer& writer, const KButton* next_cursor) {
+  if (next_cursor == nullptr) {
+    return;
+  }
+  char id[button_id::kMaxLength + 1];
+  button_id::Format(*next_cursor, id);
+  writer.Add("next_cursor", id);
+}
+
+static size_t EstimateSize(const std::vector<ObservedButton>& observed_buttons,
+                           const ButtonMap<String>& button_names) {
+  return 64 + kEstimatedButtonJsonSize *
+                  (observed_buttons.size() + button_names.size());
+}
+
+static size_t EstimateSize(const ButtonMap<String>& commands) {
+  size_t size = 64;
+  for (const auto& [button, command] : commands) {
+    size += kEstimatedButtonJsonSize + command.length();
+  }
+  return size;
+}
+
+template <typename Writer>
+static void WriteObservedButtons(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names, const std::time_t* now,
+    const uint32_t* version, const KButton* next_cursor, Writer& writer) {
   // {
   //   "type": "observed_buttons",
   //   "buttons": [
   //     {
   //       "timestamp": 10,
   //       "name": "Button 1",
+  //       "id": "ib-...",
   //       "apple_i_beacon": {
   //         "address": "00:00:00:00:00:00",
   //         "uuid": "00000000-0000-0000-0000-000000000000",
@@ -211,43 +509,130 @@ String ConvertObservedButtons(
   //   "timestamp_now": 10
   // }
 
-  std::map<KButton, String> names = button_names;
-
-  JsonDocument doc;
-  doc["type"] = "observed_buttons";
-  JsonArray buttons = doc.createNestedArray("buttons");
+  writer.Add("type", "observed_buttons");
+  writer.BeginArray("buttons");
 
   // observed recently (has "timestamp" field)
-  for (const auto& [timestamp, estimated_distance, button] : observed_buttons) {
-    JsonObject item = buttons.createNestedObject();
-    item["timestamp"] = timestamp;
-    if (estimated_distance >= 0.0) {
-      item["estimated_distance"] = estimated_distance;
-    }
-    const auto iter = names.find(button);
-    if (iter != names.end()) {
-      item["name"] = iter->second;
-      names.erase(iter);
+  for (const ObservedButton& observed : observed_buttons) {
+    const String* name = button_names.Find(observed.button);
+    writer.AddElement([&observed, name](JsonObject item) {
+      FillObservedButtonJson(observed.button, &observed, name, item);
+    });
+  }
+
+  // named buttons. The observed ones are looked up in a sorted copy instead
+  // of the list for each name.
+  ButtonMap<bool> is_observed;
+  is_observed.Reserve(observed_buttons.size());
+  for (const ObservedButton& observed : observed_buttons) {
+    is_observed.Set(observed.button, true);
+  }
+  for (const auto& [button, name] : button_names) {
+    if (is_observed.Contains(button)) {
+      continue;
     }
-    FillButtonJson(button, item);
+    writer.AddElement([&button = button, &name = name](JsonObject item) {
+      FillObservedButtonJson(button, nullptr, &name, item);
+    });
   }
+  writer.EndArray();
 
-  // named buttons
-  for (const auto& [button, name] : names) {
-    JsonObject item = buttons.createNestedObject();
-    item["name"] = name;
-    FillButtonJson(button, item);
+  if (now != nullptr) {
+    writer.Add("timestamp_now", *now);
   }
+  if (version != nullptr) {
+    writer.Add("version", *version);
+  }
+  AddNextCursor(writer, next_cursor);
+  writer.End();
+}
 
+String ConvertObservedButtons(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names) {
   std::time_t now;
   std::time(&now);
-  doc["timestamp_now"] = now;
+  const size_t estimated_size = EstimateSize(observed_buttons, button_names);
+  return WriteMessage(estimated_size, Json(), [&](auto& writer) {
+    WriteObservedButtons(observed_buttons, button_names, &now, nullptr,
+                         nullptr, writer);
+  });
+}
 
-  String out;
-  serializeJson(doc, out);
-  return out;
+template <typename Format>
+typename Format::Output ConvertObservedButtons(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names, const uint32_t version,
+    const Format format) {
+  const size_t estimated_size = EstimateSize(observed_buttons, button_names);
+  return WriteMessage(estimated_size, format, [&](auto& writer) {
+    WriteObservedButtons(observed_buttons, button_names, nullptr, &version,
+                         nullptr, writer);
+  });
+}
+
+template String ConvertObservedButtons(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names, uint32_t version, Json format);
+template std::string ConvertObservedButtons(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names, uint32_t version, MsgPack format);
+
+String ConvertObservedButtonPage(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names, const KButton* next_cursor) {
+  std::time_t now;
+  std::time(&now);
+  const size_t estimated_size = EstimateSize(observed_buttons, button_names);
+  return WriteMessage(estimated_size, Json(), [&](auto& writer) {
+    WriteObservedButtons(observed_buttons, button_names, &now, nullptr,
+                         next_cursor, writer);
+  });
 }
 
+template <typename Format>
+typename Format::Output ConvertObservedButtonDelta(
+    const uint32_t version, const KButton& button,
+    const ObservedButton* observed, const String* name, const Format format) {
+  // {
+  //   "type": "observed_buttons_delta",
+  //   "version": 2,
+  //   "upsert": [
+  //     // an item of "buttons" of "observed_buttons"
+  //   ],
+  //   "delete": [
+  //     {
+  //       "apple_i_beacon": { ... },
+  //     },
+  //   ],
+  //   "timestamp_now": 10
+  // }
+  JsonDocument doc;
+  doc["type"] = "observed_buttons_delta";
+  doc["version"] = version;
+  if (observed == nullptr && name == nullptr) {
+    JsonArray deleted = doc.createNestedArray("delete");
+    FillButtonJson(button, deleted.createNestedObject());
+  } else {
+    JsonArray upserted = doc.createNestedArray("upsert");
+    FillObservedButtonJson(button, observed, name,
+                           upserted.createNestedObject());
+  }
+
+  std::time_t now;
+  std::time(&now);
+  doc["timestamp_now"] = now;
+  return Serialize(doc, format);
+}
+
+template String ConvertObservedButtonDelta(uint32_t version,
+                                           const KButton& button,
+                                           const ObservedButton* observed,
+                                           const String* name, Json format);
+template std::string ConvertObservedButtonDelta(
+    uint32_t version, const KButton& button, const ObservedButton* observed,
+    const String* name, MsgPack format);
+
 static void FillCommandJson(const Command& command, JsonObject out) {
   out["type"] = static_cast<int>(command.type);
   out["cancel_all"] = command.cancel_all;
@@ -313,13 +698,17 @@ String ConvertCommand(const Command& command) {
   return out;
 }
 
-String ConvertCommands(const std::vector<ButtonCommandPair>& commands) {
+template <typename Writer>
+static void WriteCommands(const ButtonMap<String>& commands,
+                          const std::time_t* now, const uint32_t* version,
+                          const KButton* next_cursor, Writer& writer) {
   // {
   //   "type": "commands",
   //   "timestamp_now": 10,
   //   "commands": [
   //     {
   //       "button": {
+  //         "id": "ib-...",
   //         "apple_i_beacon": {
   //           "address": "00:00:00:00:00:00",
   //           "uuid": "00000000-0000-0000-0000-000000000000",
@@ -344,24 +733,94 @@ String ConvertCommands(const std::vector<ButtonCommandPair>& commands) {
   //     }
   //   ]
   // }
-  JsonDocument doc;
-  doc["type"] = "commands";
-  JsonArray commands_json = doc.createNestedArray("commands");
+  writer.Add("type", "commands");
+  writer.BeginArray("commands");
   for (const auto& [button, command] : commands) {
-    JsonObject item = commands_json.createNestedObject();
-    JsonObject button_json = item.createNestedObject("button");
-    FillButtonJson(button, button_json);
-    JsonObject command_json = item.createNestedObject("command");
-    FillCommandJson(command, command_json);
+    writer.AddElement([&button = button, &command = command](JsonObject item) {
+      JsonObject button_json = item.createNestedObject("button");
+      FillButtonJson(button, button_json);
+      SetStoredJson(item["command"], command, typename Writer::Format());
+    });
+  }
+  writer.EndArray();
+
+  if (now != nullptr) {
+    writer.Add("timestamp", *now);
+  }
+  if (version != nullptr) {
+    writer.Add("version", *version);
   }
+  AddNextCursor(writer, next_cursor);
+  writer.End();
+}
 
+String ConvertCommands(const ButtonMap<String>& commands) {
   std::time_t now;
   std::time(&now);
-  doc["timestamp"] = now;
+  return WriteMessage(EstimateSize(commands), Json(), [&](auto& writer) {
+    WriteCommands(commands, &now, nullptr, nullptr, writer);
+  });
+}
 
-  String out;
-  serializeJson(doc, out);
-  return out;
+template <typename Format>
+typename Format::Output ConvertCommands(const ButtonMap<String>& commands,
+                                        const uint32_t version,
+                                        const Format format) {
+  return WriteMessage(EstimateSize(commands), format, [&](auto& writer) {
+    WriteCommands(commands, nullptr, &version, nullptr, writer);
+  });
 }
 
+template String ConvertCommands(const ButtonMap<String>& commands,
+                                uint32_t version, Json format);
+template std::string ConvertCommands(const ButtonMap<String>& commands,
+                                     uint32_t version, MsgPack format);
+
+String ConvertCommandPage(const ButtonMap<String>& commands,
+                          const KButton* next_cursor) {
+  std::time_t now;
+  std::time(&now);
+  return WriteMessage(EstimateSize(commands), Json(), [&](auto& writer) {
+    WriteCommands(commands, &now, nullptr, next_cursor, writer);
+  });
+}
+
+template <typename Format>
+typename Format::Output ConvertCommandDelta(const uint32_t version,
+                                            const KButton& button,
+                                            const String* command_json,
+                                            const Format format) {
+  // {
+  //   "type": "commands_delta",
+  //   "version": 2,
+  //   "upsert": [
+  //     // an item of "commands" of "commands"
+  //   ],
+  //   "delete": [
+  //     {
+  //       "button": { ... },
+  //     },
+  //   ],
+  // }
+  JsonDocument doc;
+  doc["type"] = "commands_delta";
+  doc["version"] = version;
+  JsonArray items =
+      doc.createNestedArray(command_json != nullptr ? "upsert" : "delete");
+  JsonObject item = items.createNestedObject();
+  JsonObject button_json = item.createNestedObject("button");
+  FillButtonJson(button, button_json);
+  if (command_json != nullptr) {
+    SetStoredJson(item["command"], *command_json, format);
+  }
+  return Serialize(doc, format);
+}
+
+template String ConvertCommandDelta(uint32_t version, const KButton& button,
+                                    const String* command_json, Json format);
+template std::string ConvertCommandDelta(uint32_t version,
+                                         const KButton& button,
+                                         const String* command_json,
+                                         MsgPack format);
+
 }  // namespace to_json
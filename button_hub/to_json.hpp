@@ -1,9 +1,10 @@
 #pragma once
 
 #include <M5Unified.h>
-#include <deque>
-#include <map>
+#include <string>
+#include <vector>
 
+#include "button_map.hpp"
 #include "command_table.hpp"
 #include "settings.hpp"
 #include "types.hpp"
@@ -11,16 +12,73 @@
 
 namespace to_json {
 
-String ConvertHubInfo(const int client_count);
-String ConvertRobotInfo(const RobotInfoHolder& robot_info);
-String ConvertSettings(const Settings& settings);
-String ConvertWiFiApList(bool scanning,
-                         const std::vector<wifi::WiFiAp>& wifi_ap_list);
+// The formats of the WebSocket messages (see server.hpp), given to the
+// converters of those messages. A message is written straight in either
+// format, in the same schema: JSON as a String and MessagePack as a
+// std::string.
+struct Json {
+  using Output = String;
+};
+struct MsgPack {
+  using Output = std::string;
+};
 
+template <typename Format = Json>
+typename Format::Output ConvertHubInfo(int client_count, Format format = {});
+// The time of the hub, sent before each snapshot of the delta protocol
+template <typename Format = Json>
+typename Format::Output ConvertClock(Format format = {});
+template <typename Format = Json>
+typename Format::Output ConvertRobotInfo(const RobotInfoHolder& robot_info,
+                                         Format format = {});
+template <typename Format = Json>
+typename Format::Output ConvertSettings(const Settings& settings,
+                                        Format format = {});
+template <typename Format = Json>
+typename Format::Output ConvertWiFiApList(
+    bool scanning, const std::vector<wifi::WiFiAp>& wifi_ap_list,
+    Format format = {});
+template <typename Format = Json>
+typename Format::Output ConvertWiFiRssi(int rssi, Format format = {});
+
+// `button_names` and `commands` are those of CommandTable, the latter
+// holding the JSON of each command.
 String ConvertObservedButtons(
-    const std::deque<ObservedButton>& observed_buttons,
-    const std::map<KButton, String>& button_names);
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names);
 String ConvertCommand(const Command& command);
-String ConvertCommands(const std::vector<ButtonCommandPair>& commands);
+String ConvertCommands(const ButtonMap<String>& commands);
+
+// Messages of the WebSocket delta protocol (see server.hpp). The snapshots
+// are the same as above with "version" but without the time of the hub
+// ("timestamp_now" and "timestamp"), as they are cached until the next change.
+// The clients get the time from ConvertClock() instead.
+template <typename Format = Json>
+typename Format::Output ConvertObservedButtons(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names, uint32_t version,
+    Format format = {});
+template <typename Format = Json>
+typename Format::Output ConvertCommands(const ButtonMap<String>& commands,
+                                        uint32_t version, Format format = {});
+// The button is deleted if both `observed` and `name` are null.
+template <typename Format = Json>
+typename Format::Output ConvertObservedButtonDelta(
+    uint32_t version, const KButton& button, const ObservedButton* observed,
+    const String* name, Format format = {});
+// The command is deleted if `command_json` is null.
+template <typename Format = Json>
+typename Format::Output ConvertCommandDelta(uint32_t version,
+                                            const KButton& button,
+                                            const String* command_json,
+                                            Format format = {});
+
+// Pages of GET /buttons and GET /commands: the same as the lists above with
+// "next_cursor", the ID of the last button, if there are more pages.
+String ConvertObservedButtonPage(
+    const std::vector<ObservedButton>& observed_buttons,
+    const ButtonMap<String>& button_names, const KButton* next_cursor);
+String ConvertCommandPage(const ButtonMap<String>& commands,
+                          const KButton* next_cursor);
 
 }  // namespace to_json
@@ -0,0 +1,89 @@
+#include "ui_bundle.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+#include "log_frame.hpp"
+
+namespace ui_bundle {
+
+// Returns the null-terminated string at `offset`, or nullptr if it runs past
+// the end of the bundle.
+static const char* GetString(const uint8_t* data, const size_t size,
+                             const uint32_t offset) {
+  if (offset >= size) {
+    return nullptr;
+  }
+  const char* s = reinterpret_cast<const char*>(data + offset);
+  return std::memchr(s, '\0', size - offset) != nullptr ? s : nullptr;
+}
+
+// Sets nullptr for a left-out variant
+static bool GetBlob(const uint8_t* data, const size_t size,
+                    const uint32_t offset, const uint32_t blob_size,
+                    const uint8_t** out) {
+  if (blob_size == 0) {
+    *out = nullptr;
+    return true;
+  }
+  if (offset > size || blob_size > size - offset) {
+    return false;
+  }
+  *out = data + offset;
+  return true;
+}
+
+bool ReadHeader(const uint8_t* data, const size_t size, Header* header) {
+  if (size < sizeof(Header)) {
+    return false;
+  }
+  std::memcpy(header, data, sizeof(Header));
+  return std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+         header->format_version == kFormatVersion &&
+         header->size >= sizeof(Header) &&
+         std::memchr(header->version, '\0', sizeof(header->version)) !=
+             nullptr;
+}
+
+bool Parse(const uint8_t* data, size_t size, Bundle* bundle) {
+  Header header;
+  if (!ReadHeader(data, size, &header) || header.size > size) {
+    return false;
+  }
+  size = header.size;
+  if (header.asset_count > (size - sizeof(Header)) / sizeof(Entry) ||
+      logging::Crc32(data + sizeof(Header), size - sizeof(Header)) !=
+          header.crc) {
+    return false;
+  }
+
+  std::vector<Asset> assets(header.asset_count);
+  for (size_t i = 0; i < assets.size(); ++i) {
+    Entry entry;
+    std::memcpy(&entry, data + sizeof(Header) + i * sizeof(Entry),
+                sizeof(Entry));
+    Asset& asset = assets[i];
+    asset.path = GetString(data, size, entry.path);
+    asset.mime_type = GetString(data, size, entry.mime_type);
+    asset.etag = GetString(data, size, entry.etag);
+    asset.is_immutable = (entry.flags & kImmutable) != 0;
+    asset.size = entry.data_size;
+    asset.gz_size = entry.gz_size;
+    asset.br_size = entry.br_size;
+    if (asset.path == nullptr || asset.mime_type == nullptr ||
+        asset.etag == nullptr ||
+        !GetBlob(data, size, entry.data_offset, entry.data_size,
+                 &asset.data) ||
+        !GetBlob(data, size, entry.gz_offset, entry.gz_size, &asset.gz_data) ||
+        !GetBlob(data, size, entry.br_offset, entry.br_size, &asset.br_data)) {
+      return false;
+    }
+  }
+  bundle->version = reinterpret_cast<const char*>(data) +
+                    offsetof(Header, version);
+  bundle->assets = std::move(assets);
+  return true;
+}
+
+}  // namespace ui_bundle
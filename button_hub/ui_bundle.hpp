@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ui_bundle {
+
+// A web UI bundle is the built web UI in one blob, generated by
+// tools/gen_ui_bundle.py and stored in the "ui" partition:
+//
+//   Header
+//   Entry * asset_count
+//   null-terminated strings and the contents of the assets
+//
+// All the integers are little endian and all the offsets are from the start
+// of the bundle.
+
+constexpr char kMagic[4] = {'K', 'B', 'U', 'I'};
+constexpr uint32_t kFormatVersion = 1;
+
+struct __attribute__((packed)) Header {
+  char magic[4];
+  uint32_t format_version;
+  char version[32];  // e.g. "v1.2.3", null-terminated
+  uint32_t asset_count;
+  uint32_t size;  // of the whole bundle
+  uint32_t crc;  // logging::Crc32() of the bytes after the header
+};
+
+constexpr uint32_t kImmutable = 1;
+
+struct __attribute__((packed)) Entry {
+  uint32_t path;  // offsets of null-terminated strings
+  uint32_t mime_type;
+  uint32_t etag;
+  uint32_t flags;  // kImmutable
+  // Size 0 if the variant is left out
+  uint32_t data_offset;
+  uint32_t data_size;
+  uint32_t gz_offset;
+  uint32_t gz_size;
+  uint32_t br_offset;
+  uint32_t br_size;
+};
+
+// A file of the web UI. The pointers refer to the bundle.
+struct Asset {
+  const char* path;  // "/" for index.html
+  const char* mime_type;
+  const char* etag;  // quoted hash of the contents
+  // The path contains the hash of the contents, so it never changes
+  bool is_immutable;
+  const uint8_t* data;
+  size_t size;
+  // Compressed variants, or nullptr if not smaller than the original
+  const uint8_t* gz_data;
+  size_t gz_size;
+  const uint8_t* br_data;
+  size_t br_size;
+};
+
+struct Bundle {
+  const char* version;
+  std::vector<Asset> assets;
+};
+
+// Returns false if `data` doesn't start with a header of this format. The
+// rest of the bundle is not checked.
+bool ReadHeader(const uint8_t* data, size_t size, Header* header);
+
+// Returns false if `data` is not a whole bundle of this format, e.g. it is
+// truncated or corrupted.
+bool Parse(const uint8_t* data, size_t size, Bundle* bundle);
+
+}  // namespace ui_bundle
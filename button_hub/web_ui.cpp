@@ -0,0 +1,242 @@
+#include "web_ui.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <esp_partition.h>
+
+#include "logging.hpp"
+#include "mutex.hpp"
+
+namespace web_ui {
+
+// Generated from the built web UI by `make build`, see tools/gen_ui_bundle.py
+extern const uint8_t kEmbeddedBundle[];
+extern const size_t kEmbeddedBundleSize;
+
+static constexpr char kPartitionLabel[] = "ui";
+constexpr size_t kFlashSectorSize = 4096;
+constexpr int kSlotCount = 2;
+
+// The first sector of a slot is its header, written once the bundle after it
+// has been verified. The slot of the highest generation is used.
+struct __attribute__((packed)) SlotHeader {
+  char magic[4];
+  uint32_t generation;
+};
+constexpr char kSlotMagic[4] = {'K', 'B', 'S', 'L'};
+
+static const esp_partition_t* g_partition = nullptr;
+static const uint8_t* g_mapped = nullptr;  // the whole partition
+static size_t g_slot_size = 0;  // a multiple of kFlashSectorSize
+static kb::Mutex g_mutex;
+static ui_bundle::Bundle g_bundle;  // guard by g_mutex
+static bool g_has_bundle = false;  // guard by g_mutex
+static int g_active_slot = -1;  // guard by g_mutex. -1 for the embedded one.
+static uint32_t g_generations[kSlotCount] = {};  // guard by g_mutex
+// Assets of each slot being sent. Only the active slot gains leases.
+static std::atomic<int> g_leases[kSlotCount] = {};
+static std::atomic<bool> g_is_updating{false};
+
+static const uint8_t* GetSlotBundle(const int slot) {
+  return g_mapped + slot * g_slot_size + kFlashSectorSize;
+}
+
+static size_t GetSlotCapacity() {
+  return g_slot_size - kFlashSectorSize;
+}
+
+static void LoadSlotLocked(const int slot) {
+  SlotHeader header;
+  std::memcpy(&header, g_mapped + slot * g_slot_size, sizeof(header));
+  ui_bundle::Bundle bundle;
+  if (std::memcmp(header.magic, kSlotMagic, sizeof(kSlotMagic)) != 0 ||
+      !ui_bundle::Parse(GetSlotBundle(slot), GetSlotCapacity(), &bundle)) {
+    return;
+  }
+  g_generations[slot] = header.generation;
+  if (g_active_slot < 0 || header.generation > g_generations[g_active_slot]) {
+    g_active_slot = slot;
+    g_bundle = std::move(bundle);
+    g_has_bundle = true;
+  }
+}
+
+static void MapPartition() {
+  g_partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, kPartitionLabel);
+  if (g_partition == nullptr) {
+    logging::Log(logging::Level::kWarn,
+                 "No partition for the web UI. Flash over USB to add it.");
+    return;
+  }
+  const void* mapped = nullptr;
+  spi_flash_mmap_handle_t handle;  // never unmapped
+  const esp_err_t err = esp_partition_mmap(
+      g_partition, 0, g_partition->size, SPI_FLASH_MMAP_DATA, &mapped, &handle);
+  if (err != ESP_OK) {
+    logging::Log(logging::Level::kError, "Failed to map the web UI: %d", err);
+    return;
+  }
+  g_mapped = static_cast<const uint8_t*>(mapped);
+  g_slot_size =
+      g_partition->size / kSlotCount / kFlashSectorSize * kFlashSectorSize;
+}
+
+void Begin() {
+  MapPartition();
+  const kb::LockGuard lock(g_mutex);
+  if (g_mapped != nullptr) {
+    for (int slot = 0; slot < kSlotCount; ++slot) {
+      LoadSlotLocked(slot);
+    }
+  }
+  if (g_active_slot >= 0) {
+    logging::Log("Web UI %s in slot %d: %d assets", g_bundle.version,
+                 g_active_slot, static_cast<int>(g_bundle.assets.size()));
+    return;
+  }
+  g_has_bundle =
+      ui_bundle::Parse(kEmbeddedBundle, kEmbeddedBundleSize, &g_bundle);
+  if (g_has_bundle) {
+    logging::Log("Web UI %s embedded in the firmware", g_bundle.version);
+  } else {
+    g_bundle = {};
+    logging::Log(logging::Level::kError, "No web UI");
+  }
+}
+
+bool IsInstalled() {
+  const kb::LockGuard lock(g_mutex);
+  return g_active_slot >= 0;
+}
+
+String GetVersion() {
+  const kb::LockGuard lock(g_mutex);
+  return g_has_bundle ? String(g_bundle.version) : String();
+}
+
+AssetLease& AssetLease::operator=(AssetLease&& other) noexcept {
+  if (this != &other) {
+    if (slot_ >= 0) {
+      --g_leases[slot_];
+    }
+    slot_ = other.slot_;
+    other.slot_ = -1;
+  }
+  return *this;
+}
+
+AssetLease::~AssetLease() {
+  if (slot_ >= 0) {
+    --g_leases[slot_];
+  }
+}
+
+bool FindAsset(const char* path, ui_bundle::Asset* asset, AssetLease* lease) {
+  const kb::LockGuard lock(g_mutex);
+  if (!g_has_bundle) {
+    return false;
+  }
+  for (const ui_bundle::Asset& a : g_bundle.assets) {
+    if (std::strcmp(a.path, path) == 0) {
+      *asset = a;
+      *lease = AssetLease();
+      if (g_active_slot >= 0) {
+        ++g_leases[g_active_slot];
+        lease->slot_ = g_active_slot;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+std::unique_ptr<BundleWriter> BundleWriter::Create() {
+  if (g_mapped == nullptr || g_is_updating.exchange(true)) {
+    return nullptr;
+  }
+  int slot;
+  {
+    const kb::LockGuard lock(g_mutex);
+    slot = g_active_slot == 0 ? 1 : 0;
+    // A client may still be receiving an asset of the bundle before the
+    // active one
+    if (g_leases[slot] > 0) {
+      g_is_updating = false;
+      logging::Log(logging::Level::kWarn,
+                   "Web UI: slot %d is still being sent", slot);
+      return nullptr;
+    }
+    g_generations[slot] = 0;
+  }
+  logging::Log("Updating the web UI in slot %d", slot);
+  return std::unique_ptr<BundleWriter>(new BundleWriter(slot));
+}
+
+BundleWriter::~BundleWriter() {
+  g_is_updating = false;
+}
+
+bool BundleWriter::Write(const uint8_t* data, const size_t len) {
+  if (len > GetSlotCapacity() - written_) {
+    logging::Log(logging::Level::kError, "Web UI: too large");
+    failed_ = true;
+    return false;
+  }
+  const size_t slot_offset = slot_ * g_slot_size;
+  // Erase one sector at a time so that the AsyncTCP task is not blocked for
+  // long. The first one is the slot header, so that the slot is never taken
+  // for a valid one half written.
+  while (erased_ < kFlashSectorSize + written_ + len) {
+    const esp_err_t err = esp_partition_erase_range(
+        g_partition, slot_offset + erased_, kFlashSectorSize);
+    if (err != ESP_OK) {
+      logging::Log(logging::Level::kError, "Web UI: erase failed: %d", err);
+      failed_ = true;
+      return false;
+    }
+    erased_ += kFlashSectorSize;
+  }
+  const esp_err_t err = esp_partition_write(
+      g_partition, slot_offset + kFlashSectorSize + written_, data, len);
+  if (err != ESP_OK) {
+    logging::Log(logging::Level::kError, "Web UI: write failed: %d", err);
+    failed_ = true;
+    return false;
+  }
+  written_ += len;
+  return true;
+}
+
+bool BundleWriter::Commit() {
+  ui_bundle::Bundle bundle;
+  if (failed_ || !ui_bundle::Parse(GetSlotBundle(slot_), written_, &bundle)) {
+    logging::Log(logging::Level::kError, "Web UI: invalid bundle");
+    return false;
+  }
+  const kb::LockGuard lock(g_mutex);
+  uint32_t newest = 0;
+  for (const uint32_t generation : g_generations) {
+    newest = std::max(newest, generation);
+  }
+  SlotHeader header;
+  std::memcpy(header.magic, kSlotMagic, sizeof(kSlotMagic));
+  header.generation = newest + 1;
+  const esp_err_t err = esp_partition_write(
+      g_partition, slot_ * g_slot_size, &header, sizeof(header));
+  if (err != ESP_OK) {
+    logging::Log(logging::Level::kError, "Web UI: write failed: %d", err);
+    return false;
+  }
+  g_generations[slot_] = header.generation;
+  g_active_slot = slot_;
+  g_bundle = std::move(bundle);
+  g_has_bundle = true;
+  logging::Log("Web UI %s in slot %d: %d assets", g_bundle.version, slot_,
+               static_cast<int>(g_bundle.assets.size()));
+  return true;
+}
+
+}  // namespace web_ui
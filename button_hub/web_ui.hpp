@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "ui_bundle.hpp"
+
+namespace web_ui {
+
+// The web UI is a ui_bundle stored in the "ui" data partition, separate from
+// the firmware. The partition is mapped into memory once and the assets are
+// sent from there without being copied.
+//
+// The partition has two slots. A new bundle is written to the slot not in
+// use, and takes over only once it has passed its CRC check, so the bundle in
+// use is served until then and stays if the upload fails.
+//
+// The firmware also embeds a compressed-only bundle of the web UI it was
+// built with, which is served while the partition has no valid bundle, e.g.
+// on a hub whose partition table predates the "ui" partition because it has
+// only been updated over the air.
+
+// Maps the partition and loads the newest bundle in it, if any
+void Begin();
+
+// False while the embedded bundle is served
+bool IsInstalled();
+// Of the bundle being served. Empty if there is none.
+String GetVersion();
+
+// Keeps the slot of an asset from being erased while the asset is sent.
+// Responses hold one until they are gone.
+class AssetLease {
+ public:
+  AssetLease() = default;
+  AssetLease(AssetLease&& other) noexcept : slot_(other.slot_) {
+    other.slot_ = -1;
+  }
+  AssetLease& operator=(AssetLease&& other) noexcept;
+  ~AssetLease();
+
+ private:
+  friend bool FindAsset(const char* path, ui_bundle::Asset* asset,
+                        AssetLease* lease);
+
+  int slot_ = -1;  // -1 for the embedded bundle
+};
+
+// `asset` stays valid as long as `lease` is held
+bool FindAsset(const char* path, ui_bundle::Asset* asset, AssetLease* lease);
+
+// Writes a bundle given chunk by chunk to the slot not in use, and switches to
+// it on Commit().
+class BundleWriter {
+ public:
+  // Returns nullptr if there is no "ui" partition, another bundle is being
+  // written, or assets of the slot to write are still being sent
+  static std::unique_ptr<BundleWriter> Create();
+
+  BundleWriter(const BundleWriter&) = delete;
+  BundleWriter& operator=(const BundleWriter&) = delete;
+  ~BundleWriter();
+
+  // Returns false if the bundle doesn't fit in the slot or the flash fails
+  bool Write(const uint8_t* data, size_t len);
+  // Returns false if what has been written is not a valid bundle, in which
+  // case the bundle in use stays
+  bool Commit();
+
+ private:
+  explicit BundleWriter(int slot) : slot_(slot) {}
+
+  const int slot_;
+  size_t written_ = 0;  // of the bundle, after the slot header
+  size_t erased_ = 0;  // of the slot
+  bool failed_ = false;
+};
+
+}  // namespace web_ui
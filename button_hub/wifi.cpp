@@ -6,10 +6,13 @@
 #include <WiFiAP.h>
 
 #include "logging.hpp"
+#include "mutex.hpp"
 #include "screen.hpp"
 
 namespace wifi {
 
+static constexpr logging::Module kLogModule = logging::Module::kWiFi;
+
 static constexpr int kWiFiButtonVisibilityTimeout = 3 * 1000;
 
 ConnectState ConnectToWiFi(const char* ssid, const char* password,
@@ -28,7 +31,7 @@ ConnectState ConnectToWiFi(const String& ssid, const String& password,
     return ConnectState::kEmptySsid;
   }
 
-  Serial.print("Connecting to Wi-Fi network: ");
+  KB_LOGI("Connecting to Wi-Fi network: %s\n", ssid.c_str());
   bool initial_screen = true;
   if (user_interaction_enabled) {
     screen::DrawWiFiConnectingPage(true);
@@ -76,19 +79,19 @@ ConnectState ConnectToWiFi(const String& ssid, const String& password,
       M5.update();
       bool giveup = M5.BtnA.isPressed();
       if (giveup) {
-        Serial.println("Giving up connection");
+        KB_LOGI("Giving up connection\n");
         WiFi.disconnect();
         return ConnectState::kGiveup;
       }
     }
     if (millis() - now > timeout_millis) {
-      Serial.println("Connection timeout");
+      KB_LOGW("Connection timeout\n");
       WiFi.disconnect();
       return ConnectState::kTimeout;
     }
     vTaskDelay(1);
   } while (WiFi.status() != WL_CONNECTED);
-  Serial.printf("Connected: %s\n", GetIpAddress().c_str());
+  KB_LOGI("Connected: %s\n", GetIpAddress().c_str());
   return ConnectState::kConnected;
 }
 
@@ -96,20 +99,41 @@ String GetIpAddress() {
   return WiFi.localIP().toString();
 }
 
-static std::vector<WiFiAp> wifi_ap_list_ = {};
-
-void StartApScan() {
-  Serial.println("Start scanning...");
-  WiFi.scanNetworks(/* async= */ false);
+// The scan runs in the Wi-Fi driver. Both the HTTP server and the main loop
+// start and poll it.
+static kb::Mutex g_scan_mutex;
+// kFailed if no scan has been started
+static ScanState g_scan_state = ScanState::kFailed;  // guard by g_scan_mutex
+static std::vector<WiFiAp> wifi_ap_list_ = {};  // guard by g_scan_mutex
+static uint32_t g_last_scan_time = 0;  // guard by g_scan_mutex
+
+bool StartApScan() {
+  const kb::LockGuard lock(g_scan_mutex);
+  if (g_scan_state == ScanState::kScanning) {
+    return true;
+  }
+  KB_LOGI("Start scanning...\n");
+  if (WiFi.scanNetworks(/* async= */ true) == WIFI_SCAN_FAILED) {
+    KB_LOGE("Failed to start the Wi-Fi scan\n");
+    return false;
+  }
+  g_scan_state = ScanState::kScanning;
+  return true;
 }
 
-std::tuple<ScanState, const std::vector<WiFiAp>&> GetScannedWiFiApList() {
+// Collects the result once the scan completes
+static ScanState PollApScanLocked() {
+  if (g_scan_state != ScanState::kScanning) {
+    return g_scan_state;
+  }
   const int n = WiFi.scanComplete();
-  if (n == WIFI_SCAN_FAILED) {
-    return {ScanState::kFailed, {}};
+  if (n == WIFI_SCAN_RUNNING) {
+    return ScanState::kScanning;
   }
-  if (n == WIFI_SCAN_RUNNING || n <= 0) {
-    return {ScanState::kScanning, {}};
+  if (n < 0) {
+    KB_LOGE("Wi-Fi scan failed\n");
+    g_scan_state = ScanState::kFailed;
+    return g_scan_state;
   }
 
   std::vector<WiFiAp> ap_list;
@@ -118,13 +142,35 @@ std::tuple<ScanState, const std::vector<WiFiAp>&> GetScannedWiFiApList() {
                        WiFi.encryptionType(i)});
   }
   WiFi.scanDelete();
+  KB_LOGI("Found %d Wi-Fi networks\n", n);
   wifi_ap_list_ = std::move(ap_list);
-  return {ScanState::kSucceeded, wifi_ap_list_};
+  g_last_scan_time = millis();
+  g_scan_state = ScanState::kSucceeded;
+  return g_scan_state;
 }
 
-std::tuple<bool /* scanning */, const std::vector<WiFiAp>&>
+std::tuple<ScanState, std::vector<WiFiAp>> GetScannedWiFiApList() {
+  const kb::LockGuard lock(g_scan_mutex);
+  const ScanState state = PollApScanLocked();
+  if (state != ScanState::kSucceeded) {
+    return {state, {}};
+  }
+  return {state, wifi_ap_list_};
+}
+
+std::tuple<bool /* scanning */, std::vector<WiFiAp>>
 GetLatestScannedWiFiApList() {
-  return {WiFi.scanComplete() == WIFI_SCAN_RUNNING, wifi_ap_list_};
+  const kb::LockGuard lock(g_scan_mutex);
+  return {PollApScanLocked() == ScanState::kScanning, wifi_ap_list_};
+}
+
+bool GetApScanAge(uint32_t* age_msec) {
+  const kb::LockGuard lock(g_scan_mutex);
+  if (PollApScanLocked() != ScanState::kSucceeded) {
+    return false;
+  }
+  *age_msec = millis() - g_last_scan_time;
+  return true;
 }
 
 }  // namespace wifi
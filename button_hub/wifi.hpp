@@ -1,7 +1,9 @@
 #pragma once
 
 #include <WiFi.h>
+#include <cstdint>
 #include <functional>
+#include <tuple>
 #include <vector>
 
 namespace wifi {
@@ -40,9 +42,15 @@ enum class ScanState {
   kSucceeded,
 };
 
-void StartApScan();
-std::tuple<ScanState, const std::vector<WiFiAp>&> GetScannedWiFiApList();
-std::tuple<bool /* scanning */, const std::vector<WiFiAp>&>
+// Starts an asynchronous scan unless one is running. Returns false if the scan
+// couldn't be started.
+bool StartApScan();
+// Returns kScanning until the scan completes. The list of the last successful
+// scan is kept until the next one completes.
+std::tuple<ScanState, std::vector<WiFiAp>> GetScannedWiFiApList();
+std::tuple<bool /* scanning */, std::vector<WiFiAp>>
 GetLatestScannedWiFiApList();
+// Returns false unless the last scan has succeeded
+bool GetApScanAge(uint32_t* age_msec);
 
 }  // namespace wifi
@@ -0,0 +1,165 @@
+// Host benchmark of the containers of CommandTable at 10, 100 and 1000
+// buttons: ButtonMap against the vector with linear scans that it replaced.
+//
+//   cmake -S tests/unittest -B build && cmake --build build
+//   ./build/bench_button_map
+//
+// "serialize" writes every entry the way to_json::ConvertCommands() does,
+// less ArduinoJson: the button ID and the stored command JSON. "page" writes
+// button_query::kDefaultLimit entries after a cursor in the middle.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "button_id.hpp"
+#include "button_map.hpp"
+#include "button_query.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A typical command as stored by CommandTable
+const char kCommandJson[] =
+    "{\"type\":1,\"cancel_all\":false,\"deferrable\":false,"
+    "\"move_shelf\":{\"shelf_id\":\"shelf-01\",\"location_id\":\"dock-01\"}}";
+
+struct LinearEntry {
+  KButton button;
+  std::string value;
+};
+
+std::vector<KButton> MakeBeacons(const size_t count) {
+  std::mt19937 random(count);
+  std::vector<KButton> buttons;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t address[6];
+    uint8_t uuid[16];
+    for (uint8_t& byte : address) {
+      byte = static_cast<uint8_t>(random());
+    }
+    for (uint8_t& byte : uuid) {
+      byte = static_cast<uint8_t>(random());
+    }
+    buttons.emplace_back(AppleIBeacon(address, uuid, 1, i));
+  }
+  return buttons;
+}
+
+// Nanoseconds per call of `run`, which does `ops` operations
+template <typename Run>
+double Measure(const size_t ops, Run run) {
+  size_t rounds = 0;
+  const Clock::time_point start = Clock::now();
+  Clock::duration elapsed{};
+  do {
+    run();
+    ++rounds;
+    elapsed = Clock::now() - start;
+  } while (elapsed < std::chrono::milliseconds(200));
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         (rounds * ops);
+}
+
+void AppendEntry(const KButton& button, const std::string& command,
+                 std::string* out) {
+  char id[button_id::kMaxLength + 1];
+  button_id::Format(button, id);
+  *out += "{\"button\":{\"id\":\"";
+  *out += id;
+  *out += "\"},\"command\":";
+  *out += command;
+  *out += "},";
+}
+
+void Run(const size_t count) {
+  const std::vector<KButton> buttons = MakeBeacons(count);
+  volatile size_t sink = 0;
+
+  const double linear_insert = Measure(count, [&] {
+    std::vector<LinearEntry> entries;
+    for (const KButton& button : buttons) {
+      // CommandTable::SetCommandLocked() before ButtonMap
+      entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                   [&button](const LinearEntry& entry) {
+                                     return entry.button == button;
+                                   }),
+                    entries.end());
+      entries.push_back({button, kCommandJson});
+    }
+    sink = sink + entries.size();
+  });
+  const double map_insert = Measure(count, [&] {
+    ButtonMap<std::string> map;
+    for (const KButton& button : buttons) {
+      map.Set(button, kCommandJson);
+    }
+    sink = sink + map.size();
+  });
+
+  std::vector<LinearEntry> entries;
+  ButtonMap<std::string> map;
+  for (const KButton& button : buttons) {
+    entries.push_back({button, kCommandJson});
+    map.Set(button, kCommandJson);
+  }
+
+  const double linear_lookup = Measure(count, [&] {
+    for (const KButton& button : buttons) {
+      for (const LinearEntry& entry : entries) {
+        if (entry.button == button) {
+          sink = sink + entry.value.size();
+          break;
+        }
+      }
+    }
+  });
+  const double map_lookup = Measure(count, [&] {
+    for (const KButton& button : buttons) {
+      sink = sink + map.Find(button)->size();
+    }
+  });
+
+  const double serialize = Measure(count, [&] {
+    std::string out = "{\"type\":\"commands\",\"commands\":[";
+    for (const auto& [button, command] : map) {
+      AppendEntry(button, command, &out);
+    }
+    out += "]}";
+    sink = sink + out.size();
+  });
+
+  const KButton cursor = (map.begin() + count / 2)->button;
+  const double page = Measure(1, [&] {
+    std::string out = "{\"type\":\"commands\",\"commands\":[";
+    size_t size = 0;
+    for (auto iter = map.UpperBound(cursor);
+         iter != map.end() && size < button_query::kDefaultLimit;
+         ++iter, ++size) {
+      AppendEntry(iter->button, iter->value, &out);
+    }
+    out += "]}";
+    sink = sink + out.size();
+  });
+
+  std::printf("%6zu %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %8zu\n", count,
+              linear_insert, map_insert, linear_lookup, map_lookup, serialize,
+              page, sizeof(ButtonMap<std::string>::Entry));
+}
+
+}  // namespace
+
+int main() {
+  std::printf("ns per entry, except page in ns per page\n");
+  std::printf("%6s %10s %10s %10s %10s %10s %10s %8s\n", "count", "insert(v)",
+              "insert", "lookup(v)", "lookup", "serialize", "page",
+              "entry(B)");
+  for (const size_t count : {10, 100, 1000}) {
+    Run(count);
+  }
+  return 0;
+}
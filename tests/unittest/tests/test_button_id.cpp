@@ -0,0 +1,60 @@
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "button_id.hpp"
+
+namespace button_id {
+
+static std::string FormatToString(const KButton& button) {
+  char id[kMaxLength + 1];
+  Format(button, id);
+  return id;
+}
+
+static AppleIBeacon MakeBeacon() {
+  const uint8_t address[6] = {0xaa, 0xbb, 0xcc, 0x00, 0x01, 0xff};
+  uint8_t uuid[16];
+  for (int i = 0; i < 16; ++i) {
+    uuid[i] = static_cast<uint8_t>(i * 17);
+  }
+  return AppleIBeacon(address, uuid, 0x3001, 0x00ff);
+}
+
+TEST(ButtonIdTest, Format) {
+  EXPECT_EQ(FormatToString(KButton(M5Button(1))), "m5-1");
+  EXPECT_EQ(FormatToString(KButton(GpioButton(5))), "gpio-5");
+  EXPECT_EQ(FormatToString(KButton(GpioButton(255))), "gpio-255");
+  const std::string beacon_id = FormatToString(KButton(MakeBeacon()));
+  EXPECT_EQ(beacon_id,
+            "ib-aabbcc0001ff"
+            "00112233445566778899aabbccddeeff"
+            "300100ff");
+  EXPECT_EQ(beacon_id.size(), kMaxLength);
+}
+
+TEST(ButtonIdTest, RoundTrip) {
+  for (const KButton& button :
+       {KButton(M5Button(0)), KButton(M5Button(3)), KButton(GpioButton(1)),
+        KButton(GpioButton(255)), KButton(MakeBeacon())}) {
+    const std::string id = FormatToString(button);
+    KButton parsed;
+    ASSERT_TRUE(Parse(id.c_str(), &parsed)) << id;
+    EXPECT_TRUE(parsed == button) << id;
+  }
+}
+
+TEST(ButtonIdTest, ParseRejectsOtherSpellings) {
+  KButton button;
+  for (const char* id :
+       {"", "m5-", "m5-01", "m5-256", "m5-1a", "M5-1", "gpio--1", "gpio-1/",
+        "ib-", "ib-aabbcc0001ff", "ib-AABBCC0001FF00112233445566778899aabbccd"
+                                 "deeff300100ff",
+        "ib-aabbcc0001ff00112233445566778899aabbccddeeff300100ff0",
+        "ib-aabbcc0001ff00112233445566778899aabbccddeeff300100fg",
+        "unknown-1"}) {
+    EXPECT_FALSE(Parse(id, &button)) << id;
+  }
+}
+
+}  // namespace button_id
@@ -0,0 +1,101 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "button_map.hpp"
+
+static KButton MakeBeacon(const uint8_t last_address_byte,
+                          const uint16_t minor) {
+  const uint8_t address[6] = {0, 0, 0, 0, 0, last_address_byte};
+  const uint8_t uuid[16] = {};
+  return KButton(AppleIBeacon(address, uuid, 1, minor));
+}
+
+static std::vector<std::string> GetValues(
+    const ButtonMap<std::string>& map) {
+  std::vector<std::string> values;
+  for (const auto& [button, value] : map) {
+    values.push_back(value);
+  }
+  return values;
+}
+
+TEST(ButtonMapTest, SetAndFind) {
+  ButtonMap<std::string> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.Find(KButton(M5Button(1))), nullptr);
+
+  EXPECT_TRUE(map.Set(KButton(M5Button(1)), "a"));
+  EXPECT_TRUE(map.Set(KButton(GpioButton(1)), "b"));
+  EXPECT_TRUE(map.Set(MakeBeacon(1, 1), "c"));
+  EXPECT_EQ(map.size(), 3u);
+
+  ASSERT_NE(map.Find(KButton(M5Button(1))), nullptr);
+  EXPECT_EQ(*map.Find(KButton(M5Button(1))), "a");
+  EXPECT_EQ(*map.Find(KButton(GpioButton(1))), "b");
+  EXPECT_EQ(*map.Find(MakeBeacon(1, 1)), "c");
+  // Same id, other type
+  EXPECT_EQ(map.Find(KButton(GpioButton(2))), nullptr);
+  EXPECT_FALSE(map.Contains(KButton(M5Button(2))));
+  EXPECT_FALSE(map.Contains(MakeBeacon(1, 2)));
+}
+
+TEST(ButtonMapTest, SetReplaces) {
+  ButtonMap<std::string> map;
+  EXPECT_TRUE(map.Set(KButton(M5Button(1)), "a"));
+  EXPECT_FALSE(map.Set(KButton(M5Button(1)), "b"));
+  EXPECT_EQ(map.size(), 1u);
+  EXPECT_EQ(*map.Find(KButton(M5Button(1))), "b");
+}
+
+TEST(ButtonMapTest, SortedByButton) {
+  ButtonMap<std::string> map;
+  map.Set(KButton(GpioButton(2)), "gpio-2");
+  map.Set(MakeBeacon(2, 0), "ib-2");
+  map.Set(KButton(M5Button(3)), "m5-3");
+  map.Set(MakeBeacon(1, 5), "ib-1-5");
+  map.Set(KButton(M5Button(1)), "m5-1");
+  map.Set(MakeBeacon(1, 4), "ib-1-4");
+  EXPECT_EQ(GetValues(map),
+            (std::vector<std::string>{"ib-1-4", "ib-1-5", "ib-2", "m5-1",
+                                      "m5-3", "gpio-2"}));
+}
+
+TEST(ButtonMapTest, Erase) {
+  ButtonMap<std::string> map;
+  map.Set(KButton(M5Button(1)), "a");
+  map.Set(KButton(M5Button(2)), "b");
+  map.Set(KButton(M5Button(3)), "c");
+  EXPECT_TRUE(map.Erase(KButton(M5Button(2))));
+  EXPECT_FALSE(map.Erase(KButton(M5Button(2))));
+  EXPECT_FALSE(map.Erase(KButton(GpioButton(1))));
+  EXPECT_EQ(GetValues(map), (std::vector<std::string>{"a", "c"}));
+
+  map.Clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST(ButtonMapTest, UpperBound) {
+  ButtonMap<std::string> map;
+  map.Set(KButton(M5Button(1)), "a");
+  map.Set(KButton(M5Button(3)), "b");
+  map.Set(KButton(GpioButton(1)), "c");
+
+  // From an entry
+  auto iter = map.UpperBound(KButton(M5Button(1)));
+  ASSERT_NE(iter, map.end());
+  EXPECT_EQ(iter->value, "b");
+  // From between two entries
+  iter = map.UpperBound(KButton(M5Button(2)));
+  ASSERT_NE(iter, map.end());
+  EXPECT_EQ(iter->value, "b");
+  // Into the next type
+  iter = map.UpperBound(KButton(M5Button(200)));
+  ASSERT_NE(iter, map.end());
+  EXPECT_EQ(iter->value, "c");
+  // Before all
+  EXPECT_EQ(map.UpperBound(MakeBeacon(0, 0)), map.begin());
+  // After all
+  EXPECT_EQ(map.UpperBound(KButton(GpioButton(1))), map.end());
+}
@@ -0,0 +1,107 @@
+#include <ctime>
+
+#include <gtest/gtest.h>
+
+#include "button_query.hpp"
+
+namespace button_query {
+
+static KButton MakeBeacon() {
+  const uint8_t address[6] = {};
+  const uint8_t uuid[16] = {};
+  return KButton(AppleIBeacon(address, uuid, 1, 2));
+}
+
+TEST(ButtonQueryTest, DefaultMatchesAll) {
+  const Query query;
+  const std::time_t observed_at = 100;
+  EXPECT_TRUE(Matches(query, KButton(M5Button(1)), nullptr, nullptr));
+  EXPECT_TRUE(Matches(query, KButton(GpioButton(1)), "a", &observed_at));
+  EXPECT_TRUE(Matches(query, MakeBeacon(), nullptr, &observed_at));
+}
+
+TEST(ButtonQueryTest, MatchesTypes) {
+  Query query;
+  query.types = GetTypeBit(ButtonType::kAppleIBeacon) |
+                GetTypeBit(ButtonType::kGpioButton);
+  EXPECT_TRUE(Matches(query, MakeBeacon(), nullptr, nullptr));
+  EXPECT_TRUE(Matches(query, KButton(GpioButton(1)), nullptr, nullptr));
+  EXPECT_FALSE(Matches(query, KButton(M5Button(1)), nullptr, nullptr));
+}
+
+TEST(ButtonQueryTest, MatchesNamePrefix) {
+  Query query;
+  query.name_prefix = "Dock ";
+  EXPECT_TRUE(Matches(query, KButton(M5Button(1)), "Dock 1", nullptr));
+  EXPECT_TRUE(Matches(query, KButton(M5Button(1)), "Dock ", nullptr));
+  EXPECT_FALSE(Matches(query, KButton(M5Button(1)), "Dock", nullptr));
+  EXPECT_FALSE(Matches(query, KButton(M5Button(1)), "A Dock 1", nullptr));
+  EXPECT_FALSE(Matches(query, KButton(M5Button(1)), nullptr, nullptr));
+}
+
+TEST(ButtonQueryTest, MatchesObservedSince) {
+  Query query;
+  query.observed_since = 100;
+  const std::time_t before = 99;
+  const std::time_t at = 100;
+  const std::time_t after = 150;
+  EXPECT_FALSE(Matches(query, KButton(M5Button(1)), nullptr, &before));
+  EXPECT_TRUE(Matches(query, KButton(M5Button(1)), nullptr, &at));
+  EXPECT_TRUE(Matches(query, KButton(M5Button(1)), nullptr, &after));
+  EXPECT_FALSE(Matches(query, KButton(M5Button(1)), "a", nullptr));
+}
+
+TEST(ButtonQueryTest, IsAfterCursor) {
+  Query query;
+  EXPECT_TRUE(IsAfterCursor(query, MakeBeacon()));
+  query.has_cursor = true;
+  query.cursor = KButton(M5Button(2));
+  EXPECT_FALSE(IsAfterCursor(query, MakeBeacon()));
+  EXPECT_FALSE(IsAfterCursor(query, KButton(M5Button(2))));
+  EXPECT_TRUE(IsAfterCursor(query, KButton(M5Button(3))));
+  EXPECT_TRUE(IsAfterCursor(query, KButton(GpioButton(0))));
+}
+
+TEST(ButtonQueryTest, ParseTypes) {
+  uint8_t types = 0;
+  EXPECT_TRUE(ParseTypes("ib", &types));
+  EXPECT_EQ(types, GetTypeBit(ButtonType::kAppleIBeacon));
+  EXPECT_TRUE(ParseTypes("m5,gpio", &types));
+  EXPECT_EQ(types, GetTypeBit(ButtonType::kM5Button) |
+                       GetTypeBit(ButtonType::kGpioButton));
+  EXPECT_TRUE(ParseTypes("gpio,ib,m5", &types));
+  EXPECT_EQ(types, kAllTypes);
+
+  types = 0;
+  for (const char* invalid : {"", "m", "m55", "ib,", ",ib", "IB", "ib m5"}) {
+    EXPECT_FALSE(ParseTypes(invalid, &types)) << invalid;
+  }
+  EXPECT_EQ(types, 0);
+}
+
+TEST(ButtonQueryTest, ParseLimit) {
+  size_t limit = 0;
+  EXPECT_TRUE(ParseLimit("1", &limit));
+  EXPECT_EQ(limit, 1u);
+  EXPECT_TRUE(ParseLimit("100", &limit));
+  EXPECT_EQ(limit, kMaxLimit);
+  for (const char* invalid : {"", "0", "101", "01", "-1", "1a", "99999999999"}) {
+    EXPECT_FALSE(ParseLimit(invalid, &limit)) << invalid;
+  }
+}
+
+TEST(ButtonQueryTest, ParseObservedWithin) {
+  std::time_t since = 0;
+  EXPECT_TRUE(ParseObservedWithin("60", 1000, &since));
+  EXPECT_EQ(since, 940);
+  EXPECT_TRUE(ParseObservedWithin("0", 1000, &since));
+  EXPECT_EQ(since, 1000);
+  // Never 0, which is no filter
+  EXPECT_TRUE(ParseObservedWithin("3600", 1000, &since));
+  EXPECT_EQ(since, 1);
+  for (const char* invalid : {"", "-1", "1.5", "86401", "007"}) {
+    EXPECT_FALSE(ParseObservedWithin(invalid, 1000, &since)) << invalid;
+  }
+}
+
+}  // namespace button_query
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "json_stream.hpp"
+
+namespace json_stream {
+
+// Feeds `json` in chunks of `chunk_size` bytes. Returns false on an error.
+static bool Split(const std::string& json, const size_t chunk_size,
+                  std::vector<std::string>* elements,
+                  const size_t max_element_size = 256) {
+  ArraySplitter splitter(
+      "commands", max_element_size,
+      [elements](const char* element, const size_t size) {
+        elements->emplace_back(element, size);
+        return true;
+      });
+  for (size_t i = 0; i < json.size(); i += chunk_size) {
+    if (!splitter.Feed(json.data() + i,
+                       std::min(chunk_size, json.size() - i))) {
+      return false;
+    }
+  }
+  return splitter.IsComplete();
+}
+
+TEST(JsonStreamTest, SplitInAnyChunkSize) {
+  const std::string json =
+      "{\"version\": 1, \"names\": {\"commands\": [1]},\n"
+      " \"commands\": [{\"a\": \"}]\\\"\", \"b\": [{}]}, {}],"
+      " \"after\": [\"[\"]}\n";
+  const std::vector<std::string> expected = {
+      "{\"a\": \"}]\\\"\", \"b\": [{}]}", "{}"};
+  for (size_t chunk_size = 1; chunk_size <= json.size(); ++chunk_size) {
+    std::vector<std::string> elements;
+    EXPECT_TRUE(Split(json, chunk_size, &elements)) << chunk_size;
+    EXPECT_EQ(elements, expected) << chunk_size;
+  }
+}
+
+TEST(JsonStreamTest, EmptyArray) {
+  std::vector<std::string> elements;
+  EXPECT_TRUE(Split("{\"commands\": []}", 4, &elements));
+  EXPECT_TRUE(elements.empty());
+}
+
+TEST(JsonStreamTest, Errors) {
+  std::vector<std::string> elements;
+  // The key is missing or only a prefix of the key
+  EXPECT_FALSE(Split("{\"command\": [{}]}", 1, &elements));
+  EXPECT_FALSE(Split("{\"commandsx\": [{}]}", 1, &elements));
+  // Not closed
+  EXPECT_FALSE(Split("{\"commands\": [{}]", 1, &elements));
+  // Mismatched brackets
+  EXPECT_FALSE(Split("{\"commands\": [{}}}", 1, &elements));
+  // Not an object
+  EXPECT_FALSE(Split("[{\"commands\": []}]", 1, &elements));
+  EXPECT_FALSE(Split("{\"commands\": [1]}", 1, &elements));
+  EXPECT_FALSE(Split("{\"commands\": []} x", 1, &elements));
+  // Too large
+  elements.clear();
+  EXPECT_FALSE(Split("{\"commands\": [{\"a\": \"0123456789\"}]}", 1,
+                     &elements, 8));
+  EXPECT_TRUE(elements.empty());
+}
+
+TEST(JsonStreamTest, HandlerStops) {
+  ArraySplitter splitter("commands", 256,
+                         [](const char*, size_t) { return false; });
+  EXPECT_FALSE(splitter.Feed("{\"commands\": [{}, {}]}", 22));
+  EXPECT_FALSE(splitter.IsComplete());
+}
+
+}  // namespace json_stream
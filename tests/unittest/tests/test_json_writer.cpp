@@ -0,0 +1,108 @@
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "json_writer.hpp"
+
+namespace json_writer {
+
+class StringOut {
+ public:
+  size_t write(const uint8_t* data, const size_t size) {
+    text.append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+  void Value(const char* value) { text += value; }
+
+  std::string text;
+};
+
+TEST(JsonWriterTest, EmptyObject) {
+  StringOut out;
+  ObjectWriter<StringOut> writer(out);
+  writer.End();
+  EXPECT_EQ(out.text, "{}");
+}
+
+TEST(JsonWriterTest, Members) {
+  StringOut out;
+  ObjectWriter<StringOut> writer(out);
+  writer.BeginMember("type");
+  out.Value("\"commands\"");
+  writer.BeginMember("version");
+  out.Value("3");
+  writer.End();
+  EXPECT_EQ(out.text, "{\"type\":\"commands\",\"version\":3}");
+}
+
+TEST(JsonWriterTest, Arrays) {
+  StringOut out;
+  ObjectWriter<StringOut> writer(out);
+  writer.BeginArray("empty");
+  writer.EndArray();
+  writer.BeginArray("buttons");
+  writer.BeginElement();
+  out.Value("{\"id\":\"m5-1\"}");
+  writer.BeginElement();
+  out.Value("{}");
+  writer.EndArray();
+  writer.BeginMember("timestamp_now");
+  out.Value("10");
+  writer.End();
+  EXPECT_EQ(out.text,
+            "{\"empty\":[],\"buttons\":[{\"id\":\"m5-1\"},{}],"
+            "\"timestamp_now\":10}");
+}
+
+TEST(JsonWriterTest, SecondArrayStartsWithoutComma) {
+  StringOut out;
+  ObjectWriter<StringOut> writer(out);
+  writer.BeginArray("a");
+  writer.BeginElement();
+  out.Value("1");
+  writer.EndArray();
+  writer.BeginArray("b");
+  writer.BeginElement();
+  out.Value("2");
+  writer.EndArray();
+  writer.End();
+  EXPECT_EQ(out.text, "{\"a\":[1],\"b\":[2]}");
+}
+
+TEST(MsgPackWriterTest, EmptyObject) {
+  std::string out;
+  MsgPackObjectWriter writer(out);
+  writer.End();
+  EXPECT_EQ(out, std::string("\xdf\0\0\0\0", 5));
+}
+
+TEST(MsgPackWriterTest, MembersAndArrays) {
+  std::string out;
+  MsgPackObjectWriter writer(out);
+  writer.BeginMember("type");
+  out += "\xa1x";  // "x"
+  writer.BeginArray("a");
+  writer.BeginElement();
+  out += '\x01';
+  writer.BeginElement();
+  out += '\x02';
+  writer.EndArray();
+  writer.End();
+  EXPECT_EQ(out, std::string("\xdf\0\0\0\x02"
+                             "\xa4type\xa1x"
+                             "\xa1" "a\xdd\0\0\0\x02\x01\x02",
+                             21));
+}
+
+TEST(MsgPackWriterTest, LongKey) {
+  const std::string key(40, 'k');
+  std::string out;
+  MsgPackObjectWriter writer(out);
+  writer.BeginMember(key.c_str());
+  out += '\xc0';  // nil
+  writer.End();
+  EXPECT_EQ(out, std::string("\xdf\0\0\0\x01\xd9\x28", 7) + key + "\xc0");
+}
+
+}  // namespace json_writer
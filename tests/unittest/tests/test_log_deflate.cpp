@@ -0,0 +1,127 @@
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "log_deflate.hpp"
+
+namespace logging {
+
+static std::vector<uint8_t> ToBytes(const std::string& s) {
+  return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+static std::string LogText(const size_t size) {
+  std::string text;
+  for (int i = 0; text.size() < size; ++i) {
+    text += "2024-01-01 00:00:" + std::to_string(10 + i % 50) +
+            " I Button pressed: " + std::to_string(i % 7) + "\n";
+  }
+  text.resize(size);
+  return text;
+}
+
+static std::vector<uint8_t> Deflate(const std::vector<uint8_t>& data) {
+  static BlockDeflater deflater;
+  std::vector<uint8_t> out(kMaxDeflatedBlockSize);
+  out.resize(deflater.Deflate(data.data(), data.size(), out.data()));
+  return out;
+}
+
+static std::vector<uint8_t> ZlibInflate(const std::vector<uint8_t>& stream) {
+  std::vector<uint8_t> out(64 * 1024);
+  uLongf size = out.size();
+  EXPECT_EQ(uncompress(out.data(), &size, stream.data(), stream.size()), Z_OK);
+  out.resize(size);
+  return out;
+}
+
+TEST(LogDeflateTest, RoundTrip) {
+  std::mt19937 random(1);
+  std::vector<uint8_t> noise(kMaxBlockSize);
+  for (uint8_t& byte : noise) {
+    byte = static_cast<uint8_t>(random());
+  }
+  const std::vector<std::vector<uint8_t>> inputs = {
+      {}, ToBytes("a"), ToBytes(LogText(kMaxBlockSize)),
+      std::vector<uint8_t>(kMaxBlockSize, 'x'), noise};
+  for (const std::vector<uint8_t>& input : inputs) {
+    const std::vector<uint8_t> deflated = Deflate(input);
+    EXPECT_LE(deflated.size(), input.size() + kStoredBlockHeaderSize);
+    std::vector<uint8_t> out(kMaxBlockSize);
+    size_t size = 0;
+    ASSERT_TRUE(InflateBlock(deflated.data(), deflated.size(), out.data(),
+                             out.size(), &size));
+    out.resize(size);
+    EXPECT_EQ(out, input);
+  }
+}
+
+TEST(LogDeflateTest, CompressesLogText) {
+  const std::vector<uint8_t> input = ToBytes(LogText(kMaxBlockSize));
+  EXPECT_LT(Deflate(input).size(), input.size() / 3);
+}
+
+// Blocks concatenated into a zlib stream are readable by any inflater, which
+// is what "Content-Encoding: deflate" relies on.
+TEST(LogDeflateTest, ConcatenatedBlocksAreZlibStream) {
+  const std::string text = LogText(3 * kMaxBlockSize);
+  std::vector<uint8_t> stream(std::begin(kZlibHeader), std::end(kZlibHeader));
+  uint32_t adler = 1;
+  for (size_t i = 0; i < text.size(); i += kMaxBlockSize) {
+    const std::vector<uint8_t> block = ToBytes(text.substr(i, kMaxBlockSize));
+    const std::vector<uint8_t> deflated = Deflate(block);
+    stream.insert(stream.end(), deflated.begin(), deflated.end());
+    adler = CombineAdler32(adler, Adler32(block.data(), block.size()),
+                           block.size());
+  }
+  // A stored block as written for a record which is not compressed yet
+  const std::string record = "2024-01-01 00:01:00 E Not compressed\n";
+  uint8_t header[kStoredBlockHeaderSize];
+  WriteStoredBlockHeader(record.size(), header);
+  stream.insert(stream.end(), header, header + sizeof(header));
+  stream.insert(stream.end(), record.begin(), record.end());
+  adler = CombineAdler32(
+      adler,
+      Adler32(reinterpret_cast<const uint8_t*>(record.data()), record.size()),
+      record.size());
+
+  stream.insert(stream.end(), std::begin(kFinalDeflateBlock),
+                std::end(kFinalDeflateBlock));
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    stream.push_back(static_cast<uint8_t>(adler >> shift));
+  }
+  EXPECT_EQ(ZlibInflate(stream), ToBytes(text + record));
+}
+
+TEST(LogDeflateTest, Adler32MatchesZlib) {
+  const std::string a = LogText(100);
+  const std::string b = LogText(5000);
+  const uint8_t* pa = reinterpret_cast<const uint8_t*>(a.data());
+  const uint8_t* pb = reinterpret_cast<const uint8_t*>(b.data());
+  EXPECT_EQ(Adler32(pa, a.size()), adler32(1, pa, a.size()));
+  EXPECT_EQ(CombineAdler32(Adler32(pa, a.size()), Adler32(pb, b.size()),
+                           b.size()),
+            adler32(adler32(1, pa, a.size()), pb, b.size()));
+}
+
+TEST(LogDeflateTest, RejectCorruptedData) {
+  const std::vector<uint8_t> deflated = Deflate(ToBytes(LogText(500)));
+  std::vector<uint8_t> out(kMaxBlockSize);
+  size_t size = 0;
+  // Truncated
+  EXPECT_FALSE(InflateBlock(deflated.data(), deflated.size() / 2, out.data(),
+                            out.size(), &size));
+  // Output too small
+  EXPECT_FALSE(InflateBlock(deflated.data(), deflated.size(), out.data(), 499,
+                            &size));
+  // Dynamic Huffman codes
+  const uint8_t dynamic[] = {0x05, 0x00};
+  EXPECT_FALSE(InflateBlock(dynamic, sizeof(dynamic), out.data(), out.size(),
+                            &size));
+}
+
+}  // namespace logging
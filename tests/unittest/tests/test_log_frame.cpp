@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "log_frame.hpp"
+
+namespace logging {
+
+static void AppendFrame(std::vector<uint8_t>& out, const std::string& payload,
+                        const uint16_t magic = kFrameMagic) {
+  const FrameHeader header = MakeFrameHeader(
+      payload.data(), static_cast<uint16_t>(payload.size()), magic);
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(&header);
+  out.insert(out.end(), p, p + sizeof(header));
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+// Feeds `data` in chunks of `chunk_size` bytes
+static std::vector<std::string> Decode(const std::vector<uint8_t>& data,
+                                       const size_t chunk_size,
+                                       size_t* skipped_bytes = nullptr) {
+  std::vector<std::string> records;
+  const auto on_frame = [&records](FrameType type, const uint8_t* payload,
+                                   size_t length) {
+    const std::string record(reinterpret_cast<const char*>(payload), length);
+    records.push_back(type == FrameType::kBlock ? "block:" + record : record);
+  };
+  FrameDecoder decoder;
+  for (size_t i = 0; i < data.size(); i += chunk_size) {
+    decoder.Feed(data.data() + i, std::min(chunk_size, data.size() - i),
+                 on_frame);
+  }
+  decoder.Finish(on_frame);
+  if (skipped_bytes) {
+    *skipped_bytes = decoder.skipped_bytes();
+  }
+  return records;
+}
+
+TEST(LogFrameTest, Crc32) {
+  EXPECT_EQ(Crc32("123456789", 9), 0xcbf43926u);
+  EXPECT_EQ(Crc32("", 0), 0u);
+}
+
+TEST(LogFrameTest, DecodeInAnyChunkSize) {
+  std::vector<uint8_t> data;
+  const std::vector<std::string> expected = {
+      "2024-01-01 00:00:00 Start\n", "", std::string(kMaxFramePayloadSize, 'x'),
+      "2024-01-01 00:00:01 Button pressed: 1\n"};
+  for (const std::string& payload : expected) {
+    AppendFrame(data, payload);
+  }
+  for (const size_t chunk_size : {1, 3, 7, 64, 4096}) {
+    size_t skipped_bytes = 0;
+    EXPECT_EQ(Decode(data, chunk_size, &skipped_bytes), expected)
+        << "chunk_size=" << chunk_size;
+    EXPECT_EQ(skipped_bytes, 0u);
+  }
+}
+
+// A record torn by a power loss costs only that record, including when the
+// next boot appends to the same segment.
+TEST(LogFrameTest, SkipTornRecord) {
+  std::vector<uint8_t> data;
+  AppendFrame(data, "first\n");
+  std::vector<uint8_t> torn;
+  AppendFrame(torn, "torn record\n");
+  data.insert(data.end(), torn.begin(), torn.begin() + torn.size() / 2);
+  AppendFrame(data, "after reboot\n");
+  AppendFrame(data, "last\n");
+  // The end of the segment is torn as well
+  data.insert(data.end(), torn.begin(), torn.begin() + 5);
+
+  for (const size_t chunk_size : {1, 16, 4096}) {
+    size_t skipped_bytes = 0;
+    EXPECT_EQ(Decode(data, chunk_size, &skipped_bytes),
+              (std::vector<std::string>{"first\n", "after reboot\n", "last\n"}))
+        << "chunk_size=" << chunk_size;
+    EXPECT_EQ(skipped_bytes, torn.size() / 2 + 5);
+  }
+}
+
+TEST(LogFrameTest, SkipCorruptedPayload) {
+  std::vector<uint8_t> data;
+  AppendFrame(data, "first\n");
+  const size_t corrupted = data.size() + sizeof(FrameHeader) + 2;
+  AppendFrame(data, "corrupted\n");
+  AppendFrame(data, "last\n");
+  data[corrupted] ^= 0x01;
+  EXPECT_EQ(Decode(data, 4096),
+            (std::vector<std::string>{"first\n", "last\n"}));
+}
+
+TEST(LogFrameTest, DecodeBlockFrames) {
+  std::vector<uint8_t> data;
+  const std::string block(kMaxBlockFramePayloadSize, 'z');
+  AppendFrame(data, "record\n");
+  AppendFrame(data, block, kBlockFrameMagic);
+  // Only blocks may be longer than kMaxFramePayloadSize
+  AppendFrame(data, std::string(kMaxFramePayloadSize + 1, 'x'));
+  AppendFrame(data, "last\n");
+  for (const size_t chunk_size : {1, 100, 4096}) {
+    EXPECT_EQ(Decode(data, chunk_size),
+              (std::vector<std::string>{"record\n", "block:" + block,
+                                        "last\n"}))
+        << "chunk_size=" << chunk_size;
+  }
+}
+
+}  // namespace logging
@@ -0,0 +1,116 @@
+#include <cstring>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "log_query.hpp"
+#include "log_record.hpp"
+
+namespace logging {
+
+static bool MatchesText(const QueryFilter& filter, const char* payload) {
+  QueryRecord record;
+  EXPECT_TRUE(ParseTextRecord(payload, std::strlen(payload), &record))
+      << payload;
+  return Matches(filter, record);
+}
+
+TEST(LogQueryTest, LevelLetter) {
+  for (const Level level : {Level::kError, Level::kWarn, Level::kInfo,
+                            Level::kDebug}) {
+    Level parsed;
+    ASSERT_TRUE(ParseLevelLetter(GetLevelLetter(level), &parsed));
+    EXPECT_EQ(parsed, level);
+  }
+  Level parsed;
+  EXPECT_FALSE(ParseLevelLetter('x', &parsed));
+  EXPECT_FALSE(ParseLevelLetter('\0', &parsed));
+}
+
+TEST(LogQueryTest, ParseTextRecord) {
+  const char* payload = "2024-05-01 10:31:02 E API ERROR: Timeout\n";
+  QueryRecord record;
+  ASSERT_TRUE(ParseTextRecord(payload, std::strlen(payload), &record));
+  EXPECT_STREQ(record.date, "2024-05-01 10:31:02");
+  EXPECT_EQ(record.level, Level::kError);
+  EXPECT_EQ(std::string(record.message, record.message_length),
+            "API ERROR: Timeout");
+
+  for (const char* invalid :
+       {"", "2024-05-01 10:31:02", "2024-05-01 10:31:02 X text\n",
+        "2024-05-01 10:31:02 Etext\n"}) {
+    EXPECT_FALSE(ParseTextRecord(invalid, std::strlen(invalid), &record))
+        << invalid;
+  }
+}
+
+TEST(LogQueryTest, ParseBinaryRecord) {
+  uint8_t payload[sizeof(RecordHeader) + 4] = {};
+  const RecordHeader header{4, 0, 0x12345678,
+                            static_cast<uint8_t>(Level::kWarn)};
+  std::memcpy(payload, &header, sizeof(header));
+  QueryRecord record;
+  ASSERT_TRUE(ParseBinaryRecord(payload, sizeof(payload), &record));
+  EXPECT_EQ(std::strlen(record.date), kRecordDateLength);
+  EXPECT_EQ(record.level, Level::kWarn);
+  EXPECT_EQ(record.message_length, 0u);
+  EXPECT_FALSE(ParseBinaryRecord(payload, sizeof(header) - 1, &record));
+}
+
+TEST(LogQueryTest, TimeRange) {
+  QueryFilter filter;
+  EXPECT_TRUE(MatchesText(filter, "2024-05-01 10:31:02 I Start\n"));
+
+  // A bound is compared up to its own length
+  filter.from = "2024-05-01 10:3";
+  filter.to = "2024-05-01 10:3";
+  EXPECT_FALSE(MatchesText(filter, "2024-05-01 10:29:59 I Start\n"));
+  EXPECT_TRUE(MatchesText(filter, "2024-05-01 10:30:00 I Start\n"));
+  EXPECT_TRUE(MatchesText(filter, "2024-05-01 10:39:59 I Start\n"));
+  EXPECT_FALSE(MatchesText(filter, "2024-05-01 10:40:00 I Start\n"));
+
+  EXPECT_TRUE(IsBeforeRange(filter, "2024-05-01 10:29:59"));
+  EXPECT_FALSE(IsAfterRange(filter, "2024-05-01 10:29:59"));
+  EXPECT_TRUE(IsAfterRange(filter, "2024-05-01 10:40:00"));
+
+  filter.from = "2024-05-01 10:31:00";
+  filter.to = "";
+  EXPECT_FALSE(MatchesText(filter, "2024-05-01 10:30:59 I Start\n"));
+  EXPECT_TRUE(MatchesText(filter, "2024-05-02 00:00:00 I Start\n"));
+}
+
+TEST(LogQueryTest, OverlapsRange) {
+  QueryFilter filter;
+  EXPECT_TRUE(
+      OverlapsRange(filter, "1970-01-01 00:00:05", "2024-05-01 10:31:02"));
+
+  filter.from = "2024-05-01 10:30";
+  filter.to = "2024-05-01 10:40";
+  // A segment with records from before the clock was set
+  EXPECT_TRUE(
+      OverlapsRange(filter, "1970-01-01 00:00:05", "2024-05-01 10:31:02"));
+  EXPECT_TRUE(
+      OverlapsRange(filter, "2024-05-01 10:40:59", "2024-05-01 11:00:00"));
+  EXPECT_FALSE(
+      OverlapsRange(filter, "1970-01-01 00:00:05", "1970-01-01 00:10:00"));
+  EXPECT_FALSE(
+      OverlapsRange(filter, "2024-05-01 10:41:00", "2024-05-01 11:00:00"));
+}
+
+TEST(LogQueryTest, LevelAndText) {
+  QueryFilter filter;
+  filter.level = Level::kWarn;
+  EXPECT_TRUE(MatchesText(filter, "2024-05-01 10:31:02 E API ERROR\n"));
+  EXPECT_TRUE(MatchesText(filter, "2024-05-01 10:31:02 W Beacon: lock\n"));
+  EXPECT_FALSE(MatchesText(filter, "2024-05-01 10:31:02 I Button pressed\n"));
+
+  filter.level = Level::kDebug;
+  filter.text = "pressed";
+  EXPECT_TRUE(MatchesText(filter, "2024-05-01 10:31:02 I Button pressed\n"));
+  EXPECT_FALSE(MatchesText(filter, "2024-05-01 10:31:02 I Start\n"));
+  // The date and the level are not part of the message
+  filter.text = "2024";
+  EXPECT_FALSE(MatchesText(filter, "2024-05-01 10:31:02 I Start\n"));
+}
+
+}  // namespace logging
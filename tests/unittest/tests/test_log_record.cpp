@@ -0,0 +1,89 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "log_record.hpp"
+
+namespace logging {
+
+static size_t Capture(uint8_t* out, size_t capacity, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  const size_t size = CaptureArgs(format, args, out, capacity);
+  va_end(args);
+  return size;
+}
+
+static std::string Format(const char* format, const uint8_t* args,
+                          size_t size) {
+  char out[256];
+  const size_t length = FormatArgs(format, args, size, out, sizeof(out));
+  EXPECT_EQ(length, std::strlen(out));
+  return std::string(out, length);
+}
+
+// Test the formatted result is the same as snprintf
+TEST(LogRecordTest, RoundTrip) {
+  uint8_t buf[128];
+  {
+    const char* format = "Saved the command table: %d buttons, %d commands";
+    const size_t size = Capture(buf, sizeof(buf), format, 3, 12);
+    EXPECT_EQ(size, 8u);
+    EXPECT_EQ(Format(format, buf, size),
+              "Saved the command table: 3 buttons, 12 commands");
+  }
+  {
+    const char* format = "%s: %5.1f%% (%u) [%-4s] %c %lld %x";
+    const size_t size = Capture(buf, sizeof(buf), format, "OTA", 42.25, 7u,
+                                "ab", 'z', -1234567890123LL, 255);
+    char expected[128];
+    std::snprintf(expected, sizeof(expected), format, "OTA", 42.25, 7u, "ab",
+                  'z', -1234567890123LL, 255);
+    EXPECT_EQ(Format(format, buf, size), expected);
+  }
+  {
+    const char* format = "[%*d] [%.*s]";
+    const size_t size = Capture(buf, sizeof(buf), format, 6, 42, 3, "abcdef");
+    EXPECT_EQ(Format(format, buf, size), "[    42] [abc]");
+  }
+}
+
+// Test strings are truncated to the capacity
+TEST(LogRecordTest, Truncation) {
+  uint8_t buf[8];
+  const char* format = "%s %d";
+  const size_t size = Capture(buf, sizeof(buf), format, "0123456789", 1);
+  EXPECT_EQ(size, sizeof(buf));
+  EXPECT_EQ(Format(format, buf, size), "0123456 ");
+}
+
+// Test the hash matches FNV-1a (tools/gen_log_string_table.py)
+TEST(LogRecordTest, HashFormat) {
+  EXPECT_EQ(HashFormat(""), 0x811c9dc5u);
+  EXPECT_EQ(HashFormat("a"), 0xe40c292cu);
+}
+
+TEST(LogRecordTest, SplitRecords) {
+  const char text[] = "first\nsecond\nthird";
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(text);
+  EXPECT_EQ(GetTextRecordSize(p, sizeof(text) - 1), 6u);
+  EXPECT_EQ(GetTextRecordSize(p + 6, sizeof(text) - 7), 7u);
+  EXPECT_EQ(GetTextRecordSize(p + 13, sizeof(text) - 14), 0u);
+
+  uint8_t binary[sizeof(RecordHeader) + 4] = {};
+  const RecordHeader header{4, 0, 0, 0};
+  std::memcpy(binary, &header, sizeof(header));
+  EXPECT_EQ(GetBinaryRecordSize(binary, sizeof(binary)), sizeof(binary));
+  EXPECT_EQ(GetBinaryRecordSize(binary, sizeof(binary) - 1), 0u);
+  EXPECT_EQ(GetBinaryRecordSize(binary, 3), 0u);
+}
+
+}  // namespace logging
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,82 @@
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "log_ring.hpp"
+
+namespace logging {
+
+// Test FIFO order within the capacity
+TEST(LogRingTest, PushAndPopInOrder) {
+  Ring<int, 4> ring;
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.TryPush([i](int& slot) { slot = i; }));
+  }
+  for (int i = 0; i < 4; ++i) {
+    int value = -1;
+    EXPECT_TRUE(ring.TryPop([&value](const int& slot) { value = slot; }));
+    EXPECT_EQ(value, i);
+  }
+}
+
+// Test push fails when full and pop fails when empty
+TEST(LogRingTest, FullAndEmpty) {
+  Ring<int, 2> ring;
+  EXPECT_FALSE(ring.TryPop([](const int&) {}));
+  EXPECT_TRUE(ring.TryPush([](int& slot) { slot = 1; }));
+  EXPECT_TRUE(ring.TryPush([](int& slot) { slot = 2; }));
+  EXPECT_FALSE(ring.TryPush([](int& slot) { slot = 3; }));
+  EXPECT_TRUE(ring.TryPop([](const int& slot) { EXPECT_EQ(slot, 1); }));
+  EXPECT_TRUE(ring.TryPush([](int& slot) { slot = 4; }));
+  EXPECT_TRUE(ring.TryPop([](const int& slot) { EXPECT_EQ(slot, 2); }));
+  EXPECT_TRUE(ring.TryPop([](const int& slot) { EXPECT_EQ(slot, 4); }));
+  EXPECT_FALSE(ring.TryPop([](const int&) {}));
+}
+
+// Test many laps around the ring
+TEST(LogRingTest, WrapAround) {
+  Ring<int, 4> ring;
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(ring.TryPush([i](int& slot) { slot = i; }));
+    EXPECT_TRUE(ring.TryPop([i](const int& slot) { EXPECT_EQ(slot, i); }));
+  }
+}
+
+// Test every pushed item is popped exactly once with concurrent producers
+TEST(LogRingTest, MultipleProducers) {
+  constexpr int kProducerCount = 4;
+  constexpr int kItemsPerProducer = 10000;
+  Ring<int, 64> ring;
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducerCount; ++p) {
+    producers.emplace_back([&ring, p]() {
+      for (int i = 0; i < kItemsPerProducer; ++i) {
+        const int value = p * kItemsPerProducer + i;
+        while (!ring.TryPush([value](int& slot) { slot = value; })) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::set<int> received;
+  while (received.size() < kProducerCount * kItemsPerProducer) {
+    ring.TryPop([&received](const int& slot) {
+      EXPECT_TRUE(received.insert(slot).second);
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_FALSE(ring.TryPop([](const int&) {}));
+}
+
+}  // namespace logging
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
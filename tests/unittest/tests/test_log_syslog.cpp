@@ -0,0 +1,54 @@
+#include <cstring>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "log_syslog.hpp"
+
+namespace logging {
+
+static std::string Format(const std::string& line,
+                          const char* hostname = "hub-1") {
+  char out[256];
+  const size_t n = FormatSyslogMessage(line.data(), line.size(), hostname,
+                                       "+09:00", out, sizeof(out));
+  EXPECT_EQ(n, std::strlen(out));
+  return out;
+}
+
+TEST(LogSyslogTest, Format) {
+  EXPECT_EQ(Format("2024-05-01 10:30:00 I Button pressed: 1"),
+            "<134>1 2024-05-01T10:30:00+09:00 hub-1 button_hub - - - "
+            "Button pressed: 1");
+  EXPECT_EQ(Format("2024-05-01 10:30:00 E API ERROR", ""),
+            "<131>1 2024-05-01T10:30:00+09:00 - button_hub - - - API ERROR");
+  EXPECT_EQ(Format("2024-05-01 10:30:00 E API ERROR", nullptr),
+            "<131>1 2024-05-01T10:30:00+09:00 - button_hub - - - API ERROR");
+  EXPECT_EQ(Format("2024-05-01 10:30:00 D x"),
+            "<135>1 2024-05-01T10:30:00+09:00 hub-1 button_hub - - - x");
+}
+
+TEST(LogSyslogTest, Utf8MessageHasBom) {
+  EXPECT_EQ(Format("2024-05-01 10:30:00 W \xe3\x83\x9c"),
+            "<132>1 2024-05-01T10:30:00+09:00 hub-1 button_hub - - - "
+            "\xef\xbb\xbf\xe3\x83\x9c");
+}
+
+TEST(LogSyslogTest, RejectMalformedLine) {
+  char out[64];
+  const char line[] = "Boot #1";
+  EXPECT_EQ(FormatSyslogMessage(line, sizeof(line) - 1, "hub-1", "+09:00", out,
+                                sizeof(out)),
+            0u);
+}
+
+TEST(LogSyslogTest, Truncate) {
+  char out[16];
+  const std::string line = "2024-05-01 10:30:00 I Button pressed: 1";
+  EXPECT_EQ(FormatSyslogMessage(line.data(), line.size(), "hub-1", "+09:00",
+                                out, sizeof(out)),
+            15u);
+  EXPECT_STREQ(out, "<134>1 2024-05-");
+}
+
+}  // namespace logging
@@ -0,0 +1,86 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "rcu.hpp"
+
+namespace kb {
+
+// Test a new Rcu holds a default value
+TEST(RcuTest, DefaultValue) {
+  const Rcu<std::vector<int>> rcu;
+  ASSERT_NE(rcu.Get(), nullptr);
+  EXPECT_TRUE(rcu.Get()->empty());
+}
+
+// Test a reader keeps its generation after a new one is published
+TEST(RcuTest, ReaderKeepsGeneration) {
+  Rcu<std::vector<int>> rcu;
+  rcu.Publish(std::make_shared<const std::vector<int>>(std::vector<int>{1}));
+  const std::shared_ptr<const std::vector<int>> old = rcu.Get();
+
+  auto values = std::make_shared<std::vector<int>>(*rcu.Get());
+  values->push_back(2);
+  rcu.Publish(std::move(values));
+
+  EXPECT_EQ(*old, std::vector<int>{1});
+  EXPECT_EQ(*rcu.Get(), (std::vector<int>{1, 2}));
+}
+
+// Test a generation is freed once the last reader drops it
+TEST(RcuTest, FreesOldGeneration) {
+  Rcu<std::vector<int>> rcu;
+  rcu.Publish(std::make_shared<const std::vector<int>>(std::vector<int>{1}));
+  std::weak_ptr<const std::vector<int>> first = rcu.Get();
+  std::shared_ptr<const std::vector<int>> second =
+      std::make_shared<const std::vector<int>>(std::vector<int>{2});
+  std::weak_ptr<const std::vector<int>> second_weak = second;
+
+  rcu.Publish(std::move(second));
+  EXPECT_TRUE(first.expired());
+
+  std::shared_ptr<const std::vector<int>> held = rcu.Get();
+  rcu.Publish(std::make_shared<const std::vector<int>>(std::vector<int>{3}));
+  EXPECT_FALSE(second_weak.expired());
+  held.reset();
+  EXPECT_TRUE(second_weak.expired());
+}
+
+// Test readers see whole generations while a writer publishes new ones
+TEST(RcuTest, ConcurrentReaders) {
+  constexpr int kReaderCount = 4;
+  constexpr int kGenerationCount = 2000;
+  Rcu<std::vector<int>> rcu;
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < kReaderCount; ++r) {
+    readers.emplace_back([&rcu, &done]() {
+      size_t last_size = 0;
+      while (!done) {
+        const auto values = rcu.Get();
+        // Generation n is 0, 1, ..., n - 1, and never older than the last one
+        ASSERT_GE(values->size(), last_size);
+        last_size = values->size();
+        for (size_t i = 0; i < values->size(); ++i) {
+          ASSERT_EQ((*values)[i], static_cast<int>(i));
+        }
+      }
+    });
+  }
+  for (int n = 1; n <= kGenerationCount; ++n) {
+    auto values = std::make_shared<std::vector<int>>(*rcu.Get());
+    values->push_back(n - 1);
+    rcu.Publish(std::move(values));
+  }
+  done = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(rcu.Get()->size(), static_cast<size_t>(kGenerationCount));
+}
+
+}  // namespace kb
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include "route_table.hpp"
+
+namespace route_table {
+
+using TestRoute = Route<int>;
+
+constexpr TestRoute kRoutes[] = {
+    {"/config/wifi", kGet, 1},
+    {"/config/wifi", kPut, 2},
+    {"/log", kGet, 3},
+    {"/log/query", kGet, 4},
+    {"/commands/*", kPut, 6},
+};
+constexpr TestRoute kMoreRoutes[] = {
+    {"/log", kDelete, 5},
+};
+
+static_assert(!HasConflicts(kRoutes));
+static_assert(!HasConflicts(kRoutes, kMoreRoutes));
+static_assert(Find(kRoutes, kPut, "/config/wifi")->handler == 2);
+static_assert(Find(kRoutes, kPost, "/config/wifi") == nullptr);
+
+TEST(RouteTableTest, FindMatchesPathExactly) {
+  ASSERT_NE(Find(kRoutes, kGet, "/log"), nullptr);
+  EXPECT_EQ(Find(kRoutes, kGet, "/log")->handler, 3);
+  EXPECT_EQ(Find(kRoutes, kGet, "/log/query")->handler, 4);
+  EXPECT_EQ(Find(kRoutes, kGet, "/log/"), nullptr);
+  EXPECT_EQ(Find(kRoutes, kGet, "/lo"), nullptr);
+  EXPECT_EQ(Find(kRoutes, kGet, ""), nullptr);
+  EXPECT_EQ(Find(kRoutes, kDelete, "/log"), nullptr);
+  EXPECT_EQ(Find(kMoreRoutes, kDelete, "/log")->handler, 5);
+}
+
+TEST(RouteTableTest, FindMatchesWildcardSegment) {
+  const char* path = "/commands/m5-1";
+  const TestRoute* route = Find(kRoutes, kPut, path);
+  ASSERT_NE(route, nullptr);
+  EXPECT_EQ(route->handler, 6);
+  EXPECT_STREQ(GetWildcard(route->path, path), "m5-1");
+  EXPECT_EQ(GetWildcard(kRoutes[0].path, "/config/wifi"), nullptr);
+
+  EXPECT_EQ(Find(kRoutes, kPut, "/commands/"), nullptr);
+  EXPECT_EQ(Find(kRoutes, kPut, "/commands"), nullptr);
+  EXPECT_EQ(Find(kRoutes, kPut, "/commands/a/b"), nullptr);
+  EXPECT_EQ(Find(kRoutes, kGet, "/commands/m5-1"), nullptr);
+}
+
+TEST(RouteTableTest, HasConflicts) {
+  constexpr TestRoute kSame[] = {{"/a", kGet, 1}, {"/a", kGet, 2}};
+  constexpr TestRoute kBadMethod[] = {{"/a", kGet | kPut, 1}};
+  constexpr TestRoute kOther[] = {{"/config/wifi", kPut, 3}};
+  constexpr TestRoute kShadowed[] = {{"/commands/m5-1", kPut, 7}};
+  constexpr TestRoute kOtherMethod[] = {{"/commands/m5-1", kGet, 7}};
+  EXPECT_TRUE(HasConflicts(kSame));
+  EXPECT_TRUE(HasConflicts(kBadMethod));
+  EXPECT_TRUE(HasConflicts(kRoutes, kOther));
+  EXPECT_FALSE(HasConflicts(kMoreRoutes, kOther));
+  EXPECT_TRUE(HasConflicts(kRoutes, kShadowed));
+  EXPECT_FALSE(HasConflicts(kRoutes, kOtherMethod));
+}
+
+TEST(RouteTableTest, MethodNames) {
+  for (const uint8_t method : {kGet, kPost, kDelete, kPut, kPatch}) {
+    EXPECT_EQ(ParseMethod(GetMethodName(method)), method);
+  }
+  EXPECT_STREQ(GetMethodName(kPut), "PUT");
+  EXPECT_EQ(GetMethodName(0), nullptr);
+  EXPECT_EQ(ParseMethod("put"), 0);
+  EXPECT_EQ(ParseMethod("PUTS"), 0);
+  EXPECT_EQ(ParseMethod(""), 0);
+}
+
+}  // namespace route_table
@@ -0,0 +1,103 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "log_frame.hpp"
+#include "ui_bundle.hpp"
+
+namespace ui_bundle {
+
+// Builds a bundle like tools/gen_ui_bundle.py with the original and a gzip
+// variant of each asset
+struct TestAsset {
+  std::string path;
+  std::string data;
+  std::string gz_data;  // left out if empty
+  bool is_immutable;
+};
+
+static std::vector<uint8_t> Build(const std::vector<TestAsset>& assets) {
+  const size_t body_offset = sizeof(Header) + assets.size() * sizeof(Entry);
+  std::vector<uint8_t> body;
+  const auto append = [&body, body_offset](const std::string& bytes) {
+    const uint32_t offset = body_offset + body.size();
+    body.insert(body.end(), bytes.begin(), bytes.end());
+    return offset;
+  };
+  std::vector<Entry> entries;
+  for (const TestAsset& asset : assets) {
+    Entry entry{};
+    entry.path = append(asset.path + '\0');
+    entry.mime_type = append(std::string("text/plain") + '\0');
+    entry.etag = append(std::string("\"0123\"") + '\0');
+    entry.flags = asset.is_immutable ? kImmutable : 0;
+    entry.data_offset = append(asset.data);
+    entry.data_size = asset.data.size();
+    if (!asset.gz_data.empty()) {
+      entry.gz_offset = append(asset.gz_data);
+      entry.gz_size = asset.gz_data.size();
+    }
+    entries.push_back(entry);
+  }
+
+  std::vector<uint8_t> bundle(sizeof(Header));
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(entries.data());
+  bundle.insert(bundle.end(), p, p + entries.size() * sizeof(Entry));
+  bundle.insert(bundle.end(), body.begin(), body.end());
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.format_version = kFormatVersion;
+  std::strcpy(header.version, "v1.2.3");
+  header.asset_count = assets.size();
+  header.size = bundle.size();
+  header.crc = logging::Crc32(bundle.data() + sizeof(Header),
+                              bundle.size() - sizeof(Header));
+  std::memcpy(bundle.data(), &header, sizeof(header));
+  return bundle;
+}
+
+TEST(UiBundleTest, Parse) {
+  std::vector<uint8_t> data =
+      Build({{"/", "<html></html>", "", false},
+             {"/index-0123abcd.js", "console.log(1);", "gz", true}});
+  // Trailing bytes, e.g. the rest of the partition, are ignored
+  data.resize(data.size() + 100, 0xff);
+
+  Bundle bundle;
+  ASSERT_TRUE(Parse(data.data(), data.size(), &bundle));
+  EXPECT_STREQ(bundle.version, "v1.2.3");
+  ASSERT_EQ(bundle.assets.size(), 2u);
+  const Asset& html = bundle.assets[0];
+  EXPECT_STREQ(html.path, "/");
+  EXPECT_STREQ(html.mime_type, "text/plain");
+  EXPECT_STREQ(html.etag, "\"0123\"");
+  EXPECT_FALSE(html.is_immutable);
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(html.data), html.size),
+            "<html></html>");
+  EXPECT_EQ(html.gz_data, nullptr);
+  EXPECT_EQ(html.br_data, nullptr);
+  const Asset& js = bundle.assets[1];
+  EXPECT_STREQ(js.path, "/index-0123abcd.js");
+  EXPECT_TRUE(js.is_immutable);
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(js.gz_data), js.gz_size),
+            "gz");
+}
+
+TEST(UiBundleTest, Invalid) {
+  const std::vector<uint8_t> data = Build({{"/", "<html></html>", "", false}});
+  Bundle bundle;
+  // Truncated
+  EXPECT_FALSE(Parse(data.data(), data.size() - 1, &bundle));
+  EXPECT_FALSE(Parse(data.data(), sizeof(Header) - 1, &bundle));
+  // Corrupted
+  std::vector<uint8_t> corrupted = data;
+  corrupted.back() ^= 1;
+  EXPECT_FALSE(Parse(corrupted.data(), corrupted.size(), &bundle));
+  // Erased partition
+  const std::vector<uint8_t> erased(data.size(), 0xff);
+  EXPECT_FALSE(Parse(erased.data(), erased.size(), &bundle));
+}
+
+}  // namespace ui_bundle
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+
+# Decodes a binary log file, or the console output, of button_hub built with
+# LOG_FORMAT=binary into text with the string table generated by
+# gen_log_string_table.py.
+
+import datetime
+import json
+import re
+import struct
+import sys
+
+# See logging::RecordHeader in button_hub/log_record.hpp
+RECORD_HEADER = struct.Struct("<HIIB")
+# Indexed by logging::Level, see logging::GetLevelLetter()
+LEVEL_LETTERS = "NEWID"
+
+SPEC_PATTERN = re.compile(
+    r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<precision>\*|\d*))?"
+    r"(?P<length>hh|h|ll|l|j|z|t|L)?(?P<conversion>[%diouxXeEfFgGaAcspn])"
+)
+
+
+class ArgReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def read(self, fmt):
+        size = struct.calcsize(fmt)
+        if self.pos + size > len(self.data):
+            raise EOFError
+        (value,) = struct.unpack_from(fmt, self.data, self.pos)
+        self.pos += size
+        return value
+
+    def read_bytes(self, size):
+        if self.pos + size > len(self.data):
+            raise EOFError
+        value = self.data[self.pos : self.pos + size]
+        self.pos += size
+        return value
+
+
+# Mirrors logging::FormatArgs() in button_hub/log_record.cpp
+def format_args(fmt, args):
+    reader = ArgReader(args)
+    out = []
+    pos = 0
+    try:
+        for m in SPEC_PATTERN.finditer(fmt):
+            out.append(fmt[pos : m.start()])
+            pos = m.end()
+            conversion = m.group("conversion")
+            if conversion == "%":
+                out.append("%")
+                continue
+            if conversion == "n":
+                continue
+            width = m.group("width")
+            if width == "*":
+                width = str(reader.read("<i"))
+            precision = m.group("precision")
+            if precision == "*":
+                precision = str(reader.read("<i"))
+            elif precision == "":
+                precision = "0"
+            spec = "%" + m.group("flags") + (width or "")
+            if precision is not None and conversion != "s":
+                spec += "." + precision
+            long_long = m.group("length") in ("ll", "j")
+            if conversion in "diouxXc":
+                value = reader.read("<q" if long_long else "<i")
+                if conversion in "ouxX" and value < 0:
+                    value += 1 << (64 if long_long else 32)
+                if conversion == "c":
+                    out.append((spec + "c") % chr(value & 0xFF))
+                else:
+                    out.append((spec + conversion.replace("u", "d")) % value)
+            elif conversion in "eEfFgGaA":
+                value = reader.read("<d")
+                if conversion in "aA":
+                    out.append(float.hex(value))
+                else:
+                    out.append((spec + conversion) % value)
+            elif conversion == "p":
+                out.append("0x" + (spec + "x") % reader.read("<I"))
+            elif conversion == "s":
+                length = reader.read("<B")
+                text = reader.read_bytes(length).decode("utf-8", errors="replace")
+                if precision is not None:
+                    text = text[: int(precision)]
+                out.append((spec + "s") % text)
+        out.append(fmt[pos:])
+    except EOFError:
+        pass
+    return "".join(out)
+
+
+def decode(data, table):
+    pos = 0
+    while pos + RECORD_HEADER.size <= len(data):
+        size, time, format_id, level = RECORD_HEADER.unpack_from(data, pos)
+        pos += RECORD_HEADER.size
+        args = data[pos : pos + size]
+        pos += size
+        date = datetime.datetime.fromtimestamp(time).strftime("%Y-%m-%d %H:%M:%S")
+        fmt = table.get(f"{format_id:08x}")
+        if fmt is None:
+            text = f"<unknown format {format_id:08x}: {args.hex()}>"
+        else:
+            text = format_args(fmt, args)
+        letter = LEVEL_LETTERS[level] if level < len(LEVEL_LETTERS) else "?"
+        yield f"{date} {letter} {text}"
+
+
+# Decodes the records echoed to the console as '#' and the record in hex,
+# e.g. from "arduino-cli monitor", and passes the other lines through.
+def decode_console(lines, table):
+    for line in lines:
+        line = line.rstrip("\r\n")
+        if line.startswith("#"):
+            try:
+                data = bytes.fromhex(line[1:])
+            except ValueError:
+                yield line
+                continue
+            yield from decode(data, table)
+        else:
+            yield line
+
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3 and sys.argv[1] == "--console":
+        with open(sys.argv[2], encoding="utf-8") as f:
+            string_table = json.load(f)
+        for line in decode_console(sys.stdin, string_table):
+            print(line, flush=True)
+    elif len(sys.argv) != 3:
+        print("Usage: python3 decode_log.py log_file_name string_table_file_name")
+        print("       python3 decode_log.py --console string_table_file_name")
+    else:
+        with open(sys.argv[2], encoding="utf-8") as f:
+            string_table = json.load(f)
+        with open(sys.argv[1], "rb") as f:
+            log_data = f.read()
+        for line in decode(log_data, string_table):
+            print(line)
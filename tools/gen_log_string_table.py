@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+
+# Generates the string table used by decode_log.py from the format strings of
+# the logging::Log() calls in the sketch sources.
+
+import json
+import os
+import re
+import sys
+
+LOG_CALL_PATTERN = re.compile(
+    r'logging::Log\(\s*(?:[\w:]+\s*,\s*)?((?:"(?:[^"\\]|\\.)*"\s*)+)'
+)
+STRING_LITERAL_PATTERN = re.compile(r'"((?:[^"\\]|\\.)*)"')
+SIMPLE_ESCAPES = {
+    "n": b"\n",
+    "t": b"\t",
+    "r": b"\r",
+    "0": b"\0",
+    '"': b'"',
+    "'": b"'",
+    "\\": b"\\",
+}
+
+
+def unescape_c_string(literal):
+    out = bytearray()
+    i = 0
+    while i < len(literal):
+        c = literal[i]
+        if c != "\\":
+            out += c.encode("utf-8")
+            i += 1
+            continue
+        n = literal[i + 1]
+        if n == "x":
+            m = re.match(r"[0-9a-fA-F]+", literal[i + 2 :])
+            out.append(int(m.group(0), 16) & 0xFF)
+            i += 2 + len(m.group(0))
+        elif n in "01234567":
+            m = re.match(r"[0-7]{1,3}", literal[i + 1 :])
+            out.append(int(m.group(0), 8) & 0xFF)
+            i += 1 + len(m.group(0))
+        else:
+            out += SIMPLE_ESCAPES.get(n, n.encode("utf-8"))
+            i += 2
+    return bytes(out)
+
+
+# Must match logging::HashFormat() in button_hub/log_record.cpp
+def fnv1a32(data):
+    h = 2166136261
+    for b in data:
+        h ^= b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def collect_format_strings(source_dir):
+    formats = set()
+    for name in sorted(os.listdir(source_dir)):
+        if not name.endswith((".cpp", ".hpp", ".ino")):
+            continue
+        with open(os.path.join(source_dir, name), encoding="utf-8") as f:
+            source = f.read()
+        for call in LOG_CALL_PATTERN.finditer(source):
+            literals = STRING_LITERAL_PATTERN.findall(call.group(1))
+            formats.add(b"".join(unescape_c_string(s) for s in literals))
+    # Messages emitted by logging.cpp itself
+    formats.add(b"(%u log messages dropped)")
+    formats.add(b"Boot #%d")
+    return formats
+
+
+def generate_string_table(source_dir):
+    table = {}
+    for fmt in sorted(collect_format_strings(source_dir)):
+        key = f"{fnv1a32(fmt):08x}"
+        text = fmt.decode("utf-8", errors="replace")
+        if key in table and table[key] != text:
+            print(f"Hash collision: {table[key]!r} and {text!r}", file=sys.stderr)
+        table[key] = text
+    return table
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("Usage: python3 gen_log_string_table.py source_dir output_file_name")
+    else:
+        with open(sys.argv[2], "w", encoding="utf-8") as f:
+            json.dump(generate_string_table(sys.argv[1]), f, ensure_ascii=False, indent=1)
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+
+# Generates a web UI bundle (see button_hub/ui_bundle.hpp) from the files of
+# the built web UI. Each asset is stored as is and gzip-compressed, and also
+# brotli-compressed with --brotli (requires the brotli module). A compressed
+# variant which is not smaller than the original is left out. With
+# --compressed-only, the original is left out instead wherever the gzip
+# variant is kept.
+#
+# Install the bundle with `curl -T ui.bin http://<hub>/ui_bundle`. An output
+# file ending in .cpp gets the bundle as C++ source instead, which the firmware
+# embeds as the web UI it serves while no bundle is installed (see
+# button_hub/web_ui.hpp).
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import struct
+import zlib
+
+MAGIC = b"KBUI"
+FORMAT_VERSION = 1
+HEADER_FORMAT = "<4sI32sIII"
+ENTRY_FORMAT = "<10I"
+IMMUTABLE = 1
+
+MIME_TYPES = {
+    ".css": "text/css",
+    ".html": "text/html",
+    ".ico": "image/x-icon",
+    ".js": "text/javascript",
+    ".json": "application/json",
+    ".png": "image/png",
+    ".svg": "image/svg+xml",
+    ".txt": "text/plain",
+    ".woff2": "font/woff2",
+}
+
+# Vite names the built files "[name]-[hash].[ext]" (see webui/vite.config.ts)
+HASHED_NAME_PATTERN = re.compile(r"-[A-Za-z0-9_-]{8}\.[A-Za-z0-9]+$")
+
+
+def generate_cpp_array(bytes_data):
+    # 12 elements of "0x00, " per line fit in 80 columns with the indentation
+    lines = []
+    for i in range(0, len(bytes_data), 12):
+        chunk = bytes_data[i : i + 12]
+        lines.append("    " + ", ".join(f"0x{byte:02x}" for byte in chunk))
+    return ",\n".join(lines)
+
+
+def write_cpp(output_filename, bundle):
+    cpp_code = (
+        f"// Generated by tools/gen_ui_bundle.py\n\n"
+        f"#include <cstddef>\n"
+        f"#include <cstdint>\n\n"
+        f"namespace web_ui {{\n\n"
+        f"extern const uint8_t kEmbeddedBundle[];\n"
+        f"extern const size_t kEmbeddedBundleSize;\n\n"
+        f"alignas(4) const uint8_t kEmbeddedBundle[] = {{\n"
+        f"{generate_cpp_array(bundle)}\n}};\n\n"
+        f"const size_t kEmbeddedBundleSize = sizeof(kEmbeddedBundle);\n\n"
+        f"}}  // namespace web_ui\n"
+    )
+    with open(output_filename, "w") as f:
+        f.write(cpp_code)
+
+
+def compress(bytes_data, encoding):
+    if encoding == "gz":
+        # mtime=0 keeps the output reproducible
+        return gzip.compress(bytes_data, compresslevel=9, mtime=0)
+    import brotli
+
+    return brotli.compress(bytes_data, quality=11)
+
+
+def list_assets(input_dir):
+    paths = []
+    for root, _, files in os.walk(input_dir):
+        for file in files:
+            if file.endswith((".gz", ".br")):
+                continue
+            paths.append(os.path.relpath(os.path.join(root, file), input_dir))
+    return sorted(paths)
+
+
+def generate_ui_bundle(
+    input_dir, output_filename, version, encodings, compressed_only
+):
+    rel_paths = list_assets(input_dir)
+    header_size = struct.calcsize(HEADER_FORMAT)
+    body_offset = header_size + len(rel_paths) * struct.calcsize(ENTRY_FORMAT)
+    entries = b""
+    body = bytearray()
+
+    def append(bytes_data):
+        offset = body_offset + len(body)
+        body.extend(bytes_data)
+        return offset
+
+    for rel_path in rel_paths:
+        with open(os.path.join(input_dir, rel_path), "rb") as f:
+            bytes_data = f.read()
+
+        url_path = "/" + rel_path.replace(os.sep, "/")
+        if url_path == "/index.html":
+            url_path = "/"
+        extension = os.path.splitext(rel_path)[1]
+        mime_type = MIME_TYPES.get(extension, "application/octet-stream")
+        etag = hashlib.sha256(bytes_data).hexdigest()[:16]
+        is_immutable = bool(HASHED_NAME_PATTERN.search(rel_path))
+
+        fields = [
+            append(url_path.encode() + b"\0"),
+            append(mime_type.encode() + b"\0"),
+            append(f'"{etag}"'.encode() + b"\0"),
+            IMMUTABLE if is_immutable else 0,
+        ]
+        variants = []
+        for encoding in ["gz", "br"]:
+            compressed = (
+                compress(bytes_data, encoding) if encoding in encodings else None
+            )
+            if compressed is None or len(compressed) >= len(bytes_data):
+                variants += [0, 0]
+            else:
+                variants += [append(compressed), len(compressed)]
+        if compressed_only and variants[1] != 0:
+            fields += [0, 0]
+        else:
+            fields += [append(bytes_data), len(bytes_data)]
+        entries += struct.pack(ENTRY_FORMAT, *fields, *variants)
+
+    rest = entries + bytes(body)
+    header = struct.pack(
+        HEADER_FORMAT,
+        MAGIC,
+        FORMAT_VERSION,
+        version.encode()[:31],
+        len(rel_paths),
+        header_size + len(rest),
+        zlib.crc32(rest),
+    )
+    if output_filename.endswith(".cpp"):
+        write_cpp(output_filename, header + rest)
+        return
+    with open(output_filename, "wb") as f:
+        f.write(header + rest)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("input_dir", help="e.g. ../webui/dist")
+    parser.add_argument("output_filename", help="e.g. .build/ui.bin")
+    parser.add_argument("--version", default="", help="e.g. v1.2.3")
+    parser.add_argument("--brotli", action="store_true")
+    parser.add_argument("--compressed-only", action="store_true")
+    args = parser.parse_args()
+    encodings = ["gz", "br"] if args.brotli else ["gz"]
+    generate_ui_bundle(
+        args.input_dir,
+        args.output_filename,
+        args.version,
+        encodings,
+        args.compressed_only,
+    )
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+
+# Prints the syslog messages shipped by button_hub (see
+# button_hub/log_shipper.hpp). Listens on UDP and TCP (RFC 6587 octet
+# counting) at the same port. Point the hub at this host with
+# PUT /config/syslog to test shipping without a real collector.
+
+import argparse
+import selectors
+import socket
+
+
+def print_message(peer, message):
+    text = message.decode("utf-8", "replace").replace("\ufeff", "", 1)
+    print(f"{peer[0]}: {text}")
+
+
+class TcpStream:
+    def __init__(self, peer):
+        self.peer = peer
+        self.buffer = b""
+
+    # Returns False when the stream is broken
+    def feed(self, data):
+        self.buffer += data
+        while True:
+            length, sep, rest = self.buffer.partition(b" ")
+            if not sep:
+                return len(self.buffer) < 8
+            if not length.isdigit():
+                return False
+            if len(rest) < int(length):
+                return True
+            print_message(self.peer, rest[: int(length)])
+            self.buffer = rest[int(length) :]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--port", type=int, default=5514)
+    args = parser.parse_args()
+
+    udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp.bind(("", args.port))
+    tcp = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    tcp.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    tcp.bind(("", args.port))
+    tcp.listen()
+
+    selector = selectors.DefaultSelector()
+    selector.register(udp, selectors.EVENT_READ)
+    selector.register(tcp, selectors.EVENT_READ)
+    streams = {}
+    print(f"Listening on UDP and TCP port {args.port}")
+    while True:
+        for key, _ in selector.select():
+            sock = key.fileobj
+            if sock is udp:
+                data, peer = udp.recvfrom(65535)
+                print_message(peer, data)
+            elif sock is tcp:
+                conn, peer = tcp.accept()
+                streams[conn] = TcpStream(peer)
+                selector.register(conn, selectors.EVENT_READ)
+            else:
+                data = sock.recv(4096)
+                if not data or not streams[sock].feed(data):
+                    selector.unregister(sock)
+                    sock.close()
+                    del streams[sock]
+
+
+if __name__ == "__main__":
+    main()
@@ -13,6 +13,7 @@ import { Modal } from "./Modal";
 import { SettingPage } from "./SettingPage";
 import { WiFiSignalLevel } from "./WiFiSignalLevel";
 import { getHubHttpApiEndpoint, isValidVersion, getIntVersion } from "./utils";
+import { hubRequest } from "./rpc";
 import { Page, BottomNav } from "./BottomNav";
 import { LogList } from "./LogList";
 import { TopHeader } from "./TopHeader";
@@ -63,41 +64,25 @@ export function App({
 
   const editCommand = useCallback((button: Button, command: Command) => {
     setProgressCount((prev) => prev + 1);
-    return fetch(getHubHttpApiEndpoint("/commands"), {
-      method: "POST",
-      headers: { "Content-Type": "application/json" },
-      body: JSON.stringify({ button, command }),
-    })
+    return hubRequest("POST", "/commands", { button, command })
       .catch((err) => console.error(err))
       .then(() => setProgressCount((prev) => prev - 1));
   }, []);
   const deleteCommand = useCallback((button: Button) => {
     setProgressCount((prev) => prev + 1);
-    return fetch(getHubHttpApiEndpoint("/commands"), {
-      method: "DELETE",
-      headers: { "Content-Type": "application/json" },
-      body: JSON.stringify({ button }),
-    })
+    return hubRequest("DELETE", "/commands", { button })
       .catch((err) => console.error(err))
       .then(() => setProgressCount((prev) => prev - 1));
   }, []);
   const setButtonName = useCallback((button: Button, name: string) => {
     setProgressCount((prev) => prev + 1);
-    return fetch(getHubHttpApiEndpoint("/buttons"), {
-      method: "PUT",
-      headers: { "Content-Type": "application/json" },
-      body: JSON.stringify({ button, name }),
-    })
+    return hubRequest("PUT", "/buttons", { button, name })
       .catch((err) => console.error(err))
       .then(() => setProgressCount((prev) => prev - 1));
   }, []);
   const deleteButtonName = useCallback((button: Button) => {
     setProgressCount((prev) => prev + 1);
-    return fetch(getHubHttpApiEndpoint("/buttons"), {
-      method: "DELETE",
-      headers: { "Content-Type": "application/json" },
-      body: JSON.stringify({ button, name }),
-    })
+    return hubRequest("DELETE", "/buttons", { button, name })
       .catch((err) => console.error(err))
       .then(() => setProgressCount((prev) => prev - 1));
   }, []);
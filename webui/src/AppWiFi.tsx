@@ -141,8 +141,10 @@ export function AppWiFi() {
 
   const handleRescan = useCallback(() => {
     setMode("scanning");
+    // The hub answers at once and sends the list over the WebSocket when the
+    // scan completes
     fetch(getHubHttpApiEndpoint("/wifi_scan"))
-      .then(() => setMode("input"))
+      .then((response) => setMode(response.ok ? "input" : "error"))
       .catch(() => setMode("error"));
   }, []);
 
@@ -1,5 +1,5 @@
 import { useCallback } from "react";
-import { getHubHttpApiEndpoint } from "./utils";
+import { hubRequest } from "./rpc";
 
 export function CheckboxConfigEditor({
   path,
@@ -14,11 +14,7 @@ export function CheckboxConfigEditor({
 }) {
   const applyValue = useCallback(
     (newValue: boolean) =>
-      fetch(getHubHttpApiEndpoint(path), {
-        method: "PUT",
-        headers: { "Content-Type": "application/json" },
-        body: JSON.stringify({ [fieldKey]: newValue }),
-      }),
+      hubRequest("PUT", path, { [fieldKey]: newValue }),
     [path, fieldKey],
   );
 
@@ -2,6 +2,7 @@ import { useState, useEffect, useRef, useCallback, useMemo } from "react";
 
 import { MdDelete } from "react-icons/md";
 import { MdEdit } from "react-icons/md";
+import { MdPlayArrow } from "react-icons/md";
 
 import { Button, Command, RobotInfo, GetButtonName } from "./types";
 import { ButtonImage } from "./ButtonImage";
@@ -10,6 +11,7 @@ import { CommandEditor } from "./CommandEditor";
 import { CommandText } from "./CommandText";
 import { Icon } from "./Icon";
 import { Modal } from "./Modal";
+import { hubRequest } from "./rpc";
 
 const HIGHLIGHT_COLOR = "#ff0";
 const HIGHLIGHT_DURATION = "5s";
@@ -58,6 +60,10 @@ export function RegisteredCommand({
     [button, onEdit],
   );
   const handleDelete = useCallback(() => onDelete(button), [button, onDelete]);
+  const handleTestPress = useCallback(
+    () => hubRequest("POST", "/test_press", { button }),
+    [button],
+  );
   const printName = useMemo(
     () => name ?? GetButtonName(button),
     [name, button],
@@ -108,6 +114,12 @@ export function RegisteredCommand({
               </Icon>
               編集
             </button>
+            <button type="button" onClick={handleTestPress}>
+              <Icon color="inherit" margin="right">
+                <MdPlayArrow />
+              </Icon>
+              テスト
+            </button>
             <span style={{ flex: 1 }} />
             <button type="button" className="icon" onClick={handleDelete}>
               <Icon>
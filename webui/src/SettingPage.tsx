@@ -6,6 +6,7 @@ import { SliderConfigEditor } from "./SliderConfigEditor";
 import { ButtonWithConfirmation } from "./ButtonWithConfirmation";
 import { Settings } from "./types";
 import { getHubHttpApiEndpoint } from "./utils";
+import { hubRequest } from "./rpc";
 
 export function SettingPage({
   hubVersion,
@@ -26,10 +27,8 @@ export function SettingPage({
     });
   };
   const handleManualOta = () => {
-    fetch(getHubHttpApiEndpoint("/config/one_shot_auto_ota_is_enabled"), {
-      method: "PUT",
-      headers: { "Content-Type": "application/json" },
-      body: JSON.stringify({ one_shot_auto_ota_is_enabled: true }),
+    hubRequest("PUT", "/config/one_shot_auto_ota_is_enabled", {
+      one_shot_auto_ota_is_enabled: true,
     }).then((r) => {
       if (r.ok) {
         triggerReboot();
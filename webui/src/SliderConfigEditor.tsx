@@ -3,7 +3,7 @@ import { useState, useCallback, useEffect, useMemo, useRef } from "react";
 import { debounce } from "ts-debounce";
 
 import { useRangeInput } from "./hooks";
-import { getHubHttpApiEndpoint } from "./utils";
+import { hubRequest } from "./rpc";
 
 function useValue(
   path: string,
@@ -12,11 +12,7 @@ function useValue(
   const [localValue, setLocalValue] = useState<number>();
   const setRemoteValue = useCallback(
     (newValue: number) => {
-      fetch(getHubHttpApiEndpoint(path), {
-        method: "PUT",
-        headers: { "Content-Type": "application/json" },
-        body: JSON.stringify({ [fieldKey]: newValue }),
-      });
+      hubRequest("PUT", path, { [fieldKey]: newValue });
     },
     [path, fieldKey],
   );
@@ -1,9 +1,24 @@
-import { ChangeEvent, useCallback, useEffect, useMemo, useState } from "react";
+import {
+  ChangeEvent,
+  useCallback,
+  useEffect,
+  useMemo,
+  useRef,
+  useState,
+} from "react";
 import useWebSocket, { ReadyState } from "react-use-websocket";
-import { getHubHttpApiEndpoint, getHubWebSocketEndpoint } from "./utils";
+import { inflateRaw } from "./inflate";
+import { decodeMsgPack } from "./msgpack";
+import { RpcResponseMessage, handleRpcResponse, setRpcSender } from "./rpc";
+import {
+  getHubHttpApiEndpoint,
+  getHubWebSocketEndpoint,
+  isEqual,
+} from "./utils";
 
 import {
   Button,
+  ButtonBase,
   ButtonJson,
   Command,
   ConvertButtonJsonToButton,
@@ -320,19 +335,45 @@ interface SettingsMessage {
   settings: Settings;
 }
 
+// Sent before each snapshot, which doesn't carry the time of the hub
+interface ClockMessage {
+  type: "clock";
+  timestamp_now: number;
+}
+
 interface ObservedButtonMessage {
   type: "observed_buttons";
+  version: number;
   buttons: ButtonJson[];
+}
+
+interface ObservedButtonDeltaMessage {
+  type: "observed_buttons_delta";
+  version: number;
+  upsert?: ButtonJson[];
+  delete?: ButtonBase[];
   timestamp_now: number;
 }
 
 interface CommandsMessage {
   type: "commands";
+  version: number;
   commands: Array<{
     button: Button;
     command: Command;
   }>;
-  timestamp_now: number;
+}
+
+interface CommandsDeltaMessage {
+  type: "commands_delta";
+  version: number;
+  upsert?: Array<{
+    button: Button;
+    command: Command;
+  }>;
+  delete?: Array<{
+    button: Button;
+  }>;
 }
 
 interface WifiRssiMessage {
@@ -357,13 +398,63 @@ type WsMessage =
   | HubInfoMessage
   | RobotInfoMessage
   | SettingsMessage
+  | ClockMessage
   | ObservedButtonMessage
+  | ObservedButtonDeltaMessage
   | CommandsMessage
+  | CommandsDeltaMessage
   | WifiRssiMessage
-  | WifiApListMessage;
+  | WifiApListMessage
+  | RpcResponseMessage;
+
+type DeltaTopic = "observed_buttons" | "commands";
+
+// A header byte, 0 for plain or 1 for deflated, and a MessagePack message.
+// See "compress=deflate" in button_hub/server.cpp.
+function decodeBinaryFrame(data: ArrayBuffer) {
+  const header = new Uint8Array(data, 0, 1)[0];
+  const payload = new Uint8Array(data, 1);
+  return decodeMsgPack(header === 1 ? inflateRaw(payload) : payload);
+}
 
 let handle: number | undefined = undefined;
 
+function isSameButton(a: ButtonBase, b: ButtonBase): boolean {
+  if ("apple_i_beacon" in a && "apple_i_beacon" in b) {
+    return isEqual(a.apple_i_beacon, b.apple_i_beacon);
+  }
+  if ("m5_button" in a && "m5_button" in b) {
+    return a.m5_button.id === b.m5_button.id;
+  }
+  if ("gpio_button" in a && "gpio_button" in b) {
+    return a.gpio_button.id === b.gpio_button.id;
+  }
+  return false;
+}
+
+// Keeps the order of the snapshot: recently observed buttons (with timestamp)
+// from the newest, followed by the other named buttons.
+function applyButtonDelta(
+  buttons: Button[],
+  upsert: Button[],
+  deleted: ButtonBase[],
+): Button[] {
+  const changed = [...upsert, ...deleted];
+  let result = buttons.filter((b) => !changed.some((c) => isSameButton(b, c)));
+  for (const button of upsert) {
+    if (button.timestamp !== undefined) {
+      result = [button, ...result];
+      continue;
+    }
+    const i = result.findIndex((b) => b.timestamp === undefined);
+    result =
+      i < 0
+        ? [...result, button]
+        : [...result.slice(0, i), button, ...result.slice(i)];
+  }
+  return result;
+}
+
 export function useKachakaButtonHub() {
   const [networkState, setNetworkState] = useState<
     "offline" | "online" | "unstable"
@@ -376,13 +467,42 @@ export function useKachakaButtonHub() {
     useState<{ button: Button; command: Command }[]>();
   const [wifiRssi, setWifiRssi] = useState<number>();
   const [wifiApList, setWifiApList] = useState<"scanning" | WifiAp[]>();
+  const versions = useRef<Partial<Record<DeltaTopic, number>>>({});
+  // Seconds to add to the time of the hub to get the local time
+  const clockOffset = useRef(0);
+  const sendMessageRef = useRef<(message: string) => void>();
+
+  // A delta applies only on top of the previous version. After a gap, the
+  // deltas are ignored until the requested snapshot arrives.
+  const acceptDelta = useCallback((topic: DeltaTopic, version: number) => {
+    const current = versions.current[topic];
+    if (current === undefined || version <= current) {
+      return false;
+    }
+    if (version !== current + 1) {
+      versions.current[topic] = undefined;
+      sendMessageRef.current?.(JSON.stringify({ type: "resync", topic }));
+      return false;
+    }
+    versions.current[topic] = version;
+    return true;
+  }, []);
 
   const onMessage = useCallback((message: WebSocketEventMap["message"]) => {
     if (message?.data === undefined) {
       return;
     }
-    const parsedMessage: WsMessage = JSON.parse(message.data ?? "null");
+    // Binary frames are in MessagePack, and text frames, e.g. the log
+    // stream, are in JSON
+    const parsedMessage = (
+      message.data instanceof ArrayBuffer
+        ? decodeBinaryFrame(message.data)
+        : JSON.parse(message.data ?? "null")
+    ) as WsMessage;
     const now = Date.now();
+    if (parsedMessage.type === "response") {
+      handleRpcResponse(parsedMessage);
+    }
     if (parsedMessage.type === "hub_info") {
       setHubInfo(parsedMessage);
     }
@@ -392,17 +512,30 @@ export function useKachakaButtonHub() {
     if (parsedMessage.type === "settings") {
       setSettings(parsedMessage.settings);
     }
+    if (parsedMessage.type === "clock") {
+      clockOffset.current = now / 1000 - parsedMessage.timestamp_now;
+    }
     if (parsedMessage.type === "observed_buttons") {
+      versions.current.observed_buttons = parsedMessage.version;
       setButtons(
         parsedMessage.buttons.map((button: ButtonJson) =>
-          ConvertButtonJsonToButton(
-            now / 1000 - parsedMessage.timestamp_now,
-            button,
-          ),
+          ConvertButtonJsonToButton(clockOffset.current, button),
         ),
       );
     }
+    if (
+      parsedMessage.type === "observed_buttons_delta" &&
+      acceptDelta("observed_buttons", parsedMessage.version)
+    ) {
+      clockOffset.current = now / 1000 - parsedMessage.timestamp_now;
+      const upsert = (parsedMessage.upsert ?? []).map((button: ButtonJson) =>
+        ConvertButtonJsonToButton(clockOffset.current, button),
+      );
+      const deleted = parsedMessage.delete ?? [];
+      setButtons((prev) => prev && applyButtonDelta(prev, upsert, deleted));
+    }
     if (parsedMessage.type === "commands") {
+      versions.current.commands = parsedMessage.version;
       setCommands(
         parsedMessage.commands.map(({ button, command }) => ({
           button,
@@ -410,6 +543,23 @@ export function useKachakaButtonHub() {
         })),
       );
     }
+    if (
+      parsedMessage.type === "commands_delta" &&
+      acceptDelta("commands", parsedMessage.version)
+    ) {
+      const upsert = parsedMessage.upsert ?? [];
+      const changed = [...upsert, ...(parsedMessage.delete ?? [])];
+      setCommands(
+        (prev) =>
+          prev && [
+            ...prev.filter(
+              ({ button }) =>
+                !changed.some((c) => isSameButton(button, c.button)),
+            ),
+            ...upsert,
+          ],
+      );
+    }
     if (parsedMessage.type === "wifi_rssi") {
       setWifiRssi(parsedMessage.wifi_rssi);
     }
@@ -427,15 +577,27 @@ export function useKachakaButtonHub() {
       handle = setTimeout(() => setNetworkState("offline"), 10 * 1000);
     }, 5 * 1000);
     setNetworkState("online");
-  }, []);
+  }, [acceptDelta]);
 
-  const { readyState } = useWebSocket(getHubWebSocketEndpoint(), {
-    shouldReconnect: () => true,
-    onMessage,
-  });
+  const { readyState, sendMessage } = useWebSocket(
+    getHubWebSocketEndpoint({ format: "msgpack", compress: "deflate" }),
+    {
+      shouldReconnect: () => true,
+      onOpen: (event) => {
+        (event.target as WebSocket).binaryType = "arraybuffer";
+      },
+      onMessage,
+    },
+  );
+  sendMessageRef.current = sendMessage;
+
+  useEffect(() => {
+    setRpcSender(readyState === ReadyState.OPEN ? sendMessage : undefined);
+  }, [readyState, sendMessage]);
 
   useEffect(() => {
     if (readyState !== ReadyState.OPEN) {
+      versions.current = {};
       setButtons(undefined);
       setCommands(undefined);
     }
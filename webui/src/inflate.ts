@@ -0,0 +1,139 @@
+// Inflates the raw deflate data (RFC 1951) which the hub writes: stored
+// blocks and blocks with the fixed Huffman codes, without a final block (see
+// button_hub/log_deflate.hpp). It is synchronous so that the messages are
+// handled in the order received.
+
+const LENGTH_BASE = [
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67,
+  83, 99, 115, 131, 163, 195, 227, 258,
+];
+const LENGTH_EXTRA_BITS = [
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5,
+  5, 5, 0,
+];
+const DISTANCE_BASE = [
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+  1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+];
+const DISTANCE_EXTRA_BITS = [
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11,
+  11, 12, 12, 13, 13,
+];
+
+class BitReader {
+  private pos = 0;
+  private bits = 0;
+  private count = 0;
+
+  constructor(private data: Uint8Array) {}
+
+  get isAtEnd() {
+    return this.pos === this.data.length && this.count < 8;
+  }
+
+  // Extra bits and headers, least significant bit first
+  readBits(count: number) {
+    while (this.count < count) {
+      if (this.pos === this.data.length) {
+        throw new RangeError("Truncated deflate data");
+      }
+      this.bits |= this.data[this.pos++] << this.count;
+      this.count += 8;
+    }
+    const value = this.bits & ((1 << count) - 1);
+    this.bits >>>= count;
+    this.count -= count;
+    return value;
+  }
+
+  // Huffman codes, most significant bit first
+  readCode(length: number, code = 0) {
+    for (let i = 0; i < length; i++) {
+      code = (code << 1) | this.readBits(1);
+    }
+    return code;
+  }
+
+  alignToByte() {
+    this.readBits(this.count % 8);
+  }
+}
+
+function readLiteralOrLength(reader: BitReader) {
+  let code = reader.readCode(7);
+  if (code <= 0x17) {
+    return 256 + code;
+  }
+  code = reader.readCode(1, code);
+  if (code >= 0x30 && code <= 0xbf) {
+    return code - 0x30;
+  }
+  if (code >= 0xc0 && code <= 0xc7) {
+    return 280 + code - 0xc0;
+  }
+  return 144 + reader.readCode(1, code) - 0x190;
+}
+
+export function inflateRaw(data: Uint8Array): Uint8Array {
+  const reader = new BitReader(data);
+  let out = new Uint8Array(data.length * 4);
+  let n = 0;
+  const reserve = (size: number) => {
+    if (n + size > out.length) {
+      const grown = new Uint8Array(Math.max(out.length * 2, n + size));
+      grown.set(out.subarray(0, n));
+      out = grown;
+    }
+  };
+  while (!reader.isAtEnd) {
+    const isFinal = reader.readBits(1);
+    const type = reader.readBits(2);
+    if (type === 0) {
+      reader.alignToByte();
+      const length = reader.readBits(16);
+      if ((length ^ 0xffff) !== reader.readBits(16)) {
+        throw new RangeError("Invalid stored block");
+      }
+      reserve(length);
+      for (let i = 0; i < length; i++) {
+        out[n++] = reader.readBits(8);
+      }
+    } else if (type === 1) {
+      for (;;) {
+        const symbol = readLiteralOrLength(reader);
+        if (symbol < 256) {
+          reserve(1);
+          out[n++] = symbol;
+          continue;
+        }
+        if (symbol === 256) {
+          break;
+        }
+        const i = symbol - 257;
+        if (i >= LENGTH_BASE.length) {
+          throw new RangeError("Invalid length code");
+        }
+        const length = LENGTH_BASE[i] + reader.readBits(LENGTH_EXTRA_BITS[i]);
+        const code = reader.readCode(5);
+        if (code >= DISTANCE_BASE.length) {
+          throw new RangeError("Invalid distance code");
+        }
+        const distance =
+          DISTANCE_BASE[code] + reader.readBits(DISTANCE_EXTRA_BITS[code]);
+        if (distance > n) {
+          throw new RangeError("Invalid distance");
+        }
+        reserve(length);
+        for (let k = 0; k < length; k++, n++) {
+          out[n] = out[n - distance];
+        }
+      }
+    } else {
+      throw new RangeError("Dynamic Huffman codes are not supported");
+    }
+    if (isFinal) {
+      break;
+    }
+  }
+  return out.subarray(0, n);
+}
@@ -0,0 +1,185 @@
+// A MessagePack decoder for the messages of the hub, which the hub converts
+// from JSON. Only the types that JSON has are expected, but bin and ext are
+// skipped over so that a message is never misread.
+
+const textDecoder = new TextDecoder();
+
+class Reader {
+  private view: DataView;
+  private offset = 0;
+
+  constructor(data: ArrayBuffer | Uint8Array) {
+    this.view =
+      data instanceof Uint8Array
+        ? new DataView(data.buffer, data.byteOffset, data.byteLength)
+        : new DataView(data);
+  }
+
+  get isAtEnd() {
+    return this.offset === this.view.byteLength;
+  }
+
+  private advance(size: number) {
+    const offset = this.offset;
+    if (offset + size > this.view.byteLength) {
+      throw new RangeError("Truncated MessagePack");
+    }
+    this.offset += size;
+    return offset;
+  }
+
+  private uint(size: 1 | 2 | 4 | 8) {
+    const offset = this.advance(size);
+    switch (size) {
+      case 1:
+        return this.view.getUint8(offset);
+      case 2:
+        return this.view.getUint16(offset);
+      case 4:
+        return this.view.getUint32(offset);
+      case 8:
+        return Number(this.view.getBigUint64(offset));
+    }
+  }
+
+  private int(size: 1 | 2 | 4 | 8) {
+    const offset = this.advance(size);
+    switch (size) {
+      case 1:
+        return this.view.getInt8(offset);
+      case 2:
+        return this.view.getInt16(offset);
+      case 4:
+        return this.view.getInt32(offset);
+      case 8:
+        return Number(this.view.getBigInt64(offset));
+    }
+  }
+
+  private str(length: number) {
+    const offset = this.advance(length);
+    return textDecoder.decode(
+      new Uint8Array(this.view.buffer, this.view.byteOffset + offset, length),
+    );
+  }
+
+  private bin(length: number) {
+    const offset = this.view.byteOffset + this.advance(length);
+    return new Uint8Array(this.view.buffer.slice(offset, offset + length));
+  }
+
+  private array(length: number) {
+    const array: unknown[] = [];
+    for (let i = 0; i < length; i++) {
+      array.push(this.value());
+    }
+    return array;
+  }
+
+  private map(length: number) {
+    const map: Record<string, unknown> = {};
+    for (let i = 0; i < length; i++) {
+      const key = String(this.value());
+      map[key] = this.value();
+    }
+    return map;
+  }
+
+  value(): unknown {
+    const type = this.uint(1);
+    if (type <= 0x7f) {
+      return type;
+    }
+    if (type <= 0x8f) {
+      return this.map(type & 0x0f);
+    }
+    if (type <= 0x9f) {
+      return this.array(type & 0x0f);
+    }
+    if (type <= 0xbf) {
+      return this.str(type & 0x1f);
+    }
+    if (type >= 0xe0) {
+      return type - 0x100;
+    }
+    switch (type) {
+      case 0xc0:
+        return null;
+      case 0xc2:
+        return false;
+      case 0xc3:
+        return true;
+      case 0xc4:
+        return this.bin(this.uint(1));
+      case 0xc5:
+        return this.bin(this.uint(2));
+      case 0xc6:
+        return this.bin(this.uint(4));
+      case 0xc7:
+        return this.ext(this.uint(1));
+      case 0xc8:
+        return this.ext(this.uint(2));
+      case 0xc9:
+        return this.ext(this.uint(4));
+      case 0xca:
+        return this.view.getFloat32(this.advance(4));
+      case 0xcb:
+        return this.view.getFloat64(this.advance(8));
+      case 0xcc:
+        return this.uint(1);
+      case 0xcd:
+        return this.uint(2);
+      case 0xce:
+        return this.uint(4);
+      case 0xcf:
+        return this.uint(8);
+      case 0xd0:
+        return this.int(1);
+      case 0xd1:
+        return this.int(2);
+      case 0xd2:
+        return this.int(4);
+      case 0xd3:
+        return this.int(8);
+      case 0xd4:
+        return this.ext(1);
+      case 0xd5:
+        return this.ext(2);
+      case 0xd6:
+        return this.ext(4);
+      case 0xd7:
+        return this.ext(8);
+      case 0xd8:
+        return this.ext(16);
+      case 0xd9:
+        return this.str(this.uint(1));
+      case 0xda:
+        return this.str(this.uint(2));
+      case 0xdb:
+        return this.str(this.uint(4));
+      case 0xdc:
+        return this.array(this.uint(2));
+      case 0xdd:
+        return this.array(this.uint(4));
+      case 0xde:
+        return this.map(this.uint(2));
+      case 0xdf:
+        return this.map(this.uint(4));
+    }
+    throw new RangeError(`Invalid MessagePack type: ${type}`);
+  }
+
+  private ext(length: number) {
+    this.advance(1 + length); // the type and the data
+    return undefined;
+  }
+}
+
+export function decodeMsgPack(data: ArrayBuffer | Uint8Array): unknown {
+  const reader = new Reader(data);
+  const value = reader.value();
+  if (!reader.isAtEnd) {
+    throw new RangeError("Extra bytes after MessagePack");
+  }
+  return value;
+}
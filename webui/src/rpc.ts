@@ -0,0 +1,71 @@
+import { getHubHttpApiEndpoint } from "./utils";
+
+// Writes go over the hub WebSocket while it is open, which saves a TCP
+// connection per request and lets several of them be in flight, and over
+// HTTP otherwise. The hub serves both with the same handlers.
+
+export interface RpcResponseMessage {
+  type: "response";
+  id: number;
+  status: number;
+  body?: unknown;
+}
+
+export interface HubResponse {
+  ok: boolean;
+  status: number;
+}
+
+const RPC_TIMEOUT_MSEC = 10 * 1000;
+
+let sendRpc: ((message: string) => void) | undefined = undefined;
+let nextRpcId = 1;
+const pendingRpcs = new Map<number, (response: HubResponse) => void>();
+
+// Called with the send function of the WebSocket while it is open, and with
+// undefined once it is closed
+export function setRpcSender(send: ((message: string) => void) | undefined) {
+  sendRpc = send;
+  if (send === undefined) {
+    // The responses will never arrive
+    for (const resolve of pendingRpcs.values()) {
+      resolve({ ok: false, status: 0 });
+    }
+    pendingRpcs.clear();
+  }
+}
+
+export function handleRpcResponse(message: RpcResponseMessage) {
+  const resolve = pendingRpcs.get(message.id);
+  if (resolve) {
+    pendingRpcs.delete(message.id);
+    resolve({
+      ok: 200 <= message.status && message.status < 300,
+      status: message.status,
+    });
+  }
+}
+
+export function hubRequest(
+  method: "POST" | "PUT" | "DELETE",
+  path: string,
+  body: unknown,
+): Promise<HubResponse> {
+  if (sendRpc === undefined) {
+    return fetch(getHubHttpApiEndpoint(path), {
+      method,
+      headers: { "Content-Type": "application/json" },
+      body: JSON.stringify(body),
+    }).then(({ ok, status }) => ({ ok, status }));
+  }
+  const id = nextRpcId++;
+  sendRpc(JSON.stringify({ type: "request", id, method, path, body }));
+  return new Promise((resolve) => {
+    pendingRpcs.set(id, resolve);
+    setTimeout(() => {
+      if (pendingRpcs.delete(id)) {
+        resolve({ ok: false, status: 0 });
+      }
+    }, RPC_TIMEOUT_MSEC);
+  });
+}
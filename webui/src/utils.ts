@@ -38,7 +38,7 @@ export function getHubHttpApiEndpoint(
   return url.href;
 }
 
-export function getHubWebSocketEndpoint() {
+export function getHubWebSocketEndpoint(search?: Record<string, string>) {
   const hubHost = getHubHost();
   const hubPort = getHubPort();
   const url = new URL(`ws://${hubHost}`);
@@ -48,6 +48,11 @@ export function getHubWebSocketEndpoint() {
     url.port = hubPort.toString(); // for port forwarding
   }
   url.pathname = "/ws";
+  if (search) {
+    for (const [key, value] of Object.entries(search)) {
+      url.searchParams.append(key, value);
+    }
+  }
   return url.href;
 }
 